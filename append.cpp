@@ -0,0 +1,305 @@
+//------------------------------------------------------------------------------
+// append.cpp
+//------------------------------------------------------------------------------
+
+#include "append.hpp"
+
+#include "compress.hpp"
+#include "crc32.hpp"
+#include "io.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <format>
+#include <set>
+#include <string_view>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    constexpr uint16_t VERSION_NEEDED = 20; //2.0: DEFLATE
+    constexpr uint16_t MADE_BY_UNIX = 3 << 8;
+    constexpr uint64_t MAX_OFFSET = 0xffffffff;
+    constexpr uint16_t MAX_ENTRIES = 0xffff;
+
+    struct NewEntry {
+        zip::LocalFileHeader header;
+        uint32_t mode;
+        std::vector<std::byte> data;
+    };
+
+    std::string error_with_errno(const std::string& message) {
+        return message + ": " + std::strerror(errno);
+    }
+
+    std::expected<void, std::string> write_at(int fd, std::span<const std::byte> data, off_t offset) {
+        while (!data.empty()) {
+            auto written = ::pwrite(fd, data.data(), data.size(), offset);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return std::unexpected(error_with_errno("Unable to write archive"));
+            }
+            data = data.subspan(written);
+            offset += written;
+        }
+        return {};
+    }
+
+    // MS-DOS time and date, in local time, from 1980 on.
+    std::pair<uint16_t, uint16_t> dos_time(time_t time) {
+        std::tm local{};
+        ::localtime_r(&time, &local);
+        if (local.tm_year < 80) {
+            return {0, (1 << 5) | 1};
+        }
+
+        uint16_t dos_time = (local.tm_hour << 11) | (local.tm_min << 5) | (local.tm_sec / 2);
+        uint16_t dos_date = ((local.tm_year - 80) << 9) | ((local.tm_mon + 1) << 5) | local.tm_mday;
+        return {dos_time, dos_date};
+    }
+
+    // The path as an entry name: relative, without empty or "." components.
+    // A ".." component is refused, as it would lead extraction out of its
+    // directory.
+    std::expected<std::string, std::string> entry_name(const std::string& path) {
+        std::string name;
+        std::string_view rest = path;
+        while (!rest.empty()) {
+            auto component = rest.substr(0, rest.find('/'));
+            rest.remove_prefix(std::min(rest.size(), component.size() + 1));
+            if (component.empty() || component == ".") {
+                continue;
+            }
+            if (component == "..") {
+                return std::unexpected(std::format("{} has a '..' component.", path));
+            }
+            name += name.empty() ? "" : "/";
+            name += component;
+        }
+        if (name.empty()) {
+            return std::unexpected(std::format("{} does not name a file.", path));
+        }
+        return name;
+    }
+
+    // Reads and compresses a file, or stores it if compressing doesn't help.
+    std::expected<NewEntry, std::string> prepare_entry(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return std::unexpected(error_with_errno(std::format("Unable to open {}", path)));
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+            ::close(fd);
+            return std::unexpected(std::format("{} is not a regular file.", path));
+        }
+        if (static_cast<uint64_t>(st.st_size) > MAX_OFFSET) {
+            ::close(fd);
+            return std::unexpected(std::format("{} is too large for an archive without ZIP64.", path));
+        }
+
+        std::vector<std::byte> contents(st.st_size);
+        size_t filled = 0;
+        while (filled < contents.size()) {
+            auto got = ::read(fd, contents.data() + filled, contents.size() - filled);
+            if (got < 0 && errno == EINTR) {
+                continue;
+            }
+            if (got <= 0) {
+                ::close(fd);
+                return std::unexpected(std::format("Unable to read {}.", path));
+            }
+            filled += got;
+        }
+        ::close(fd);
+
+        NewEntry entry;
+        entry.mode = st.st_mode;
+        auto& h = entry.header;
+        h.extraction_version = VERSION_NEEDED;
+        h.gp_bit_flag = 0;
+        std::tie(h.last_mod_file_time, h.last_mod_file_date) = dos_time(st.st_mtime);
+        h.crc_32 = zip::crc32(contents);
+        h.uncompressed_size = static_cast<uint32_t>(contents.size());
+        h.file_name = *entry_name(path);
+
+        auto compressed = deflate::compress(contents);
+        if (compressed.size() < contents.size()) {
+            h.compression_method = 8;
+            entry.data = std::move(compressed);
+        } else {
+            h.compression_method = 0;
+            entry.data = std::move(contents);
+        }
+        h.compressed_size = static_cast<uint32_t>(entry.data.size());
+
+        return entry;
+    }
+
+    zip::CentralDirectoryHeader directory_header(const NewEntry& entry, uint32_t offset) {
+        auto& local = entry.header;
+
+        zip::CentralDirectoryHeader h{};
+        h.version_made_by = MADE_BY_UNIX | VERSION_NEEDED;
+        h.version_needed = local.extraction_version;
+        h.general_purpose_bit_flag = local.gp_bit_flag;
+        h.compression_method = local.compression_method;
+        h.last_mod_file_time = local.last_mod_file_time;
+        h.last_mod_file_date = local.last_mod_file_date;
+        h.crc_32 = local.crc_32;
+        h.compressed_size = local.compressed_size;
+        h.uncompressed_size = local.uncompressed_size;
+        h.file_name_length = static_cast<uint16_t>(local.file_name.size());
+        h.external_file_attributes = entry.mode << 16;
+        h.relative_offset_of_local_header = offset;
+        h.file_name = local.file_name;
+        return h;
+    }
+
+    // The central directory and EOCD as they are, which get written after
+    // the new entries, and put back if that fails.
+    struct ArchiveTail {
+        zip::EOCD eocd;
+        std::vector<std::byte> bytes;
+        std::set<std::string> names;
+    };
+
+    std::expected<ArchiveTail, std::string> read_tail(const std::string& archive_path) {
+        auto archive = zippee::mapped_file::open(archive_path);
+        if (!archive) {
+            return std::unexpected(archive.error());
+        }
+
+        auto data = archive->data();
+        auto eocd = zip::search_for_eocd(data);
+        if (!eocd) {
+            return std::unexpected(eocd.error());
+        }
+        if (eocd->disk_number != 0 || eocd->num_disk_with_central_directory_start != 0) {
+            return std::unexpected("Multi-volume archives cannot be appended to.");
+        }
+        if (eocd->offset_start_central_directory == MAX_OFFSET || eocd->total_num_entries_central_directory == MAX_ENTRIES) {
+            return std::unexpected("ZIP64 archives cannot be appended to.");
+        }
+        if (eocd->offset_start_central_directory + static_cast<size_t>(eocd->size_central_directory) > data.size()) {
+            return std::unexpected("Central directory extends past the end of the archive.");
+        }
+
+        ArchiveTail tail{*eocd};
+        auto from = data.subspan(eocd->offset_start_central_directory);
+        tail.bytes.assign(from.begin(), from.end());
+        auto headers = zip::read_central_directory_headers(from.first(eocd->size_central_directory));
+        if (!headers) {
+            return std::unexpected(headers.error());
+        }
+        for (auto& h : *headers) {
+            tail.names.insert(h.file_name);
+        }
+        return tail;
+    }
+
+    std::expected<void, std::string> write_entries(
+        int fd,
+        const ArchiveTail& tail,
+        std::span<const std::string> file_paths,
+        std::vector<zip::CentralDirectoryHeader>& added) {
+        uint64_t position = tail.eocd.offset_start_central_directory;
+        std::vector<std::byte> directory(tail.bytes.begin(), tail.bytes.begin() + tail.eocd.size_central_directory);
+
+        for (auto& path : file_paths) {
+            auto entry = prepare_entry(path);
+            if (!entry) {
+                return std::unexpected(entry.error());
+            }
+
+            std::vector<std::byte> local_header;
+            zip::write_local_header(entry->header, local_header);
+            if (position + local_header.size() + entry->data.size() > MAX_OFFSET) {
+                return std::unexpected("Archive would grow too large without ZIP64.");
+            }
+
+            auto header = directory_header(*entry, static_cast<uint32_t>(position));
+            if (auto written = write_at(fd, local_header, position); !written) {
+                return written;
+            }
+            position += local_header.size();
+            if (auto written = write_at(fd, entry->data, position); !written) {
+                return written;
+            }
+            position += entry->data.size();
+
+            zip::write_central_directory_header(header, directory);
+            added.push_back(std::move(header));
+        }
+
+        auto eocd = tail.eocd;
+        auto entries = static_cast<uint16_t>(eocd.total_num_entries_central_directory + added.size());
+        eocd.total_num_entries_central_directory = entries;
+        eocd.total_num_entries_central_directory_this_disk = entries;
+        eocd.size_central_directory = static_cast<uint32_t>(directory.size());
+        eocd.offset_start_central_directory = static_cast<uint32_t>(position);
+        if (position + directory.size() > MAX_OFFSET) {
+            return std::unexpected("Archive would grow too large without ZIP64.");
+        }
+        zip::write_eocd(eocd, directory);
+
+        if (auto written = write_at(fd, directory, position); !written) {
+            return written;
+        }
+        if (::ftruncate(fd, position + directory.size()) != 0) {
+            return std::unexpected(error_with_errno("Unable to truncate archive"));
+        }
+        if (::fsync(fd) != 0) {
+            return std::unexpected(error_with_errno("Unable to sync archive"));
+        }
+        return {};
+    }
+}
+
+std::expected<std::vector<zip::CentralDirectoryHeader>, std::string>
+zip::append_files(const std::string& archive_path, std::span<const std::string> file_paths) {
+    auto tail = read_tail(archive_path);
+    if (!tail) {
+        return std::unexpected(tail.error());
+    }
+
+    if (tail->eocd.total_num_entries_central_directory + file_paths.size() >= MAX_ENTRIES) {
+        return std::unexpected("Too many entries for an archive without ZIP64.");
+    }
+    for (auto& path : file_paths) {
+        auto name = entry_name(path);
+        if (!name) {
+            return std::unexpected(name.error());
+        }
+        if (!tail->names.insert(*name).second) {
+            return std::unexpected(std::format("{} is already in the archive.", *name));
+        }
+    }
+
+    int fd = ::open(archive_path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return std::unexpected(error_with_errno(std::format("Unable to open {} for writing", archive_path)));
+    }
+
+    std::vector<CentralDirectoryHeader> added;
+    auto written = write_entries(fd, *tail, file_paths, added);
+    if (!written) {
+        //put the original directory back where it was
+        auto offset = tail->eocd.offset_start_central_directory;
+        if (write_at(fd, tail->bytes, offset) && ::ftruncate(fd, offset + tail->bytes.size()) == 0) {
+            ::fsync(fd);
+        }
+        ::close(fd);
+        return std::unexpected(written.error());
+    }
+
+    ::close(fd);
+    return added;
+}
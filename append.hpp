@@ -0,0 +1,27 @@
+//------------------------------------------------------------------------------
+// append.hpp
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "zip.hpp"
+
+#include <expected>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace zip {
+
+// Adds files to an existing archive. The new entries are written over the old
+// central directory, followed by the old directory, the new entries' headers
+// and a new EOCD; the data of existing entries is never read or moved, so the
+// cost follows the size of the new files. Each file is stored under its path
+// less any leading '/' and any "." components, compressed unless that doesn't
+// make it smaller; a path with a ".." component is refused. If writing fails
+// part way the original directory is put back.
+// ZIP64 and multi-volume archives are not supported.
+std::expected<std::vector<CentralDirectoryHeader>, std::string>
+append_files(const std::string& archive_path, std::span<const std::string> file_paths);
+
+}
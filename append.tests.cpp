@@ -0,0 +1,134 @@
+//------------------------------------------------------------------------------
+// append.tests.cpp
+//------------------------------------------------------------------------------
+
+#include "append.hpp"
+#include "crc32.hpp"
+#include "deflate.hpp"
+#include "test_archive.hpp"
+
+#include <cstdio>
+#include <fstream>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+using test::to_bytes;
+
+std::vector<std::byte> read_file(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    return to_bytes(std::string(std::istreambuf_iterator<char>(file), {}));
+}
+
+// An archive holding "first.txt", stored, with a comment.
+std::string write_archive(const std::string& name) {
+    return test::write_temp_file(name, test::make_archive({{"first.txt", "first entry"}}, 0, "kept"));
+}
+
+std::vector<std::byte> entry_data(std::span<std::byte> archive, const zip::CentralDirectoryHeader& h) {
+    auto local = zip::read_local_header(archive.subspan(h.relative_offset_of_local_header));
+    EXPECT_TRUE(local.has_value());
+    auto data = archive.subspan(h.relative_offset_of_local_header + local->header_size(), h.compressed_size);
+    if (h.compression_method == 0) {
+        return {data.begin(), data.end()};
+    }
+    return deflate::decompress(data);
+}
+
+}
+
+TEST(Append, adds_entries_after_existing_data) {
+    auto path = write_archive("zippee_append.zip");
+    auto before = read_file(path);
+    std::string text;
+    for (int i = 0; i < 200; i++) {
+        text += "the same line over and over\n";
+    }
+    auto compressible = test::write_temp_file("zippee_append_text", to_bytes(text));
+    auto tiny = test::write_temp_file("zippee_append_tiny", to_bytes("x"));
+
+    std::vector<std::string> files = {compressible, tiny};
+    auto added = zip::append_files(path, files);
+    ASSERT_TRUE(added.has_value()) << added.error();
+    ASSERT_EQ(added->size(), 2);
+    EXPECT_EQ((*added)[0].compression_method, 8);
+    EXPECT_EQ((*added)[1].compression_method, 0);
+
+    auto after = read_file(path);
+    auto original_eocd = zip::search_for_eocd(before);
+    ASSERT_TRUE(original_eocd.has_value());
+    EXPECT_TRUE(std::equal(before.begin(), before.begin() + original_eocd->offset_start_central_directory, after.begin()));
+
+    auto eocd = zip::search_for_eocd(after);
+    ASSERT_TRUE(eocd.has_value());
+    EXPECT_EQ(eocd->total_num_entries_central_directory, 3);
+    EXPECT_EQ(eocd->comment, "kept");
+
+    auto headers = zip::read_central_directory_headers(std::span{after}.subspan(eocd->offset_start_central_directory));
+    ASSERT_TRUE(headers.has_value()) << headers.error();
+    ASSERT_EQ(headers->size(), 3);
+    EXPECT_EQ((*headers)[0].file_name, "first.txt");
+    EXPECT_EQ((*headers)[1].file_name, compressible.substr(1));
+    EXPECT_EQ(entry_data(after, (*headers)[0]), to_bytes("first entry"));
+    EXPECT_EQ(entry_data(after, (*headers)[1]), to_bytes(text));
+    EXPECT_EQ(entry_data(after, (*headers)[2]), to_bytes("x"));
+    EXPECT_EQ((*headers)[1].crc_32, zip::crc32(to_bytes(text)));
+
+    std::remove(path.c_str());
+    std::remove(compressible.c_str());
+    std::remove(tiny.c_str());
+}
+
+TEST(Append, rejects_duplicate_names) {
+    auto path = write_archive("zippee_append_duplicate.zip");
+    auto before = read_file(path);
+    auto file = test::write_temp_file("zippee_append_once", to_bytes("once"));
+
+    std::vector<std::string> files = {file, file};
+    auto added = zip::append_files(path, files);
+    ASSERT_FALSE(added.has_value());
+    EXPECT_EQ(read_file(path), before);
+
+    std::remove(path.c_str());
+    std::remove(file.c_str());
+}
+
+TEST(Append, restores_directory_on_failure) {
+    auto path = write_archive("zippee_append_restore.zip");
+    auto before = read_file(path);
+    auto file = test::write_temp_file("zippee_append_present", to_bytes(std::string(5000, 'p')));
+
+    std::vector<std::string> files = {file, testing::TempDir() + "zippee_append_missing"};
+    auto added = zip::append_files(path, files);
+    ASSERT_FALSE(added.has_value());
+    EXPECT_EQ(read_file(path), before);
+
+    std::remove(path.c_str());
+    std::remove(file.c_str());
+}
+
+TEST(Append, normalises_names_and_refuses_parent_components) {
+    auto path = write_archive("zippee_append_names.zip");
+    auto before = read_file(path);
+    test::write_temp_file("zippee_append_dotted", to_bytes("dotted"));
+
+    std::vector<std::string> climbing = {testing::TempDir() + "sub/../zippee_append_dotted"};
+    auto refused = zip::append_files(path, climbing);
+    ASSERT_FALSE(refused.has_value());
+    EXPECT_NE(refused.error().find("'..'"), std::string::npos);
+    EXPECT_EQ(read_file(path), before);
+
+    std::vector<std::string> dotted = {testing::TempDir() + "./zippee_append_dotted"};
+    auto added = zip::append_files(path, dotted);
+    ASSERT_TRUE(added.has_value()) << added.error();
+    ASSERT_EQ(added->size(), 1);
+    auto name = (*added)[0].file_name;
+    EXPECT_TRUE(name.ends_with("/zippee_append_dotted"));
+    EXPECT_FALSE(name.starts_with('/'));
+    EXPECT_EQ(name.find("/./"), std::string::npos);
+    EXPECT_EQ(name.find("//"), std::string::npos);
+
+    std::remove(path.c_str());
+    std::remove((testing::TempDir() + "zippee_append_dotted").c_str());
+}
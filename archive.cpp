@@ -0,0 +1,257 @@
+//------------------------------------------------------------------------------
+// archive.cpp
+//------------------------------------------------------------------------------
+
+#include "archive.hpp"
+#include "crc32.hpp"
+#include "deflate.hpp"
+#include "zstd.hpp"
+
+#include <algorithm>
+#include <format>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+    // An entry's stated size, as far as it can be trusted: no more than its
+    // compressed data can expand to.
+    size_t trusted_size(const zip::CentralDirectoryHeader& h, std::span<const std::byte> compressed) {
+        auto ratio = h.compression_method == zstd::ZIP_METHOD ? zstd::MAX_RATIO : deflate::MAX_RATIO;
+        return std::min<size_t>(h.uncompressed_size, compressed.size() * ratio);
+    }
+}
+
+zip::EntryCache::EntryCache(size_t budget, size_t shards)
+    : _shards(std::max<size_t>(shards, 1)),
+      _shard_budget(budget / _shards.size()) {}
+
+zip::EntryCache::Shard& zip::EntryCache::shard(size_t index) const {
+    return _shards[index % _shards.size()];
+}
+
+zip::EntryContents zip::EntryCache::find(size_t index) const {
+    auto& shard = this->shard(index);
+    std::lock_guard lock(shard.mutex);
+    auto found = shard.entries.find(index);
+    if (found == shard.entries.end()) {
+        shard.misses++;
+        return nullptr;
+    }
+    shard.hits++;
+    shard.recent.splice(shard.recent.begin(), shard.recent, found->second.second);
+    return found->second.first;
+}
+
+void zip::EntryCache::insert(size_t index, EntryContents contents) const {
+    auto size = contents->size();
+    if (size > _shard_budget) {
+        return;
+    }
+
+    auto& shard = this->shard(index);
+    std::lock_guard lock(shard.mutex);
+    if (shard.entries.contains(index)) {
+        return;
+    }
+    while (shard.bytes + size > _shard_budget) {
+        auto oldest = shard.entries.find(shard.recent.back());
+        shard.bytes -= oldest->second.first->size();
+        shard.entries.erase(oldest);
+        shard.recent.pop_back();
+        shard.evictions++;
+    }
+    shard.recent.push_front(index);
+    shard.entries.emplace(index, std::pair{std::move(contents), shard.recent.begin()});
+    shard.bytes += size;
+}
+
+zip::CacheStats zip::EntryCache::stats() const {
+    CacheStats stats;
+    for (auto& shard : _shards) {
+        std::lock_guard lock(shard.mutex);
+        stats.hits += shard.hits;
+        stats.misses += shard.misses;
+        stats.evictions += shard.evictions;
+        stats.entries += shard.entries.size();
+        stats.bytes += shard.bytes;
+    }
+    return stats;
+}
+
+zip::Archive::Archive(std::unique_ptr<zippee::byte_source> source, std::vector<CentralDirectoryHeader> headers, size_t cache_bytes, size_t cache_shards)
+    : _source(std::move(source)),
+      _headers(std::move(headers)) {
+    _names.reserve(_headers.size());
+    for (size_t i = 0; i < _headers.size(); i++) {
+        _names[_headers[i].file_name] = i;
+    }
+    if (cache_bytes > 0) {
+        _cache = std::make_unique<EntryCache>(cache_bytes, cache_shards);
+    }
+}
+
+std::expected<std::unique_ptr<zip::Archive>, std::string> zip::Archive::open(const std::string& path, const Options& options) {
+    auto source = zippee::open_source(path, options.pread);
+    if (!source) {
+        return std::unexpected(source.error());
+    }
+    return open(std::move(*source), options);
+}
+
+std::expected<std::unique_ptr<zip::Archive>, std::string> zip::Archive::open(std::unique_ptr<zippee::byte_source> source, const Options& options) {
+    auto eocd = read_eocd(*source);
+    if (!eocd) {
+        return std::unexpected(eocd.error());
+    }
+    auto headers = read_central_directory(*source, *eocd);
+    if (!headers) {
+        return std::unexpected(headers.error());
+    }
+    return std::unique_ptr<Archive>(new Archive(std::move(source), std::move(*headers), options.cache_bytes, options.cache_shards));
+}
+
+const zippee::byte_source& zip::Archive::source() const {
+    return *_source;
+}
+
+std::span<const zip::CentralDirectoryHeader> zip::Archive::entries() const {
+    return _headers;
+}
+
+std::optional<size_t> zip::Archive::find(std::string_view name) const {
+    auto found = _names.find(name);
+    if (found == _names.end()) {
+        return std::nullopt;
+    }
+    return found->second;
+}
+
+std::expected<zip::EntryContents, std::string> zip::Archive::decompress(const CentralDirectoryHeader& h) const {
+    auto location = locate_entry_data(*_source, h);
+    if (!location) {
+        return std::unexpected(location.error());
+    }
+
+    thread_local std::vector<std::byte> buffer;
+    auto compressed = _source->read(location->offset, h.compressed_size, buffer);
+    if (!compressed) {
+        return std::unexpected(compressed.error());
+    }
+
+    //sized up front from the stated size, as far as it can be trusted, so
+    //the contents kept are no larger than they need to be
+    std::vector<std::byte> output;
+    output.reserve(trusted_size(h, *compressed) + deflate::OUTPUT_MARGIN);
+    try {
+        if (h.compression_method == 0) {
+            output.assign(compressed->begin(), compressed->end());
+        } else if (h.compression_method == 8) {
+            deflate::thread_decoder().decompress(*compressed, output);
+        } else if (h.compression_method == zstd::ZIP_METHOD) {
+            zstd::thread_decoder().decompress(*compressed, output);
+        } else {
+            return std::unexpected(std::format("Unsupported compression method {}.", h.compression_method));
+        }
+    } catch (const std::runtime_error& e) {
+        return std::unexpected(e.what());
+    }
+
+    if (crc32(output) != location->crc_32) {
+        return std::unexpected("CRC32 does not match.");
+    }
+    if (output.size() != h.uncompressed_size) {
+        return std::unexpected("Size does not match.");
+    }
+    return std::make_shared<const std::vector<std::byte>>(std::move(output));
+}
+
+std::expected<zip::EntryContents, std::string> zip::Archive::read(size_t index) const {
+    if (index >= _headers.size()) {
+        return std::unexpected(std::format("No entry {} in an archive of {}.", index, _headers.size()));
+    }
+    if (_cache) {
+        if (auto contents = _cache->find(index)) {
+            return contents;
+        }
+    }
+
+    auto contents = decompress(_headers[index]);
+    if (contents && _cache) {
+        _cache->insert(index, *contents);
+    }
+    return contents;
+}
+
+std::expected<zip::EntryContents, std::string> zip::Archive::read(std::string_view name) const {
+    auto index = find(name);
+    if (!index) {
+        return std::unexpected(std::format("No entry named {}.", name));
+    }
+    return read(*index);
+}
+
+std::expected<std::vector<std::byte>, std::string> zip::Archive::read_range(size_t index, uint64_t offset, uint64_t length) const {
+    if (index >= _headers.size()) {
+        return std::unexpected(std::format("No entry {} in an archive of {}.", index, _headers.size()));
+    }
+    auto& h = _headers[index];
+    length = std::min(length, std::numeric_limits<uint64_t>::max() - offset);
+    auto clip = [&](std::span<const std::byte> data) {
+        data = data.subspan(std::min<uint64_t>(offset, data.size()));
+        data = data.first(std::min<uint64_t>(length, data.size()));
+        return std::vector<std::byte>(data.begin(), data.end());
+    };
+
+    if (_cache) {
+        if (auto contents = _cache->find(index)) {
+            return clip(*contents);
+        }
+    }
+
+    auto location = locate_entry_data(*_source, h);
+    if (!location) {
+        return std::unexpected(location.error());
+    }
+
+    thread_local std::vector<std::byte> buffer;
+    if (h.compression_method == 0) {
+        uint64_t first = std::min<uint64_t>(offset, h.compressed_size);
+        uint64_t last = std::min<uint64_t>(offset + length, h.compressed_size);
+        auto data = _source->read(location->offset + first, last - first, buffer);
+        if (!data) {
+            return std::unexpected(data.error());
+        }
+        return std::vector<std::byte>(data->begin(), data->end());
+    }
+    if (h.compression_method != 8 && h.compression_method != zstd::ZIP_METHOD) {
+        return std::unexpected(std::format("Unsupported compression method {}.", h.compression_method));
+    }
+
+    auto compressed = _source->read(location->offset, h.compressed_size, buffer);
+    if (!compressed) {
+        return std::unexpected(compressed.error());
+    }
+
+    std::vector<std::byte> output;
+    try {
+        if (h.compression_method == zstd::ZIP_METHOD) {
+            //matches reach back the frame's window, and blocks reserve up to a whole block at once
+            auto window = zstd::sink_window(*compressed, trusted_size(h, *compressed));
+            deflate::RangeSink sink(offset, length, output, true, window, zstd::SINK_CHUNK);
+            zstd::thread_decoder().decompress_range(*compressed, sink);
+        } else {
+            deflate::RangeSink sink(offset, length, output);
+            deflate::thread_decoder().decompress_range(*compressed, sink);
+        }
+    } catch (const std::runtime_error& e) {
+        return std::unexpected(e.what());
+    }
+    return output;
+}
+
+std::optional<zip::CacheStats> zip::Archive::cache_stats() const {
+    if (!_cache) {
+        return std::nullopt;
+    }
+    return _cache->stats();
+}
@@ -0,0 +1,123 @@
+//------------------------------------------------------------------------------
+// archive.hpp
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "source.hpp"
+#include "zip.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace zip {
+
+// Decompressed contents of an entry. Shared, so a reader keeps what it was
+// given even after the cache lets it go.
+using EntryContents = std::shared_ptr<const std::vector<std::byte>>;
+
+struct CacheStats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t evictions = 0;
+    size_t entries = 0;
+    size_t bytes = 0;
+};
+
+// Decompressed entries, keyed by their index in the directory, kept up to a
+// budget of bytes with the least recently read let go first. Entries are
+// spread over shards, each with its own lock and an even part of the budget,
+// so readers of different entries seldom wait on one another. An entry
+// larger than a shard's budget isn't kept.
+class EntryCache {
+private:
+    struct Shard {
+        std::mutex mutex;
+        std::list<size_t> recent;
+        std::unordered_map<size_t, std::pair<EntryContents, std::list<size_t>::iterator>> entries;
+        size_t bytes = 0;
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t evictions = 0;
+    };
+
+    mutable std::vector<Shard> _shards;
+    size_t _shard_budget;
+
+    Shard& shard(size_t index) const;
+
+public:
+    EntryCache(size_t budget, size_t shards);
+
+    // The entry's contents if they are kept, counting a hit or a miss.
+    EntryContents find(size_t index) const;
+    // Keeps contents, letting the least recently read go until they fit.
+    // Contents already kept for the entry stay as they are.
+    void insert(size_t index, EntryContents contents) const;
+
+    CacheStats stats() const;
+};
+
+// An opened archive: its source and central directory, read once, and the
+// entries decompressed on request. Everything here is safe to call from
+// several threads at once; each decompresses with its own thread_decoder.
+//
+// With a cache budget, decompressed entries are kept so that reading one
+// again costs no more than handing it over. Two threads missing the same
+// entry at once both decompress it, and the first to finish is kept.
+class Archive {
+private:
+    std::unique_ptr<zippee::byte_source> _source;
+    std::vector<CentralDirectoryHeader> _headers;
+    // names are views of _headers, which never change once read
+    std::unordered_map<std::string_view, size_t> _names;
+    std::unique_ptr<EntryCache> _cache;
+
+    Archive(std::unique_ptr<zippee::byte_source> source, std::vector<CentralDirectoryHeader> headers, size_t cache_bytes, size_t cache_shards);
+
+    std::expected<EntryContents, std::string> decompress(const CentralDirectoryHeader& h) const;
+
+public:
+    struct Options {
+        // read with pread instead of mapping; split archives are always mapped
+        bool pread = false;
+        // bytes of decompressed entries to keep, or 0 to keep none
+        size_t cache_bytes = 0;
+        size_t cache_shards = 16;
+    };
+
+    static std::expected<std::unique_ptr<Archive>, std::string> open(const std::string& path, const Options& options);
+    static std::expected<std::unique_ptr<Archive>, std::string> open(std::unique_ptr<zippee::byte_source> source, const Options& options);
+
+    const zippee::byte_source& source() const;
+    std::span<const CentralDirectoryHeader> entries() const;
+
+    // The index of the entry with this name. Where names repeat, the last
+    // entry has it, as it would be the one left after extracting.
+    std::optional<size_t> find(std::string_view name) const;
+
+    // An entry's contents, checked against its CRC-32 and size.
+    std::expected<EntryContents, std::string> read(size_t index) const;
+    std::expected<EntryContents, std::string> read(std::string_view name) const;
+
+    // Bytes [offset, offset + length) of an entry, clipped to its end. They
+    // come from the cache if the entry is kept there; otherwise the entry is
+    // decoded only as far as the range reaches, and so isn't checked, nor
+    // kept.
+    std::expected<std::vector<std::byte>, std::string> read_range(size_t index, uint64_t offset, uint64_t length) const;
+
+    // Nothing without a cache.
+    std::optional<CacheStats> cache_stats() const;
+};
+
+}
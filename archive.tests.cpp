@@ -0,0 +1,186 @@
+//------------------------------------------------------------------------------
+// archive.tests.cpp
+//------------------------------------------------------------------------------
+
+#include "archive.hpp"
+#include "test_archive.hpp"
+#include "zstd.hpp"
+
+#include <thread>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+using test::to_bytes;
+
+std::unique_ptr<zip::Archive> open_archive(std::vector<std::byte>& archive, const zip::Archive::Options& options) {
+    auto opened = zip::Archive::open(std::make_unique<zippee::mapped_source>(std::span{archive}), options);
+    EXPECT_TRUE(opened.has_value());
+    return opened ? std::move(*opened) : nullptr;
+}
+
+std::string text(const zip::EntryContents& contents) {
+    return std::string(reinterpret_cast<const char*>(contents->data()), contents->size());
+}
+
+std::string repeated(const std::string& word, size_t count) {
+    std::string s;
+    for (size_t i = 0; i < count; i++) {
+        s += word + std::to_string(i % 97) + ' ';
+    }
+    return s;
+}
+
+}
+
+TEST(Archive, reads_entries_by_name_and_index) {
+    auto archive_bytes = test::make_archive({
+        {"stored.txt", "stored contents"},
+        {"deflated.txt", repeated("deflated", 2000), 8},
+        {"twice.txt", "first"},
+        {"twice.txt", "second"},
+    });
+    auto archive = open_archive(archive_bytes, {});
+    ASSERT_NE(archive, nullptr);
+    ASSERT_EQ(archive->entries().size(), 4);
+    EXPECT_FALSE(archive->cache_stats());
+
+    auto stored = archive->read("stored.txt");
+    ASSERT_TRUE(stored.has_value()) << stored.error();
+    EXPECT_EQ(text(*stored), "stored contents");
+
+    auto deflated = archive->read(1);
+    ASSERT_TRUE(deflated.has_value()) << deflated.error();
+    EXPECT_EQ(text(*deflated), repeated("deflated", 2000));
+
+    EXPECT_EQ(archive->find("twice.txt"), 3);
+    EXPECT_EQ(text(*archive->read("twice.txt")), "second");
+
+    EXPECT_FALSE(archive->find("missing.txt"));
+    EXPECT_FALSE(archive->read("missing.txt"));
+    EXPECT_FALSE(archive->read(4));
+}
+
+TEST(Archive, checks_crc) {
+    auto archive_bytes = test::make_archive({{"entry.txt", "some contents"}});
+    //corrupt the stored data, after the 30 byte header and name
+    archive_bytes[30 + 9] ^= std::byte{1};
+    auto archive = open_archive(archive_bytes, {.cache_bytes = 1024});
+    ASSERT_NE(archive, nullptr);
+
+    auto result = archive->read("entry.txt");
+    ASSERT_FALSE(result.has_value());
+    EXPECT_EQ(result.error(), "CRC32 does not match.");
+    EXPECT_EQ(archive->cache_stats()->entries, 0);
+}
+
+TEST(Archive, cache_keeps_recently_read_entries_within_budget) {
+    std::vector<test::ArchiveEntry> entries;
+    for (int i = 0; i < 4; i++) {
+        entries.push_back({"entry" + std::to_string(i), std::string(100, static_cast<char>('a' + i))});
+    }
+    auto archive_bytes = test::make_archive(entries);
+    auto archive = open_archive(archive_bytes, {.cache_bytes = 250, .cache_shards = 1});
+    ASSERT_NE(archive, nullptr);
+
+    auto first = archive->read(0);
+    auto again = archive->read(0);
+    ASSERT_TRUE(first && again);
+    EXPECT_EQ(first->get(), again->get());
+
+    //two fit; reading entry 0 again makes entry 1 the one let go
+    archive->read(1);
+    archive->read(0);
+    archive->read(2);
+    auto stats = *archive->cache_stats();
+    EXPECT_EQ(stats.hits, 2);
+    EXPECT_EQ(stats.misses, 3);
+    EXPECT_EQ(stats.evictions, 1);
+    EXPECT_EQ(stats.entries, 2);
+    EXPECT_EQ(stats.bytes, 200);
+
+    EXPECT_EQ(archive->read(0)->get(), first->get());
+    archive->read(1);
+    EXPECT_EQ(archive->cache_stats()->hits, 3);
+    EXPECT_EQ(archive->cache_stats()->misses, 4);
+
+    //the entry evicted is still whole for whoever holds it
+    EXPECT_EQ(text(*first), std::string(100, 'a'));
+}
+
+TEST(Archive, cache_skips_entries_larger_than_a_shard) {
+    auto archive_bytes = test::make_archive({{"large", std::string(1000, 'x')}});
+    auto archive = open_archive(archive_bytes, {.cache_bytes = 4000, .cache_shards = 8});
+    ASSERT_NE(archive, nullptr);
+
+    EXPECT_TRUE(archive->read(0));
+    EXPECT_TRUE(archive->read(0));
+    EXPECT_EQ(archive->cache_stats()->hits, 0);
+    EXPECT_EQ(archive->cache_stats()->entries, 0);
+}
+
+TEST(Archive, read_range_sizes_zstd_windows_from_what_can_be_trusted) {
+    // "Hello, zstd! Hello, zstd!\n", with a window descriptor at byte 5
+    const unsigned char frame[] = {
+        0x28, 0xb5, 0x2f, 0xfd, 0x04, 0x68, 0xa5, 0x00, 0x00, 0x70, 0x48, 0x65, 0x6c, 0x6c, 0x6f, 0x2c,
+        0x20, 0x7a, 0x73, 0x74, 0x64, 0x21, 0x20, 0x0a, 0x01, 0x00, 0xc0, 0xcd, 0x2f, 0xdf, 0x80, 0x77,
+        0xb6,
+    };
+    for (auto [descriptor, error] : {std::pair{0x88, ""}, std::pair{0xa8, "Zstandard frame window is too large."}}) {
+        std::string contents(reinterpret_cast<const char*>(frame), sizeof(frame));
+        contents[5] = static_cast<char>(descriptor);
+        auto archive_bytes = test::make_archive({{"entry.zst", contents, zstd::ZIP_METHOD}});
+        //a stated size far beyond what the frame can make
+        auto eocd = zip::search_for_eocd(archive_bytes);
+        ASSERT_TRUE(eocd.has_value());
+        auto stated = archive_bytes.begin() + eocd->offset_start_central_directory + 24;
+        std::fill(stated, stated + 4, std::byte{0xff});
+        auto archive = open_archive(archive_bytes, {});
+        ASSERT_NE(archive, nullptr);
+
+        auto range = archive->read_range(0, 7, 4);
+        if (*error) {
+            ASSERT_FALSE(range.has_value());
+            EXPECT_EQ(range.error(), error);
+        } else {
+            ASSERT_TRUE(range.has_value()) << range.error();
+            EXPECT_EQ(*range, to_bytes("zstd"));
+        }
+    }
+}
+
+TEST(Archive, concurrent_readers) {
+    std::vector<test::ArchiveEntry> entries;
+    for (int i = 0; i < 32; i++) {
+        entries.push_back({"entry" + std::to_string(i), repeated(std::to_string(i), 500 + i * 10), static_cast<uint16_t>(i % 2 == 0 ? 8 : 0)});
+    }
+    auto archive_bytes = test::make_archive(entries);
+    auto archive = open_archive(archive_bytes, {.cache_bytes = 1 << 20, .cache_shards = 4});
+    ASSERT_NE(archive, nullptr);
+
+    constexpr size_t THREADS = 8;
+    constexpr size_t READS = 400;
+    std::atomic<size_t> wrong{0};
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < THREADS; t++) {
+        threads.emplace_back([&, t] {
+            for (size_t i = 0; i < READS; i++) {
+                auto index = (i * 7 + t) % entries.size();
+                auto contents = archive->read(entries[index].name);
+                if (!contents || text(*contents) != entries[index].contents) {
+                    wrong++;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_EQ(wrong, 0);
+    auto stats = *archive->cache_stats();
+    EXPECT_EQ(stats.hits + stats.misses, THREADS * READS);
+    EXPECT_EQ(stats.entries, entries.size());
+    EXPECT_EQ(stats.evictions, 0);
+}
@@ -0,0 +1,398 @@
+
+//------------------------------------------------------------------------------
+// bench.cpp
+//------------------------------------------------------------------------------
+
+#include "crc32.hpp"
+#include "deflate.hpp"
+#include "io.hpp"
+#include "perf.hpp"
+#include "zip.hpp"
+#include "zstd.hpp"
+
+#include "vendor/CLI11.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <format>
+#include <memory_resource>
+#include <print>
+#include <string>
+#include <vector>
+
+namespace {
+    struct Corpus {
+        std::vector<zippee::mapped_file> archives;
+        std::vector<std::span<std::byte>> entries;
+        std::vector<size_t> sizes;
+        size_t compressed_bytes = 0;
+        size_t uncompressed_bytes = 0;
+
+        //Zstandard entries, benchmarked apart from the DEFLATE ones above
+        std::vector<std::span<std::byte>> zstd_entries;
+        size_t zstd_compressed_bytes = 0;
+        size_t zstd_uncompressed_bytes = 0;
+    };
+
+    bool load_archive(const std::string& path, Corpus& corpus) {
+        auto file = zippee::mapped_file::open(path);
+        if (!file) {
+            std::println("Unable to open {}.", path);
+            return false;
+        }
+
+        auto data = file->data();
+        auto eocd = zip::search_for_eocd(data);
+        if (!eocd) {
+            std::println("{}: {}", path, eocd.error());
+            return false;
+        }
+
+        auto headers = zip::read_central_directory_headers(data.subspan(eocd->offset_start_central_directory));
+        if (!headers) {
+            std::println("{}: {}", path, headers.error());
+            return false;
+        }
+        for (auto& h : *headers) {
+            if (h.compression_method != 8 && h.compression_method != zstd::ZIP_METHOD) {
+                continue;
+            }
+
+            auto local_header = zip::read_local_header(data.subspan(h.relative_offset_of_local_header));
+            if (!local_header) {
+                continue;
+            }
+
+            auto offset = h.relative_offset_of_local_header + local_header->header_size();
+            if (h.compression_method == zstd::ZIP_METHOD) {
+                corpus.zstd_entries.push_back(data.subspan(offset, h.compressed_size));
+                corpus.zstd_compressed_bytes += h.compressed_size;
+                corpus.zstd_uncompressed_bytes += h.uncompressed_size;
+                continue;
+            }
+
+            corpus.entries.push_back(data.subspan(offset, h.compressed_size));
+            corpus.sizes.push_back(h.uncompressed_size);
+            corpus.compressed_bytes += h.compressed_size;
+            corpus.uncompressed_bytes += h.uncompressed_size;
+        }
+
+        corpus.archives.push_back(std::move(*file));
+        return true;
+    }
+
+    // Hardware counts for one configuration, over everything it processed.
+    struct CounterRow {
+        std::string label;
+        zippee::PerfSample sample;
+        size_t input_bytes;
+        size_t output_bytes;
+    };
+
+    void run(
+        const Corpus& corpus,
+        deflate::Kernel kernel,
+        bool literal_runs,
+        bool checked,
+        size_t iterations,
+        zippee::PerfCounters& counters,
+        std::vector<CounterRow>& counter_rows) {
+        deflate::set_kernel(kernel);
+
+        deflate::Decoder decoder;
+        decoder.set_literal_runs(literal_runs);
+        decoder.set_fast_loop(!checked);
+        std::vector<std::byte> output;
+
+        //warm up tables, output capacity and caches
+        for (auto entry : corpus.entries) {
+            decoder.decompress(entry, output);
+        }
+        decoder.reset_stats();
+
+        counters.start();
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; i++) {
+            for (auto entry : corpus.entries) {
+                decoder.decompress(entry, output);
+            }
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        counters.stop();
+
+        auto label = std::format("{:<8} {:<13}", deflate::kernel_name(kernel), literal_runs ? "literal runs" : "single");
+        counter_rows.push_back({label, counters.read(), corpus.compressed_bytes * iterations, corpus.uncompressed_bytes * iterations});
+
+        const auto& stats = decoder.stats();
+        double seconds = elapsed.count();
+        std::println("{} {:>10.1f} {:>10.1f} {:>12.1f} {:>10.1f}",
+            label,
+            corpus.compressed_bytes * iterations / seconds / 1e6,
+            corpus.uncompressed_bytes * iterations / seconds / 1e6,
+            stats.literals / seconds / 1e6,
+            stats.matches / seconds / 1e6);
+    }
+
+    // Inflate with dynamic block tables built afresh for every block, and
+    // with them kept in a cache of the given size.
+    void run_table_cache(const Corpus& corpus, size_t capacity, bool checked, size_t iterations) {
+        deflate::Decoder decoder;
+        decoder.set_fast_loop(!checked);
+        decoder.set_table_cache(capacity);
+        std::vector<std::byte> output;
+
+        for (auto entry : corpus.entries) {
+            decoder.decompress(entry, output);
+        }
+        decoder.reset_stats();
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t n = 0; n < iterations; n++) {
+            for (auto entry : corpus.entries) {
+                decoder.decompress(entry, output);
+            }
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        const auto& stats = decoder.stats();
+        auto lookups = stats.table_cache_hits + stats.table_cache_misses;
+        double seconds = elapsed.count();
+        std::println("{:<13} {:>10.1f} {:>10.1f} {:>12.0f} {:>7}",
+            capacity == 0 ? std::string("off") : std::format("{} tables", capacity),
+            corpus.compressed_bytes * iterations / seconds / 1e6,
+            corpus.uncompressed_bytes * iterations / seconds / 1e6,
+            stats.dynamic_blocks / seconds,
+            lookups == 0 ? std::string("-") : std::format("{:.1f}%", 100.0 * stats.table_cache_hits / lookups));
+    }
+
+    // The stages of extraction that don't touch the disk, alone and together:
+    // CRC-32 over inflated output, and inflate followed by CRC-32 per entry.
+    void run_stages(const Corpus& corpus, size_t iterations, zippee::PerfCounters& counters, std::vector<CounterRow>& counter_rows) {
+        deflate::Decoder decoder;
+        std::vector<std::vector<std::byte>> outputs(corpus.entries.size());
+        for (size_t i = 0; i < corpus.entries.size(); i++) {
+            decoder.decompress(corpus.entries[i], outputs[i]);
+        }
+
+        uint32_t crc = 0;
+        counters.start();
+        for (size_t n = 0; n < iterations; n++) {
+            for (auto& output : outputs) {
+                crc ^= zip::crc32(output);
+            }
+        }
+        counters.stop();
+        counter_rows.push_back({"crc32", counters.read(), corpus.uncompressed_bytes * iterations, corpus.uncompressed_bytes * iterations});
+
+        std::vector<std::byte> output;
+        counters.start();
+        for (size_t n = 0; n < iterations; n++) {
+            for (auto entry : corpus.entries) {
+                decoder.decompress(entry, output);
+                crc ^= zip::crc32(output);
+            }
+        }
+        counters.stop();
+        counter_rows.push_back({"inflate+crc32", counters.read(), corpus.compressed_bytes * iterations, corpus.uncompressed_bytes * iterations});
+
+        //keep the checksums from being optimised away
+        if (crc == 0x12345678) {
+            std::println("");
+        }
+    }
+
+    // Zstandard over its entries, to set beside DEFLATE's rows above; both
+    // decode into a reused vector.
+    void run_zstd(const Corpus& corpus, size_t iterations, zippee::PerfCounters& counters, std::vector<CounterRow>& counter_rows) {
+        zstd::Decoder decoder;
+        std::vector<std::byte> output;
+
+        for (auto entry : corpus.zstd_entries) {
+            decoder.decompress(entry, output);
+        }
+        decoder.reset_stats();
+
+        counters.start();
+        auto start = std::chrono::steady_clock::now();
+        for (size_t n = 0; n < iterations; n++) {
+            for (auto entry : corpus.zstd_entries) {
+                decoder.decompress(entry, output);
+            }
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        counters.stop();
+        counter_rows.push_back({"zstd", counters.read(), corpus.zstd_compressed_bytes * iterations, corpus.zstd_uncompressed_bytes * iterations});
+
+        const auto& stats = decoder.stats();
+        double seconds = elapsed.count();
+        std::println("{:<22} {:>10.1f} {:>10.1f} {:>12.1f} {:>10}",
+            "zstd",
+            corpus.zstd_compressed_bytes * iterations / seconds / 1e6,
+            corpus.zstd_uncompressed_bytes * iterations / seconds / 1e6,
+            stats.sequences / seconds / 1e6,
+            stats.compressed_blocks / iterations);
+    }
+
+    enum class Allocation {
+        Malloc,
+        Arena,
+        ReusedArena
+    };
+
+    std::string_view allocation_name(Allocation allocation) {
+        switch (allocation) {
+            case Allocation::Malloc: return "malloc";
+            case Allocation::Arena: return "arena";
+            case Allocation::ReusedArena: return "reused arena";
+        }
+        return "";
+    }
+
+    // Inflates every entry into output of its own, as extraction does, so the
+    // cost of allocating it counts. Malloc grows a fresh vector; arena sizes a
+    // fresh arena from the stated size, as --arena does; reused arena carves
+    // from one retained buffer, released in one go after each entry.
+    void run_allocation(const Corpus& corpus, Allocation allocation, bool checked, size_t iterations) {
+        deflate::Decoder decoder;
+        decoder.set_fast_loop(!checked);
+
+        auto largest = std::ranges::max(corpus.sizes);
+        std::vector<std::byte> retained(largest + deflate::OUTPUT_MARGIN);
+        std::pmr::monotonic_buffer_resource reused(retained.data(), retained.size());
+
+        auto inflate_entry = [&](size_t i) {
+            auto entry = corpus.entries[i];
+            switch (allocation) {
+                case Allocation::Malloc:
+                {
+                    std::vector<std::byte> output;
+                    decoder.decompress(entry, output);
+                }
+                break;
+
+                case Allocation::Arena:
+                {
+                    std::pmr::monotonic_buffer_resource arena(corpus.sizes[i] + deflate::OUTPUT_MARGIN);
+                    std::pmr::vector<std::byte> output(&arena);
+                    output.reserve(corpus.sizes[i] + deflate::OUTPUT_MARGIN);
+                    decoder.decompress(entry, output);
+                }
+                break;
+
+                case Allocation::ReusedArena:
+                {
+                    {
+                        std::pmr::vector<std::byte> output(&reused);
+                        output.reserve(corpus.sizes[i] + deflate::OUTPUT_MARGIN);
+                        decoder.decompress(entry, output);
+                    }
+                    reused.release();
+                }
+                break;
+            }
+        };
+
+        for (size_t i = 0; i < corpus.entries.size(); i++) {
+            inflate_entry(i);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t n = 0; n < iterations; n++) {
+            for (size_t i = 0; i < corpus.entries.size(); i++) {
+                inflate_entry(i);
+            }
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        double seconds = elapsed.count();
+        std::println("{:<13} {:>10.1f} {:>10.1f} {:>10.0f}",
+            allocation_name(allocation),
+            corpus.compressed_bytes * iterations / seconds / 1e6,
+            corpus.uncompressed_bytes * iterations / seconds / 1e6,
+            corpus.entries.size() * iterations / seconds);
+    }
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> input_filepaths;
+    size_t iterations = 5;
+    bool checked = false;
+
+    CLI::App app{"Benchmarks inflate over the DEFLATE entries of ZIP files, and Zstandard over any Zstandard ones.", "zippee_bench"};
+    app.add_option("inputs", input_filepaths, "Input files.")->required();
+    app.add_option("--iterations", iterations, "Passes over the corpus per configuration.");
+    app.add_flag("--checked", checked, "Disable the fast inflate loop, checking every read against the end of input.");
+
+    try {
+        app.parse(argc, argv);
+    } catch (const CLI::ParseError& e) {
+        return app.exit(e);
+    }
+
+    Corpus corpus;
+    for (auto& path : input_filepaths) {
+        if (!load_archive(path, corpus)) {
+            return -1;
+        }
+    }
+
+    std::println("{} entries, {} bytes compressed, {} bytes uncompressed.",
+        corpus.entries.size(), corpus.compressed_bytes, corpus.uncompressed_bytes);
+    if (!corpus.zstd_entries.empty()) {
+        std::println("{} Zstandard entries, {} bytes compressed, {} bytes uncompressed.",
+            corpus.zstd_entries.size(), corpus.zstd_compressed_bytes, corpus.zstd_uncompressed_bytes);
+    }
+
+    zippee::PerfCounters counters;
+    std::vector<CounterRow> counter_rows;
+
+    if (!corpus.entries.empty()) {
+        std::println("{:<8} {:<13} {:>10} {:>10} {:>12} {:>10}", "kernel", "decode", "in MB/s", "out MB/s", "Mliterals/s", "Mmatches/s");
+
+        auto initial = deflate::active_kernel();
+        for (auto kernel : {deflate::Kernel::Generic, deflate::Kernel::BMI2, deflate::Kernel::AVX2}) {
+            if (!deflate::kernel_supported(kernel)) {
+                continue;
+            }
+
+            for (bool literal_runs : {false, true}) {
+                run(corpus, kernel, literal_runs, checked, iterations, counters, counter_rows);
+            }
+        }
+        deflate::set_kernel(initial);
+
+        std::println("");
+        std::println("{:<13} {:>10} {:>10} {:>10}", "output", "in MB/s", "out MB/s", "entries/s");
+        for (auto allocation : {Allocation::Malloc, Allocation::Arena, Allocation::ReusedArena}) {
+            run_allocation(corpus, allocation, checked, iterations);
+        }
+
+        std::println("");
+        std::println("{:<13} {:>10} {:>10} {:>12} {:>7}", "table cache", "in MB/s", "out MB/s", "blocks/s", "hits");
+        for (size_t capacity : {size_t{0}, size_t{1}, deflate::TableCache::DEFAULT_CAPACITY}) {
+            run_table_cache(corpus, capacity, checked, iterations);
+        }
+    }
+
+    if (!corpus.zstd_entries.empty()) {
+        std::println("");
+        std::println("{:<22} {:>10} {:>10} {:>12} {:>10}", "codec", "in MB/s", "out MB/s", "Msequences/s", "blocks");
+        run_zstd(corpus, iterations, counters, counter_rows);
+    }
+
+    std::println("");
+    if (!counters.available()) {
+        std::println("Hardware counters unavailable: {}", counters.error());
+        return 0;
+    }
+
+    if (!corpus.entries.empty()) {
+        run_stages(corpus, iterations, counters, counter_rows);
+    }
+    std::println("{:<22} {}", "counters", zippee::perf_header());
+    for (auto& row : counter_rows) {
+        std::println("{:<22} {}", row.label, zippee::perf_row(row.sample, row.input_bytes, row.output_bytes));
+    }
+
+    return 0;
+}
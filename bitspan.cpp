@@ -26,35 +26,20 @@ size_t zippee::bitspan::bits_read() const {
     return _bit_offset;
 }
 
-uint32_t zippee::bitspan::peek_bits(uint8_t bits) {
-    if (bits == 0) {
-        return 0;
-    }
-
-    int64_t bits_remain = static_cast<int64_t>(_data.size() * 8) - _bit_offset - bits;
-    if (bits_remain < 0) {
-        throw std::runtime_error("Not enough bits available.");
-    }
-
-    size_t byte_offset = _bit_offset / 8;
-    size_t bits_in = _bit_offset % 8;
-
-    uint32_t val = *reinterpret_cast<uint32_t*>(&_data[byte_offset]);
-    val >>= bits_in;
-    //mask for bits asked for
-    val &= 0xffffffff >> (32 - bits);
-
-    return val;
+void zippee::bitspan::round_to_next_byte() {
+    _bit_offset = (_bit_offset + 7) & ~size_t{7};
 }
 
-uint32_t zippee::bitspan::read_bits(uint8_t bits) {
-    auto ret = peek_bits(bits);
-    _bit_offset += bits;
-    return ret;
-}
+std::span<std::byte> zippee::bitspan::read_bytes(size_t count) {
+    round_to_next_byte();
 
-void zippee::bitspan::round_to_next_byte() {
-    _bit_offset += _bit_offset % 8;
+    auto bytes_in = _bit_offset / 8;
+    if (bytes_in + count > _data.size()) {
+        throw std::runtime_error("Not enough bytes available.");
+    }
+
+    _bit_offset += count * 8;
+    return _data.subspan(bytes_in, count);
 }
 
 std::span<std::byte> zippee::bitspan::to_span() const {
@@ -7,7 +7,10 @@
 
 #include <array>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <span>
+#include <stdexcept>
 
 namespace zippee {
     class bitspan {
@@ -24,12 +27,60 @@ namespace zippee {
         bitspan(std::array<std::byte, N>& arr) : bitspan(std::span{arr}) {}
 
         size_t bits_read() const;
+        size_t bits_remaining() const;
 
         uint32_t peek_bits(uint8_t bits);
         uint32_t read_bits(uint8_t bits);
+        void skip_bits(size_t bits);
 
         void round_to_next_byte();
+        std::span<std::byte> read_bytes(size_t count);
 
         std::span<std::byte> to_span() const;
     };
-}
\ No newline at end of file
+}
+
+// The bit accessors sit on the inflate hot path, so they are defined here to
+// be inlined into, and compiled for the instruction set of, each decode kernel.
+
+inline size_t zippee::bitspan::bits_remaining() const {
+    return _data.size() * 8 - _bit_offset;
+}
+
+inline uint32_t zippee::bitspan::peek_bits(uint8_t bits) {
+    if (bits == 0) {
+        return 0;
+    }
+
+    if (bits_remaining() < bits) {
+        throw std::runtime_error("Not enough bits available.");
+    }
+
+    size_t byte_offset = _bit_offset / 8;
+    size_t bits_in = _bit_offset % 8;
+
+    uint64_t val = 0;
+    if (byte_offset + sizeof(val) <= _data.size()) {
+        std::memcpy(&val, &_data[byte_offset], sizeof(val));
+    } else {
+        std::memcpy(&val, &_data[byte_offset], _data.size() - byte_offset);
+    }
+    val >>= bits_in;
+    //mask for bits asked for
+    val &= (uint64_t{1} << bits) - 1;
+
+    return static_cast<uint32_t>(val);
+}
+
+inline uint32_t zippee::bitspan::read_bits(uint8_t bits) {
+    auto ret = peek_bits(bits);
+    _bit_offset += bits;
+    return ret;
+}
+
+inline void zippee::bitspan::skip_bits(size_t bits) {
+    if (bits_remaining() < bits) {
+        throw std::runtime_error("Not enough bits available.");
+    }
+    _bit_offset += bits;
+}
@@ -151,3 +151,63 @@ TEST(BitSpan, round_to_next_byte_fullbyte_reads) {
     bits.round_to_next_byte();
     EXPECT_EQ(bits.bits_read(), 16);
 }
+
+TEST(BitSpan, round_to_next_byte_odd_offsets) {
+    auto data = make_bytes(0x12, 0x34, 0x56);
+    bitspan bits(data);
+
+    bits.read_bits(3);
+    bits.round_to_next_byte();
+    EXPECT_EQ(bits.bits_read(), 8);
+
+    bits.read_bits(1);
+    bits.round_to_next_byte();
+    EXPECT_EQ(bits.bits_read(), 16);
+
+    bits.read_bits(7);
+    bits.round_to_next_byte();
+    EXPECT_EQ(bits.bits_read(), 24);
+}
+
+TEST(BitSpan, read_bytes_realigns) {
+    auto data = make_bytes(0xff, 0x12, 0x34, 0x56);
+    bitspan bits(data);
+
+    bits.read_bits(5);
+    auto bytes = bits.read_bytes(2);
+    EXPECT_EQ(bytes.size(), 2);
+    EXPECT_EQ(bytes[0], std::byte{0x12});
+    EXPECT_EQ(bytes[1], std::byte{0x34});
+    EXPECT_EQ(bits.bits_read(), 24);
+    EXPECT_EQ(bits.read_bits(8), 0x56);
+}
+
+TEST(BitSpan, fail_to_read_bytes_past_end) {
+    auto data = make_bytes(0x12, 0x34);
+    bitspan bits(data);
+
+    bits.read_bits(1);
+    EXPECT_THROW(bits.read_bytes(2), std::runtime_error);
+}
+
+TEST(BitSpan, bits_remaining) {
+    auto data = make_bytes(0x12, 0x34);
+    bitspan bits(data);
+
+    EXPECT_EQ(bits.bits_remaining(), 16);
+    bits.read_bits(5);
+    EXPECT_EQ(bits.bits_remaining(), 11);
+    bits.read_bits(11);
+    EXPECT_EQ(bits.bits_remaining(), 0);
+}
+
+TEST(BitSpan, skip_bits) {
+    auto data = make_bytes(0xf8, 0xf8);
+    bitspan bits(data);
+
+    bits.skip_bits(4);
+    EXPECT_EQ(bits.bits_read(), 4);
+    EXPECT_EQ(bits.peek_bits(4), 0xf);
+    EXPECT_THROW(bits.skip_bits(13), std::runtime_error);
+    EXPECT_EQ(bits.bits_read(), 4);
+}
@@ -0,0 +1,200 @@
+//------------------------------------------------------------------------------
+// client.cpp
+//------------------------------------------------------------------------------
+
+#include "server.hpp"
+
+#include "vendor/CLI11.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <format>
+#include <fstream>
+#include <print>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    std::string_view as_text(std::span<const std::byte> data) {
+        return {reinterpret_cast<const char*>(data.data()), data.size()};
+    }
+
+    // The names in a list reply, leaving out directories.
+    std::vector<std::string> entry_names(std::span<const std::byte> listing) {
+        std::vector<std::string> names;
+        auto text = as_text(listing);
+        while (!text.empty()) {
+            auto line = text.substr(0, text.find('\n'));
+            text.remove_prefix(std::min(text.size(), line.size() + 1));
+            auto name = line.substr(0, line.find('\t'));
+            if (!name.empty() && !name.ends_with('/')) {
+                names.emplace_back(name);
+            }
+        }
+        return names;
+    }
+
+    // Latency at quantile q of sorted latencies.
+    double percentile(const std::vector<double>& sorted, double q) {
+        auto index = static_cast<size_t>(q * (sorted.size() - 1) + 0.5);
+        return sorted[std::min(index, sorted.size() - 1)];
+    }
+
+    struct LoadOptions {
+        size_t connections = 8;
+        size_t requests = 1000;
+        std::vector<std::string> entries;
+        std::optional<std::pair<uint64_t, uint64_t>> range;
+    };
+
+    // Reads entries over many connections at once, each making its requests
+    // one after another, and reports the rate served and the spread of how
+    // long each request took.
+    int load_test(const std::string& socket_path, const std::string& archive, LoadOptions options) {
+        if (options.entries.empty()) {
+            auto client = zippee::Client::connect(socket_path);
+            if (!client) {
+                std::println("{}", client.error());
+                return -1;
+            }
+            auto listing = (*client)->list(archive);
+            if (!listing) {
+                std::println("{}", listing.error());
+                return -1;
+            }
+            options.entries = entry_names(*listing);
+            if (options.entries.empty()) {
+                std::println("{} has no entries to read.", archive);
+                return -1;
+            }
+        }
+
+        std::vector<std::vector<double>> latencies(options.connections);
+        std::atomic<size_t> failed{0};
+        std::atomic<size_t> bytes{0};
+        std::vector<std::thread> threads;
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t c = 0; c < options.connections; c++) {
+            threads.emplace_back([&, c] {
+                auto client = zippee::Client::connect(socket_path);
+                if (!client) {
+                    failed += options.requests;
+                    return;
+                }
+                latencies[c].reserve(options.requests);
+                for (size_t i = 0; i < options.requests; i++) {
+                    auto& entry = options.entries[(c + i * options.connections) % options.entries.size()];
+                    auto begin = std::chrono::steady_clock::now();
+                    auto contents = options.range
+                        ? (*client)->read(archive, entry, options.range->first, options.range->second)
+                        : (*client)->read(archive, entry);
+                    auto end = std::chrono::steady_clock::now();
+                    latencies[c].push_back(std::chrono::duration<double, std::micro>(end - begin).count());
+                    if (contents) {
+                        bytes += contents->size();
+                    } else {
+                        failed++;
+                    }
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::vector<double> all;
+        for (auto& some : latencies) {
+            all.insert(all.end(), some.begin(), some.end());
+        }
+        std::ranges::sort(all);
+        if (all.empty()) {
+            std::println("No requests were made.");
+            return -1;
+        }
+
+        std::println("{} requests over {} connections in {:.3f} s, {} failed.", all.size(), options.connections, seconds, failed.load());
+        std::println("{:.0f} requests/s, {:.1f} MB/s.", all.size() / seconds, bytes / seconds / 1e6);
+        std::println("{:>10} {:>10} {:>10} {:>10} {:>10}", "p50 us", "p90 us", "p99 us", "p99.9 us", "max us");
+        std::println("{:>10.1f} {:>10.1f} {:>10.1f} {:>10.1f} {:>10.1f}",
+            percentile(all, 0.5), percentile(all, 0.9), percentile(all, 0.99), percentile(all, 0.999), all.back());
+        return failed == 0 ? 0 : 1;
+    }
+}
+
+int main(int argc, char** argv) {
+    std::string socket_path;
+    std::string archive;
+    std::string entry;
+    std::string output;
+    std::pair<uint64_t, uint64_t> range;
+    LoadOptions load_options;
+
+    CLI::App app{"Makes requests of a zippee --serve daemon, or measures how fast it serves them.", "zippee_client"};
+    app.add_option("socket", socket_path, "The daemon's Unix socket.")->required();
+    app.require_subcommand(1);
+
+    auto list = app.add_subcommand("list", "List an archive's entries.");
+    list->add_option("archive", archive, "Archive, as the daemon was given it.")->required();
+
+    auto stat = app.add_subcommand("stat", "Show one entry.");
+    stat->add_option("archive", archive, "Archive, as the daemon was given it.")->required();
+    stat->add_option("entry", entry, "Entry name.")->required();
+
+    auto read = app.add_subcommand("read", "Write an entry's contents to standard output, or a file.");
+    read->add_option("archive", archive, "Archive, as the daemon was given it.")->required();
+    read->add_option("entry", entry, "Entry name.")->required();
+    auto read_range = read->add_option("--range", range, "Read only LENGTH bytes from OFFSET.")->type_name("OFFSET LENGTH");
+    read->add_option("--output", output, "Write to this file instead.");
+
+    auto load = app.add_subcommand("load", "Read entries over many connections at once, reporting requests/s and latency.");
+    load->add_option("archive", archive, "Archive, as the daemon was given it.")->required();
+    load->add_option("--connections", load_options.connections, "Connections making requests at once.");
+    load->add_option("--requests", load_options.requests, "Requests made on each connection.");
+    load->add_option("--entry", load_options.entries, "Read only these entries, instead of all of them in turn.");
+    auto load_range = load->add_option("--range", range, "Read only LENGTH bytes from OFFSET of each entry.")->type_name("OFFSET LENGTH");
+
+    try {
+        app.parse(argc, argv);
+    } catch (const CLI::ParseError& e) {
+        return app.exit(e);
+    }
+
+    if (*load) {
+        if (*load_range) {
+            load_options.range = range;
+        }
+        return load_test(socket_path, archive, std::move(load_options));
+    }
+
+    auto client = zippee::Client::connect(socket_path);
+    if (!client) {
+        std::println("{}", client.error());
+        return -1;
+    }
+
+    auto reply = *list ? (*client)->list(archive)
+        : *stat ? (*client)->stat(archive, entry)
+        : *read_range ? (*client)->read(archive, entry, range.first, range.second)
+        : (*client)->read(archive, entry);
+    if (!reply) {
+        std::println(stderr, "{}", reply.error());
+        return 1;
+    }
+
+    if (!output.empty()) {
+        std::ofstream file(output, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(reply->data()), reply->size());
+        if (!file) {
+            std::println(stderr, "Unable to write {}.", output);
+            return 1;
+        }
+        return 0;
+    }
+    std::fwrite(reply->data(), 1, reply->size(), stdout);
+    return 0;
+}
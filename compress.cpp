@@ -0,0 +1,231 @@
+//------------------------------------------------------------------------------
+// compress.cpp
+//------------------------------------------------------------------------------
+
+#include "compress.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+namespace {
+    constexpr std::array<uint16_t, 29> LENGTH_BASES = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+    };
+
+    constexpr std::array<uint8_t, 29> LENGTH_EXTRAS = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+    };
+
+    constexpr std::array<uint16_t, 30> DISTANCE_BASES = {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+    };
+
+    constexpr std::array<uint8_t, 30> DISTANCE_EXTRAS = {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+        7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+    };
+
+    constexpr size_t MIN_MATCH = 3;
+    constexpr size_t MAX_MATCH = 258;
+    constexpr size_t WINDOW_SIZE = 32 * 1024;
+    constexpr size_t HASH_BITS = 15;
+    // Candidates tried per position; longer chains find little more on
+    // typical data.
+    constexpr size_t MAX_CHAIN = 64;
+    constexpr uint16_t END_OF_BLOCK = 256;
+
+    // Packs codes into bytes least significant bit first, as DEFLATE
+    // streams are read.
+    class BitWriter {
+    private:
+        std::vector<std::byte>& _output;
+        uint64_t _bits = 0;
+        size_t _count = 0;
+
+    public:
+        explicit BitWriter(std::vector<std::byte>& output)
+            : _output(output) {
+        }
+
+        void put(uint32_t value, size_t count) {
+            _bits |= static_cast<uint64_t>(value) << _count;
+            _count += count;
+            while (_count >= 8) {
+                _output.push_back(static_cast<std::byte>(_bits));
+                _bits >>= 8;
+                _count -= 8;
+            }
+        }
+
+        // Pads the last byte with zeroes.
+        void flush() {
+            if (_count > 0) {
+                _output.push_back(static_cast<std::byte>(_bits));
+            }
+            _bits = 0;
+            _count = 0;
+        }
+    };
+
+    uint32_t reverse_bits(uint32_t code, size_t length) {
+        uint32_t reversed = 0;
+        for (size_t i = 0; i < length; i++) {
+            reversed = (reversed << 1) | (code & 1);
+            code >>= 1;
+        }
+        return reversed;
+    }
+
+    // Huffman codes are defined most significant bit first.
+    void put_code(BitWriter& writer, uint32_t code, size_t length) {
+        writer.put(reverse_bits(code, length), length);
+    }
+
+    // Codes of the fixed literal/length alphabet, RFC 1951 3.2.6.
+    void put_fixed_symbol(BitWriter& writer, uint16_t symbol) {
+        if (symbol < 144) {
+            put_code(writer, 0x30 + symbol, 8);
+        } else if (symbol < 256) {
+            put_code(writer, 0x190 + symbol - 144, 9);
+        } else if (symbol < 280) {
+            put_code(writer, symbol - 256, 7);
+        } else {
+            put_code(writer, 0xc0 + symbol - 280, 8);
+        }
+    }
+
+    // Index of the last base no greater than value.
+    template<size_t N>
+    size_t base_index(const std::array<uint16_t, N>& bases, size_t value) {
+        return std::upper_bound(bases.begin(), bases.end(), value) - bases.begin() - 1;
+    }
+
+    void put_match(BitWriter& writer, size_t length, size_t distance) {
+        auto length_index = base_index(LENGTH_BASES, length);
+        put_fixed_symbol(writer, static_cast<uint16_t>(257 + length_index));
+        writer.put(static_cast<uint32_t>(length - LENGTH_BASES[length_index]), LENGTH_EXTRAS[length_index]);
+
+        auto distance_index = base_index(DISTANCE_BASES, distance);
+        put_code(writer, static_cast<uint32_t>(distance_index), 5);
+        writer.put(static_cast<uint32_t>(distance - DISTANCE_BASES[distance_index]), DISTANCE_EXTRAS[distance_index]);
+    }
+
+    struct Match {
+        size_t length = 0;
+        size_t distance = 0;
+    };
+
+    // Chains each position to the previous one with the same hash of its
+    // next three bytes, within the window.
+    class MatchFinder {
+    private:
+        std::span<const std::byte> _data;
+        std::vector<int32_t> _head;
+        std::vector<int32_t> _previous;
+
+        size_t hash(size_t position) const {
+            uint32_t bytes = static_cast<uint32_t>(_data[position])
+                | static_cast<uint32_t>(_data[position + 1]) << 8
+                | static_cast<uint32_t>(_data[position + 2]) << 16;
+            return (bytes * 2654435761u) >> (32 - HASH_BITS);
+        }
+
+    public:
+        explicit MatchFinder(std::span<const std::byte> data)
+            : _data(data)
+            , _head(size_t{1} << HASH_BITS, -1)
+            , _previous(WINDOW_SIZE, -1) {
+        }
+
+        void insert(size_t position) {
+            if (_data.size() - position < MIN_MATCH) {
+                return;
+            }
+            auto& head = _head[hash(position)];
+            _previous[position % WINDOW_SIZE] = head;
+            head = static_cast<int32_t>(position);
+        }
+
+        Match longest(size_t position) const {
+            Match best;
+            if (_data.size() - position < MIN_MATCH) {
+                return best;
+            }
+
+            auto limit = std::min(MAX_MATCH, _data.size() - position);
+            auto candidate = _head[hash(position)];
+            for (size_t chain = 0; chain < MAX_CHAIN && candidate >= 0; chain++) {
+                auto start = static_cast<size_t>(candidate);
+                if (start >= position || position - start >= WINDOW_SIZE) {
+                    break;
+                }
+
+                size_t length = 0;
+                while (length < limit && _data[start + length] == _data[position + length]) {
+                    length++;
+                }
+                if (length > best.length) {
+                    best = {length, position - start};
+                    if (length == limit) {
+                        break;
+                    }
+                }
+
+                auto next = _previous[start % WINDOW_SIZE];
+                if (next >= candidate) {
+                    break; //slot reused by a later position
+                }
+                candidate = next;
+            }
+
+            return best.length >= MIN_MATCH ? best : Match{};
+        }
+    };
+}
+
+std::vector<std::byte> deflate::compress(std::span<const std::byte> data) {
+    std::vector<std::byte> output;
+    output.reserve(data.size() / 2 + 16);
+    BitWriter writer(output);
+
+    writer.put(1, 1); //BFINAL
+    writer.put(0b01, 2); //fixed Huffman codes
+
+    MatchFinder finder(data);
+    size_t position = 0;
+    while (position < data.size()) {
+        auto match = finder.longest(position);
+        finder.insert(position);
+
+        if (match.length > 0 && position + 1 < data.size()) {
+            //a longer match starting at the next byte is worth a literal
+            auto next = finder.longest(position + 1);
+            if (next.length > match.length) {
+                put_fixed_symbol(writer, std::to_integer<uint16_t>(data[position]));
+                position++;
+                continue;
+            }
+        }
+
+        if (match.length == 0) {
+            put_fixed_symbol(writer, std::to_integer<uint16_t>(data[position]));
+            position++;
+            continue;
+        }
+
+        put_match(writer, match.length, match.distance);
+        for (size_t i = 1; i < match.length; i++) {
+            finder.insert(position + i);
+        }
+        position += match.length;
+    }
+
+    put_fixed_symbol(writer, END_OF_BLOCK);
+    writer.flush();
+    return output;
+}
@@ -0,0 +1,18 @@
+//------------------------------------------------------------------------------
+// compress.hpp
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <vector>
+
+namespace deflate {
+
+// Compresses data as a single fixed Huffman block, finding matches with hash
+// chains over the 32 KiB window and deferring a match by one byte when the
+// next one is longer. Quick and simple rather than as small as possible.
+std::vector<std::byte> compress(std::span<const std::byte> data);
+
+}
@@ -0,0 +1,68 @@
+//------------------------------------------------------------------------------
+// compress.tests.cpp
+//------------------------------------------------------------------------------
+
+#include "compress.hpp"
+#include "deflate.hpp"
+
+#include <random>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+std::vector<std::byte> round_trip(const std::vector<std::byte>& data) {
+    auto compressed = deflate::compress(data);
+    std::vector<std::byte> output;
+    auto consumed = deflate::Decoder().decompress(compressed, output);
+    EXPECT_EQ(consumed, compressed.size());
+    return output;
+}
+
+}
+
+TEST(Compress, empty) {
+    std::vector<std::byte> data;
+    auto compressed = deflate::compress(data);
+
+    EXPECT_EQ(compressed, std::vector<std::byte>({std::byte{0x03}, std::byte{0x00}}));
+    EXPECT_TRUE(round_trip(data).empty());
+}
+
+TEST(Compress, short_literals) {
+    std::vector<std::byte> data = {std::byte{'a'}, std::byte{0xff}};
+    EXPECT_EQ(round_trip(data), data);
+}
+
+TEST(Compress, repeated_byte) {
+    std::vector<std::byte> data(100000, std::byte{'z'});
+    auto compressed = deflate::compress(data);
+
+    EXPECT_LT(compressed.size(), 1000);
+    EXPECT_EQ(round_trip(data), data);
+}
+
+TEST(Compress, text_across_window) {
+    std::mt19937 random(7);
+    std::vector<std::string> words = {"best", "worst", "times", "wisdom", "age", "of", "it", "was", "the"};
+    std::vector<std::byte> data;
+    while (data.size() < 200000) {
+        for (char c : words[random() % words.size()] + " ") {
+            data.push_back(std::byte(c));
+        }
+    }
+
+    auto compressed = deflate::compress(data);
+    EXPECT_LT(compressed.size(), data.size() / 2);
+    EXPECT_EQ(round_trip(data), data);
+}
+
+TEST(Compress, random_bytes) {
+    std::mt19937 random(11);
+    std::vector<std::byte> data(70000);
+    for (auto& b : data) {
+        b = std::byte(random() & 0x0f);
+    }
+
+    EXPECT_EQ(round_trip(data), data);
+}
@@ -5,7 +5,11 @@
 
 #include "crc32.hpp"
 
+#include "trace.hpp"
+
 #include <array>
+#include <future>
+#include <vector>
 
 /*
 
@@ -40,8 +44,9 @@ namespace {
     std::array<uint32_t, 256> crc_table = generate_crc_table();
 }
 
-uint32_t zip::crc32(const std::vector<std::byte>& data) {
-    uint32_t crc32 = 0xffffffff;
+uint32_t zip::crc32(std::span<const std::byte> data, uint32_t crc) {
+    ZIPPEE_TRACE_SCOPE("crc32");
+    uint32_t crc32 = crc ^ 0xffffffff;
 
     for (auto b : data) {
         crc32 ^= std::to_integer<uint32_t>(b);
@@ -51,3 +56,95 @@ uint32_t zip::crc32(const std::vector<std::byte>& data) {
     crc32 ^= 0xffffffff;
     return crc32;
 }
+
+/*
+
+Combining two CRCs treats appending length_b zero bytes to the first message as
+a linear operator over GF(2), applied by repeated squaring. This is the approach
+zlib's crc32_combine takes, which lets chunks be checksummed independently.
+
+*/
+
+namespace {
+    using gf2_matrix = std::array<uint32_t, 32>;
+
+    uint32_t gf2_matrix_times(const gf2_matrix& mat, uint32_t vec) {
+        uint32_t sum = 0;
+        for (size_t i = 0; vec; vec >>= 1, i++) {
+            if (vec & 1) {
+                sum ^= mat[i];
+            }
+        }
+        return sum;
+    }
+
+    void gf2_matrix_square(gf2_matrix& square, const gf2_matrix& mat) {
+        for (size_t n = 0; n < 32; n++) {
+            square[n] = gf2_matrix_times(mat, mat[n]);
+        }
+    }
+
+    const size_t MIN_PARALLEL_CHUNK = 1 << 20;
+}
+
+uint32_t zip::crc32_combine(uint32_t crc_a, uint32_t crc_b, size_t length_b) {
+    if (length_b == 0) {
+        return crc_a;
+    }
+
+    gf2_matrix even;
+    gf2_matrix odd;
+
+    //operator for one zero bit
+    odd[0] = 0xEDB88320;
+    uint32_t row = 1;
+    for (size_t n = 1; n < 32; n++) {
+        odd[n] = row;
+        row <<= 1;
+    }
+
+    gf2_matrix_square(even, odd); //two zero bits
+    gf2_matrix_square(odd, even); //four zero bits
+
+    do {
+        gf2_matrix_square(even, odd);
+        if (length_b & 1) {
+            crc_a = gf2_matrix_times(even, crc_a);
+        }
+        length_b >>= 1;
+
+        if (length_b == 0) {
+            break;
+        }
+
+        gf2_matrix_square(odd, even);
+        if (length_b & 1) {
+            crc_a = gf2_matrix_times(odd, crc_a);
+        }
+        length_b >>= 1;
+    } while (length_b != 0);
+
+    return crc_a ^ crc_b;
+}
+
+uint32_t zip::crc32_parallel(std::span<const std::byte> data, size_t threads) {
+    size_t chunks = std::min(threads, data.size() / MIN_PARALLEL_CHUNK);
+    if (chunks <= 1) {
+        return crc32(data);
+    }
+
+    const size_t chunk_size = (data.size() + chunks - 1) / chunks;
+    std::vector<std::future<uint32_t>> partials;
+    for (size_t offset = 0; offset < data.size(); offset += chunk_size) {
+        auto chunk = data.subspan(offset, std::min(chunk_size, data.size() - offset));
+        partials.push_back(std::async(std::launch::async, [chunk] { return crc32(chunk); }));
+    }
+
+    uint32_t crc = partials.front().get();
+    for (size_t i = 1; i < partials.size(); i++) {
+        size_t length = std::min(chunk_size, data.size() - i * chunk_size);
+        crc = crc32_combine(crc, partials[i].get(), length);
+    }
+
+    return crc;
+}
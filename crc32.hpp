@@ -5,9 +5,13 @@
 
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
-#include <vector>
+#include <span>
 
 namespace zip {
-    uint32_t crc32(const std::vector<std::byte>& data);
+    // Pass the CRC of preceding data as crc to continue it.
+    uint32_t crc32(std::span<const std::byte> data, uint32_t crc = 0);
+    uint32_t crc32_combine(uint32_t crc_a, uint32_t crc_b, size_t length_b);
+    uint32_t crc32_parallel(std::span<const std::byte> data, size_t threads);
 }
@@ -26,3 +26,38 @@ TEST(CRC32, basic) {
 
     EXPECT_EQ(crc32, 0xd5223c9a);
 }
+
+TEST(CRC32, continue) {
+    auto data = std::vector<std::byte>({
+        std::byte{'H'}, std::byte{'i'}, std::byte{'\n'}
+    });
+    auto head = std::span{data}.subspan(0, 2);
+    auto tail = std::span{data}.subspan(2);
+
+    EXPECT_EQ(zip::crc32(tail, zip::crc32(head)), 0xd5223c9a);
+}
+
+TEST(CRC32, combine) {
+    auto data = std::vector<std::byte>({
+        std::byte{'H'}, std::byte{'i'}, std::byte{'\n'}
+    });
+    auto head = std::span{data}.subspan(0, 1);
+    auto tail = std::span{data}.subspan(1);
+
+    auto crc32 = zip::crc32_combine(zip::crc32(head), zip::crc32(tail), tail.size());
+
+    EXPECT_EQ(crc32, 0xd5223c9a);
+}
+
+TEST(CRC32, combine_empty_tail) {
+    EXPECT_EQ(zip::crc32_combine(0xd5223c9a, 0, 0), 0xd5223c9a);
+}
+
+TEST(CRC32, parallel_matches_serial) {
+    std::vector<std::byte> data(5 * 1024 * 1024 + 17);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = std::byte{static_cast<uint8_t>(i * 31 + (i >> 9))};
+    }
+
+    EXPECT_EQ(zip::crc32_parallel(data, 4), zip::crc32(data));
+}
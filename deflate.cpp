@@ -5,39 +5,622 @@
 
 #include "deflate.hpp"
 
+#include "trace.hpp"
+
 #include <algorithm>
 #include <cassert>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
 #include <print>
 #include <utility>
 
 namespace {
-    std::vector<deflate::HuffmanCode> fixed_huffman_lit_codelengths()  {
-        std::vector<size_t> code_lengths;
+    const std::array<size_t, 19> CODE_LENGTH_ORDER = {
+        16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+    };
+
+    const std::array<uint16_t, 30> LENGTH_EXTRAS = {
+        0, //padding
+        0, 0, 0, 0, 0, 0, 0, 0, // no extras
+        1, 1, 1, 1, // 1-bit extras
+        2, 2, 2, 2, // 2-bit extras
+        3, 3, 3, 3, // 3-bit extras
+        4, 4, 4, 4, // 4-bit extras
+        5, 5, 5, 5, // 5-bit extras
+        0 // no extras
+    };
 
-        for (size_t i = 0; i < 288; i++) {
+    const std::array<uint16_t, 30> LENGTH_STARTS = {
+        0, //padding
+        3, 4, 5, 6, 7, 8, 9, 10, // no extras
+        11, 13, 15, 17, // 1-bit extras
+        19, 23, 27, 31, // 2-bit extras
+        35, 43, 51, 59, // 3-bit extras
+        67, 83, 99, 115, // 4-bit extras
+        131, 163, 195, 227, // 5-bit extras
+        258 // no extras
+    };
+
+    const std::array<std::tuple<uint16_t, uint16_t>, 30> DISTANCE_TABLE = {{
+        {0, 1}, {0, 2}, {0, 3}, {0, 4}, // no extras
+        {1, 5}, {1, 7}, // 1-bit extras
+        {2, 9}, {2, 13}, // 2-bit extras
+        {3, 17}, {3, 25}, // 3-bit extras
+        {4, 33}, {4, 49}, // 4-bit extras
+        {5, 65}, {5, 97}, // 5-bit extras
+        {6, 129}, {6, 193}, // 6-bit extras
+        {7, 257}, {7, 385}, // 7-bit extras
+        {8, 513}, {8, 769}, // 8-bit extras
+        {9, 1025}, {9, 1537}, // 9-bit extras
+        {10, 2049}, {10, 3073}, // 10-bit extras
+        {11, 4097}, {11, 6145}, // 11-bit extras
+        {12, 8193}, {12, 12289}, // 12-bit extras
+        {13, 16385}, {13, 24577}, // 13-bit extras
+    }};
+
+    std::array<size_t, 288> fixed_huffman_lit_codelengths() {
+        std::array<size_t, 288> code_lengths;
+
+        for (size_t i = 0; i < code_lengths.size(); i++) {
             if (i < 144) {
-                code_lengths.push_back(8);
+                code_lengths[i] = 8;
             } else if (i < 256) {
-                code_lengths.push_back(9);
+                code_lengths[i] = 9;
             } else if (i < 280) {
-                code_lengths.push_back(7);
-            } else if (i < 288) {
-                code_lengths.push_back(8);
+                code_lengths[i] = 7;
+            } else {
+                code_lengths[i] = 8;
             }
         }
 
-        assert(code_lengths.size() == 288);
+        return code_lengths;
+    }
+
+    std::array<size_t, 32> fixed_huffman_dist_codelengths() {
+        std::array<size_t, 32> code_lengths;
+        code_lengths.fill(5);
+        return code_lengths;
+    }
+
+    size_t reverse_bits(size_t code, size_t length) {
+        size_t reversed = 0;
+        for (size_t i = 0; i < length; i++) {
+            reversed = (reversed << 1) | (code & 0x1);
+            code >>= 1;
+        }
+        return reversed;
+    }
+
+    [[gnu::always_inline]] inline size_t read_length(size_t symbol, zippee::bitspan& data) {
+        size_t length = LENGTH_STARTS[symbol & 0xff];
+        length += data.read_bits(LENGTH_EXTRAS[symbol & 0xff]);
+        return length;
+    }
+
+    [[gnu::always_inline]] inline size_t read_distance(size_t distance_symbol, zippee::bitspan& data) {
+        if (distance_symbol >= DISTANCE_TABLE.size()) {
+            throw std::runtime_error("Non compliant distance symbol.");
+        }
+
+        size_t distance = std::get<1>(DISTANCE_TABLE[distance_symbol]);
+        distance += data.read_bits(std::get<0>(DISTANCE_TABLE[distance_symbol]));
+        return distance;
+    }
+
+    [[gnu::always_inline]] inline size_t decode_symbol(const deflate::HuffmanTable& table, zippee::bitspan& data) {
+        using deflate::HuffmanTable;
+
+        auto available = std::min(HuffmanTable::LOOKUP_BITS, data.bits_remaining());
+        auto entry = table.lookup[data.peek_bits(available)];
+        if (entry.code_length != 0 && entry.code_length <= available) {
+            data.skip_bits(entry.code_length);
+            return entry.symbol;
+        }
+
+        //codes that fit in the lookup were all matched above, unless near the end of input
+        size_t first = available == HuffmanTable::LOOKUP_BITS ? table.long_codes_start : 0;
+        for (size_t i = first; i < table.code_count; i++) {
+            const auto& code = table.codes[i];
+            auto bits = data.peek_bits(code.code_length);
+            if (bits == code.code) {
+                data.skip_bits(code.code_length);
+                return code.symbol;
+            }
+        }
 
-        return deflate::bitlengths_to_huffman(code_lengths);
+        throw std::runtime_error("Couldn't find a matching code.");
     }
 
-    std::vector<deflate::HuffmanCode> fixed_huffman_dist_codelengths() {
-        return deflate::bitlengths_to_huffman(std::vector<size_t>(32, 5));
+    // Growth step for vector output; kept small as it is zero filled by
+    // resize and the unused part is trimmed at the end of every block.
+    constexpr size_t OUTPUT_CHUNK = 64 * 1024;
+
+    // Writes into the sink's area through a raw pointer, keeping at least
+    // deflate::OUTPUT_MARGIN bytes of room past it so that literals and matches need no
+    // per-byte size checks. The output is committed on destruction.
+    class OutputCursor {
+    private:
+        deflate::OutputSink& _sink;
+
+        // Sinks may move output within the area, so its size is asked after.
+        void point(std::span<std::byte> area) {
+            begin = area.data();
+            pos = begin + _sink.size();
+            end = begin + area.size();
+        }
+
+    public:
+        std::byte* begin;
+        std::byte* pos;
+        std::byte* end;
+
+        explicit OutputCursor(deflate::OutputSink& sink)
+            : _sink(sink) {
+            point(sink.reserve(deflate::OUTPUT_MARGIN));
+        }
+
+        ~OutputCursor() {
+            _sink.commit(pos - begin);
+        }
+
+        [[gnu::always_inline]] inline void reserve() {
+            if (static_cast<size_t>(end - pos) < deflate::OUTPUT_MARGIN) {
+                grow();
+            }
+        }
+
+        void grow() {
+            _sink.commit(pos - begin);
+            point(_sink.reserve(deflate::OUTPUT_MARGIN));
+        }
+    };
+
+    // Bit reader for the fast loop. Bits are taken from a 64-bit buffer that is
+    // topped up to at least 56 bits with one unaligned 8-byte load, which is
+    // only safe while 8 bytes of input remain; the caller checks that instead
+    // of every read checking bounds.
+    class FastBits {
+    private:
+        const std::byte* _start;
+        const std::byte* _in;
+        uint64_t _buffer = 0;
+        size_t _count = 0;
+
+    public:
+        explicit FastBits(const zippee::bitspan& data)
+            : _start(data.to_span().data())
+            , _in(_start) {
+            refill();
+            consume(data.bits_read() % 8);
+        }
+
+        const std::byte* in() const {
+            return _in;
+        }
+
+        size_t bits_consumed() const {
+            return (_in - _start) * 8 - _count;
+        }
+
+        [[gnu::always_inline]] inline void refill() {
+            uint64_t word;
+            std::memcpy(&word, _in, sizeof(word));
+            _buffer |= word << _count;
+            _in += (63 - _count) >> 3;
+            _count |= 56;
+        }
+
+        [[gnu::always_inline]] inline uint64_t peek(size_t bits) const {
+            return _buffer & ((uint64_t{1} << bits) - 1);
+        }
+
+        [[gnu::always_inline]] inline void consume(size_t bits) {
+            _buffer >>= bits;
+            _count -= bits;
+        }
+
+        [[gnu::always_inline]] inline uint64_t read(size_t bits) {
+            auto val = peek(bits);
+            consume(bits);
+            return val;
+        }
+    };
+
+    [[gnu::always_inline]] inline size_t fast_decode_symbol(const deflate::HuffmanTable& table, FastBits& bits) {
+        using deflate::HuffmanTable;
+
+        auto entry = table.lookup[bits.peek(HuffmanTable::LOOKUP_BITS)];
+        if (entry.code_length != 0) {
+            bits.consume(entry.code_length);
+            return entry.symbol;
+        }
+
+        for (size_t i = table.long_codes_start; i < table.code_count; i++) {
+            const auto& code = table.codes[i];
+            if (bits.peek(code.code_length) == code.code) {
+                bits.consume(code.code_length);
+                return code.symbol;
+            }
+        }
+
+        throw std::runtime_error("Couldn't find a matching code.");
+    }
+
+    // Decodes without per-symbol input bounds checks while at least 8 bytes of
+    // input remain, which covers the 48 bits a length/distance pair can need.
+    // Returns true if the end of the block was reached; otherwise data is left
+    // for the careful loop to finish. Errors match those of the careful loop.
+    template<size_t CopyWidth, bool LiteralRuns>
+    [[gnu::always_inline]] inline bool inflate_fast(
+        zippee::bitspan& data,
+        OutputCursor& out,
+        const deflate::HuffmanTable& lit_table,
+        const deflate::HuffmanTable& dist_table,
+        deflate::DecoderStats& stats) {
+        using deflate::HuffmanTable;
+
+        auto input = data.to_span();
+        if (input.size() < 16) {
+            return false;
+        }
+
+        FastBits bits(data);
+        const std::byte* in_limit = input.data() + input.size() - 8;
+        bool end_of_block = false;
+        size_t literals = 0;
+        size_t matches = 0;
+        size_t match_bytes = 0;
+
+        while (bits.in() <= in_limit) {
+            bits.refill();
+            out.reserve();
+            size_t symbol;
+
+            if constexpr (LiteralRuns) {
+                const auto& run = lit_table.literal_runs[bits.peek(HuffmanTable::LITERAL_RUN_BITS)];
+                if (run.code_length != 0) {
+                    bits.consume(run.code_length);
+                    if (run.count != 0) {
+                        //always store the whole run; only count bytes are kept
+                        std::memcpy(out.pos, run.literals.data(), run.literals.size());
+                        out.pos += run.count;
+                        literals += run.count;
+                        continue;
+                    }
+                    symbol = run.symbol;
+                } else {
+                    symbol = fast_decode_symbol(lit_table, bits);
+                }
+            } else {
+                symbol = fast_decode_symbol(lit_table, bits);
+            }
+
+            if (symbol < 256) {
+                *out.pos++ = std::byte{static_cast<uint8_t>(symbol)};
+                literals++;
+            } else if (symbol == 256) {
+                end_of_block = true;
+                break;
+            } else if (symbol < 286) {
+                size_t length = LENGTH_STARTS[symbol & 0xff] + bits.read(LENGTH_EXTRAS[symbol & 0xff]);
+
+                auto distance_symbol = fast_decode_symbol(dist_table, bits);
+                if (distance_symbol >= DISTANCE_TABLE.size()) {
+                    throw std::runtime_error("Non compliant distance symbol.");
+                }
+                size_t distance = std::get<1>(DISTANCE_TABLE[distance_symbol])
+                    + bits.read(std::get<0>(DISTANCE_TABLE[distance_symbol]));
+
+                deflate::copy_match<CopyWidth>(out.begin, out.pos, length, distance);
+                matches++;
+                match_bytes += length;
+            } else {
+                throw std::runtime_error("Non compliant symbol.");
+            }
+        }
+
+        data.skip_bits(bits.bits_consumed() - data.bits_read() % 8);
+        stats.literals += literals;
+        stats.matches += matches;
+        stats.match_bytes += match_bytes;
+        return end_of_block;
+    }
+
+    // Checks every read against the end of input; used for the tail of a
+    // block's input, and for all of it when the fast loop is disabled.
+    template<size_t CopyWidth, bool LiteralRuns>
+    [[gnu::always_inline]] inline void inflate_careful(
+        zippee::bitspan& input,
+        OutputCursor& out,
+        const deflate::HuffmanTable& lit_table,
+        const deflate::HuffmanTable& dist_table,
+        deflate::DecoderStats& stats) {
+        using deflate::HuffmanTable;
+
+        //a local copy can stay in registers, as output stores can't alias it
+        zippee::bitspan data(input);
+        size_t literals = 0;
+        size_t matches = 0;
+        size_t match_bytes = 0;
+
+        while (true) {
+            out.reserve();
+            size_t symbol;
+
+            if constexpr (LiteralRuns) {
+                auto available = std::min(HuffmanTable::LITERAL_RUN_BITS, data.bits_remaining());
+                const auto& run = lit_table.literal_runs[data.peek_bits(available)];
+                if (run.code_length != 0 && run.code_length <= available) {
+                    data.skip_bits(run.code_length);
+                    if (run.count != 0) {
+                        //always store the whole run; only count bytes are kept
+                        std::memcpy(out.pos, run.literals.data(), run.literals.size());
+                        out.pos += run.count;
+                        literals += run.count;
+                        continue;
+                    }
+                    symbol = run.symbol;
+                } else {
+                    symbol = decode_symbol(lit_table, data);
+                }
+            } else {
+                symbol = decode_symbol(lit_table, data);
+            }
+
+            if (symbol < 256) {
+                *out.pos++ = std::byte{static_cast<uint8_t>(symbol)};
+                literals++;
+            }
+            else if (symbol == 256) {
+                break; //end of block
+            } else if (symbol > 256 && symbol < 286) {
+                auto length = read_length(symbol, data);
+                auto distance = read_distance(decode_symbol(dist_table, data), data);
+                deflate::copy_match<CopyWidth>(out.begin, out.pos, length, distance);
+                matches++;
+                match_bytes += length;
+            } else {
+                throw std::runtime_error("Non compliant symbol.");
+            }
+        }
+
+        input = data;
+        stats.literals += literals;
+        stats.matches += matches;
+        stats.match_bytes += match_bytes;
+    }
+
+    template<size_t CopyWidth, bool LiteralRuns>
+    [[gnu::always_inline]] inline void inflate_huffman(
+        zippee::bitspan& data,
+        deflate::OutputSink& output,
+        const deflate::HuffmanTable& lit_table,
+        const deflate::HuffmanTable& dist_table,
+        bool fast_loop,
+        deflate::DecoderStats& stats) {
+        OutputCursor out(output);
+
+        if (fast_loop && inflate_fast<CopyWidth, LiteralRuns>(data, out, lit_table, dist_table, stats)) {
+            return;
+        }
+
+        inflate_careful<CopyWidth, LiteralRuns>(data, out, lit_table, dist_table, stats);
+    }
+
+    using InflateKernel = void (*)(zippee::bitspan&, deflate::OutputSink&, const deflate::HuffmanTable&, const deflate::HuffmanTable&, bool, deflate::DecoderStats&);
+
+    template<bool LiteralRuns>
+    void inflate_generic(zippee::bitspan& data, deflate::OutputSink& output, const deflate::HuffmanTable& lit_table, const deflate::HuffmanTable& dist_table, bool fast_loop, deflate::DecoderStats& stats) {
+        inflate_huffman<8, LiteralRuns>(data, output, lit_table, dist_table, fast_loop, stats);
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    // Same loop compiled to use shrx/bzhi for bit extraction, and for AVX2
+    // 32-byte match copies.
+    template<bool LiteralRuns>
+    [[gnu::target("bmi2")]]
+    void inflate_bmi2(zippee::bitspan& data, deflate::OutputSink& output, const deflate::HuffmanTable& lit_table, const deflate::HuffmanTable& dist_table, bool fast_loop, deflate::DecoderStats& stats) {
+        inflate_huffman<8, LiteralRuns>(data, output, lit_table, dist_table, fast_loop, stats);
+    }
+
+    template<bool LiteralRuns>
+    [[gnu::target("bmi2,avx2")]]
+    void inflate_avx2(zippee::bitspan& data, deflate::OutputSink& output, const deflate::HuffmanTable& lit_table, const deflate::HuffmanTable& dist_table, bool fast_loop, deflate::DecoderStats& stats) {
+        inflate_huffman<32, LiteralRuns>(data, output, lit_table, dist_table, fast_loop, stats);
+    }
+
+    // indexed by [literal runs][kernel]
+    const std::array<std::array<InflateKernel, 3>, 2> INFLATE_KERNELS = {{
+        {inflate_generic<false>, inflate_bmi2<false>, inflate_avx2<false>},
+        {inflate_generic<true>, inflate_bmi2<true>, inflate_avx2<true>}
+    }};
+#else
+    const std::array<std::array<InflateKernel, 3>, 2> INFLATE_KERNELS = {{
+        {inflate_generic<false>, inflate_generic<false>, inflate_generic<false>},
+        {inflate_generic<true>, inflate_generic<true>, inflate_generic<true>}
+    }};
+#endif
+
+    const std::array<std::string_view, 3> KERNEL_NAMES = {"generic", "bmi2", "avx2"};
+
+    deflate::Kernel initial_kernel() {
+        if (const char* name = std::getenv("ZIPPEE_KERNEL")) {
+            auto kernel = deflate::kernel_from_name(name);
+            if (kernel && deflate::kernel_supported(*kernel)) {
+                return *kernel;
+            }
+        }
+
+        return deflate::best_kernel();
+    }
+
+    std::atomic<deflate::Kernel> selected_kernel = initial_kernel();
+
+    // Table builders shared by the default and polymorphic allocator
+    // overloads; scratch space comes from the same allocator as the result.
+    template<typename Allocator>
+    std::vector<deflate::HuffmanCode, Allocator> reversed(std::span<const deflate::HuffmanCode> codes, const Allocator& allocator) {
+        std::vector<deflate::HuffmanCode, Allocator> reversed_codes(allocator);
+
+        for (auto& item : codes) {
+            auto reversed = item;
+            auto original = item;
+            reversed.code = 0;
+
+            while (original.code_length > 0) {
+                reversed.code <<= 1;
+                reversed.code |= original.code & 0x1;
+                original.code >>= 1;
+                original.code_length--;
+            }
+
+            reversed_codes.push_back(reversed);
+        }
+
+        return reversed_codes;
+    }
+
+    template<typename Allocator>
+    std::vector<deflate::HuffmanCode, Allocator> codes_from_bitlengths(std::span<const size_t> bitlengths, const Allocator& allocator) {
+        using SizeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<size_t>;
+        std::vector<size_t, SizeAllocator> bl_count(bitlengths.size(), 0, allocator);
+        size_t max_bits = 0;
+        //count the number of codes for each code length
+        for (size_t i = 0; i < bitlengths.size(); i++) {
+            if (bitlengths[i] == 0) continue;
+
+            bl_count[bitlengths[i]]++;
+            max_bits = std::max(max_bits, bitlengths[i]);
+        }
+
+        //find the numerical value of the smallest code for each code length
+        size_t code = 0;
+        std::vector<size_t, SizeAllocator> next_code(bitlengths.size(), 0, allocator);
+        for (size_t bits = 1; bits <= max_bits; bits++) {
+            code = (code + bl_count[bits - 1]) << 1;
+            next_code[bits] = code;
+        }
+
+        //assign numerical values to all codes
+        std::vector<deflate::HuffmanCode, Allocator> huffman_to_symbol(allocator);
+        for (size_t n = 0; n < bitlengths.size(); n++) {
+            auto bit_length = bitlengths[n];
+            if (bit_length != 0) {
+                huffman_to_symbol.push_back(deflate::HuffmanCode{
+                    .code = next_code[bit_length],
+                    .code_length = bit_length,
+                    .symbol = n
+                });
+                next_code[bit_length]++;
+            }
+        }
+
+        std::sort(huffman_to_symbol.begin(), huffman_to_symbol.end());
+        return reversed(std::span<const deflate::HuffmanCode>{huffman_to_symbol}, allocator);
     }
 }
 
-std::vector<std::byte> deflate::decompress(std::span<std::byte> data) {
-    std::vector<std::byte> decompressed;
+bool deflate::kernel_supported(Kernel kernel) {
+    switch (kernel) {
+        case Kernel::Generic:
+            return true;
+#if defined(__x86_64__) || defined(__i386__)
+        case Kernel::BMI2:
+            return __builtin_cpu_supports("bmi2");
+        case Kernel::AVX2:
+            return __builtin_cpu_supports("bmi2") && __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+deflate::Kernel deflate::best_kernel() {
+    for (auto kernel : {Kernel::AVX2, Kernel::BMI2}) {
+        if (kernel_supported(kernel)) {
+            return kernel;
+        }
+    }
+
+    return Kernel::Generic;
+}
+
+deflate::Kernel deflate::active_kernel() {
+    return selected_kernel.load(std::memory_order_relaxed);
+}
+
+bool deflate::set_kernel(Kernel kernel) {
+    if (!kernel_supported(kernel)) {
+        return false;
+    }
+
+    selected_kernel.store(kernel, std::memory_order_relaxed);
+    return true;
+}
+
+std::string_view deflate::kernel_name(Kernel kernel) {
+    return KERNEL_NAMES[static_cast<size_t>(kernel)];
+}
+
+std::optional<deflate::Kernel> deflate::kernel_from_name(std::string_view name) {
+    for (size_t i = 0; i < KERNEL_NAMES.size(); i++) {
+        if (KERNEL_NAMES[i] == name) {
+            return Kernel(i);
+        }
+    }
+
+    return std::nullopt;
+}
+
+deflate::Decoder::Decoder() {
+    build_huffman_table(fixed_huffman_lit_codelengths(), _fixed_lit_table);
+    build_literal_runs(_fixed_lit_table);
+    build_huffman_table(fixed_huffman_dist_codelengths(), _fixed_dist_table);
+}
+
+void deflate::Decoder::set_table_cache(size_t capacity) {
+    _table_cache.set_capacity(capacity);
+}
+
+void deflate::Decoder::set_literal_runs(bool enabled) {
+    _literal_runs = enabled;
+}
+
+void deflate::Decoder::set_fast_loop(bool enabled) {
+    _fast_loop = enabled;
+}
+
+const deflate::DecoderStats& deflate::Decoder::stats() const {
+    return _stats;
+}
+
+void deflate::Decoder::reset_stats() {
+    _stats = {};
+}
+
+void deflate::Decoder::inflate(
+    zippee::bitspan& data,
+    OutputSink& output,
+    const HuffmanTable& lit_table,
+    const HuffmanTable& dist_table) {
+    INFLATE_KERNELS[_literal_runs][static_cast<size_t>(active_kernel())](data, output, lit_table, dist_table, _fast_loop, _stats);
+}
+
+size_t deflate::Decoder::decompress(std::span<std::byte> data, std::vector<std::byte>& output) {
+    output.clear();
+    VectorSink sink(output);
+    return decompress(data, sink);
+}
+
+size_t deflate::Decoder::decompress(std::span<std::byte> data, std::pmr::vector<std::byte>& output) {
+    output.clear();
+    PmrVectorSink sink(output);
+    return decompress(data, sink);
+}
+
+size_t deflate::Decoder::decompress(std::span<std::byte> data, OutputSink& output) {
     zippee::bitspan bits(data);
 
     bool isLast = true;
@@ -47,20 +630,25 @@ std::vector<std::byte> deflate::decompress(std::span<std::byte> data) {
         switch (get_btype(bits)) {
             case BType::NoCompression:
             {
-                std::println("Reading uncompressed block; note, untested!");
-                uncompressed_block(bits, decompressed);
+                ZIPPEE_TRACE_SCOPE("stored block");
+                uncompressed_block(bits, output);
+                _stats.stored_blocks++;
             }
             break;
 
             case BType::FixedHuffmanCodes:
             {
-                fixed_block(bits, decompressed);
+                ZIPPEE_TRACE_SCOPE("fixed block");
+                fixed_block(bits, output);
+                _stats.fixed_blocks++;
             }
             break;
 
             case BType::DynamicHuffmanCodes:
             {
-                dynamic_block(bits, decompressed);
+                ZIPPEE_TRACE_SCOPE("dynamic block");
+                dynamic_block(bits, output);
+                _stats.dynamic_blocks++;
             }
             break;
 
@@ -73,6 +661,312 @@ std::vector<std::byte> deflate::decompress(std::span<std::byte> data) {
         }
     } while (!isLast);
 
+    return (bits.bits_read() + 7) / 8;
+}
+
+bool deflate::Decoder::decompress_range(std::span<std::byte> data, RangeSink& output) {
+    try {
+        decompress(data, output);
+    } catch (const OutputComplete&) {
+        return false;
+    }
+    output.flush();
+    return true;
+}
+
+void deflate::Decoder::fixed_block(zippee::bitspan& data, std::vector<std::byte>& output) {
+    VectorSink sink(output);
+    fixed_block(data, sink);
+}
+
+void deflate::Decoder::fixed_block(zippee::bitspan& data, OutputSink& output) {
+    inflate(data, output, _fixed_lit_table, _fixed_dist_table);
+}
+
+void deflate::Decoder::dynamic_block(zippee::bitspan& data, std::vector<std::byte>& output) {
+    VectorSink sink(output);
+    dynamic_block(data, sink);
+}
+
+void deflate::Decoder::dynamic_block(zippee::bitspan& data, OutputSink& output) {
+    auto literal_count = data.read_bits(5) + 257;
+    auto distance_count = data.read_bits(5) + 1;
+    auto code_length_count = data.read_bits(4) + 4;
+
+    std::array<size_t, HEADER_CODE_LENGTHS> header_code_lengths{};
+    for (size_t i = 0; i < code_length_count; i++) {
+        header_code_lengths[CODE_LENGTH_ORDER[i]] = data.read_bits(3);
+    }
+    if (!_code_length_table_built || header_code_lengths != _header_code_lengths) {
+        _code_length_table_built = false;
+        build_huffman_table(header_code_lengths, _code_length_table);
+        _header_code_lengths = header_code_lengths;
+        _code_length_table_built = true;
+    }
+
+    // literal and distance code lengths form one sequence; repeats may cross between them
+    auto code_lengths = std::span{_code_lengths}.subspan(0, literal_count + distance_count);
+    read_code_length_seq(code_lengths, _code_length_table, data);
+
+    if (_table_cache.capacity() > 0) {
+        bool hit = false;
+        auto& tables = _table_cache.get(code_lengths, literal_count, _literal_runs, hit);
+        (hit ? _stats.table_cache_hits : _stats.table_cache_misses)++;
+        inflate(data, output, tables.lit, tables.dist);
+        return;
+    }
+
+    build_huffman_table(code_lengths.subspan(0, literal_count), _lit_table);
+    if (_literal_runs) {
+        build_literal_runs(_lit_table);
+    }
+    build_huffman_table(code_lengths.subspan(literal_count), _dist_table);
+
+    inflate(data, output, _lit_table, _dist_table);
+}
+
+deflate::TableCache::TableCache(size_t capacity) {
+    set_capacity(capacity);
+}
+
+void deflate::TableCache::set_capacity(size_t capacity) {
+    if (capacity == _entries.size()) {
+        return;
+    }
+
+    //keeps the most recently used
+    auto used = std::span{_entries}.first(_size);
+    std::ranges::sort(used, std::ranges::greater{}, [](auto& entry) { return entry->last_used; });
+    _size = std::min(_size, capacity);
+
+    auto previous = _entries.size();
+    _entries.resize(capacity);
+    for (size_t i = previous; i < capacity; i++) {
+        _entries[i] = std::make_unique<Entry>();
+    }
+}
+
+size_t deflate::TableCache::capacity() const {
+    return _entries.size();
+}
+
+size_t deflate::TableCache::size() const {
+    return _size;
+}
+
+const deflate::TableCache::Tables& deflate::TableCache::get(
+    std::span<const size_t> code_lengths,
+    size_t literal_count,
+    bool literal_runs,
+    bool& hit) {
+    assert(!_entries.empty() && code_lengths.size() <= MAX_CODE_LENGTHS);
+
+    //FNV-1a; code lengths fit in a byte
+    uint64_t hash = 0xcbf29ce484222325 ^ literal_count;
+    for (auto length : code_lengths) {
+        hash = (hash ^ length) * 0x100000001b3;
+    }
+
+    auto matches = [&](const Entry& entry) {
+        return entry.hash == hash
+            && entry.literal_count == literal_count
+            && entry.length_count == code_lengths.size()
+            && std::equal(code_lengths.begin(), code_lengths.end(), entry.code_lengths.begin());
+    };
+
+    auto used = std::span{_entries}.first(_size);
+    Entry* found = nullptr;
+    for (auto& entry : used) {
+        if (matches(*entry)) {
+            found = entry.get();
+            break;
+        }
+    }
+
+    hit = found != nullptr;
+    if (!found) {
+        if (_size < _entries.size()) {
+            found = _entries[_size++].get();
+        } else {
+            found = std::ranges::min_element(used, {}, [](auto& entry) { return entry->last_used; })->get();
+        }
+
+        //matches nothing until the tables are whole
+        found->length_count = MAX_CODE_LENGTHS + 1;
+        build_huffman_table(code_lengths.subspan(0, literal_count), found->tables.lit);
+        build_huffman_table(code_lengths.subspan(literal_count), found->tables.dist);
+        found->tables.literal_runs = false;
+
+        found->hash = hash;
+        found->literal_count = literal_count;
+        found->length_count = code_lengths.size();
+        std::copy(code_lengths.begin(), code_lengths.end(), found->code_lengths.begin());
+    }
+
+    if (literal_runs && !found->tables.literal_runs) {
+        build_literal_runs(found->tables.lit);
+        found->tables.literal_runs = true;
+    }
+
+    found->last_used = ++_clock;
+    return found->tables;
+}
+
+template<typename Allocator>
+deflate::BasicVectorSink<Allocator>::BasicVectorSink(std::vector<std::byte, Allocator>& output)
+    : _output(output)
+    , _size(output.size()) {
+}
+
+template<typename Allocator>
+deflate::BasicVectorSink<Allocator>::~BasicVectorSink() {
+    _output.resize(_size);
+}
+
+template<typename Allocator>
+size_t deflate::BasicVectorSink<Allocator>::size() const {
+    return _size;
+}
+
+template<typename Allocator>
+std::span<std::byte> deflate::BasicVectorSink<Allocator>::reserve(size_t margin) {
+    if (_output.size() - _size < margin) {
+        // prefers spare capacity over reallocating, so a reused vector settles
+        auto target = _output.size() + OUTPUT_CHUNK;
+        if (_output.capacity() >= _size + margin) {
+            target = std::min(target, _output.capacity());
+        }
+        _output.resize(std::max(target, _size + margin));
+    }
+
+    return _output;
+}
+
+template<typename Allocator>
+void deflate::BasicVectorSink<Allocator>::commit(size_t size) {
+    _size = size;
+}
+
+template class deflate::BasicVectorSink<std::allocator<std::byte>>;
+template class deflate::BasicVectorSink<std::pmr::polymorphic_allocator<std::byte>>;
+
+deflate::SpanSink::SpanSink(std::span<std::byte> area, size_t window)
+    : _area(area)
+    , _window(window) {
+}
+
+size_t deflate::SpanSink::size() const {
+    return _size;
+}
+
+std::span<std::byte> deflate::SpanSink::reserve(size_t margin) {
+    if (_area.size() - _size < margin) {
+        throw std::runtime_error("Output exceeds the space provided.");
+    }
+
+    written(_size);
+    if (_window == 0) {
+        return _area;
+    }
+    return _area.first(std::min(_area.size(), _size + std::max(margin, _window)));
+}
+
+void deflate::SpanSink::commit(size_t size) {
+    _size = size;
+}
+
+void deflate::SpanSink::written(size_t) {
+}
+
+deflate::WindowSink::WindowSink(size_t chunk, size_t window)
+    : _buffer(window + std::max(chunk, MAX_RESERVE))
+    , _window(window) {
+}
+
+size_t deflate::WindowSink::size() const {
+    return _size;
+}
+
+std::span<std::byte> deflate::WindowSink::reserve(size_t margin) {
+    if (_buffer.size() - _size < margin && _size > _window) {
+        //slide the window down, handing on what falls out of it
+        auto history = _size - _window;
+        consume(std::span{_buffer}.first(history));
+        std::memmove(_buffer.data(), _buffer.data() + history, _window);
+        _size = _window;
+    }
+
+    if (_buffer.size() - _size < margin) {
+        throw std::runtime_error("Output reservation exceeds the window buffer.");
+    }
+
+    return _buffer;
+}
+
+void deflate::WindowSink::commit(size_t size) {
+    _size = size;
+}
+
+void deflate::WindowSink::flush() {
+    consume(std::span{_buffer}.first(_size));
+    _size = 0;
+}
+
+deflate::RangeSink::RangeSink(
+    uint64_t offset,
+    uint64_t length,
+    std::vector<std::byte>& output,
+    bool stop,
+    size_t window,
+    size_t chunk)
+    : WindowSink(chunk, window)
+    , _output(output)
+    , _begin(offset)
+    , _end(offset + length)
+    , _stop(stop) {
+}
+
+void deflate::RangeSink::consume(std::span<const std::byte> output) {
+    auto start = _consumed;
+    _consumed += output.size();
+    if (_consumed <= _begin || start >= _end) {
+        return;
+    }
+
+    auto first = std::max(start, _begin) - start;
+    auto last = std::min(_consumed, _end) - start;
+    _output.insert(_output.end(), output.begin() + first, output.begin() + last);
+}
+
+std::span<std::byte> deflate::RangeSink::reserve(size_t margin) {
+    if (!_stop) {
+        return WindowSink::reserve(margin);
+    }
+
+    if (_consumed + size() >= _end) {
+        flush();
+        throw OutputComplete{};
+    }
+
+    auto area = WindowSink::reserve(margin);
+    auto wanted = _end - (_consumed + size());
+    return area.first(std::min<uint64_t>(area.size(), size() + std::max<uint64_t>(margin, wanted)));
+}
+
+deflate::Decoder& deflate::thread_decoder() {
+    thread_local Decoder decoder;
+    return decoder;
+}
+
+std::vector<std::byte> deflate::decompress(std::span<std::byte> data) {
+    std::vector<std::byte> decompressed;
+    thread_decoder().decompress(data, decompressed);
+    return decompressed;
+}
+
+std::pmr::vector<std::byte> deflate::decompress(std::span<std::byte> data, std::pmr::memory_resource* resource) {
+    std::pmr::vector<std::byte> decompressed(resource);
+    thread_decoder().decompress(data, decompressed);
     return decompressed;
 }
 
@@ -87,51 +981,40 @@ deflate::BType deflate::get_btype(zippee::bitspan& data) {
 }
 
 void deflate::uncompressed_block(zippee::bitspan& data, std::vector<std::byte>& output) {
+    VectorSink sink(output);
+    uncompressed_block(data, sink);
+}
+
+void deflate::uncompressed_block(zippee::bitspan& data, OutputSink& output) {
     data.round_to_next_byte();
     auto len = data.read_bits(16);
     auto nlen = data.read_bits(16);
 
-    if (len != ~nlen) {
+    if ((len ^ nlen) != 0xffff) {
         throw std::runtime_error("LEN and NLEN do not match.");
     }
 
-    auto uncompressed_data_span = data.to_span().subspan(0, len);
-    output.insert(output.end(), uncompressed_data_span.begin(), uncompressed_data_span.end());
+    auto uncompressed_data_span = data.read_bytes(len);
+    auto area = output.reserve(len);
+    auto offset = output.size();
+    std::memcpy(area.data() + offset, uncompressed_data_span.data(), len);
+    output.commit(offset + len);
 }
 
 void deflate::fixed_block(zippee::bitspan& data, std::vector<std::byte>& output) {
-    auto lit_huffman_table = fixed_huffman_lit_codelengths();
-    auto dist_huffman_table = fixed_huffman_dist_codelengths();
-
-    decompress_huffman(data, output, lit_huffman_table, dist_huffman_table);
+    thread_decoder().fixed_block(data, output);
 }
 
 void deflate::dynamic_block(zippee::bitspan& data, std::vector<std::byte>& output) {
-    auto literal_count = data.read_bits(5) + 257;
-    auto distance_count = data.read_bits(5) + 1;
-    auto code_length_count = data.read_bits(4) + 4;
-
-    auto code_length_bytes = dynamic_header_code_lengths(code_length_count, data);
-    auto huffman_table = bitlengths_to_huffman(code_length_bytes);
-
-    std::vector<size_t> lit_code_lengths = read_code_length_seq(literal_count, huffman_table, data);
-    std::vector<size_t> dist_code_lengths = read_code_length_seq(distance_count, huffman_table, data);
-
-    auto lit_huffman_table = bitlengths_to_huffman(lit_code_lengths);
-    auto dist_huffman_table = bitlengths_to_huffman(dist_code_lengths);
-
-    decompress_huffman(data, output, lit_huffman_table, dist_huffman_table);
+    thread_decoder().dynamic_block(data, output);
 }
 
 std::vector<size_t> deflate::dynamic_header_code_lengths(size_t count, zippee::bitspan& data) {
-    const std::array<size_t, 19> code_length_idx_to_alphabet = {
-        16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
-    };
-    std::vector<size_t> code_lengths(code_length_idx_to_alphabet.size(), 0);
+    std::vector<size_t> code_lengths(CODE_LENGTH_ORDER.size(), 0);
 
     for (size_t i = 0; i < count; i++) {
         size_t val = data.read_bits(3);
-        code_lengths[code_length_idx_to_alphabet[i]] = val;
+        code_lengths[CODE_LENGTH_ORDER[i]] = val;
     }
 
     return code_lengths;
@@ -161,63 +1044,113 @@ void deflate::decompress_huffman(
 
 std::vector<deflate::HuffmanCode>
 deflate::bitlengths_to_huffman(const std::vector<size_t>& bitlengths) {
-    std::vector<size_t> bl_count(bitlengths.size(), 0);
-    size_t max_bits = 0;
-    //count the number of codes for each code length
-    for (size_t i = 0; i < bitlengths.size(); i++) {
-        if (bitlengths[i] == 0) continue;
+    return codes_from_bitlengths(std::span{bitlengths}, std::allocator<HuffmanCode>());
+}
 
-        bl_count[bitlengths[i]]++;
-        max_bits = std::max(max_bits, bitlengths[i]);
+std::pmr::vector<deflate::HuffmanCode>
+deflate::bitlengths_to_huffman(std::span<const size_t> bitlengths, std::pmr::memory_resource* resource) {
+    return codes_from_bitlengths(bitlengths, std::pmr::polymorphic_allocator<HuffmanCode>(resource));
+}
+
+std::vector<deflate::HuffmanCode> deflate::reverse_codes(const std::vector<HuffmanCode>& codes) {
+    return reversed(std::span{codes}, std::allocator<HuffmanCode>());
+}
+
+std::pmr::vector<deflate::HuffmanCode>
+deflate::reverse_codes(std::span<const HuffmanCode> codes, std::pmr::memory_resource* resource) {
+    return reversed(codes, std::pmr::polymorphic_allocator<HuffmanCode>(resource));
+}
+
+void deflate::build_huffman_table(std::span<const size_t> bitlengths, HuffmanTable& table) {
+    if (bitlengths.size() > HuffmanTable::MAX_SYMBOLS) {
+        throw std::runtime_error("Too many symbols for Huffman table.");
     }
 
-    //find the numerical value of the smallest code for each code length
+    //count the number of codes for each code length
+    std::array<size_t, HuffmanTable::MAX_CODE_LENGTH + 1> bl_count{};
+    for (auto bit_length : bitlengths) {
+        if (bit_length > HuffmanTable::MAX_CODE_LENGTH) {
+            throw std::runtime_error("Code length too long.");
+        }
+        bl_count[bit_length]++;
+    }
+    bl_count[0] = 0;
+
+    //find the smallest code and the first slot in the sorted table for each code length
+    std::array<size_t, HuffmanTable::MAX_CODE_LENGTH + 1> next_code{};
+    std::array<size_t, HuffmanTable::MAX_CODE_LENGTH + 1> next_slot{};
     size_t code = 0;
-    std::vector<size_t> next_code(bitlengths.size(), 0);
-    for (size_t bits = 1; bits <= max_bits; bits++) {
+    size_t slot = 0;
+    for (size_t bits = 1; bits <= HuffmanTable::MAX_CODE_LENGTH; bits++) {
         code = (code + bl_count[bits - 1]) << 1;
         next_code[bits] = code;
+        next_slot[bits] = slot;
+        slot += bl_count[bits];
+
+        if (bits == HuffmanTable::LOOKUP_BITS) {
+            table.long_codes_start = slot;
+        }
     }
+    table.code_count = slot;
 
-    //assign numerical values to all codes
-    std::vector<HuffmanCode> huffman_to_symbol;
+    //assign numerical values to all codes, stored reversed as they are read LSB first
     for (size_t n = 0; n < bitlengths.size(); n++) {
         auto bit_length = bitlengths[n];
         if (bit_length != 0) {
-            huffman_to_symbol.push_back(HuffmanCode{
-                .code = next_code[bit_length],
+            table.codes[next_slot[bit_length]++] = HuffmanCode{
+                .code = reverse_bits(next_code[bit_length], bit_length),
                 .code_length = bit_length,
                 .symbol = n
-            });
+            };
             next_code[bit_length]++;
         }
     }
 
-    std::sort(huffman_to_symbol.begin(), huffman_to_symbol.end());
-    huffman_to_symbol = reverse_codes(huffman_to_symbol);
-
-    return huffman_to_symbol;
+    table.lookup.fill({});
+    for (size_t i = 0; i < table.long_codes_start; i++) {
+        const auto& c = table.codes[i];
+        for (size_t idx = c.code; idx < table.lookup.size(); idx += size_t{1} << c.code_length) {
+            if (table.lookup[idx].code_length == 0) {
+                table.lookup[idx] = {
+                    .symbol = static_cast<uint16_t>(c.symbol),
+                    .code_length = static_cast<uint8_t>(c.code_length)
+                };
+            }
+        }
+    }
 }
 
-std::vector<deflate::HuffmanCode> deflate::reverse_codes(const std::vector<HuffmanCode>& codes) {
-    std::vector<HuffmanCode> reversed_codes;
+void deflate::build_literal_runs(HuffmanTable& table) {
+    const size_t lookup_mask = table.lookup.size() - 1;
+
+    for (size_t idx = 0; idx < table.literal_runs.size(); idx++) {
+        HuffmanTable::LiteralRun run{};
+        size_t bits = idx;
+
+        auto first = table.lookup[bits & lookup_mask];
+        if (first.code_length != 0 && first.symbol >= 256) {
+            run.symbol = first.symbol;
+            run.code_length = first.code_length;
+        }
 
-    for (auto& item : codes) {
-        auto reversed = item;
-        auto original = item;
-        reversed.code = 0;
+        while (run.count < HuffmanTable::MAX_LITERAL_RUN) {
+            auto entry = table.lookup[bits & lookup_mask];
+            if (entry.code_length == 0 || entry.symbol >= 256
+                || run.code_length + entry.code_length > HuffmanTable::LITERAL_RUN_BITS) {
+                break;
+            }
 
-        while (original.code_length > 0) {
-            reversed.code <<= 1;
-            reversed.code |= original.code & 0x1;
-            original.code >>= 1;
-            original.code_length--;
+            run.literals[run.count++] = static_cast<uint8_t>(entry.symbol);
+            run.code_length += entry.code_length;
+            bits >>= entry.code_length;
         }
 
-        reversed_codes.push_back(reversed);
+        table.literal_runs[idx] = run;
     }
+}
 
-    return reversed_codes;
+size_t deflate::get_symbol_for_code(const HuffmanTable& table, zippee::bitspan& data) {
+    return decode_symbol(table, data);
 }
 
 size_t deflate::get_symbol_for_code(const std::vector<HuffmanCode>& codes, zippee::bitspan& data) {
@@ -268,70 +1201,70 @@ std::vector<size_t> deflate::read_code_length_seq(size_t count, const std::vecto
     return code_length_seq;
 }
 
+void deflate::read_code_length_seq(std::span<size_t> code_lengths, const HuffmanTable& table, zippee::bitspan& data) {
+    for (size_t i = 0; i < code_lengths.size();) {
+        auto val = get_symbol_for_code(table, data);
+        size_t repeat_count = 0;
+
+        if (val < 16) {
+            repeat_count = 1;
+        } else if (val == 16) {
+            if (i == 0) {
+                throw std::runtime_error("Repeat with no previous code length.");
+            }
+            repeat_count = data.read_bits(2) + 3;
+            val = code_lengths[i - 1];
+        } else if (val == 17) {
+            repeat_count = data.read_bits(3) + 3;
+            val = 0;
+        } else if (val == 18) {
+            repeat_count = data.read_bits(7) + 11;
+            val = 0;
+        } else {
+            throw std::runtime_error("Unexpected symbol.");
+        }
+
+        if (i + repeat_count > code_lengths.size()) {
+            throw std::runtime_error("Code length repeat exceeds count.");
+        }
+
+        std::fill_n(code_lengths.begin() + i, repeat_count, val);
+        i += repeat_count;
+    }
+}
+
 std::tuple<size_t, size_t> deflate::read_length_and_distance(
     size_t symbol,
     const std::vector<HuffmanCode>& distance_codes,
     zippee::bitspan& data) {
     assert(symbol > 256 && symbol < 286);
 
-    const std::array<uint16_t, 30> length_extras = {
-        0, //padding
-        0, 0, 0, 0, 0, 0, 0, 0, // no extras
-        1, 1, 1, 1, // 1-bit extras
-        2, 2, 2, 2, // 2-bit extras
-        3, 3, 3, 3, // 3-bit extras
-        4, 4, 4, 4, // 4-bit extras
-        5, 5, 5, 5, // 5-bit extras
-        0 // no extras
-    };
-    const std::array<uint16_t, 30> length_starts = {
-        0, //padding
-        3, 4, 5, 6, 7, 8, 9, 10, // no extras
-        11, 13, 15, 17, // 1-bit extras
-        19, 23, 27, 31, // 2-bit extras
-        35, 43, 51, 59, // 3-bit extras
-        67, 83, 99, 115, // 4-bit extras
-        131, 163, 195, 227, // 5-bit extras
-        258 // no extras
-    };
+    size_t length = read_length(symbol, data);
+    size_t distance = read_distance(get_symbol_for_code(distance_codes, data), data);
 
-    size_t length = length_starts[symbol & 0xff];
-    auto length_extra = data.read_bits(length_extras[symbol & 0xff]);
-    length += length_extra;
+    return {length, distance};
+}
 
-    const std::array<std::tuple<uint16_t, uint16_t>, 30> distance_table = {{
-        {0, 1}, {0, 2}, {0, 3}, {0, 4}, // no extras
-        {1, 5}, {1, 7}, // 1-bit extras
-        {2, 9}, {2, 13}, // 2-bit extras
-        {3, 17}, {3, 25}, // 3-bit extras
-        {4, 33}, {4, 49}, // 4-bit extras
-        {5, 65}, {5, 97}, // 5-bit extras
-        {6, 129}, {6, 193}, // 6-bit extras
-        {7, 257}, {7, 385}, // 7-bit extras
-        {8, 513}, {8, 769}, // 8-bit extras
-        {9, 1025}, {9, 1537}, // 9-bit extras
-        {10, 2049}, {10, 3073}, // 10-bit extras
-        {11, 4097}, {11, 6145}, // 11-bit extras
-        {12, 8193}, {12, 12289}, // 12-bit extras
-        {13, 16385}, {13, 24577}, // 13-bit extras
-    }};
+std::tuple<size_t, size_t> deflate::read_length_and_distance(
+    size_t symbol,
+    const HuffmanTable& distance_table,
+    zippee::bitspan& data) {
+    assert(symbol > 256 && symbol < 286);
 
-    auto distance_symbol = get_symbol_for_code(distance_codes, data);
-    size_t distance = std::get<1>(distance_table[distance_symbol]);
-    auto distance_extra = data.read_bits(std::get<0>(distance_table[distance_symbol]));
-    distance += distance_extra;
+    size_t length = read_length(symbol, data);
+    size_t distance = read_distance(decode_symbol(distance_table, data), data);
 
     return {length, distance};
 }
 
 void deflate::duplicate_string(std::vector<std::byte>& data, size_t length, size_t distance) {
-    assert(distance > 0 && distance <= 32768);
-    assert(distance < data.size());
-
-    const size_t startIdx = data.size() - distance;
-    const size_t endIdx = data.size() - 1;
-    for (size_t i = 0; i < length; i++) {
-        auto copyIdx = startIdx + (i % (endIdx - startIdx + 1));
-        data.push_back(data[copyIdx]);
+    if (distance == 0 || distance > data.size()) {
+        throw std::runtime_error("Distance exceeds decompressed data.");
     }
-}
\ No newline at end of file
+
+    const size_t dest = data.size();
+    data.resize(dest + length);
+    std::byte* begin = data.data();
+    std::byte* pos = begin + dest;
+    copy_match<1>(begin, pos, length, distance);
+}
@@ -7,8 +7,16 @@
 
 #include "bitspan.hpp"
 
+#include <array>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <memory_resource>
+#include <optional>
 #include <span>
+#include <stdexcept>
+#include <string_view>
 #include <vector>
 #include <map>
 
@@ -32,12 +40,368 @@ struct HuffmanCode {
     }
 };
 
+// Decode table with fixed capacity so it can be rebuilt for every block
+// without touching the heap. Codes up to LOOKUP_BITS long resolve with a
+// single index into lookup; longer codes fall back to a search of codes.
+struct HuffmanTable {
+    static constexpr size_t MAX_SYMBOLS = 288;
+    static constexpr size_t MAX_CODE_LENGTH = 15;
+    static constexpr size_t LOOKUP_BITS = 10;
+    static constexpr size_t LITERAL_RUN_BITS = 11;
+    static constexpr size_t MAX_LITERAL_RUN = 3;
+
+    struct Entry {
+        uint16_t symbol;
+        uint8_t code_length; // 0 if no code of LOOKUP_BITS or fewer matches
+    };
+
+    // Consecutive literals whose codes all fit in LITERAL_RUN_BITS, so one
+    // lookup can emit several. If the next symbol isn't a literal, count is 0
+    // and symbol holds it instead; code_length is 0 if neither applies.
+    struct LiteralRun {
+        uint16_t symbol;
+        uint8_t count;
+        uint8_t code_length; // of all the literals together
+        std::array<uint8_t, MAX_LITERAL_RUN> literals;
+    };
+
+    std::array<Entry, 1 << LOOKUP_BITS> lookup;
+    std::array<HuffmanCode, MAX_SYMBOLS> codes; // sorted by code length, bits reversed
+    size_t code_count = 0;
+    size_t long_codes_start = 0; // first code longer than LOOKUP_BITS
+
+    std::array<LiteralRun, 1 << LITERAL_RUN_BITS> literal_runs;
+};
+
+void build_huffman_table(std::span<const size_t> bitlengths, HuffmanTable& table);
+void build_literal_runs(HuffmanTable& table);
+size_t get_symbol_for_code(const HuffmanTable& table, zippee::bitspan& data);
+
+// Instruction set variants of the Huffman decode loop. The best one the CPU
+// supports is chosen at startup, unless ZIPPEE_KERNEL names another.
+enum class Kernel {
+    Generic,
+    BMI2,
+    AVX2
+};
+
+bool kernel_supported(Kernel kernel);
+Kernel best_kernel();
+Kernel active_kernel();
+bool set_kernel(Kernel kernel);
+std::string_view kernel_name(Kernel kernel);
+std::optional<Kernel> kernel_from_name(std::string_view name);
+
+// Room a fixed output area needs past the output it holds: the longest match
+// plus the widest copy overrun, as literals and matches are stored in chunks
+// that may write past the end of the output.
+constexpr size_t OUTPUT_MARGIN = 258 + 32;
+
+// DEFLATE expands data at most about 1032 to 1, which bounds how far a stated
+// size is trusted.
+constexpr size_t MAX_RATIO = 1032;
+
+// Matches at least CopyWidth back are copied CopyWidth bytes at a time,
+// which cannot overlap, and may write up to CopyWidth - 1 bytes past the
+// match. With a CopyWidth of 8 or more, closer matches first have their
+// pattern laid out 8 bytes on, and are then copied 8 bytes at a time; below
+// that they repeat their pattern byte by byte. Shared with the Zstandard
+// decoder, whose sequences copy matches the same way.
+template<size_t CopyWidth>
+[[gnu::always_inline]] inline void copy_match(std::byte* begin, std::byte*& pos, size_t length, size_t distance) {
+    if (distance == 0 || distance > static_cast<size_t>(pos - begin)) {
+        throw std::runtime_error("Distance exceeds decompressed data.");
+    }
+
+    const std::byte* src = pos - distance;
+    std::byte* dest = pos;
+    pos += length;
+
+    if (distance >= CopyWidth) {
+        do {
+            std::memcpy(dest, src, CopyWidth);
+            dest += CopyWidth;
+            src += CopyWidth;
+        } while (dest < pos);
+    } else if constexpr (CopyWidth >= 8) {
+        if (distance < 8) {
+            //after the first 8 bytes the source trails by a multiple of the pattern, at least 8
+            static constexpr std::array<uint8_t, 8> STEP = {0, 1, 2, 1, 4, 4, 4, 4};
+            static constexpr std::array<uint8_t, 8> TRAIL = {0, 8, 8, 9, 8, 10, 12, 14};
+            dest[0] = src[0];
+            dest[1] = src[1];
+            dest[2] = src[2];
+            dest[3] = src[3];
+            std::memcpy(dest + 4, src + STEP[distance], 4);
+            dest += 8;
+            src = dest - TRAIL[distance];
+        }
+        while (dest < pos) {
+            std::memcpy(dest, src, 8);
+            dest += 8;
+            src += 8;
+        }
+    } else {
+        for (size_t i = 0; i < length; i++) {
+            dest[i] = src[i];
+        }
+    }
+}
+
+// Destination for inflated data. The decoder writes through raw pointers
+// into the area reserve() returns, and records how much of it is output with
+// commit(); the sink is only called again once the area runs short.
+class OutputSink {
+public:
+    virtual ~OutputSink() = default;
+
+    // Bytes of output at the start of the area.
+    virtual size_t size() const = 0;
+
+    // Returns the writable area. It starts with the output so far and has
+    // room for at least margin bytes more, or this throws.
+    virtual std::span<std::byte> reserve(size_t margin) = 0;
+
+    virtual void commit(size_t size) = 0;
+};
+
+// Appends to a vector, growing it as needed and trimming it to the output on
+// destruction. Instantiated for the default and polymorphic allocators.
+template<typename Allocator>
+class BasicVectorSink : public OutputSink {
+private:
+    std::vector<std::byte, Allocator>& _output;
+    size_t _size;
+
+public:
+    explicit BasicVectorSink(std::vector<std::byte, Allocator>& output);
+    ~BasicVectorSink();
+
+    size_t size() const override;
+    std::span<std::byte> reserve(size_t margin) override;
+    void commit(size_t size) override;
+};
+
+extern template class BasicVectorSink<std::allocator<std::byte>>;
+extern template class BasicVectorSink<std::pmr::polymorphic_allocator<std::byte>>;
+
+using VectorSink = BasicVectorSink<std::allocator<std::byte>>;
+using PmrVectorSink = BasicVectorSink<std::pmr::polymorphic_allocator<std::byte>>;
+
+// Writes into a fixed area, which must have OUTPUT_MARGIN bytes to spare past
+// the largest output expected. A non-zero window hands the area out that
+// many bytes at a time, calling written() in between, so progress can be acted
+// on while decoding.
+class SpanSink : public OutputSink {
+private:
+    std::span<std::byte> _area;
+    size_t _window;
+    size_t _size = 0;
+
+protected:
+    virtual void written(size_t size);
+
+public:
+    explicit SpanSink(std::span<std::byte> area, size_t window = 0);
+
+    size_t size() const override;
+    std::span<std::byte> reserve(size_t margin) override;
+    void commit(size_t size) override;
+};
+
+// Holds only the output matches can still refer back to, passing the rest
+// to consume() as room is needed, so output of any size takes a fixed buffer.
+class WindowSink : public OutputSink {
+private:
+    std::vector<std::byte> _buffer;
+    size_t _window;
+    size_t _size = 0;
+
+protected:
+    virtual void consume(std::span<const std::byte> output) = 0;
+
+public:
+    // Farthest back a DEFLATE match can reach.
+    static constexpr size_t WINDOW_SIZE = 32 * 1024;
+    // Largest single reservation: a whole stored block.
+    static constexpr size_t MAX_RESERVE = 65535 + OUTPUT_MARGIN;
+
+    // A window other than DEFLATE's suits other formats, as does a chunk
+    // above MAX_RESERVE where they reserve more at once.
+    explicit WindowSink(size_t chunk = 256 * 1024, size_t window = WINDOW_SIZE);
+
+    size_t size() const override;
+    std::span<std::byte> reserve(size_t margin) override;
+    void commit(size_t size) override;
+
+    // Passes on all output still held and starts afresh, for a new stream.
+    void flush();
+};
+
+// Thrown by a sink that has all the output it wants, to end decoding there.
+// Not an error, so not a std::runtime_error; whoever handed the decoder the
+// sink catches it.
+struct OutputComplete {};
+
+// Keeps bytes [offset, offset + length) of the output, appending them to
+// output, and drops the rest as it leaves the window, so bytes before the
+// range are never stored. Once the range is complete reserve() throws
+// OutputComplete, unless told to carry on to the end of the stream; the
+// area it hands out stops at the end of the range, so that is as soon as
+// the decoder reaches it. Decode through Decoder::decompress_range.
+class RangeSink : public WindowSink {
+private:
+    std::vector<std::byte>& _output;
+    uint64_t _begin;
+    uint64_t _end;
+    bool _stop;
+    uint64_t _consumed = 0;
+
+protected:
+    void consume(std::span<const std::byte> output) override;
+
+public:
+    RangeSink(
+        uint64_t offset,
+        uint64_t length,
+        std::vector<std::byte>& output,
+        bool stop = true,
+        size_t window = WINDOW_SIZE,
+        size_t chunk = 256 * 1024);
+
+    std::span<std::byte> reserve(size_t margin) override;
+};
+
+struct DecoderStats {
+    size_t stored_blocks = 0;
+    size_t fixed_blocks = 0;
+    size_t dynamic_blocks = 0;
+    size_t literals = 0;
+    size_t matches = 0;
+    size_t match_bytes = 0;
+    size_t table_cache_hits = 0;
+    size_t table_cache_misses = 0;
+};
+
+// Literal/length and distance tables built for dynamic blocks, kept by the
+// code lengths that built them. Encoders at one setting often repeat a
+// block header across blocks and entries, which then reuse the tables
+// instead of building them again. Holds at most capacity pairs, dropping the
+// least recently used. Not thread safe; each Decoder has its own.
+class TableCache {
+public:
+    static constexpr size_t MAX_CODE_LENGTHS = HuffmanTable::MAX_SYMBOLS + 32;
+    static constexpr size_t DEFAULT_CAPACITY = 8;
+
+    struct Tables {
+        HuffmanTable lit;
+        HuffmanTable dist;
+        bool literal_runs = false;
+    };
+
+private:
+    struct Entry {
+        uint64_t hash;
+        size_t literal_count;
+        size_t length_count;
+        std::array<uint8_t, MAX_CODE_LENGTHS> code_lengths;
+        uint64_t last_used;
+        Tables tables;
+    };
+
+    // allocated up front, so a full cache allocates nothing more
+    std::vector<std::unique_ptr<Entry>> _entries;
+    size_t _size = 0;
+    uint64_t _clock = 0;
+
+public:
+    explicit TableCache(size_t capacity = DEFAULT_CAPACITY);
+
+    // Zero turns the cache off. Shrinking drops what no longer fits.
+    void set_capacity(size_t capacity);
+    size_t capacity() const;
+    size_t size() const;
+
+    // Tables for code lengths, the first literal_count of them for
+    // literals/lengths and the rest for distances, with literal runs if
+    // asked for. Sets hit if they were already built. Capacity must not be
+    // zero.
+    const Tables& get(std::span<const size_t> code_lengths, size_t literal_count, bool literal_runs, bool& hit);
+};
+
+// Reusable inflate state. All tables and scratch space are owned with fixed
+// capacity, so once output has grown to fit, decoding allocates nothing.
+// A Decoder is not thread safe; use one per thread.
+class Decoder {
+private:
+    static constexpr size_t MAX_CODE_LENGTHS = TableCache::MAX_CODE_LENGTHS;
+    static constexpr size_t HEADER_CODE_LENGTHS = 19;
+
+    HuffmanTable _fixed_lit_table;
+    HuffmanTable _fixed_dist_table;
+    HuffmanTable _code_length_table;
+    HuffmanTable _lit_table;
+    HuffmanTable _dist_table;
+    TableCache _table_cache;
+    // what _code_length_table was last built from, for when blocks repeat it
+    std::array<size_t, HEADER_CODE_LENGTHS> _header_code_lengths{};
+    bool _code_length_table_built = false;
+    std::array<size_t, MAX_CODE_LENGTHS> _code_lengths;
+    bool _literal_runs = false;
+    bool _fast_loop = true;
+    DecoderStats _stats;
+
+    void inflate(zippee::bitspan& data, OutputSink& output, const HuffmanTable& lit_table, const HuffmanTable& dist_table);
+
+public:
+    Decoder();
+
+    // Literal runs decode several short literal codes per table lookup; the
+    // tables for them cost extra to build for each dynamic block. Off by default.
+    void set_literal_runs(bool enabled);
+
+    // The fast loop skips per-symbol bounds checks while enough input remains,
+    // leaving the end of the input to a fully checked loop. Disabling it
+    // checks everything, for comparison. On by default.
+    void set_fast_loop(bool enabled);
+
+    // Dynamic block tables kept for reuse; see TableCache. Zero builds them
+    // afresh for every block.
+    void set_table_cache(size_t capacity);
+
+    const DecoderStats& stats() const;
+    void reset_stats();
+
+    // Replaces the contents of output with the inflated data. Returns the
+    // number of input bytes the DEFLATE stream occupied, so framing that
+    // follows it can be found.
+    size_t decompress(std::span<std::byte> data, std::vector<std::byte>& output);
+    size_t decompress(std::span<std::byte> data, std::pmr::vector<std::byte>& output);
+    // Appends the inflated data to output.
+    size_t decompress(std::span<std::byte> data, OutputSink& output);
+    // Inflates until output has its range. Returns whether the stream was
+    // decoded to its end, which only then can be checksummed; either way
+    // all of the range there is has been passed on.
+    bool decompress_range(std::span<std::byte> data, RangeSink& output);
+
+    void fixed_block(zippee::bitspan& data, std::vector<std::byte>& output);
+    void fixed_block(zippee::bitspan& data, OutputSink& output);
+    void dynamic_block(zippee::bitspan& data, std::vector<std::byte>& output);
+    void dynamic_block(zippee::bitspan& data, OutputSink& output);
+};
+
+Decoder& thread_decoder();
+
 std::vector<std::byte> decompress(std::span<std::byte> data);
+// Output is allocated from resource, so it can come from an arena that is
+// released all at once.
+std::pmr::vector<std::byte> decompress(std::span<std::byte> data, std::pmr::memory_resource* resource);
 
 bool is_bfinal(zippee::bitspan& data);
 BType get_btype(zippee::bitspan& data);
 
 void uncompressed_block(zippee::bitspan& data, std::vector<std::byte>& output);
+void uncompressed_block(zippee::bitspan& data, OutputSink& output);
 
 void fixed_block(zippee::bitspan& data, std::vector<std::byte>& output);
 
@@ -51,11 +415,15 @@ void decompress_huffman(
     std::vector<HuffmanCode>& dist_table);
 
 std::vector<HuffmanCode> bitlengths_to_huffman(const std::vector<size_t>& bitlengths);
+std::pmr::vector<HuffmanCode> bitlengths_to_huffman(std::span<const size_t> bitlengths, std::pmr::memory_resource* resource);
 std::vector<HuffmanCode> reverse_codes(const std::vector<HuffmanCode>& codes);
+std::pmr::vector<HuffmanCode> reverse_codes(std::span<const HuffmanCode> codes, std::pmr::memory_resource* resource);
 size_t get_symbol_for_code(const std::vector<HuffmanCode>& codes, zippee::bitspan& data);
 
 std::vector<size_t> read_code_length_seq(size_t count, const std::vector<HuffmanCode>& codes, zippee::bitspan& data);
+void read_code_length_seq(std::span<size_t> code_lengths, const HuffmanTable& table, zippee::bitspan& data);
 std::tuple<size_t, size_t> read_length_and_distance(size_t symbol, const std::vector<HuffmanCode>& distance_codes, zippee::bitspan& data);
+std::tuple<size_t, size_t> read_length_and_distance(size_t symbol, const HuffmanTable& distance_table, zippee::bitspan& data);
 void duplicate_string(std::vector<std::byte>& data, size_t length, size_t distance);
 
 }
@@ -2,20 +2,84 @@
 // deflate.tests.cpp
 //------------------------------------------------------------------------------
 
+#include "compress.hpp"
 #include "deflate.hpp"
+#include "test_archive.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <memory_resource>
+#include <new>
+#include <random>
 
 #include <gtest/gtest.h>
 
 namespace {
 
+std::atomic<size_t> allocation_count{0};
+
 // https://stackoverflow.com/a/45172360
 template<typename... Ts>
 std::array<std::byte, sizeof...(Ts)> make_bytes(Ts&&... args) noexcept {
     return{std::byte(std::forward<Ts>(args))...};
 }
 
+using test::to_bytes;
+
+const std::string DICKENS = "It was the best of times, it was the worst of times, it was the age of wisdom, it was the age of foolishness, it was the epoch of belief, it was the epoch of incredulity, it was the season of Light, it was the season of Darkness.";
+
+// DICKENS compressed as a single dynamic Huffman block
+auto dickens_deflated() {
+    return make_bytes(
+        0x75, 0xcd, 0xc1, 0x09, 0x80, 0x30, 0x10, 0x44, 0xd1, 0x56, 0xb6, 0x00, 0xb1, 0x0a, 0x2f, 0x82,
+        0x4d, 0x24, 0x3a, 0x31, 0x8b, 0x31, 0x2b, 0xd9, 0x95, 0x60, 0xf7, 0x92, 0x93, 0x08, 0x7a, 0x7e,
+        0x7f, 0x98, 0xd1, 0xa8, 0x3a, 0x25, 0x8b, 0x20, 0x0f, 0x35, 0x92, 0x40, 0xc6, 0x3b, 0xb4, 0x23,
+        0x7e, 0xa4, 0x4a, 0xf9, 0x23, 0xb7, 0xa2, 0x41, 0x65, 0x5d, 0x64, 0xff, 0x92, 0x20, 0x92, 0x58,
+        0x63, 0x86, 0xbe, 0x87, 0x38, 0x64, 0x8e, 0x2d, 0xf0, 0x48, 0x8c, 0xf0, 0x6d, 0x9c, 0xe7, 0x82,
+        0xe5, 0x4c, 0x6c, 0xd7, 0x2b, 0x50, 0x38, 0x95, 0xdc, 0x8a, 0x89, 0xd7, 0x68, 0x3f, 0x36, 0xb8,
+        0xb2, 0xb5, 0xdf, 0xfe, 0x06
+    );
+}
+
+// Runs of repeats at several distances and lengths compressed as a single
+// fixed Huffman block
+auto fixed_matches_deflated() {
+    return make_bytes(
+        0x4b, 0x4c, 0x1c, 0x05, 0xc4, 0x82, 0x8a, 0xca, 0xaa, 0x41, 0x88, 0x12, 0x93, 0x92, 0x53, 0x52,
+        0xd3, 0xd2, 0x33, 0x46, 0x69, 0xf2, 0x68, 0x06, 0x46, 0x26, 0x66, 0x16, 0x56, 0x36, 0x76, 0x0e,
+        0x4e, 0x2e, 0x6e, 0x1e, 0x5e, 0x3e, 0x7e, 0x01, 0x41, 0x21, 0x61, 0x11, 0x51, 0x31, 0x71, 0x09,
+        0x49, 0x29, 0x69, 0x19, 0x59, 0x39, 0x79, 0x05, 0x45, 0x25, 0x65, 0x15, 0x55, 0x35, 0x75, 0x0d,
+        0x4d, 0x2d, 0x6d, 0x1d, 0x5d, 0x3d, 0x7d, 0x03, 0x43, 0x23, 0x63, 0x13, 0x53, 0x33, 0x73, 0x0b,
+        0x4b, 0x2b, 0x6b, 0x1b, 0x5b, 0x3b, 0xfb, 0x51, 0xfd, 0x43, 0x5b, 0x3f, 0x82, 0x0f, 0x4b, 0x11,
+        0x99, 0x59, 0xd9, 0x39, 0xb9, 0x79, 0xf9, 0x05, 0x85, 0x45, 0xc5, 0x25, 0xa5, 0x65, 0xe5, 0xc0,
+        0x3c, 0xe6, 0xe8, 0xe4, 0xec, 0xe2, 0xea, 0x36, 0xaa, 0x92, 0xba, 0x2a, 0x01
+    );
+}
+
+}
+
+// Counting replacements for the global allocator, so tests can assert that a
+// code path performs no heap allocations.
+#pragma GCC diagnostic push
+//GCC pairs these with the library's new once inlined, not with each other
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void* operator new(size_t size) {
+    allocation_count++;
+    if (void* p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
 }
 
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+#pragma GCC diagnostic pop
+
 TEST(Deflate, is_bfinal_true_zero_offset) {
     auto data = make_bytes(0x01);
     zippee::bitspan bits(data);
@@ -188,6 +252,17 @@ TEST(Deflate, bitlengths_to_huffman_3_2_2) {
     EXPECT_EQ(huffman_table, result);
 }
 
+TEST(Deflate, bitlengths_to_huffman_from_resource) {
+    std::vector<size_t> bitlengths = {3, 3, 3, 3, 3, 2, 4, 4};
+    std::array<std::byte, 1024> buffer;
+    std::pmr::monotonic_buffer_resource arena(buffer.data(), buffer.size(), std::pmr::null_memory_resource());
+
+    auto huffman_table = deflate::bitlengths_to_huffman(bitlengths, &arena);
+
+    EXPECT_EQ(huffman_table.get_allocator().resource(), &arena);
+    EXPECT_TRUE(std::ranges::equal(huffman_table, deflate::bitlengths_to_huffman(bitlengths)));
+}
+
 TEST(Deflate, reverse_codes) {
     auto codes = std::vector<deflate::HuffmanCode>({
         {0b00, 2, 5},
@@ -386,3 +461,527 @@ TEST(Deflate, duplicate_string_earlier_bytes_two) {
 }
 
 
+
+TEST(Deflate, uncompressed_block) {
+    auto data = make_bytes(0x01, 0x05, 0x00, 0xfa, 0xff, 'h', 'e', 'l', 'l', 'o', 0xee);
+    zippee::bitspan bits(data);
+    bits.read_bits(3);
+
+    std::vector<std::byte> output = {std::byte{'>'}};
+    deflate::uncompressed_block(bits, output);
+
+    const auto expected = make_bytes('>', 'h', 'e', 'l', 'l', 'o');
+    EXPECT_TRUE(std::equal(output.begin(), output.end(), expected.begin(), expected.end()));
+    EXPECT_EQ(bits.bits_read(), 80);
+}
+
+TEST(Deflate, uncompressed_block_len_nlen_mismatch) {
+    auto data = make_bytes(0x01, 0x05, 0x00, 0xfb, 0xff, 'h', 'e', 'l', 'l', 'o');
+    zippee::bitspan bits(data);
+    bits.read_bits(3);
+
+    std::vector<std::byte> output;
+    EXPECT_THROW(deflate::uncompressed_block(bits, output), std::runtime_error);
+}
+
+TEST(Deflate, uncompressed_block_truncated) {
+    auto data = make_bytes(0x01, 0x05, 0x00, 0xfa, 0xff, 'h', 'e');
+    zippee::bitspan bits(data);
+    bits.read_bits(3);
+
+    std::vector<std::byte> output;
+    EXPECT_THROW(deflate::uncompressed_block(bits, output), std::runtime_error);
+}
+
+TEST(Deflate, decompress_uncompressed_blocks) {
+    auto data = make_bytes(
+        0x00, 0x02, 0x00, 0xfd, 0xff, 'a', 'b',
+        0x01, 0x03, 0x00, 0xfc, 0xff, 'c', 'd', 'e'
+    );
+
+    auto output = deflate::decompress(std::span{data});
+
+    const auto expected = make_bytes('a', 'b', 'c', 'd', 'e');
+    EXPECT_TRUE(std::equal(output.begin(), output.end(), expected.begin(), expected.end()));
+}
+
+TEST(Deflate, decompress_fixed_then_uncompressed_block) {
+    auto data = make_bytes(
+        0x4a, 0x4c, 0x4a, 0x4e, 0x04, 0x23, 0x00, 0x00, 0x00, 0x00, 0xff, 0xff,
+        0xab, 0xa8, 0xac, 0x02, 0x00
+    );
+
+    auto output = deflate::decompress(std::span{data});
+
+    const std::string expected = "abcabcabcxyz";
+    ASSERT_EQ(output.size(), expected.size());
+    EXPECT_TRUE(std::equal(output.begin(), output.end(), expected.begin(),
+        [](std::byte a, char b) { return a == std::byte(b); }));
+}
+
+TEST(Deflate, build_huffman_table_3_2_2) {
+    std::vector<size_t> bitlengths = {3, 3, 3, 3, 3, 2, 4, 4};
+    deflate::HuffmanTable table;
+    deflate::build_huffman_table(bitlengths, table);
+
+    EXPECT_EQ(table.code_count, 8);
+    EXPECT_EQ(table.long_codes_start, 8);
+    EXPECT_TRUE(std::equal(table.codes.begin(), table.codes.begin() + table.code_count,
+        deflate::bitlengths_to_huffman(bitlengths).begin()));
+
+    auto data = make_bytes(0xa8, 0x0f);
+    zippee::bitspan bits(data);
+    EXPECT_EQ(deflate::get_symbol_for_code(table, bits), 5);
+    EXPECT_EQ(deflate::get_symbol_for_code(table, bits), 0);
+    EXPECT_EQ(deflate::get_symbol_for_code(table, bits), 3);
+    EXPECT_EQ(deflate::get_symbol_for_code(table, bits), 7);
+    EXPECT_EQ(bits.bits_read(), 12);
+}
+
+TEST(Deflate, get_symbol_for_code_long_codes) {
+    std::vector<size_t> bitlengths(15, 0);
+    for (size_t i = 1; i < bitlengths.size(); i++) {
+        bitlengths[i] = i;
+    }
+    bitlengths[0] = 14;
+
+    deflate::HuffmanTable table;
+    deflate::build_huffman_table(bitlengths, table);
+    EXPECT_EQ(table.long_codes_start, 10);
+
+    //codes are runs of 1s terminated by a 0; symbol 0 is thirteen 1s then a 0
+    auto data = make_bytes(0xff, 0x1f);
+    zippee::bitspan bits(data);
+    EXPECT_EQ(deflate::get_symbol_for_code(table, bits), 0);
+    EXPECT_EQ(bits.bits_read(), 14);
+}
+
+TEST(Deflate, get_symbol_for_code_no_match) {
+    deflate::HuffmanTable table;
+    deflate::build_huffman_table(std::vector<size_t>(30, 0), table);
+
+    auto data = make_bytes(0xff, 0xff);
+    zippee::bitspan bits(data);
+    EXPECT_THROW(deflate::get_symbol_for_code(table, bits), std::runtime_error);
+}
+
+TEST(Deflate, read_code_length_sequence_table) {
+    auto codes = std::vector<size_t>({4, 0, 5, 0, 4, 3, 2, 3, 3, 0, 0, 0, 0, 0, 0, 0, 4, 3, 5});
+    deflate::HuffmanTable table;
+    deflate::build_huffman_table(codes, table);
+
+    auto data = make_bytes(0xfb, 0x7c, 0x85, 0x87, 0x3a, 0x85, 0xe5, 0x3, 0x93, 0x94, 0x80, 0x31, 0xa, 0x3e, 0x3, 0x86, 0x24, 0x9d, 0x10, 0x2, 0x89, 0x43, 0xd8, 0x20, 0x81, 0x8f, 0xc9, 0xbf, 0x7, 0x13, 0xcf, 0xa4, 0x88, 0xb7);
+
+    zippee::bitspan vector_bits(data);
+    vector_bits.read_bits(1);
+    auto expected = deflate::read_code_length_seq(270, deflate::bitlengths_to_huffman(codes), vector_bits);
+
+    zippee::bitspan bits(data);
+    bits.read_bits(1);
+    std::vector<size_t> result(270);
+    deflate::read_code_length_seq(result, table, bits);
+
+    EXPECT_EQ(result, expected);
+    EXPECT_EQ(bits.bits_read(), vector_bits.bits_read());
+}
+
+TEST(Deflate, read_code_length_sequence_repeat_overflow) {
+    //single code of length 1 for symbol 18, which repeats zero 11+ times
+    std::vector<size_t> codes(19, 0);
+    codes[18] = 1;
+    codes[0] = 1;
+    deflate::HuffmanTable table;
+    deflate::build_huffman_table(codes, table);
+
+    auto data = make_bytes(0x01, 0x00);
+    zippee::bitspan bits(data);
+    std::vector<size_t> result(5);
+    EXPECT_THROW(deflate::read_code_length_seq(result, table, bits), std::runtime_error);
+}
+
+TEST(Deflate, duplicate_string_distance_too_far) {
+    std::vector<std::byte> data = {std::byte{0x11}, std::byte{0x12}};
+    EXPECT_THROW(deflate::duplicate_string(data, 2, 3), std::runtime_error);
+}
+
+TEST(Deflate, decompress_dynamic_block) {
+    auto data = dickens_deflated();
+    auto output = deflate::decompress(std::span{data});
+    EXPECT_EQ(output, to_bytes(DICKENS));
+}
+
+TEST(Deflate, decoder_reuse_without_allocation) {
+    auto dynamic = dickens_deflated();
+    auto stored = make_bytes(0x01, 0x05, 0x00, 0xfa, 0xff, 'h', 'e', 'l', 'l', 'o');
+    auto fixed = make_bytes(
+        0x4a, 0x4c, 0x4a, 0x4e, 0x04, 0x23, 0x00, 0x00, 0x00, 0x00, 0xff, 0xff,
+        0xab, 0xa8, 0xac, 0x02, 0x00
+    );
+
+    deflate::Decoder decoder;
+    decoder.set_literal_runs(true);
+    std::vector<std::byte> output;
+    auto warm_up = allocation_count.load();
+    decoder.decompress(std::span{dynamic}, output);
+    ASSERT_GT(allocation_count.load(), warm_up);
+    ASSERT_EQ(output, to_bytes(DICKENS));
+
+    auto before = allocation_count.load();
+    decoder.decompress(std::span{dynamic}, output);
+    decoder.decompress(std::span{stored}, output);
+    decoder.decompress(std::span{fixed}, output);
+    decoder.decompress(std::span{dynamic}, output);
+    auto after = allocation_count.load();
+
+    EXPECT_EQ(after - before, 0);
+    EXPECT_EQ(output, to_bytes(DICKENS));
+}
+
+TEST(Deflate, decompress_into_arena) {
+    auto data = dickens_deflated();
+    std::vector<std::byte> buffer(128 * 1024);
+    std::pmr::monotonic_buffer_resource arena(buffer.data(), buffer.size(), std::pmr::null_memory_resource());
+    deflate::thread_decoder();
+
+    auto before = allocation_count.load();
+    auto output = deflate::decompress(data, &arena);
+    EXPECT_EQ(allocation_count.load(), before);
+
+    EXPECT_EQ(output.get_allocator().resource(), &arena);
+    EXPECT_TRUE(std::ranges::equal(output, to_bytes(DICKENS)));
+}
+
+TEST(Deflate, decompress_into_span) {
+    auto data = dickens_deflated();
+    std::vector<std::byte> area(DICKENS.size() + deflate::OUTPUT_MARGIN);
+    deflate::SpanSink sink(area);
+
+    auto consumed = deflate::Decoder().decompress(data, sink);
+
+    EXPECT_EQ(consumed, data.size());
+    ASSERT_EQ(sink.size(), DICKENS.size());
+    area.resize(sink.size());
+    EXPECT_EQ(area, to_bytes(DICKENS));
+}
+
+TEST(Deflate, decompress_into_span_too_small) {
+    auto data = dickens_deflated();
+    std::vector<std::byte> area(DICKENS.size() + deflate::OUTPUT_MARGIN - 1);
+    deflate::SpanSink sink(area);
+
+    EXPECT_THROW(deflate::Decoder().decompress(data, sink), std::runtime_error);
+}
+
+TEST(Deflate, decompress_into_span_window) {
+    class CountingSink : public deflate::SpanSink {
+    public:
+        using deflate::SpanSink::SpanSink;
+        std::vector<size_t> progress;
+
+    protected:
+        void written(size_t size) override {
+            progress.push_back(size);
+        }
+    };
+
+    auto data = fixed_matches_deflated();
+    std::vector<std::byte> area(2048);
+    CountingSink sink(area, 64);
+
+    deflate::Decoder().decompress(data, sink);
+
+    EXPECT_EQ(sink.size(), 1660);
+    ASSERT_GT(sink.progress.size(), 2);
+    EXPECT_TRUE(std::is_sorted(sink.progress.begin(), sink.progress.end()));
+}
+
+TEST(Deflate, decompress_through_window) {
+    class CollectingSink : public deflate::WindowSink {
+    public:
+        std::vector<std::byte> output;
+        size_t consumed_calls = 0;
+
+        CollectingSink() : deflate::WindowSink(0) {}
+
+    protected:
+        void consume(std::span<const std::byte> data) override {
+            output.insert(output.end(), data.begin(), data.end());
+            consumed_calls++;
+        }
+    };
+
+    // long enough to slide the window many times, with matches reaching back
+    // across slides
+    std::vector<std::byte> expected;
+    deflate::Decoder decoder;
+    for (size_t i = 0; i < 1000; i++) {
+        auto block = fixed_matches_deflated();
+        std::vector<std::byte> output;
+        decoder.decompress(block, output);
+        expected.insert(expected.end(), output.begin(), output.end());
+    }
+
+    CollectingSink sink;
+    for (size_t i = 0; i < 1000; i++) {
+        auto block = fixed_matches_deflated();
+        decoder.decompress(block, sink);
+    }
+    sink.flush();
+
+    EXPECT_EQ(sink.output, expected);
+    EXPECT_GT(sink.consumed_calls, 2);
+    EXPECT_EQ(sink.size(), 0);
+}
+
+TEST(Deflate, decompress_range) {
+    std::string text;
+    for (size_t i = 0; text.size() < 1024 * 1024; i++) {
+        text += "line " + std::to_string(i) + " of " + std::to_string(i * 7919 % 1000) + "\n";
+    }
+    auto expected = to_bytes(text);
+    auto data = deflate::compress(expected);
+    deflate::Decoder decoder;
+
+    std::array<std::pair<size_t, size_t>, 5> ranges{{
+        {0, 100},
+        {300000, 5000},
+        {expected.size() - 10, 10},
+        {expected.size() - 10, 100},
+        {expected.size() + 5, 10},
+    }};
+    for (auto [offset, length] : ranges) {
+        for (bool stop : {true, false}) {
+            std::vector<std::byte> output;
+            deflate::RangeSink sink(offset, length, output, stop);
+
+            auto complete = decoder.decompress_range(data, sink);
+
+            auto first = std::min(offset, expected.size());
+            auto last = std::min(offset + length, expected.size());
+            EXPECT_TRUE(std::ranges::equal(output, std::span{expected}.subspan(first, last - first))) << offset << " " << length;
+            //stopping leaves the rest of the stream undecoded
+            EXPECT_EQ(complete, !stop || offset + length > expected.size()) << offset << " " << length;
+        }
+    }
+}
+
+TEST(Deflate, kernel_names) {
+    using deflate::Kernel;
+
+    for (auto kernel : {Kernel::Generic, Kernel::BMI2, Kernel::AVX2}) {
+        EXPECT_EQ(deflate::kernel_from_name(deflate::kernel_name(kernel)), kernel);
+    }
+    EXPECT_FALSE(deflate::kernel_from_name("sse9").has_value());
+    EXPECT_TRUE(deflate::kernel_supported(Kernel::Generic));
+    EXPECT_TRUE(deflate::kernel_supported(deflate::best_kernel()));
+}
+
+class DeflateKernel : public testing::TestWithParam<std::tuple<deflate::Kernel, bool>> {
+protected:
+    deflate::Kernel _previous;
+    deflate::Decoder _decoder;
+
+    void SetUp() override {
+        auto [kernel, literal_runs] = GetParam();
+        if (!deflate::kernel_supported(kernel)) {
+            GTEST_SKIP() << "Kernel not supported on this CPU.";
+        }
+        _previous = deflate::active_kernel();
+        ASSERT_TRUE(deflate::set_kernel(kernel));
+        _decoder.set_literal_runs(literal_runs);
+    }
+
+    void TearDown() override {
+        if (deflate::kernel_supported(std::get<0>(GetParam()))) {
+            deflate::set_kernel(_previous);
+        }
+    }
+
+    std::vector<std::byte> decompress(std::span<std::byte> data) {
+        std::vector<std::byte> output;
+        _decoder.decompress(data, output);
+        return output;
+    }
+};
+
+TEST_P(DeflateKernel, dynamic_block) {
+    auto data = dickens_deflated();
+    EXPECT_EQ(decompress(std::span{data}), to_bytes(DICKENS));
+    EXPECT_EQ(_decoder.stats().dynamic_blocks, 1);
+    EXPECT_EQ(_decoder.stats().literals + _decoder.stats().match_bytes, DICKENS.size());
+}
+
+TEST_P(DeflateKernel, fixed_block_matches) {
+    std::string expected = std::string(300, 'a');
+    for (size_t i = 0; i < 50; i++) {
+        expected += "xyz";
+    }
+    for (size_t i = 0; i < 40; i++) {
+        expected += "abcdefgh";
+    }
+    for (size_t i = 0; i < 8; i++) {
+        for (char c = 0; c < 64; c++) {
+            expected += c;
+        }
+    }
+    for (size_t i = 0; i < 9; i++) {
+        expected += "0123456789abcdefghijklmnopqrstuvwxyzABCDEF";
+    }
+
+    auto data = fixed_matches_deflated();
+
+    EXPECT_EQ(decompress(std::span{data}), to_bytes(expected));
+    EXPECT_EQ(_decoder.stats().fixed_blocks, 1);
+}
+
+// The fast loop trusts that enough input remains rather than checking each
+// read, so corrupt streams must fail the same way they do in the careful loop.
+TEST_P(DeflateKernel, fast_loop_matches_careful_loop_on_corrupt_input) {
+    deflate::Decoder careful;
+    careful.set_literal_runs(std::get<1>(GetParam()));
+    careful.set_fast_loop(false);
+
+    auto outcome = [](deflate::Decoder& decoder, std::span<std::byte> data) {
+        std::vector<std::byte> output;
+        std::string error;
+        try {
+            decoder.decompress(data, output);
+        } catch (const std::exception& e) {
+            error = e.what();
+        }
+        return std::pair{output, error};
+    };
+
+    auto dickens = dickens_deflated();
+    auto fixed = fixed_matches_deflated();
+    const std::vector<std::vector<std::byte>> seeds = {
+        {dickens.begin(), dickens.end()},
+        {fixed.begin(), fixed.end()},
+    };
+
+    std::mt19937 rng(31);
+    for (size_t i = 0; i < 4000; i++) {
+        auto data = seeds[i % seeds.size()];
+        switch (rng() % 3) {
+            case 0:
+                for (size_t flips = 1 + rng() % 4; flips > 0; flips--) {
+                    data[rng() % data.size()] ^= std::byte(1 << (rng() % 8));
+                }
+                break;
+            case 1:
+                data[rng() % data.size()] = std::byte(rng());
+                break;
+            case 2:
+                data.resize(rng() % data.size());
+                break;
+        }
+
+        auto expected = outcome(careful, data);
+        auto actual = outcome(_decoder, data);
+        ASSERT_EQ(actual.second, expected.second) << "mutation " << i;
+        ASSERT_EQ(actual.first, expected.first) << "mutation " << i;
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Kernels,
+    DeflateKernel,
+    testing::Combine(
+        testing::Values(deflate::Kernel::Generic, deflate::Kernel::BMI2, deflate::Kernel::AVX2),
+        testing::Bool()),
+    [](const testing::TestParamInfo<std::tuple<deflate::Kernel, bool>>& info) {
+        return std::string(deflate::kernel_name(std::get<0>(info.param)))
+            + (std::get<1>(info.param) ? "_literal_runs" : "_single");
+    });
+
+TEST(Deflate, build_literal_runs) {
+    //'a' = 0, 'b' = 10, 'c' = 110, end of block = 111
+    std::vector<size_t> bitlengths(257, 0);
+    bitlengths['a'] = 1;
+    bitlengths['b'] = 2;
+    bitlengths['c'] = 3;
+    bitlengths[256] = 3;
+
+    deflate::HuffmanTable table;
+    deflate::build_huffman_table(bitlengths, table);
+    deflate::build_literal_runs(table);
+
+    //read LSB first: a, b, c, then end of block
+    auto run = table.literal_runs[0b111'011'01'0];
+    EXPECT_EQ(run.count, 3);
+    EXPECT_EQ(run.code_length, 6);
+    EXPECT_EQ(run.literals[0], 'a');
+    EXPECT_EQ(run.literals[1], 'b');
+    EXPECT_EQ(run.literals[2], 'c');
+
+    //end of block first
+    run = table.literal_runs[0b111];
+    EXPECT_EQ(run.count, 0);
+    EXPECT_EQ(run.symbol, 256);
+    EXPECT_EQ(run.code_length, 3);
+
+    //c then end of block stops the run
+    run = table.literal_runs[0b111'011];
+    EXPECT_EQ(run.count, 1);
+    EXPECT_EQ(run.code_length, 3);
+    EXPECT_EQ(run.literals[0], 'c');
+}
+
+TEST(Deflate, table_cache_reuses_and_evicts) {
+    auto lengths = [](size_t long_symbol) {
+        std::vector<size_t> code_lengths(257 + 2, 0);
+        code_lengths['a'] = 1;
+        code_lengths[long_symbol] = 2;
+        code_lengths[256] = 2;
+        code_lengths[257] = 1; //one distance code
+        return code_lengths;
+    };
+
+    deflate::TableCache cache(2);
+    bool hit = true;
+    auto& first = cache.get(lengths('b'), 257, false, hit);
+    EXPECT_FALSE(hit);
+    EXPECT_EQ(first.lit.code_count, 3);
+    EXPECT_EQ(first.dist.code_count, 1);
+
+    auto& again = cache.get(lengths('b'), 257, false, hit);
+    EXPECT_TRUE(hit);
+    EXPECT_EQ(&again, &first);
+
+    //the same lengths split differently are different tables
+    cache.get(lengths('b'), 256, false, hit);
+    EXPECT_FALSE(hit);
+
+    //'b' split at 257 was used least recently, so goes first
+    cache.get(lengths('c'), 257, false, hit);
+    EXPECT_FALSE(hit);
+    cache.get(lengths('b'), 256, true, hit);
+    EXPECT_TRUE(hit);
+    cache.get(lengths('b'), 257, false, hit);
+    EXPECT_FALSE(hit);
+    EXPECT_EQ(cache.size(), 2);
+
+    cache.set_capacity(1);
+    EXPECT_EQ(cache.size(), 1);
+    cache.get(lengths('b'), 257, false, hit);
+    EXPECT_TRUE(hit);
+}
+
+TEST(Deflate, decoder_table_cache_hits) {
+    auto dynamic = dickens_deflated();
+    deflate::Decoder decoder;
+    std::vector<std::byte> output;
+
+    decoder.decompress(std::span{dynamic}, output);
+    decoder.decompress(std::span{dynamic}, output);
+    EXPECT_EQ(decoder.stats().table_cache_misses, 1);
+    EXPECT_EQ(decoder.stats().table_cache_hits, 1);
+    EXPECT_EQ(output, to_bytes(DICKENS));
+
+    decoder.reset_stats();
+    decoder.set_table_cache(0);
+    decoder.set_literal_runs(true);
+    decoder.decompress(std::span{dynamic}, output);
+    EXPECT_EQ(decoder.stats().table_cache_hits + decoder.stats().table_cache_misses, 0);
+    EXPECT_EQ(output, to_bytes(DICKENS));
+}
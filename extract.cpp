@@ -0,0 +1,1192 @@
+//------------------------------------------------------------------------------
+// extract.cpp
+//------------------------------------------------------------------------------
+
+#include "extract.hpp"
+
+#include "crc32.hpp"
+#include "gzip.hpp"
+#include "io.hpp"
+#include "parallel.hpp"
+#include "pipeline.hpp"
+#include "trace.hpp"
+#include "zlib.hpp"
+#include "zstd.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <filesystem>
+#include <format>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <print>
+#include <set>
+
+#include <unistd.h>
+
+namespace {
+    // Entries are written flattened into directory, or the working directory
+    // if it is empty.
+    std::string output_path(const std::string& directory, const std::string& filename) {
+        std::string adjusted = filename;
+        std::replace(adjusted.begin(), adjusted.end(), '/', '_');
+        return directory.empty() ? adjusted : directory + "/" + adjusted;
+    }
+
+    std::expected<void, std::string> writeout(const zippee::output_location& location, std::span<const std::byte> d) {
+        ZIPPEE_TRACE_SCOPE("writeout", location.name);
+        int fd = location.create();
+        if (fd < 0) {
+            return std::unexpected(std::format("Unable to create {}.", location.name));
+        }
+
+        while (!d.empty()) {
+            auto written = ::write(fd, d.data(), d.size());
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                ::close(fd);
+                return std::unexpected(std::format("Unable to write out {}.", location.name));
+            }
+            d = d.subspan(written);
+        }
+
+        ::close(fd);
+        return {};
+    }
+
+    // Where extracted entries go: flattened into directory, or laid out as
+    // the tree their names describe when there is a tree.
+    struct OutputRoot {
+        std::string directory;
+        std::unique_ptr<zippee::output_tree> tree;
+
+        std::expected<zippee::output_location, std::string> locate(const std::string& file_name) const {
+            if (tree) {
+                return tree->locate(file_name);
+            }
+            return zippee::output_location{nullptr, output_path(directory, file_name)};
+        }
+
+        // Makes every directory the entries need before any of them are
+        // written. An entry whose directory can't be made fails when it is
+        // located.
+        void make_parents(const std::vector<zip::CentralDirectoryHeader>& headers) const {
+            if (!tree) {
+                return;
+            }
+            for (auto& h : headers) {
+                static_cast<void>(tree->make_parents(h.file_name));
+            }
+        }
+    };
+
+    // Opens the tree under output_dir/subdirectory with --output-dir, or
+    // otherwise makes subdirectory, if any, to flatten entries into.
+    std::expected<OutputRoot, std::string> open_output(const std::string& output_dir, const std::string& subdirectory) {
+        OutputRoot root;
+        if (output_dir.empty()) {
+            root.directory = subdirectory;
+            if (!subdirectory.empty()) {
+                std::error_code error;
+                std::filesystem::create_directories(subdirectory, error);
+                if (error) {
+                    return std::unexpected(std::format("Unable to create {}: {}", subdirectory, error.message()));
+                }
+            }
+            return root;
+        }
+
+        auto tree = zippee::output_tree::open(subdirectory.empty() ? output_dir : output_dir + "/" + subdirectory);
+        if (!tree) {
+            return std::unexpected(tree.error());
+        }
+        root.tree = std::move(*tree);
+        return root;
+    }
+
+    // Where a single-stream input's output goes: into output_dir when one is
+    // given, made if need be.
+    std::expected<zippee::output_location, std::string> stream_location(const std::string& output_dir, const std::string& name) {
+        if (output_dir.empty()) {
+            return zippee::output_location{nullptr, name};
+        }
+
+        std::error_code error;
+        std::filesystem::create_directories(output_dir, error);
+        if (error) {
+            return std::unexpected(std::format("Unable to create {}: {}", output_dir, error.message()));
+        }
+        return zippee::output_location{nullptr, output_dir + "/" + name};
+    }
+
+    // Name for the output of a single-stream input: its file name without the
+    // compression suffix.
+    std::string stream_output_path(const std::string& input_filepath, std::initializer_list<std::string_view> suffixes) {
+        auto name = std::filesystem::path(input_filepath).filename().string();
+        for (auto suffix : suffixes) {
+            if (name.size() > suffix.size() && name.ends_with(suffix)) {
+                return name.substr(0, name.size() - suffix.size());
+            }
+        }
+        return name + ".out";
+    }
+
+    // Entries at least this large are inflated straight into a mapped output
+    // file when that is enabled; smaller ones aren't worth the mapping.
+    constexpr size_t MMAP_OUTPUT_MIN = 1024 * 1024;
+    // How much mapped output is produced between starting writebacks.
+    constexpr size_t WRITEBACK_INTERVAL = 8 * 1024 * 1024;
+
+    // Inflates into a mapped output file. As each interval of output is
+    // finished it is checksummed, while still in memory, and its writeback
+    // started.
+    class MappedSink : public deflate::SpanSink {
+    private:
+        zippee::mapped_output& _file;
+        size_t _checked = 0;
+        uint32_t _crc32 = 0;
+
+    protected:
+        void written(size_t size) override {
+            auto chunk = _file.data().subspan(_checked, size - _checked);
+            _crc32 = zip::crc32(chunk, _crc32);
+            _checked = size;
+            _file.write_back(size);
+        }
+
+    public:
+        explicit MappedSink(zippee::mapped_output& file)
+            : SpanSink(file.data(), WRITEBACK_INTERVAL)
+            , _file(file) {
+        }
+
+        uint32_t finish() {
+            written(size());
+            return _crc32;
+        }
+    };
+
+    // An entry on its way through extraction. Once error is set, later steps
+    // pass the entry along untouched for the writer to report.
+    struct EntryJob {
+        const zip::CentralDirectoryHeader* header;
+        zippee::output_location output;
+        size_t data_offset = 0;
+        uint32_t expected_crc = 0;
+        // the compressed data, in place in a mapped archive or read into
+        // compressed_buffer
+        std::vector<std::byte> compressed_buffer;
+        std::span<std::byte> compressed;
+        // declared ahead of decompressed, which may be allocated from it
+        std::unique_ptr<std::pmr::monotonic_buffer_resource> arena;
+        std::pmr::vector<std::byte> decompressed;
+        std::string error;
+
+        // set instead of decompressed when inflating into the output file
+        std::optional<zippee::mapped_output> mapped;
+        size_t mapped_size = 0;
+        uint32_t mapped_crc32 = 0;
+    };
+
+    // Finds an entry's data and reads it in, or starts it being read in if
+    // the archive is mapped.
+    EntryJob read_entry(const zippee::byte_source& archive, const zip::CentralDirectoryHeader& h, const OutputRoot& root) {
+        EntryJob job{&h};
+
+        auto output = root.locate(h.file_name);
+        if (!output) {
+            job.error = std::format("Unable to extract {}: {}", h.file_name, output.error());
+            return job;
+        }
+        job.output = std::move(*output);
+
+        auto location = zip::locate_entry_data(archive, h);
+        if (!location) {
+            job.error = location.error();
+            return job;
+        }
+        job.data_offset = location->offset;
+        job.expected_crc = location->crc_32;
+
+        archive.prefetch(job.data_offset, h.compressed_size);
+        if (auto compressed = archive.read(job.data_offset, h.compressed_size, job.compressed_buffer); !compressed) {
+            job.error = std::format("Unable to read {}: {}", h.file_name, compressed.error());
+        } else {
+            job.compressed = *compressed;
+        }
+
+        return job;
+    }
+
+    // Decodes with the decoder for the entry's method; Zstandard has its own,
+    // one per thread like DEFLATE's.
+    template<typename Output>
+    void decompress_entry(deflate::Decoder& decoder, const zip::CentralDirectoryHeader& h, std::span<std::byte> compressed, Output& output) {
+        if (h.compression_method == zstd::ZIP_METHOD) {
+            zstd::thread_decoder().decompress(compressed, output);
+        } else {
+            decoder.decompress(compressed, output);
+        }
+    }
+
+    // An entry's stated size, as far as it can be trusted: no more than its
+    // compressed data can expand to.
+    size_t trusted_size(const zip::CentralDirectoryHeader& h, std::span<const std::byte> compressed) {
+        auto ratio = h.compression_method == zstd::ZIP_METHOD ? zstd::MAX_RATIO : deflate::MAX_RATIO;
+        return std::min<size_t>(h.uncompressed_size, compressed.size() * ratio);
+    }
+
+    void inflate_mapped(deflate::Decoder& decoder, std::span<std::byte> compressed, EntryJob& job) {
+        auto file = zippee::mapped_output::create_at(job.output.dir_fd(), job.output.name, job.header->uncompressed_size + deflate::OUTPUT_MARGIN);
+        if (!file) {
+            job.error = std::format("Unable to create {}: {}", job.header->file_name, file.error());
+            return;
+        }
+
+        job.mapped = std::move(*file);
+        MappedSink sink(*job.mapped);
+        decompress_entry(decoder, *job.header, compressed, sink);
+        job.mapped_size = sink.size();
+        job.mapped_crc32 = sink.finish();
+    }
+
+    // Gives the entry its own arena, sized up front from the stated size, so
+    // its output is one allocation released in one go with the entry.
+    void inflate_arena(deflate::Decoder& decoder, std::span<std::byte> compressed, EntryJob& job) {
+        auto expected = trusted_size(*job.header, compressed);
+        job.arena = std::make_unique<std::pmr::monotonic_buffer_resource>(expected + deflate::OUTPUT_MARGIN);
+        job.decompressed = std::pmr::vector<std::byte>(job.arena.get());
+        job.decompressed.reserve(expected + deflate::OUTPUT_MARGIN);
+        decompress_entry(decoder, *job.header, compressed, job.decompressed);
+    }
+
+    void inflate_entry(const zippee::ExtractOptions& options, deflate::Decoder& decoder, EntryJob& job) {
+        auto& h = *job.header;
+        if (!job.error.empty() || h.compression_method == 0) {
+            return; //nothing to inflate
+        }
+        ZIPPEE_TRACE_SCOPE("inflate", h.file_name);
+        if (h.compression_method != 8 && h.compression_method != zstd::ZIP_METHOD) {
+            job.error = std::format("Unsupported compression method {} for {}.", h.compression_method, h.file_name);
+            return;
+        }
+
+        auto compressed = job.compressed;
+        try {
+            //the output file is allocated at the stated size up front, so a
+            //size the data can't reach goes through memory instead
+            auto mapped = h.uncompressed_size >= MMAP_OUTPUT_MIN && h.uncompressed_size == trusted_size(h, compressed);
+            if (options.mmap_output && mapped) {
+                inflate_mapped(decoder, compressed, job);
+            } else if (options.arena) {
+                inflate_arena(decoder, compressed, job);
+            } else {
+                decompress_entry(decoder, h, compressed, job.decompressed);
+            }
+        } catch (const std::runtime_error& e) {
+            job.error = std::format("Unable to decompress {}: {}", h.file_name, e.what());
+        }
+    }
+
+    // Stored entries are checked in place when the archive is mapped, so the
+    // writer can have the kernel copy them without them passing through
+    // memory here.
+    void verify_entry(size_t threads, EntryJob& job) {
+        auto& h = *job.header;
+        if (!job.error.empty()) {
+            return;
+        }
+        ZIPPEE_TRACE_SCOPE("verify", h.file_name);
+
+        uint32_t crc32;
+        if (h.compression_method == 0) {
+            crc32 = zip::crc32_parallel(job.compressed, threads);
+        } else if (job.mapped) {
+            crc32 = job.mapped_crc32;
+        } else {
+            crc32 = zip::crc32(job.decompressed);
+        }
+
+        if (crc32 != job.expected_crc) {
+            job.error = std::format("CRC32 does not match for {}.", h.file_name);
+        }
+    }
+
+    // Returns what was written, or why the entry failed.
+    std::expected<std::string, std::string> write_entry(const zippee::byte_source& archive, EntryJob& job) {
+        auto& h = *job.header;
+        ZIPPEE_TRACE_SCOPE("write", h.file_name);
+
+        if (!job.error.empty()) {
+            if (job.mapped) {
+                job.output.remove();
+            }
+            return std::unexpected(job.error);
+        }
+
+        if (job.output.name.empty()) {
+            return std::format("Created directory {}.", h.file_name);
+        }
+
+        if (job.mapped) {
+            if (auto finished = job.mapped->finish(job.mapped_size); !finished) {
+                return std::unexpected(std::format("Unable to write out {}: {}", h.file_name, finished.error()));
+            }
+            return std::format("Decompressed and wrote out {}.", h.file_name);
+        }
+
+        //a stored entry read into memory to be checked is written from there,
+        //rather than read from the archive a second time
+        if (h.compression_method == 0 && archive.fd() >= 0 && job.compressed_buffer.empty()) {
+            int out_fd = job.output.create();
+            if (out_fd < 0) {
+                return std::unexpected(std::format("Unable to create {}.", h.file_name));
+            }
+
+            auto copied = zippee::copy_range(archive.fd(), job.data_offset, h.compressed_size, out_fd);
+            ::close(out_fd);
+
+            if (!copied) {
+                return std::unexpected(std::format("Unable to write out {}: {}", h.file_name, copied.error()));
+            }
+            return std::format("Copied out {}.", h.file_name);
+        }
+
+        auto output = h.compression_method == 0 ? std::span<const std::byte>(job.compressed) : job.decompressed;
+        if (auto written = writeout(job.output, output); !written) {
+            return std::unexpected(written.error());
+        }
+        return std::format("Decompressed and wrote out {}.", h.file_name);
+    }
+
+    // Makes an entry from the output of the one it duplicates, once that has
+    // been written.
+    std::expected<std::string, std::string> write_copy(
+        const OutputRoot& root,
+        const zip::CentralDirectoryHeader& h,
+        const EntryJob& original,
+        bool original_written) {
+        ZIPPEE_TRACE_SCOPE("copy", h.file_name);
+        auto& from = original.header->file_name;
+        if (!original_written) {
+            return std::unexpected(std::format("Unable to extract {}: it duplicates {}, which failed.", h.file_name, from));
+        }
+
+        auto output = root.locate(h.file_name);
+        if (!output) {
+            return std::unexpected(std::format("Unable to extract {}: {}", h.file_name, output.error()));
+        }
+
+        auto cloned = zippee::clone_file(original.output, *output);
+        if (!cloned) {
+            return std::unexpected(std::format("Unable to copy {} to {}: {}", from, h.file_name, cloned.error()));
+        }
+        switch (*cloned) {
+            case zippee::clone_kind::reflink: return std::format("Reflinked {} from {}.", h.file_name, from);
+            case zippee::clone_kind::hard_link: return std::format("Hard linked {} to {}.", h.file_name, from);
+            case zippee::clone_kind::copy: break;
+        }
+        return std::format("Copied {} from {}.", h.file_name, from);
+    }
+
+    using JobChannel = zippee::Channel<EntryJob>;
+
+    // Closes a stage's channels however it exits, so its neighbours never
+    // wait on a stage that has gone.
+    struct CloseOnExit {
+        JobChannel* input;
+        JobChannel* output;
+
+        ~CloseOnExit() {
+            if (input) {
+                input->close();
+            }
+            if (output) {
+                output->close();
+            }
+        }
+    };
+
+    // Finds each entry's data and starts it being read in ahead of inflate.
+    zippee::Task read_stage(
+        const zippee::byte_source& archive,
+        const std::vector<zip::CentralDirectoryHeader>& headers,
+        const OutputRoot& root,
+        const zippee::Duplicates& duplicates,
+        JobChannel& output,
+        zippee::StageMetrics& metrics) {
+        CloseOnExit closer{nullptr, &output};
+        ZIPPEE_TRACE_THREAD(metrics.name);
+        metrics.start();
+
+        for (auto& h : headers) {
+            if (duplicates.is_copy(h)) {
+                continue;
+            }
+
+            auto job = read_entry(archive, h, root);
+
+            metrics.items++;
+            if (!co_await metrics.wait_output(output.push(std::move(job)))) {
+                break;
+            }
+        }
+
+        metrics.finish();
+    }
+
+    zippee::Task inflate_stage(
+        const zippee::ExtractOptions& options,
+        JobChannel& input,
+        JobChannel& output,
+        zippee::StageMetrics& metrics,
+        deflate::DecoderStats& decoder_stats) {
+        CloseOnExit closer{&input, &output};
+        auto& decoder = deflate::thread_decoder();
+        decoder.set_literal_runs(options.literal_runs);
+        decoder.set_table_cache(options.table_cache);
+        decoder.reset_stats();
+        ZIPPEE_TRACE_THREAD(metrics.name);
+        metrics.start();
+
+        while (auto job = co_await metrics.wait_input(input.pop())) {
+            inflate_entry(options, decoder, *job);
+
+            metrics.items++;
+            if (!co_await metrics.wait_output(output.push(std::move(*job)))) {
+                break;
+            }
+        }
+
+        metrics.finish();
+        decoder_stats = decoder.stats();
+    }
+
+    zippee::Task verify_stage(
+        const zippee::ExtractOptions& options,
+        JobChannel& input,
+        JobChannel& output,
+        zippee::StageMetrics& metrics) {
+        CloseOnExit closer{&input, &output};
+        ZIPPEE_TRACE_THREAD(metrics.name);
+        metrics.start();
+
+        while (auto job = co_await metrics.wait_input(input.pop())) {
+            verify_entry(options.threads, *job);
+
+            metrics.items++;
+            if (!co_await metrics.wait_output(output.push(std::move(*job)))) {
+                break;
+            }
+        }
+
+        metrics.finish();
+    }
+
+    zippee::Task write_stage(
+        const zippee::byte_source& archive,
+        const OutputRoot& root,
+        const zippee::Duplicates& duplicates,
+        JobChannel& input,
+        zippee::StageMetrics& metrics,
+        size_t& failed) {
+        CloseOnExit closer{&input, nullptr};
+        ZIPPEE_TRACE_THREAD(metrics.name);
+        metrics.start();
+
+        while (auto job = co_await metrics.wait_input(input.pop())) {
+            std::println("Found {}.", job->header->file_name);
+            auto written = write_entry(archive, *job);
+            std::println("{}", written ? *written : written.error());
+            failed += !written;
+            for (auto i : duplicates.copies_of(*job->header)) {
+                auto& copy = duplicates.headers[i];
+                std::println("Found {}.", copy.file_name);
+                auto made = write_copy(root, copy, *job, written.has_value());
+                std::println("{}", made ? *made : made.error());
+                failed += !made;
+            }
+            metrics.items++;
+        }
+
+        metrics.finish();
+    }
+
+    void print_pipeline_stats(
+        std::span<const zippee::StageMetrics> stages,
+        std::span<JobChannel* const> channels,
+        zippee::StageMetrics::Clock::duration elapsed,
+        const deflate::DecoderStats& decoder_stats) {
+        auto percent = [elapsed](zippee::StageMetrics::Clock::duration d) {
+            return elapsed.count() == 0 ? 0.0 : 100.0 * d.count() / elapsed.count();
+        };
+
+        std::println("{:<8} {:>8} {:>8} {:>9} {:>9}", "stage", "entries", "busy %", "starved %", "blocked %");
+        for (auto& stage : stages) {
+            std::println("{:<8} {:>8} {:>8.1f} {:>9.1f} {:>9.1f}",
+                stage.name, stage.items, percent(stage.busy), percent(stage.starved), percent(stage.blocked));
+        }
+        for (size_t i = 0; i < channels.size(); i++) {
+            std::println("{} -> {} queue peaked at {} of {}.",
+                stages[i].name, stages[i + 1].name, channels[i]->max_depth(), channels[i]->capacity());
+        }
+
+        auto lookups = decoder_stats.table_cache_hits + decoder_stats.table_cache_misses;
+        if (lookups > 0) {
+            std::println("Huffman table cache: {} hits, {} misses over {} dynamic blocks ({:.1f}% hit).",
+                decoder_stats.table_cache_hits, decoder_stats.table_cache_misses, decoder_stats.dynamic_blocks,
+                100.0 * decoder_stats.table_cache_hits / lookups);
+        }
+    }
+
+    // Hardware counts for each stage's thread and all of them together, per
+    // byte of the archive's compressed and uncompressed entries.
+    void print_stage_counters(std::span<const zippee::StageMetrics> stages, size_t input_bytes, size_t output_bytes) {
+        zippee::PerfSample total;
+        for (auto& stage : stages) {
+            total += stage.events;
+        }
+        if (!total[zippee::PerfEvent::Cycles] && !total[zippee::PerfEvent::Instructions]) {
+            std::println("Hardware counters unavailable: {}", zippee::PerfCounters().error());
+            return;
+        }
+
+        std::println("{:<8} {}", "stage", zippee::perf_header());
+        for (auto& stage : stages) {
+            std::println("{:<8} {}", stage.name, zippee::perf_row(stage.events, input_bytes, output_bytes));
+        }
+        std::println("{:<8} {}", "total", zippee::perf_row(total, input_bytes, output_bytes));
+    }
+
+    // Checksums output as it leaves the window, so an entry of any size is
+    // checked holding only the window.
+    class CrcSink : public deflate::WindowSink {
+    private:
+        uint32_t _crc32 = 0;
+        size_t _total = 0;
+
+    protected:
+        void consume(std::span<const std::byte> output) override {
+            _crc32 = zip::crc32(output, _crc32);
+            _total += output.size();
+        }
+
+    public:
+        using WindowSink::WindowSink;
+
+        // CRC-32 and size of the output since the last call.
+        std::pair<uint32_t, size_t> finish() {
+            flush();
+            return {std::exchange(_crc32, 0), std::exchange(_total, 0)};
+        }
+    };
+
+    // Passes the range on, and checksums everything decoded for when the
+    // whole entry is.
+    class CheckedRangeSink : public deflate::RangeSink {
+    private:
+        uint32_t _crc32 = 0;
+        size_t _total = 0;
+
+    protected:
+        void consume(std::span<const std::byte> output) override {
+            _crc32 = zip::crc32(output, _crc32);
+            _total += output.size();
+            RangeSink::consume(output);
+        }
+
+    public:
+        using RangeSink::RangeSink;
+
+        uint32_t crc32() const {
+            return _crc32;
+        }
+
+        size_t total() const {
+            return _total;
+        }
+    };
+
+    // One input of a batch. Its entries report into their own slots, and
+    // whichever finishes last prints the archive's report as one block.
+    struct BatchArchive {
+        std::string input;
+        std::string directory;
+        OutputRoot output;
+        std::unique_ptr<zippee::byte_source> file;
+        std::vector<zip::CentralDirectoryHeader> headers;
+        zippee::Duplicates duplicates;
+        std::vector<std::string> reports;
+        std::vector<char> failed;
+        std::atomic<size_t> remaining{0};
+    };
+
+    struct BatchTotals {
+        std::mutex print_mutex;
+        std::atomic<size_t> entries{0};
+        std::atomic<size_t> failed{0};
+        std::atomic<size_t> compressed_bytes{0};
+        std::atomic<size_t> uncompressed_bytes{0};
+    };
+
+    void print_archive(BatchArchive& archive, BatchTotals& totals) {
+        std::lock_guard lock(totals.print_mutex);
+        std::println("{}:", archive.input);
+        for (auto& report : archive.reports) {
+            std::println("  {}", report);
+        }
+    }
+
+    void fail_archive(BatchArchive& archive, BatchTotals& totals, std::string error) {
+        archive.reports.push_back(std::move(error));
+        totals.failed++;
+        print_archive(archive, totals);
+    }
+
+    // Each input gets an output name after its own, numbered when two inputs
+    // would share one.
+    std::vector<std::string> batch_directories(const std::vector<std::string>& inputs) {
+        std::vector<std::string> directories;
+        std::set<std::string> taken;
+        for (auto& input : inputs) {
+            auto stem = std::filesystem::path(input).stem().string();
+            auto directory = stem;
+            for (size_t n = 2; !taken.insert(directory).second; n++) {
+                directory = std::format("{}_{}", stem, n);
+            }
+            directories.push_back(std::move(directory));
+        }
+        return directories;
+    }
+
+    // Runs one entry, and any entries that duplicate it.
+    void run_batch_entry(BatchArchive& archive, size_t i, const zippee::ExtractOptions& options, BatchTotals& totals) {
+        auto& h = archive.headers[i];
+        std::vector<size_t> handled{i};
+        auto& decoder = deflate::thread_decoder();
+        decoder.set_literal_runs(options.literal_runs);
+        decoder.set_table_cache(options.table_cache);
+
+        if (options.test_only) {
+            size_t size = 0;
+            auto error = zippee::test_entry(*archive.file, h, size);
+            archive.failed[i] = error.has_value();
+            archive.reports[i] = error ? std::format("FAILED {}: {}", h.file_name, *error) : std::format("OK {}", h.file_name);
+            totals.compressed_bytes += h.compressed_size;
+            totals.uncompressed_bytes += size;
+        } else {
+            // the pool already has a worker per core, so checksums stay on this one
+            auto job = read_entry(*archive.file, h, archive.output);
+            inflate_entry(options, decoder, job);
+            verify_entry(1, job);
+            auto written = write_entry(*archive.file, job);
+            archive.failed[i] = !written.has_value();
+            archive.reports[i] = written ? *written : written.error();
+
+            for (auto j : archive.duplicates.copies_of(h)) {
+                auto made = write_copy(archive.output, archive.headers[j], job, written.has_value());
+                archive.failed[j] = !made.has_value();
+                archive.reports[j] = made ? *made : made.error();
+                handled.push_back(j);
+            }
+        }
+
+        for (auto j : handled) {
+            totals.entries++;
+            if (archive.failed[j]) {
+                totals.failed++;
+            }
+        }
+        if (archive.remaining.fetch_sub(handled.size()) == handled.size()) {
+            print_archive(archive, totals);
+        }
+    }
+
+    // Opens an archive and queues each of its entries on the pool. Single
+    // stream inputs are decompressed whole by the job that opened them, into
+    // a file named as the archive's directory would be.
+    void start_batch_archive(
+        zippee::WorkStealingPool& pool,
+        BatchArchive& archive,
+        bool list_contents,
+        const zippee::ExtractOptions& options,
+        BatchTotals& totals) {
+        //listing needs only the tail and the directory, which pread fetches
+        //without the rest of the archive ever being touched
+        auto file = zippee::open_source(archive.input, options.pread || list_contents);
+        if (!file) {
+            fail_archive(archive, totals, file.error());
+            return;
+        }
+        archive.file = std::move(*file);
+
+        auto input = zippee::identify_input(*archive.file);
+        if (!input) {
+            fail_archive(archive, totals, input.error());
+            return;
+        }
+
+        std::optional<std::expected<std::vector<std::byte>, std::string>> stream;
+        if (input->kind != zippee::InputKind::Zip) {
+            std::vector<std::byte> buffer;
+            auto data = archive.file->read(0, archive.file->size(), buffer);
+            if (!data) {
+                stream = std::unexpected(data.error());
+            } else if (input->kind == zippee::InputKind::Gzip) {
+                stream = gzip::decompress(*data, 1);
+            } else {
+                stream = zlib::decompress(*data);
+            }
+        }
+
+        if (stream) {
+            totals.entries++;
+            if (!*stream) {
+                fail_archive(archive, totals, std::format("FAILED: {}", stream->error()));
+            } else if (options.test_only) {
+                archive.reports.push_back("OK");
+                totals.compressed_bytes += archive.file->size();
+                totals.uncompressed_bytes += (*stream)->size();
+                print_archive(archive, totals);
+            } else {
+                auto location = stream_location(options.output_dir, archive.directory);
+                auto written = location ? writeout(*location, **stream) : std::unexpected(location.error());
+                if (!written) {
+                    fail_archive(archive, totals, written.error());
+                    return;
+                }
+                archive.reports.push_back(std::format("Decompressed and wrote out {}.", location->name));
+                print_archive(archive, totals);
+            }
+            return;
+        }
+
+        auto headers = zip::read_central_directory(*archive.file, *input->eocd);
+        if (!headers) {
+            fail_archive(archive, totals, headers.error());
+            return;
+        }
+        archive.headers = zippee::select_entries(std::move(*headers), options.entries);
+
+        if (list_contents || archive.headers.empty()) {
+            for (auto& h : archive.headers) {
+                archive.reports.push_back(zippee::list_entry(*archive.file, h, options.local_headers));
+            }
+            print_archive(archive, totals);
+            return;
+        }
+
+        if (!options.test_only) {
+            auto root = open_output(options.output_dir, archive.directory);
+            if (!root) {
+                fail_archive(archive, totals, root.error());
+                return;
+            }
+            archive.output = std::move(*root);
+            archive.output.make_parents(archive.headers);
+            if (options.dedupe) {
+                archive.duplicates = zippee::Duplicates(*archive.file, archive.headers);
+            }
+        }
+
+        archive.reports.resize(archive.headers.size());
+        archive.failed.resize(archive.headers.size());
+        archive.remaining = archive.headers.size();
+        for (size_t i = 0; i < archive.headers.size(); i++) {
+            if (archive.duplicates.is_copy(archive.headers[i])) {
+                continue;
+            }
+            pool.submit([&archive, i, &options, &totals] {
+                run_batch_entry(archive, i, options, totals);
+            });
+        }
+    }
+}
+
+std::expected<zippee::Input, std::string> zippee::identify_input(const byte_source& source) {
+    std::vector<std::byte> buffer;
+    auto head = source.read(0, std::min<uint64_t>(source.size(), zlib::Header::SIZE), buffer);
+    if (!head) {
+        return std::unexpected(head.error());
+    }
+    if (gzip::is_gzip(*head)) {
+        return Input{InputKind::Gzip};
+    }
+
+    auto eocd = zip::read_eocd(source);
+    if (eocd) {
+        return Input{InputKind::Zip, *eocd};
+    }
+    if (zlib::read_header(*head)) {
+        return Input{InputKind::Zlib};
+    }
+    return std::unexpected(eocd.error());
+}
+
+std::vector<zip::CentralDirectoryHeader> zippee::select_entries(std::vector<zip::CentralDirectoryHeader> headers, const std::vector<std::string>& names) {
+    if (names.empty()) {
+        return headers;
+    }
+
+    std::set<std::string_view> wanted(names.begin(), names.end());
+    std::erase_if(headers, [&](const zip::CentralDirectoryHeader& h) {
+        return !wanted.contains(h.file_name);
+    });
+    return headers;
+}
+
+std::string zippee::list_entry(const byte_source& archive, const zip::CentralDirectoryHeader& h, bool local_headers) {
+    if (!local_headers) {
+        return std::format("Found {}.", h.file_name);
+    }
+    auto data = zip::locate_entry_data(archive, h);
+    if (!data) {
+        return data.error();
+    }
+    return std::format("Found {}, data at {}.", h.file_name, data->offset);
+}
+
+zippee::Duplicates::Duplicates(const byte_source& archive, std::span<const zip::CentralDirectoryHeader> headers)
+    : headers(headers)
+    , originals(zip::find_duplicates(archive, headers))
+    , copies(headers.size()) {
+    for (size_t i = 0; i < originals.size(); i++) {
+        if (originals[i] != i) {
+            copies[originals[i]].push_back(i);
+        }
+    }
+}
+
+bool zippee::Duplicates::is_copy(const zip::CentralDirectoryHeader& h) const {
+    size_t i = &h - headers.data();
+    return !originals.empty() && originals[i] != i;
+}
+
+std::span<const size_t> zippee::Duplicates::copies_of(const zip::CentralDirectoryHeader& h) const {
+    return copies.empty() ? std::span<const size_t>{} : std::span<const size_t>(copies[&h - headers.data()]);
+}
+
+int zippee::extract_stream(
+    const std::string& input_filepath,
+    std::expected<std::vector<std::byte>, std::string> decompressed,
+    std::initializer_list<std::string_view> suffixes,
+    const std::string& output_dir,
+    bool test_only) {
+    if (!decompressed) {
+        std::println("Unable to decompress {}: {}", input_filepath, decompressed.error());
+        return -1;
+    }
+
+    if (test_only) {
+        std::println("OK {}", input_filepath);
+        return 0;
+    }
+
+    auto location = stream_location(output_dir, stream_output_path(input_filepath, suffixes));
+    if (!location) {
+        std::println("{}", location.error());
+        return -1;
+    }
+    if (auto written = writeout(*location, *decompressed); !written) {
+        std::println("{}", written.error());
+        return -1;
+    }
+    std::println("Decompressed and wrote out {}.", location->name);
+    return 0;
+}
+
+int zippee::extract_entries(
+    const byte_source& archive,
+    const std::vector<zip::CentralDirectoryHeader>& headers,
+    const ExtractOptions& options) {
+    auto root = open_output(options.output_dir, "");
+    if (!root) {
+        std::println("{}", root.error());
+        return -1;
+    }
+    root->make_parents(headers);
+    auto duplicates = options.dedupe ? Duplicates(archive, headers) : Duplicates();
+
+    JobChannel to_inflate(options.queue_depth);
+    JobChannel to_verify(options.queue_depth);
+    JobChannel to_write(options.queue_depth);
+    std::array<zippee::StageMetrics, 4> metrics{{{"read"}, {"inflate"}, {"verify"}, {"write"}}};
+    deflate::DecoderStats decoder_stats;
+    size_t failed = 0;
+    for (auto& stage : metrics) {
+        stage.count_events = options.show_stats;
+    }
+
+    std::array<zippee::Executor, 4> executors;
+    std::array<zippee::Task, 4> stages{
+        read_stage(archive, headers, *root, duplicates, to_inflate, metrics[0]),
+        inflate_stage(options, to_inflate, to_verify, metrics[1], decoder_stats),
+        verify_stage(options, to_verify, to_write, metrics[2]),
+        write_stage(archive, *root, duplicates, to_write, metrics[3], failed),
+    };
+
+    auto start = zippee::StageMetrics::Clock::now();
+    for (size_t i = 0; i < stages.size(); i++) {
+        stages[i].start(executors[i]);
+    }
+    for (auto& stage : stages) {
+        stage.wait();
+    }
+    auto elapsed = zippee::StageMetrics::Clock::now() - start;
+
+    if (options.show_stats) {
+        std::array<JobChannel*, 3> channels{&to_inflate, &to_verify, &to_write};
+        print_pipeline_stats(metrics, channels, elapsed, decoder_stats);
+
+        size_t compressed_bytes = 0;
+        size_t uncompressed_bytes = 0;
+        for (auto& h : headers) {
+            compressed_bytes += h.compressed_size;
+            uncompressed_bytes += h.uncompressed_size;
+        }
+        print_stage_counters(metrics, compressed_bytes, uncompressed_bytes);
+
+        if (auto source = dynamic_cast<const zippee::pread_source*>(&archive)) {
+            std::println("Read {} of {} archive bytes.", source->bytes_read(), source->size());
+        }
+    }
+    return failed == 0 ? 0 : 1;
+}
+
+std::optional<std::string> zippee::test_entry(
+    const byte_source& archive,
+    const zip::CentralDirectoryHeader& h,
+    size_t& size) {
+    ZIPPEE_TRACE_SCOPE("test", h.file_name);
+    auto location = zip::locate_entry_data(archive, h);
+    if (!location) {
+        return location.error();
+    }
+
+    thread_local std::vector<std::byte> buffer;
+    auto compressed = archive.read(location->offset, h.compressed_size, buffer);
+    if (!compressed) {
+        return compressed.error();
+    }
+
+    uint32_t crc32;
+    if (h.compression_method == 0) {
+        crc32 = zip::crc32(*compressed);
+        size = compressed->size();
+    } else if (h.compression_method == 8) {
+        thread_local CrcSink sink;
+        try {
+            deflate::thread_decoder().decompress(*compressed, sink);
+        } catch (const std::runtime_error& e) {
+            sink.finish();
+            return e.what();
+        }
+        std::tie(crc32, size) = sink.finish();
+    } else if (h.compression_method == zstd::ZIP_METHOD) {
+        //matches reach back the frame's window, past what the DEFLATE sink
+        //keeps, so the entry gets a sink of its own
+        try {
+            CrcSink zstd_sink(zstd::SINK_CHUNK, zstd::sink_window(*compressed, trusted_size(h, *compressed)));
+            zstd::thread_decoder().decompress(*compressed, zstd_sink);
+            std::tie(crc32, size) = zstd_sink.finish();
+        } catch (const std::runtime_error& e) {
+            return e.what();
+        }
+    } else {
+        return std::format("Unsupported compression method {}.", h.compression_method);
+    }
+
+    if (crc32 != location->crc_32) {
+        return "CRC32 does not match.";
+    }
+    if (size != h.uncompressed_size) {
+        return "Size does not match.";
+    }
+    return std::nullopt;
+}
+
+int zippee::test_entries(
+    const byte_source& archive,
+    const std::vector<zip::CentralDirectoryHeader>& headers,
+    const ExtractOptions& options) {
+    std::vector<std::optional<std::string>> errors(headers.size());
+    std::atomic<size_t> compressed_bytes{0};
+    std::atomic<size_t> uncompressed_bytes{0};
+
+    auto start = std::chrono::steady_clock::now();
+    zippee::parallel_for(headers.size(), options.threads, [&](size_t i) {
+        deflate::thread_decoder().set_literal_runs(options.literal_runs);
+        deflate::thread_decoder().set_table_cache(options.table_cache);
+
+        size_t size = 0;
+        errors[i] = test_entry(archive, headers[i], size);
+        compressed_bytes += headers[i].compressed_size;
+        uncompressed_bytes += size;
+    });
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    size_t failed = 0;
+    for (size_t i = 0; i < headers.size(); i++) {
+        if (errors[i]) {
+            std::println("FAILED {}: {}", headers[i].file_name, *errors[i]);
+            failed++;
+        } else {
+            std::println("OK {}", headers[i].file_name);
+        }
+    }
+
+    double seconds = elapsed.count();
+    std::println("Tested {} entries: {} passed, {} failed.", headers.size(), headers.size() - failed, failed);
+    std::println("{:.1f} MB compressed, {:.1f} MB uncompressed in {:.2f} s: {:.1f} MB/s in, {:.1f} MB/s out.",
+        compressed_bytes / 1e6, uncompressed_bytes / 1e6, seconds,
+        seconds > 0 ? compressed_bytes / seconds / 1e6 : 0.0,
+        seconds > 0 ? uncompressed_bytes / seconds / 1e6 : 0.0);
+
+    return failed == 0 ? 0 : 1;
+}
+
+std::expected<std::vector<std::byte>, std::string> zippee::read_range(
+    const byte_source& archive,
+    const zip::CentralDirectoryHeader& h,
+    const ExtractOptions& options) {
+    auto location = zip::locate_entry_data(archive, h);
+    if (!location) {
+        return std::unexpected(location.error());
+    }
+
+    auto [offset, length] = *options.range;
+    length = std::min(length, std::numeric_limits<uint64_t>::max() - offset);
+    std::vector<std::byte> buffer;
+    std::vector<std::byte> output;
+
+    if (h.compression_method == 0) {
+        auto whole = options.range_crc;
+        uint64_t first = whole ? 0 : std::min<uint64_t>(offset, h.compressed_size);
+        uint64_t last = whole ? h.compressed_size : std::min<uint64_t>(offset + length, h.compressed_size);
+        auto data = archive.read(location->offset + first, last - first, buffer);
+        if (!data) {
+            return std::unexpected(data.error());
+        }
+        if (whole) {
+            if (zip::crc32(*data) != location->crc_32) {
+                return std::unexpected("CRC32 does not match.");
+            }
+            *data = data->subspan(std::min<uint64_t>(offset, data->size()));
+            *data = data->first(std::min<uint64_t>(length, data->size()));
+        }
+        return std::vector<std::byte>(data->begin(), data->end());
+    }
+
+    if (h.compression_method != 8 && h.compression_method != zstd::ZIP_METHOD) {
+        return std::unexpected(std::format("Unsupported compression method {}.", h.compression_method));
+    }
+
+    auto compressed = archive.read(location->offset, h.compressed_size, buffer);
+    if (!compressed) {
+        return std::unexpected(compressed.error());
+    }
+
+    try {
+        uint32_t crc32;
+        size_t total;
+        if (h.compression_method == zstd::ZIP_METHOD) {
+            //Zstandard matches reach back the frame's window, and blocks reserve up to a whole block at once
+            auto window = zstd::sink_window(*compressed, trusted_size(h, *compressed));
+            CheckedRangeSink sink(offset, length, output, !options.range_crc, window, zstd::SINK_CHUNK);
+            zstd::thread_decoder().decompress_range(*compressed, sink);
+            crc32 = sink.crc32();
+            total = sink.total();
+        } else {
+            CheckedRangeSink sink(offset, length, output, !options.range_crc);
+            deflate::thread_decoder().decompress_range(*compressed, sink);
+            crc32 = sink.crc32();
+            total = sink.total();
+        }
+
+        if (options.range_crc && (crc32 != location->crc_32 || total != h.uncompressed_size)) {
+            return std::unexpected("CRC32 does not match.");
+        }
+    } catch (const std::runtime_error& e) {
+        return std::unexpected(std::format("Unable to decompress: {}", e.what()));
+    }
+    return output;
+}
+
+int zippee::extract_ranges(
+    const byte_source& archive,
+    const std::vector<zip::CentralDirectoryHeader>& headers,
+    const ExtractOptions& options) {
+    auto root = open_output(options.output_dir, "");
+    if (!root) {
+        std::println("{}", root.error());
+        return -1;
+    }
+    root->make_parents(headers);
+
+    size_t failed = 0;
+    for (auto& h : headers) {
+        std::println("Found {}.", h.file_name);
+        auto location = root->locate(h.file_name);
+        if (!location) {
+            std::println("Unable to extract {}: {}", h.file_name, location.error());
+            failed++;
+            continue;
+        }
+        if (location->name.empty()) {
+            std::println("Created directory {}.", h.file_name);
+            continue;
+        }
+
+        auto range = read_range(archive, h, options);
+        auto written = range ? writeout(*location, *range) : std::unexpected(std::format("Unable to extract {}: {}", h.file_name, range.error()));
+        if (!written) {
+            std::println("{}", written.error());
+            failed++;
+            continue;
+        }
+
+        auto first = std::min<uint64_t>(options.range->first, h.uncompressed_size);
+        std::println("Wrote bytes {} to {} of {}{}.",
+            first, first + range->size(), h.file_name, options.range_crc ? ", CRC32 checked" : "");
+    }
+    return failed == 0 ? 0 : 1;
+}
+
+int zippee::process_batch(const std::vector<std::string>& inputs, bool list_contents, const ExtractOptions& options) {
+    auto directories = batch_directories(inputs);
+    std::vector<std::unique_ptr<BatchArchive>> archives;
+    BatchTotals totals;
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        zippee::WorkStealingPool pool(options.threads);
+        for (size_t i = 0; i < inputs.size(); i++) {
+            auto& archive = *archives.emplace_back(std::make_unique<BatchArchive>());
+            archive.input = inputs[i];
+            archive.directory = directories[i];
+            pool.submit([&pool, &archive, list_contents, &options, &totals] {
+                start_batch_archive(pool, archive, list_contents, options, totals);
+            });
+        }
+        pool.wait();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    if (options.test_only) {
+        double seconds = elapsed.count();
+        size_t failed = totals.failed;
+        std::println("Tested {} entries in {} inputs: {} failed.", totals.entries.load(), inputs.size(), failed);
+        std::println("{:.1f} MB compressed, {:.1f} MB uncompressed in {:.2f} s: {:.1f} MB/s in, {:.1f} MB/s out.",
+            totals.compressed_bytes / 1e6, totals.uncompressed_bytes / 1e6, seconds,
+            seconds > 0 ? totals.compressed_bytes / seconds / 1e6 : 0.0,
+            seconds > 0 ? totals.uncompressed_bytes / seconds / 1e6 : 0.0);
+    }
+
+    return totals.failed == 0 ? 0 : 1;
+}
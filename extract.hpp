@@ -0,0 +1,128 @@
+//------------------------------------------------------------------------------
+// extract.hpp
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "deflate.hpp"
+#include "source.hpp"
+#include "zip.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <initializer_list>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Extracting, testing and listing what zippee is given: the entries of a ZIP
+// archive, a single gzip or zlib stream, or a batch of either. Each reports
+// on standard output as it goes and returns the process's exit status: 0 if
+// everything succeeded, 1 if any entry failed, or -1 if nothing could be
+// attempted.
+namespace zippee {
+    struct ExtractOptions {
+        bool literal_runs = false;
+        size_t threads = 1;
+        size_t queue_depth = 4;
+        bool show_stats = false;
+        bool mmap_output = false;
+        bool test_only = false;
+        bool arena = false;
+        bool dedupe = false;
+        bool pread = false;
+        bool local_headers = false;
+        // offset and length of the part of each entry to extract
+        std::optional<std::pair<uint64_t, uint64_t>> range;
+        bool range_crc = false;
+        std::vector<std::string> entries;
+        size_t table_cache = deflate::TableCache::DEFAULT_CAPACITY;
+        std::string output_dir;
+    };
+
+    enum class InputKind {
+        Zip,
+        Gzip,
+        Zlib
+    };
+
+    struct Input {
+        InputKind kind;
+        std::optional<zip::EOCD> eocd;
+    };
+
+    // Tells a ZIP from a single gzip or zlib stream, reading only the first
+    // bytes of the input and the tail that would hold a ZIP's EOCD.
+    std::expected<Input, std::string> identify_input(const byte_source& source);
+
+    // The entries named with --entry, in the order the archive has them, or
+    // all of them if none were named.
+    std::vector<zip::CentralDirectoryHeader> select_entries(std::vector<zip::CentralDirectoryHeader> headers, const std::vector<std::string>& names);
+
+    // What --list says of an entry. The central directory has all of it, so
+    // an entry's local header is only read when asked for.
+    std::string list_entry(const byte_source& archive, const zip::CentralDirectoryHeader& h, bool local_headers);
+
+    // Entries with the same contents as an earlier one, which are made from
+    // that entry's output instead of being inflated again. Empty unless
+    // deduplicating.
+    struct Duplicates {
+        std::span<const zip::CentralDirectoryHeader> headers;
+        std::vector<size_t> originals;
+        std::vector<std::vector<size_t>> copies;
+
+        Duplicates() = default;
+        Duplicates(const byte_source& archive, std::span<const zip::CentralDirectoryHeader> headers);
+
+        bool is_copy(const zip::CentralDirectoryHeader& h) const;
+        std::span<const size_t> copies_of(const zip::CentralDirectoryHeader& h) const;
+    };
+
+    // Writes out, or with test_only just reports, a single stream input
+    // decompressed whole, named after input_filepath less the first of
+    // suffixes it ends with.
+    int extract_stream(
+        const std::string& input_filepath,
+        std::expected<std::vector<std::byte>, std::string> decompressed,
+        std::initializer_list<std::string_view> suffixes,
+        const std::string& output_dir,
+        bool test_only);
+
+    // Runs entries through read -> inflate -> verify -> write stages, each on
+    // its own thread, so one entry can be written while the next is checked
+    // and the one after is inflated. The queues between stages hold at most
+    // queue_depth entries, which bounds how much inflated data is in memory.
+    // Entries inflated into mapped files have their pages written back as
+    // they go, so only the mappings are held.
+    int extract_entries(const byte_source& archive, const std::vector<zip::CentralDirectoryHeader>& headers, const ExtractOptions& options);
+
+    // Returns an error, or nothing if the entry checks out. size is set to
+    // the bytes of output checked. Output is discarded as it leaves the
+    // window the entry's method needs, so memory doesn't grow with its size.
+    std::optional<std::string> test_entry(const byte_source& archive, const zip::CentralDirectoryHeader& h, size_t& size);
+
+    // Checks every entry across the worker threads without writing anything,
+    // then reports each in archive order.
+    int test_entries(const byte_source& archive, const std::vector<zip::CentralDirectoryHeader>& headers, const ExtractOptions& options);
+
+    // Bytes [offset, offset + length) of an entry, for the options' range,
+    // clipped to its end. Stored entries are read straight from that part of
+    // the archive; compressed ones are decoded only as far as the range
+    // reaches, unless the CRC-32 is to be checked, which needs all of the
+    // entry.
+    std::expected<std::vector<std::byte>, std::string> read_range(const byte_source& archive, const zip::CentralDirectoryHeader& h, const ExtractOptions& options);
+
+    // Extracts the range of each entry, as a file of just those bytes.
+    int extract_ranges(const byte_source& archive, const std::vector<zip::CentralDirectoryHeader>& headers, const ExtractOptions& options);
+
+    // Extracts, tests or lists many inputs at once. Every entry of every
+    // archive is a job on one work-stealing pool, so a batch of small
+    // archives keeps all the workers busy where one archive at a time would
+    // not. Each archive is extracted into its own directory, under
+    // output_dir when that is given.
+    int process_batch(const std::vector<std::string>& inputs, bool list_contents, const ExtractOptions& options);
+}
@@ -0,0 +1,305 @@
+//------------------------------------------------------------------------------
+// extract.tests.cpp
+//------------------------------------------------------------------------------
+
+#include "extract.hpp"
+#include "compress.hpp"
+#include "test_archive.hpp"
+#include "zstd.hpp"
+
+#include <filesystem>
+#include <fstream>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+using test::to_bytes;
+
+// "Hello, zstd! Hello, zstd!\n" as a Zstandard frame, with a window
+// descriptor at byte 5
+std::string hello_zstd(unsigned char window = 0x68) {
+    const unsigned char frame[] = {
+        0x28, 0xb5, 0x2f, 0xfd, 0x04, window, 0xa5, 0x00, 0x00, 0x70, 0x48, 0x65, 0x6c, 0x6c, 0x6f, 0x2c,
+        0x20, 0x7a, 0x73, 0x74, 0x64, 0x21, 0x20, 0x0a, 0x01, 0x00, 0xc0, 0xcd, 0x2f, 0xdf, 0x80, 0x77,
+        0xb6,
+    };
+    return std::string(reinterpret_cast<const char*>(frame), sizeof(frame));
+}
+
+const std::string HELLO = "Hello, zstd! Hello, zstd!\n";
+
+std::string repeated(const std::string& word, size_t count) {
+    std::string s;
+    for (size_t i = 0; i < count; i++) {
+        s += word + std::to_string(i % 97) + ' ';
+    }
+    return s;
+}
+
+std::string text(std::span<const std::byte> bytes) {
+    return std::string(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+}
+
+std::string read_text(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), {});
+}
+
+// An empty directory for a test's output.
+std::string fresh_directory(const std::string& name) {
+    auto path = testing::TempDir() + name;
+    std::filesystem::remove_all(path);
+    return path;
+}
+
+std::vector<zip::CentralDirectoryHeader> headers_of(const zippee::byte_source& source) {
+    auto eocd = zip::read_eocd(source);
+    EXPECT_TRUE(eocd.has_value());
+    auto headers = eocd ? zip::read_central_directory(source, *eocd) : std::unexpected(eocd.error());
+    EXPECT_TRUE(headers.has_value());
+    return headers ? *headers : std::vector<zip::CentralDirectoryHeader>{};
+}
+
+// Flips a bit of the entry's data at offset.
+void corrupt(std::vector<std::byte>& archive, const zip::CentralDirectoryHeader& h, size_t offset = 0) {
+    auto data = zip::locate_entry_data(zippee::mapped_source(archive), h);
+    ASSERT_TRUE(data.has_value());
+    archive[data->offset + offset] ^= std::byte{1};
+}
+
+std::vector<test::ArchiveEntry> every_method() {
+    return {
+        {"stored.txt", "0123456789"},
+        {"deflated.txt", repeated("deflated", 2000), 8},
+        {"hello.zst", HELLO, zstd::ZIP_METHOD, hello_zstd()},
+    };
+}
+
+}
+
+TEST(Extract, identify_input_tells_formats_apart) {
+    auto archive = test::make_archive({{"entry.txt", "contents"}});
+    auto zip_input = zippee::identify_input(zippee::mapped_source(archive));
+    ASSERT_TRUE(zip_input.has_value()) << zip_input.error();
+    EXPECT_EQ(zip_input->kind, zippee::InputKind::Zip);
+    EXPECT_EQ(zip_input->eocd->total_num_entries_central_directory, 1);
+
+    std::vector<std::byte> gzip{std::byte{0x1f}, std::byte{0x8b}, std::byte{0x08}, std::byte{0x00}};
+    gzip.resize(20);
+    EXPECT_EQ(zippee::identify_input(zippee::mapped_source(gzip))->kind, zippee::InputKind::Gzip);
+
+    std::vector<std::byte> zlib{std::byte{0x78}, std::byte{0x9c}};
+    auto deflated = deflate::compress(to_bytes("contents"));
+    zlib.insert(zlib.end(), deflated.begin(), deflated.end());
+    EXPECT_EQ(zippee::identify_input(zippee::mapped_source(zlib))->kind, zippee::InputKind::Zlib);
+
+    auto garbage = to_bytes("neither a ZIP nor a stream");
+    EXPECT_FALSE(zippee::identify_input(zippee::mapped_source(garbage)).has_value());
+}
+
+TEST(Extract, select_entries_keeps_archive_order) {
+    auto archive = test::make_archive({{"a.txt", "a"}, {"b.txt", "b"}, {"c.txt", "c"}});
+    auto headers = headers_of(zippee::mapped_source(archive));
+
+    EXPECT_EQ(zippee::select_entries(headers, {}).size(), 3);
+    auto selected = zippee::select_entries(headers, {"c.txt", "a.txt", "missing.txt"});
+    ASSERT_EQ(selected.size(), 2);
+    EXPECT_EQ(selected[0].file_name, "a.txt");
+    EXPECT_EQ(selected[1].file_name, "c.txt");
+}
+
+TEST(Extract, duplicates_point_copies_at_their_original) {
+    auto archive = test::make_archive({{"a.txt", "same"}, {"b.txt", "different"}, {"c.txt", "same"}});
+    zippee::mapped_source source(archive);
+    auto headers = headers_of(source);
+
+    zippee::Duplicates duplicates(source, headers);
+    EXPECT_EQ(duplicates.originals, (std::vector<size_t>{0, 1, 0}));
+    EXPECT_FALSE(duplicates.is_copy(headers[0]));
+    EXPECT_TRUE(duplicates.is_copy(headers[2]));
+    EXPECT_EQ(std::vector<size_t>(duplicates.copies_of(headers[0]).begin(), duplicates.copies_of(headers[0]).end()), std::vector<size_t>{2});
+    EXPECT_TRUE(duplicates.copies_of(headers[1]).empty());
+
+    //not deduplicating, nothing is a copy
+    zippee::Duplicates none;
+    EXPECT_FALSE(none.is_copy(headers[2]));
+    EXPECT_TRUE(none.copies_of(headers[0]).empty());
+}
+
+TEST(Extract, test_entry_checks_each_method) {
+    auto entries = every_method();
+    entries.push_back({"unsupported.bin", "data", 12});
+    auto archive = test::make_archive(entries);
+    zippee::mapped_source source(archive);
+    auto headers = headers_of(source);
+    ASSERT_EQ(headers.size(), 4);
+
+    for (size_t i = 0; i < 3; i++) {
+        size_t size = 0;
+        auto error = zippee::test_entry(source, headers[i], size);
+        EXPECT_FALSE(error) << headers[i].file_name << ": " << *error;
+        EXPECT_EQ(size, entries[i].contents.size());
+    }
+
+    size_t size = 0;
+    EXPECT_EQ(zippee::test_entry(source, headers[3], size), "Unsupported compression method 12.");
+
+    corrupt(archive, headers[0], 5);
+    EXPECT_EQ(zippee::test_entry(source, headers[0], size), "CRC32 does not match.");
+}
+
+TEST(Extract, test_entry_refuses_oversized_zstd_windows) {
+    auto archive = test::make_archive({{"hello.zst", HELLO, zstd::ZIP_METHOD, hello_zstd(0xa8)}});
+    zippee::mapped_source source(archive);
+    auto headers = headers_of(source);
+
+    size_t size = 0;
+    EXPECT_EQ(zippee::test_entry(source, headers[0], size), "Zstandard frame window is too large.");
+}
+
+TEST(Extract, read_range_of_each_method) {
+    auto entries = every_method();
+    auto archive = test::make_archive(entries);
+    zippee::mapped_source source(archive);
+    auto headers = headers_of(source);
+
+    zippee::ExtractOptions options;
+    options.range = {3, 4};
+    EXPECT_EQ(text(*zippee::read_range(source, headers[0], options)), "3456");
+    options.range = {5000, 300};
+    EXPECT_EQ(text(*zippee::read_range(source, headers[1], options)), entries[1].contents.substr(5000, 300));
+    options.range = {7, 4};
+    EXPECT_EQ(text(*zippee::read_range(source, headers[2], options)), "zstd");
+
+    //clipped to the end of the entry
+    options.range = {8, 100};
+    EXPECT_EQ(text(*zippee::read_range(source, headers[0], options)), "89");
+    options.range = {100, 4};
+    EXPECT_EQ(text(*zippee::read_range(source, headers[2], options)), "");
+
+    //damage outside the range is only seen when the whole entry is checked
+    corrupt(archive, headers[0], 0);
+    options.range = {3, 4};
+    EXPECT_EQ(text(*zippee::read_range(source, headers[0], options)), "3456");
+    options.range_crc = true;
+    auto checked = zippee::read_range(source, headers[0], options);
+    ASSERT_FALSE(checked.has_value());
+    EXPECT_EQ(checked.error(), "CRC32 does not match.");
+}
+
+TEST(Extract, extract_entries_writes_each_entry_and_reports_failures) {
+    auto entries = every_method();
+    entries.push_back({"damaged.txt", "damaged"});
+    auto archive = test::make_archive(entries);
+    zippee::mapped_source source(archive);
+    auto headers = headers_of(source);
+
+    zippee::ExtractOptions options;
+    options.output_dir = fresh_directory("zippee_extract");
+    options.queue_depth = 1;
+    testing::internal::CaptureStdout();
+    EXPECT_EQ(zippee::extract_entries(source, headers, options), 0);
+    testing::internal::GetCapturedStdout();
+    for (auto& entry : entries) {
+        EXPECT_EQ(read_text(options.output_dir + "/" + entry.name), entry.contents) << entry.name;
+    }
+
+    corrupt(archive, headers[3]);
+    options.output_dir = fresh_directory("zippee_extract_damaged");
+    testing::internal::CaptureStdout();
+    EXPECT_EQ(zippee::extract_entries(source, headers, options), 1);
+    auto output = testing::internal::GetCapturedStdout();
+    EXPECT_NE(output.find("CRC32 does not match for damaged.txt."), std::string::npos);
+    EXPECT_EQ(read_text(options.output_dir + "/stored.txt"), "0123456789");
+}
+
+TEST(Extract, extract_entries_copies_stored_entries_only_when_checked_in_place) {
+    auto contents = repeated("stored", 20000);
+    auto path = test::write_temp_file("zippee_extract_stored.zip", test::make_archive({{"stored.txt", contents}}));
+
+    for (bool pread : {false, true}) {
+        auto source = zippee::open_source(path, pread);
+        ASSERT_TRUE(source.has_value());
+        auto headers = headers_of(**source);
+
+        zippee::ExtractOptions options;
+        options.output_dir = fresh_directory("zippee_extract_stored");
+        testing::internal::CaptureStdout();
+        EXPECT_EQ(zippee::extract_entries(**source, headers, options), 0);
+        auto output = testing::internal::GetCapturedStdout();
+
+        //read through pread to be checked, the entry isn't copied from the archive again
+        auto copied = output.find("Copied out stored.txt.") != std::string::npos;
+        EXPECT_EQ(copied, !pread) << output;
+        EXPECT_EQ(read_text(options.output_dir + "/stored.txt"), contents);
+    }
+    std::remove(path.c_str());
+}
+
+TEST(Extract, extract_entries_makes_duplicates_from_the_original) {
+    auto archive = test::make_archive({{"a.txt", repeated("same", 100), 8}, {"b.txt", repeated("same", 100), 8}});
+    zippee::mapped_source source(archive);
+    auto headers = headers_of(source);
+
+    zippee::ExtractOptions options;
+    options.output_dir = fresh_directory("zippee_extract_dedupe");
+    options.dedupe = true;
+    testing::internal::CaptureStdout();
+    EXPECT_EQ(zippee::extract_entries(source, headers, options), 0);
+    auto output = testing::internal::GetCapturedStdout();
+    //linked, reflinked or copied, whichever the filesystem allows, but not inflated again
+    EXPECT_NE(output.find("Found b.txt."), std::string::npos) << output;
+    EXPECT_EQ(output.find("Decompressed and wrote out b.txt."), std::string::npos) << output;
+    EXPECT_EQ(read_text(options.output_dir + "/b.txt"), repeated("same", 100));
+}
+
+TEST(Extract, test_entries_fails_if_any_entry_does) {
+    auto archive = test::make_archive(every_method());
+    zippee::mapped_source source(archive);
+    auto headers = headers_of(source);
+
+    zippee::ExtractOptions options;
+    options.threads = 2;
+    testing::internal::CaptureStdout();
+    EXPECT_EQ(zippee::test_entries(source, headers, options), 0);
+    corrupt(archive, headers[0]);
+    EXPECT_EQ(zippee::test_entries(source, headers, options), 1);
+    auto output = testing::internal::GetCapturedStdout();
+    EXPECT_NE(output.find("FAILED stored.txt: CRC32 does not match."), std::string::npos);
+}
+
+TEST(Extract, process_batch_extracts_each_archive_into_its_own_directory) {
+    auto first = test::write_temp_file("zippee_batch.zip", test::make_archive(every_method()));
+    auto second_archive = test::make_archive({{"a.txt", "same"}, {"b.txt", "same"}, {"damaged.txt", "damaged"}});
+    corrupt(second_archive, headers_of(zippee::mapped_source(second_archive))[2]);
+    std::filesystem::create_directories(testing::TempDir() + "zippee_batch_other");
+    auto second = test::write_temp_file("zippee_batch_other/zippee_batch.zip", second_archive);
+
+    zippee::ExtractOptions options;
+    options.threads = 2;
+    options.dedupe = true;
+    options.output_dir = fresh_directory("zippee_batch_out");
+    testing::internal::CaptureStdout();
+    EXPECT_EQ(zippee::process_batch({first, second}, false, options), 1);
+    auto output = testing::internal::GetCapturedStdout();
+
+    //the second archive of the same name is numbered
+    for (auto& entry : every_method()) {
+        EXPECT_EQ(read_text(options.output_dir + "/zippee_batch/" + entry.name), entry.contents) << entry.name;
+    }
+    EXPECT_EQ(read_text(options.output_dir + "/zippee_batch_2/a.txt"), "same");
+    EXPECT_EQ(read_text(options.output_dir + "/zippee_batch_2/b.txt"), "same");
+    EXPECT_NE(output.find("CRC32 does not match for damaged.txt."), std::string::npos) << output;
+
+    options.test_only = true;
+    testing::internal::CaptureStdout();
+    EXPECT_EQ(zippee::process_batch({first}, false, options), 0);
+    EXPECT_EQ(zippee::process_batch({first, second}, false, options), 1);
+    output = testing::internal::GetCapturedStdout();
+    EXPECT_NE(output.find("OK hello.zst"), std::string::npos) << output;
+    EXPECT_NE(output.find("FAILED damaged.txt: CRC32 does not match."), std::string::npos) << output;
+
+    std::remove(first.c_str());
+    std::remove(second.c_str());
+}
@@ -0,0 +1,239 @@
+//------------------------------------------------------------------------------
+// gzip.cpp
+//------------------------------------------------------------------------------
+
+#include "gzip.hpp"
+
+#include "crc32.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+    constexpr uint8_t FLAG_HCRC = 0x02;
+    constexpr uint8_t FLAG_EXTRA = 0x04;
+    constexpr uint8_t FLAG_NAME = 0x08;
+    constexpr uint8_t FLAG_COMMENT = 0x10;
+    constexpr uint8_t FLAGS_RESERVED = 0xe0;
+
+    uint16_t read_le16(std::span<const std::byte> data) {
+        return std::to_integer<uint16_t>(data[0]) | (std::to_integer<uint16_t>(data[1]) << 8);
+    }
+
+    uint32_t read_le32(std::span<const std::byte> data) {
+        return read_le16(data) | (static_cast<uint32_t>(read_le16(data.subspan(2))) << 16);
+    }
+
+    std::optional<std::string> read_zero_terminated(std::span<const std::byte>& data) {
+        auto end = std::find(data.begin(), data.end(), std::byte{0});
+        if (end == data.end()) {
+            return std::nullopt;
+        }
+
+        std::string s(reinterpret_cast<const char*>(data.data()), end - data.begin());
+        data = data.subspan(s.size() + 1);
+        return s;
+    }
+
+    std::optional<uint16_t> find_bgzf_block_size(std::span<const std::byte> extra) {
+        while (extra.size() >= 4) {
+            auto length = read_le16(extra.subspan(2));
+            if (extra.size() < 4u + length) {
+                break;
+            }
+            if (extra[0] == std::byte{'B'} && extra[1] == std::byte{'C'} && length == 2) {
+                return read_le16(extra.subspan(4));
+            }
+            extra = extra.subspan(4 + length);
+        }
+
+        return std::nullopt;
+    }
+
+    std::expected<std::vector<std::byte>, std::string> decompress_parallel(
+        const std::vector<std::span<std::byte>>& members, size_t threads) {
+        std::vector<std::vector<std::byte>> outputs(members.size());
+        std::vector<std::string> errors(members.size());
+
+        zippee::parallel_for(members.size(), threads, [&](size_t i) {
+            auto decompressed = gzip::decompress_member(members[i], outputs[i], deflate::thread_decoder());
+            if (!decompressed) {
+                errors[i] = decompressed.error();
+            }
+        });
+
+        size_t total = 0;
+        for (size_t i = 0; i < members.size(); i++) {
+            if (!errors[i].empty()) {
+                return std::unexpected(errors[i]);
+            }
+            total += outputs[i].size();
+        }
+
+        std::vector<std::byte> output(total);
+        auto pos = output.data();
+        for (const auto& o : outputs) {
+            std::memcpy(pos, o.data(), o.size());
+            pos += o.size();
+        }
+
+        return output;
+    }
+
+    std::expected<std::vector<std::byte>, std::string> decompress_sequential(std::span<std::byte> data) {
+        auto& decoder = deflate::thread_decoder();
+        std::vector<std::byte> output;
+        std::vector<std::byte> member_output;
+
+        auto size = gzip::decompress_member(data, output, decoder);
+        while (size && *size < data.size()) {
+            data = data.subspan(*size);
+            size = gzip::decompress_member(data, member_output, decoder);
+            output.insert(output.end(), member_output.begin(), member_output.end());
+        }
+
+        if (!size) {
+            return std::unexpected(size.error());
+        }
+
+        return output;
+    }
+}
+
+bool gzip::is_gzip(std::span<const std::byte> data) {
+    return data.size() >= 2 && data[0] == std::byte{0x1f} && data[1] == std::byte{0x8b};
+}
+
+std::expected<gzip::MemberHeader, std::string> gzip::read_member_header(std::span<const std::byte> data) {
+    if (data.size() < MemberHeader::SPEC_MIN_SIZE) {
+        return std::unexpected("Not enough bytes for a gzip member header.");
+    }
+    if (!is_gzip(data)) {
+        return std::unexpected("Missing gzip magic number.");
+    }
+
+    MemberHeader h;
+    h.compression_method = std::to_integer<uint8_t>(data[2]);
+    h.flags = std::to_integer<uint8_t>(data[3]);
+    h.modification_time = read_le32(data.subspan(4));
+    h.extra_flags = std::to_integer<uint8_t>(data[8]);
+    h.operating_system = std::to_integer<uint8_t>(data[9]);
+
+    if (h.compression_method != 8) {
+        return std::unexpected("gzip member is not compressed with DEFLATE.");
+    }
+    if (h.flags & FLAGS_RESERVED) {
+        return std::unexpected("gzip member has reserved flags set.");
+    }
+
+    auto rest = data.subspan(MemberHeader::SPEC_MIN_SIZE);
+
+    if (h.flags & FLAG_EXTRA) {
+        if (rest.size() < 2 || rest.size() - 2 < read_le16(rest)) {
+            return std::unexpected("gzip extra field is truncated.");
+        }
+        auto extra = rest.subspan(2, read_le16(rest));
+        h.extra_field.assign(extra.begin(), extra.end());
+        h.bgzf_block_size = find_bgzf_block_size(extra);
+        rest = rest.subspan(2 + extra.size());
+    }
+
+    if (h.flags & FLAG_NAME) {
+        auto name = read_zero_terminated(rest);
+        if (!name) {
+            return std::unexpected("gzip file name is unterminated.");
+        }
+        h.file_name = std::move(*name);
+    }
+
+    if (h.flags & FLAG_COMMENT) {
+        auto comment = read_zero_terminated(rest);
+        if (!comment) {
+            return std::unexpected("gzip comment is unterminated.");
+        }
+        h.comment = std::move(*comment);
+    }
+
+    if (h.flags & FLAG_HCRC) {
+        if (rest.size() < 2) {
+            return std::unexpected("gzip header CRC is truncated.");
+        }
+        auto covered = data.subspan(0, data.size() - rest.size());
+        if (read_le16(rest) != (zip::crc32(covered) & 0xffff)) {
+            return std::unexpected("gzip header CRC does not match.");
+        }
+        rest = rest.subspan(2);
+    }
+
+    h.header_size = data.size() - rest.size();
+    return h;
+}
+
+std::expected<std::vector<std::span<std::byte>>, std::string> gzip::bgzf_members(std::span<std::byte> data) {
+    std::vector<std::span<std::byte>> members;
+
+    while (!data.empty()) {
+        auto header = read_member_header(data);
+        if (!header) {
+            return std::unexpected(header.error());
+        }
+        if (!header->bgzf_block_size) {
+            return std::unexpected("gzip member has no BGZF block size.");
+        }
+
+        size_t size = *header->bgzf_block_size + 1u;
+        if (size < header->header_size + MemberHeader::TRAILER_SIZE || size > data.size()) {
+            return std::unexpected("BGZF block size is out of range.");
+        }
+
+        members.push_back(data.subspan(0, size));
+        data = data.subspan(size);
+    }
+
+    return members;
+}
+
+std::expected<size_t, std::string> gzip::decompress_member(
+    std::span<std::byte> data, std::vector<std::byte>& output, deflate::Decoder& decoder) {
+    auto header = read_member_header(data);
+    if (!header) {
+        return std::unexpected(header.error());
+    }
+
+    size_t deflate_size;
+    try {
+        deflate_size = decoder.decompress(data.subspan(header->header_size), output);
+    } catch (const std::runtime_error& e) {
+        return std::unexpected(e.what());
+    }
+
+    auto trailer = data.subspan(header->header_size + deflate_size);
+    if (trailer.size() < MemberHeader::TRAILER_SIZE) {
+        return std::unexpected("gzip member trailer is truncated.");
+    }
+    if (read_le32(trailer) != zip::crc32(output)) {
+        return std::unexpected("CRC32 does not match.");
+    }
+    if (read_le32(trailer.subspan(4)) != static_cast<uint32_t>(output.size())) {
+        return std::unexpected("gzip member size does not match.");
+    }
+
+    return header->header_size + deflate_size + MemberHeader::TRAILER_SIZE;
+}
+
+std::expected<std::vector<std::byte>, std::string> gzip::decompress(std::span<std::byte> data, size_t threads) {
+    auto header = read_member_header(data);
+    if (!header) {
+        return std::unexpected(header.error());
+    }
+
+    if (header->bgzf_block_size) {
+        if (auto members = bgzf_members(data)) {
+            return decompress_parallel(*members, threads);
+        }
+    }
+
+    return decompress_sequential(data);
+}
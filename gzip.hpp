@@ -0,0 +1,59 @@
+//------------------------------------------------------------------------------
+// gzip.hpp
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "deflate.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace gzip {
+
+// RFC 1952 member header, up to the start of the DEFLATE stream.
+struct MemberHeader {
+    uint8_t compression_method;
+    uint8_t flags;
+    uint32_t modification_time;
+    uint8_t extra_flags;
+    uint8_t operating_system;
+
+    std::vector<std::byte> extra_field;
+    std::string file_name;
+    std::string comment;
+
+    // BGZF stores the total member size less one in a "BC" extra subfield,
+    // which lets members be found without inflating them.
+    std::optional<uint16_t> bgzf_block_size;
+
+    size_t header_size;
+
+    static const size_t SPEC_MIN_SIZE = 10;
+    static const size_t TRAILER_SIZE = 8;
+};
+
+bool is_gzip(std::span<const std::byte> data);
+
+std::expected<MemberHeader, std::string> read_member_header(std::span<const std::byte> data);
+
+// Splits a BGZF file into its members, or fails if any member lacks a block
+// size.
+std::expected<std::vector<std::span<std::byte>>, std::string> bgzf_members(std::span<std::byte> data);
+
+// Inflates the member at the start of data into output, replacing its
+// contents, and checks the CRC-32 and size in the trailer. Returns the size
+// of the whole member.
+std::expected<size_t, std::string> decompress_member(std::span<std::byte> data, std::vector<std::byte>& output, deflate::Decoder& decoder);
+
+// Inflates every member in order. BGZF members are independent and of known
+// size, so they are spread across up to threads workers; other members have
+// to be inflated one after another to find where the next begins.
+std::expected<std::vector<std::byte>, std::string> decompress(std::span<std::byte> data, size_t threads);
+
+}
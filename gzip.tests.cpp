@@ -0,0 +1,190 @@
+//------------------------------------------------------------------------------
+// gzip.tests.cpp
+//------------------------------------------------------------------------------
+
+#include "gzip.hpp"
+#include "test_archive.hpp"
+
+#include <cstring>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+// https://stackoverflow.com/a/45172360
+template<typename... Ts>
+std::array<std::byte, sizeof...(Ts)> make_bytes(Ts&&... args) noexcept {
+    return{std::byte(std::forward<Ts>(args))...};
+}
+
+using test::to_bytes;
+
+// "Hello, gzip!\n"
+auto hello_member() {
+    return make_bytes(
+        0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0xf3, 0x48, 0xcd, 0xc9, 0xc9, 0xd7,
+        0x51, 0x48, 0xaf, 0xca, 0x2c, 0x50, 0xe4, 0x02, 0x00, 0x05, 0x14, 0xa6, 0xf3, 0x0d, 0x00, 0x00,
+        0x00
+    );
+}
+
+// "second member\n"
+auto second_member() {
+    return make_bytes(
+        0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x2b, 0x4e, 0x4d, 0xce, 0xcf, 0x4b,
+        0x51, 0xc8, 0x4d, 0xcd, 0x4d, 0x4a, 0x2d, 0xe2, 0x02, 0x00, 0x36, 0x18, 0x4b, 0x0e, 0x0e, 0x00,
+        0x00, 0x00
+    );
+}
+
+// Three BGZF blocks of "first block, second block, third block." and the
+// empty end-of-file block
+auto bgzf_blocks() {
+    return make_bytes(
+        0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x06, 0x00, 0x42, 0x43, 0x02, 0x00,
+        0x28, 0x00, 0x4b, 0xcb, 0x2c, 0x2a, 0x2e, 0x51, 0x48, 0xca, 0xc9, 0x4f, 0xce, 0xd6, 0x51, 0x00,
+        0x00, 0x85, 0x75, 0xa3, 0xec, 0x0d, 0x00, 0x00, 0x00, 0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0xff, 0x06, 0x00, 0x42, 0x43, 0x02, 0x00, 0x29, 0x00, 0x2b, 0x4e, 0x4d, 0xce, 0xcf,
+        0x4b, 0x51, 0x48, 0xca, 0xc9, 0x4f, 0xce, 0xd6, 0x51, 0x00, 0x00, 0x14, 0x99, 0x6d, 0xe8, 0x0e,
+        0x00, 0x00, 0x00, 0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x06, 0x00, 0x42,
+        0x43, 0x02, 0x00, 0x27, 0x00, 0x2b, 0xc9, 0xc8, 0x2c, 0x4a, 0x51, 0x48, 0xca, 0xc9, 0x4f, 0xce,
+        0xd6, 0x03, 0x00, 0x3f, 0x41, 0xc0, 0xb4, 0x0c, 0x00, 0x00, 0x00, 0x1f, 0x8b, 0x08, 0x04, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0xff, 0x06, 0x00, 0x42, 0x43, 0x02, 0x00, 0x1b, 0x00, 0x03, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+    );
+}
+
+}
+
+TEST(Gzip, is_gzip) {
+    EXPECT_TRUE(gzip::is_gzip(hello_member()));
+    EXPECT_FALSE(gzip::is_gzip(make_bytes('P', 'K', 0x03, 0x04)));
+    EXPECT_FALSE(gzip::is_gzip(make_bytes(0x1f)));
+}
+
+TEST(Gzip, read_member_header_minimal) {
+    auto header = gzip::read_member_header(hello_member());
+
+    ASSERT_TRUE(header);
+    EXPECT_EQ(header->compression_method, 8);
+    EXPECT_EQ(header->operating_system, 3);
+    EXPECT_FALSE(header->bgzf_block_size);
+    EXPECT_EQ(header->header_size, 10);
+}
+
+TEST(Gzip, read_member_header_name_comment_crc) {
+    auto data = make_bytes(
+        0x1f, 0x8b, 0x08, 0x1a, 0x01, 0x02, 0x03, 0x04, 0x02, 0x03, 0x61, 0x2e, 0x74, 0x78, 0x74, 0x00,
+        0x6e, 0x6f, 0x74, 0x65, 0x00, 0xbe, 0x8c
+    );
+
+    auto header = gzip::read_member_header(data);
+
+    ASSERT_TRUE(header);
+    EXPECT_EQ(header->modification_time, 0x04030201);
+    EXPECT_EQ(header->file_name, "a.txt");
+    EXPECT_EQ(header->comment, "note");
+    EXPECT_EQ(header->header_size, data.size());
+
+    data[21] ^= std::byte{1};
+    EXPECT_FALSE(gzip::read_member_header(data));
+}
+
+TEST(Gzip, read_member_header_reserved_flags) {
+    auto data = hello_member();
+    data[3] = std::byte{0x20};
+    EXPECT_FALSE(gzip::read_member_header(data));
+}
+
+TEST(Gzip, read_member_header_bgzf) {
+    auto header = gzip::read_member_header(bgzf_blocks());
+
+    ASSERT_TRUE(header);
+    EXPECT_EQ(header->bgzf_block_size, 40);
+    EXPECT_EQ(header->header_size, 18);
+}
+
+TEST(Gzip, decompress_member) {
+    auto data = hello_member();
+    std::vector<std::byte> output;
+
+    auto size = gzip::decompress_member(data, output, deflate::thread_decoder());
+
+    ASSERT_TRUE(size);
+    EXPECT_EQ(*size, data.size());
+    EXPECT_EQ(output, to_bytes("Hello, gzip!\n"));
+}
+
+TEST(Gzip, decompress_member_crc_mismatch) {
+    auto data = hello_member();
+    data[25] ^= std::byte{1};
+    std::vector<std::byte> output;
+
+    auto size = gzip::decompress_member(data, output, deflate::thread_decoder());
+
+    ASSERT_FALSE(size);
+    EXPECT_EQ(size.error(), "CRC32 does not match.");
+}
+
+TEST(Gzip, decompress_member_truncated) {
+    auto data = hello_member();
+    std::vector<std::byte> output;
+
+    EXPECT_FALSE(gzip::decompress_member(std::span{data}.subspan(0, data.size() - 1), output, deflate::thread_decoder()));
+    EXPECT_FALSE(gzip::decompress_member(std::span{data}.subspan(0, 16), output, deflate::thread_decoder()));
+}
+
+TEST(Gzip, decompress_multiple_members) {
+    auto hello = hello_member();
+    auto second = second_member();
+    std::vector<std::byte> data(hello.begin(), hello.end());
+    data.insert(data.end(), second.begin(), second.end());
+
+    auto output = gzip::decompress(data, 4);
+
+    ASSERT_TRUE(output);
+    EXPECT_EQ(*output, to_bytes("Hello, gzip!\nsecond member\n"));
+}
+
+TEST(Gzip, decompress_trailing_garbage) {
+    auto hello = hello_member();
+    std::vector<std::byte> data(hello.begin(), hello.end());
+    data.push_back(std::byte{0});
+
+    EXPECT_FALSE(gzip::decompress(data, 1));
+}
+
+TEST(Gzip, bgzf_members) {
+    auto data = bgzf_blocks();
+
+    auto members = gzip::bgzf_members(data);
+
+    ASSERT_TRUE(members);
+    ASSERT_EQ(members->size(), 4);
+    EXPECT_EQ(members->at(0).size(), 41);
+    EXPECT_EQ(members->at(3).size(), 28);
+
+    auto hello = hello_member();
+    EXPECT_FALSE(gzip::bgzf_members(hello));
+}
+
+TEST(Gzip, decompress_bgzf_keeps_order) {
+    auto data = bgzf_blocks();
+
+    for (size_t threads : {1, 2, 8}) {
+        auto output = gzip::decompress(data, threads);
+
+        ASSERT_TRUE(output);
+        EXPECT_EQ(*output, to_bytes("first block, second block, third block."));
+    }
+}
+
+TEST(Gzip, decompress_bgzf_corrupt_block) {
+    auto data = bgzf_blocks();
+    data[76] ^= std::byte{1}; // CRC-32 of the second block
+
+    auto output = gzip::decompress(data, 2);
+
+    ASSERT_FALSE(output);
+    EXPECT_EQ(output.error(), "CRC32 does not match.");
+}
@@ -0,0 +1,440 @@
+
+//------------------------------------------------------------------------------
+// io.cpp
+//------------------------------------------------------------------------------
+
+#include "io.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <format>
+#include <utility>
+
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    // Splits an entry name into its directory and file name, dropping empty
+    // and "." components. Refuses names that would leave the tree.
+    std::expected<std::pair<std::string, std::string>, std::string> split_entry_name(std::string_view name) {
+        if (name.starts_with('/')) {
+            return std::unexpected(std::format("{} is an absolute path.", name));
+        }
+
+        std::string directory;
+        std::string leaf;
+        size_t start = 0;
+        while (start <= name.size()) {
+            auto end = std::min(name.find('/', start), name.size());
+            auto component = name.substr(start, end - start);
+            start = end + 1;
+
+            if (component == "..") {
+                return std::unexpected(std::format("{} leads outside the output directory.", name));
+            }
+            if (component.empty() || component == ".") {
+                continue;
+            }
+            if (!leaf.empty()) {
+                directory += directory.empty() ? leaf : "/" + leaf;
+            }
+            leaf = component;
+        }
+
+        //a trailing '/' names a directory
+        if (name.ends_with('/')) {
+            if (!leaf.empty()) {
+                directory += directory.empty() ? leaf : "/" + leaf;
+            }
+            leaf.clear();
+        }
+        return std::pair{directory, leaf};
+    }
+
+    bool should_fallback(int err) {
+        return err == EXDEV || err == EINVAL || err == ENOSYS || err == EOPNOTSUPP || err == EBADF;
+    }
+}
+
+zippee::mapped_file::mapped_file(int fd, std::span<std::byte> data)
+    : _fd(fd)
+    , _data(data) {
+}
+
+std::expected<zippee::mapped_file, std::string> zippee::mapped_file::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return std::unexpected("Unable to open file.");
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return std::unexpected("Unable to stat file.");
+    }
+
+    if (st.st_size == 0) {
+        return mapped_file(fd, {});
+    }
+
+    void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+        ::close(fd);
+        return std::unexpected("Unable to map file.");
+    }
+
+    return mapped_file(fd, std::span{static_cast<std::byte*>(addr), static_cast<size_t>(st.st_size)});
+}
+
+zippee::mapped_file::mapped_file(mapped_file&& other)
+    : _fd(std::exchange(other._fd, -1))
+    , _data(std::exchange(other._data, {})) {
+}
+
+zippee::mapped_file& zippee::mapped_file::operator=(mapped_file&& other) {
+    std::swap(_fd, other._fd);
+    std::swap(_data, other._data);
+    return *this;
+}
+
+zippee::mapped_file::~mapped_file() {
+    if (!_data.empty()) {
+        munmap(_data.data(), _data.size());
+    }
+    if (_fd >= 0) {
+        ::close(_fd);
+    }
+}
+
+int zippee::mapped_file::fd() const {
+    return _fd;
+}
+
+std::span<std::byte> zippee::mapped_file::data() const {
+    return _data;
+}
+
+void zippee::mapped_file::prefetch(size_t offset, size_t length) const {
+    if (offset >= _data.size()) {
+        return;
+    }
+
+    //madvise wants a page aligned start
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t start = offset & ~(page_size - 1);
+    size_t end = std::min(offset + length, _data.size());
+    madvise(_data.data() + start, end - start, MADV_WILLNEED);
+}
+
+zippee::mapped_output::mapped_output(int fd, std::span<std::byte> data)
+    : _fd(fd)
+    , _data(data) {
+}
+
+std::expected<zippee::mapped_output, std::string> zippee::mapped_output::create(const std::string& path, size_t size) {
+    return create_at(AT_FDCWD, path, size);
+}
+
+std::expected<zippee::mapped_output, std::string> zippee::mapped_output::create_at(int dir_fd, const std::string& name, size_t size) {
+    if (size == 0) {
+        return std::unexpected("Unable to map an empty output.");
+    }
+
+    int fd = ::openat(dir_fd, name.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return std::unexpected("Unable to create file.");
+    }
+
+    //allocating the blocks now avoids fragmentation and page faults on holes
+    int allocated = fallocate(fd, 0, 0, size);
+    if (allocated != 0 && (errno == EOPNOTSUPP || errno == ENOSYS)) {
+        allocated = ftruncate(fd, size);
+    }
+    if (allocated != 0) {
+        std::string error = std::string("Unable to allocate file: ") + std::strerror(errno);
+        ::close(fd);
+        return std::unexpected(error);
+    }
+
+    void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        ::close(fd);
+        return std::unexpected("Unable to map file.");
+    }
+
+    return mapped_output(fd, std::span{static_cast<std::byte*>(addr), size});
+}
+
+zippee::mapped_output::mapped_output(mapped_output&& other)
+    : _fd(std::exchange(other._fd, -1))
+    , _data(std::exchange(other._data, {}))
+    , _writeback_started(other._writeback_started)
+    , _dropped(other._dropped) {
+}
+
+zippee::mapped_output& zippee::mapped_output::operator=(mapped_output&& other) {
+    std::swap(_fd, other._fd);
+    std::swap(_data, other._data);
+    std::swap(_writeback_started, other._writeback_started);
+    std::swap(_dropped, other._dropped);
+    return *this;
+}
+
+zippee::mapped_output::~mapped_output() {
+    if (!_data.empty()) {
+        munmap(_data.data(), _data.size());
+    }
+    if (_fd >= 0) {
+        ::close(_fd);
+    }
+}
+
+std::span<std::byte> zippee::mapped_output::data() const {
+    return _data;
+}
+
+void zippee::mapped_output::write_back(size_t size) {
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+    size = std::min(size, _data.size()) & ~(page_size - 1);
+    if (size <= _writeback_started) {
+        return;
+    }
+
+    sync_file_range(_fd, _writeback_started, size - _writeback_started, SYNC_FILE_RANGE_WRITE);
+
+    //the batch before this one has had a whole batch's time to be written
+    if (_writeback_started > _dropped) {
+        auto length = _writeback_started - _dropped;
+        sync_file_range(_fd, _dropped, length,
+            SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        madvise(_data.data() + _dropped, length, MADV_DONTNEED);
+        posix_fadvise(_fd, _dropped, length, POSIX_FADV_DONTNEED);
+        _dropped = _writeback_started;
+    }
+
+    _writeback_started = size;
+}
+
+std::expected<void, std::string> zippee::mapped_output::finish(size_t size) {
+    munmap(_data.data(), _data.size());
+    _data = {};
+
+    if (ftruncate(_fd, size) != 0) {
+        return std::unexpected(std::string("Unable to truncate file: ") + std::strerror(errno));
+    }
+
+    return {};
+}
+
+std::expected<void, std::string> zippee::sendfile_range(int in_fd, off_t offset, size_t length, int out_fd) {
+    while (length > 0) {
+        auto sent = sendfile(out_fd, in_fd, &offset, length);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return std::unexpected(std::string("sendfile failed: ") + std::strerror(errno));
+        }
+        if (sent == 0) {
+            return std::unexpected("sendfile reached end of input early.");
+        }
+        length -= sent;
+    }
+
+    return {};
+}
+
+std::expected<void, std::string> zippee::copy_range(int in_fd, off_t offset, size_t length, int out_fd) {
+    while (length > 0) {
+        auto copied = copy_file_range(in_fd, &offset, out_fd, nullptr, length, 0);
+        if (copied < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (should_fallback(errno)) {
+                return sendfile_range(in_fd, offset, length, out_fd);
+            }
+            return std::unexpected(std::string("copy_file_range failed: ") + std::strerror(errno));
+        }
+        if (copied == 0) {
+            return std::unexpected("copy_file_range reached end of input early.");
+        }
+        length -= copied;
+    }
+
+    return {};
+}
+
+zippee::directory_handle::directory_handle(int fd)
+    : _fd(fd) {
+}
+
+zippee::directory_handle::~directory_handle() {
+    if (_fd >= 0 && _fd != AT_FDCWD) {
+        ::close(_fd);
+    }
+}
+
+int zippee::directory_handle::fd() const {
+    return _fd;
+}
+
+int zippee::output_location::dir_fd() const {
+    return directory ? directory->fd() : AT_FDCWD;
+}
+
+int zippee::output_location::create(int flags) const {
+    return ::openat(dir_fd(), name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_NOFOLLOW | flags, 0644);
+}
+
+void zippee::output_location::remove() const {
+    ::unlinkat(dir_fd(), name.c_str(), 0);
+}
+
+std::expected<zippee::clone_kind, std::string> zippee::clone_file(const output_location& from, const output_location& to) {
+    int in_fd = ::openat(from.dir_fd(), from.name.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if (in_fd < 0) {
+        return std::unexpected(std::format("Unable to open {}: {}", from.name, std::strerror(errno)));
+    }
+
+    struct stat st;
+    if (::fstat(in_fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        ::close(in_fd);
+        return std::unexpected(std::format("{} is not a regular file.", from.name));
+    }
+
+    //to may be a link to from left by an earlier run, which truncating would empty
+    to.remove();
+    int out_fd = to.create();
+    if (out_fd >= 0 && ::ioctl(out_fd, FICLONE, in_fd) == 0) {
+        ::close(out_fd);
+        ::close(in_fd);
+        return clone_kind::reflink;
+    }
+    if (out_fd >= 0) {
+        ::close(out_fd);
+    }
+
+    to.remove();
+    if (::linkat(from.dir_fd(), from.name.c_str(), to.dir_fd(), to.name.c_str(), 0) == 0) {
+        ::close(in_fd);
+        return clone_kind::hard_link;
+    }
+
+    out_fd = to.create();
+    if (out_fd < 0) {
+        ::close(in_fd);
+        return std::unexpected(std::format("Unable to create {}: {}", to.name, std::strerror(errno)));
+    }
+    auto copied = copy_range(in_fd, 0, st.st_size, out_fd);
+    ::close(out_fd);
+    ::close(in_fd);
+    if (!copied) {
+        to.remove();
+        return std::unexpected(copied.error());
+    }
+    return clone_kind::copy;
+}
+
+zippee::output_tree::output_tree(handle root, size_t max_open)
+    : _root(std::move(root))
+    , _max_open(std::max<size_t>(max_open, 1)) {
+}
+
+std::expected<std::unique_ptr<zippee::output_tree>, std::string>
+zippee::output_tree::open(const std::string& root, size_t max_open) {
+    std::string made;
+    for (size_t end = 0; end != std::string::npos;) {
+        end = root.find('/', end + 1);
+        made = root.substr(0, end);
+        if (::mkdir(made.c_str(), 0755) != 0 && errno != EEXIST) {
+            return std::unexpected(std::format("Unable to make {}: {}", made, std::strerror(errno)));
+        }
+    }
+
+    int fd = ::open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return std::unexpected(std::format("Unable to open {}: {}", root, std::strerror(errno)));
+    }
+    return std::unique_ptr<output_tree>(new output_tree(std::make_shared<directory_handle>(fd), max_open));
+}
+
+// Called with _mutex held; opens parents first, each from its own parent.
+std::expected<zippee::output_tree::handle, std::string> zippee::output_tree::directory(const std::string& path) {
+    if (path.empty()) {
+        return _root;
+    }
+
+    if (auto found = _open.find(path); found != _open.end()) {
+        _recent.splice(_recent.begin(), _recent, found->second.second);
+        return found->second.first;
+    }
+
+    auto slash = path.rfind('/');
+    auto parent = directory(slash == std::string::npos ? std::string() : path.substr(0, slash));
+    if (!parent) {
+        return parent;
+    }
+    auto name = slash == std::string::npos ? path : path.substr(slash + 1);
+
+    if (!_made.contains(path)) {
+        if (::mkdirat((*parent)->fd(), name.c_str(), 0755) != 0 && errno != EEXIST) {
+            return std::unexpected(std::format("Unable to make {}: {}", path, std::strerror(errno)));
+        }
+        _made.insert(path);
+    }
+
+    int fd = ::openat((*parent)->fd(), name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+        return std::unexpected(std::format("Unable to open {}: {}", path, std::strerror(errno)));
+    }
+
+    if (_open.size() >= _max_open) {
+        //anyone still using the evicted handle keeps it open until done
+        _open.erase(_recent.back());
+        _recent.pop_back();
+    }
+    auto opened = std::make_shared<directory_handle>(fd);
+    _recent.push_front(path);
+    _open.emplace(path, std::pair{opened, _recent.begin()});
+    return opened;
+}
+
+std::expected<void, std::string> zippee::output_tree::make_parents(std::string_view entry_name) {
+    auto split = split_entry_name(entry_name);
+    if (!split) {
+        return std::unexpected(split.error());
+    }
+
+    std::lock_guard lock(_mutex);
+    auto parent = directory(split->first);
+    if (!parent) {
+        return std::unexpected(parent.error());
+    }
+    return {};
+}
+
+std::expected<zippee::output_location, std::string> zippee::output_tree::locate(std::string_view entry_name) {
+    auto split = split_entry_name(entry_name);
+    if (!split) {
+        return std::unexpected(split.error());
+    }
+
+    std::lock_guard lock(_mutex);
+    auto parent = directory(split->first);
+    if (!parent) {
+        return std::unexpected(parent.error());
+    }
+    return output_location{*parent, split->second};
+}
+
+size_t zippee::output_tree::open_directories() {
+    std::lock_guard lock(_mutex);
+    return _open.size();
+}
@@ -0,0 +1,155 @@
+
+//------------------------------------------------------------------------------
+// io.hpp
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+#include <expected>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <sys/types.h>
+
+namespace zippee {
+    class mapped_file {
+    private:
+        int _fd;
+        std::span<std::byte> _data;
+
+        mapped_file(int fd, std::span<std::byte> data);
+
+    public:
+        static std::expected<mapped_file, std::string> open(const std::string& path);
+
+        mapped_file(mapped_file&& other);
+        mapped_file& operator=(mapped_file&& other);
+        mapped_file(const mapped_file&) = delete;
+        mapped_file& operator=(const mapped_file&) = delete;
+        ~mapped_file();
+
+        int fd() const;
+        std::span<std::byte> data() const;
+
+        // Asks the kernel to start reading a range in ahead of its use.
+        void prefetch(size_t offset, size_t length) const;
+    };
+
+    // A new file allocated up front and mapped writable, so output can be
+    // produced in place rather than buffered and written. Writeback can be
+    // started as output is produced, keeping the dirty page cache bounded.
+    class mapped_output {
+    private:
+        int _fd;
+        std::span<std::byte> _data;
+        size_t _writeback_started = 0;
+        size_t _dropped = 0;
+
+        mapped_output(int fd, std::span<std::byte> data);
+
+    public:
+        static std::expected<mapped_output, std::string> create(const std::string& path, size_t size);
+        // Creates the file name relative to the directory dir_fd.
+        static std::expected<mapped_output, std::string> create_at(int dir_fd, const std::string& name, size_t size);
+
+        mapped_output(mapped_output&& other);
+        mapped_output& operator=(mapped_output&& other);
+        mapped_output(const mapped_output&) = delete;
+        mapped_output& operator=(const mapped_output&) = delete;
+        ~mapped_output();
+
+        std::span<std::byte> data() const;
+
+        // Starts writeback of output up to size, waits for the previous
+        // writeback to finish and drops those pages from memory.
+        void write_back(size_t size);
+
+        // Unmaps the file and truncates it to size.
+        std::expected<void, std::string> finish(size_t size);
+    };
+
+    std::expected<void, std::string> copy_range(int in_fd, off_t offset, size_t length, int out_fd);
+    // As copy_range, for output that copy_file_range can't write to, such as
+    // a socket.
+    std::expected<void, std::string> sendfile_range(int in_fd, off_t offset, size_t length, int out_fd);
+
+    // An open directory, closed once nothing holds it.
+    class directory_handle {
+    private:
+        int _fd;
+
+    public:
+        explicit directory_handle(int fd);
+        ~directory_handle();
+        directory_handle(const directory_handle&) = delete;
+        directory_handle& operator=(const directory_handle&) = delete;
+
+        int fd() const;
+    };
+
+    // A file to create: name relative to directory, which is kept open for
+    // as long as this is. No directory means the working directory.
+    struct output_location {
+        std::shared_ptr<const directory_handle> directory;
+        std::string name;
+
+        int dir_fd() const;
+        int create(int flags = 0) const;
+        void remove() const;
+    };
+
+    enum class clone_kind {
+        reflink,
+        hard_link,
+        copy
+    };
+
+    // Makes to a file with the same contents as from, as cheaply as the
+    // filesystem allows: a reflink sharing from's extents, else a hard link
+    // to it, else a copy.
+    std::expected<clone_kind, std::string> clone_file(const output_location& from, const output_location& to);
+
+    // Directory tree that entries are extracted into. Each directory is made
+    // once and then held open, so files are created with openat relative to
+    // their parent instead of resolving the whole path again. Up to max_open
+    // directories stay open, the least recently used closing first; one that
+    // was closed is reopened without being made again.
+    //
+    // Names are confined to the tree: absolute names and ".." components are
+    // refused, and nothing inside it is reached through a symbolic link.
+    class output_tree {
+    private:
+        using handle = std::shared_ptr<const directory_handle>;
+
+        handle _root;
+        size_t _max_open;
+
+        std::mutex _mutex;
+        std::list<std::string> _recent;
+        std::unordered_map<std::string, std::pair<handle, std::list<std::string>::iterator>> _open;
+        std::unordered_set<std::string> _made;
+
+        output_tree(handle root, size_t max_open);
+        std::expected<handle, std::string> directory(const std::string& path);
+
+    public:
+        static std::expected<std::unique_ptr<output_tree>, std::string> open(const std::string& root, size_t max_open = 256);
+
+        // Makes the directories leading to an entry, so they can all be made
+        // before any files are written.
+        std::expected<void, std::string> make_parents(std::string_view entry_name);
+
+        // Where an entry is to be written. An entry naming a directory, with a
+        // trailing '/', is made here and given an empty name.
+        std::expected<output_location, std::string> locate(std::string_view entry_name);
+
+        size_t open_directories();
+    };
+}
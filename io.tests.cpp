@@ -0,0 +1,237 @@
+
+//------------------------------------------------------------------------------
+// io.tests.cpp
+//------------------------------------------------------------------------------
+
+#include "io.hpp"
+#include "test_archive.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+std::string read_file(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), {});
+}
+
+}
+
+TEST(IO, mapped_file_contents) {
+    auto path = test::write_temp_file("zippee_mapped", test::to_bytes("hello world"));
+
+    auto file = zippee::mapped_file::open(path);
+    ASSERT_TRUE(file.has_value());
+    EXPECT_EQ(file->data().size(), 11);
+    EXPECT_EQ(file->data()[6], std::byte{'w'});
+    EXPECT_GE(file->fd(), 0);
+
+    std::remove(path.c_str());
+}
+
+TEST(IO, mapped_file_empty) {
+    auto path = test::write_temp_file("zippee_mapped_empty", test::to_bytes(""));
+
+    auto file = zippee::mapped_file::open(path);
+    ASSERT_TRUE(file.has_value());
+    EXPECT_TRUE(file->data().empty());
+
+    std::remove(path.c_str());
+}
+
+TEST(IO, mapped_file_missing) {
+    auto file = zippee::mapped_file::open(testing::TempDir() + "zippee_does_not_exist");
+    EXPECT_FALSE(file.has_value());
+}
+
+TEST(IO, copy_range) {
+    auto in_path = test::write_temp_file("zippee_copy_in", test::to_bytes("0123456789"));
+    auto out_path = testing::TempDir() + "zippee_copy_out";
+
+    auto in = zippee::mapped_file::open(in_path);
+    ASSERT_TRUE(in.has_value());
+    int out_fd = ::open(out_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    ASSERT_GE(out_fd, 0);
+
+    auto result = zippee::copy_range(in->fd(), 3, 5, out_fd);
+    ::close(out_fd);
+
+    EXPECT_TRUE(result.has_value());
+    EXPECT_EQ(read_file(out_path), "34567");
+
+    std::remove(in_path.c_str());
+    std::remove(out_path.c_str());
+}
+
+TEST(IO, copy_range_past_end) {
+    auto in_path = test::write_temp_file("zippee_copy_short", test::to_bytes("0123"));
+    auto out_path = testing::TempDir() + "zippee_copy_short_out";
+
+    auto in = zippee::mapped_file::open(in_path);
+    ASSERT_TRUE(in.has_value());
+    int out_fd = ::open(out_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    ASSERT_GE(out_fd, 0);
+
+    auto result = zippee::copy_range(in->fd(), 2, 10, out_fd);
+    ::close(out_fd);
+
+    EXPECT_FALSE(result.has_value());
+
+    std::remove(in_path.c_str());
+    std::remove(out_path.c_str());
+}
+
+TEST(IO, mapped_output) {
+    auto path = testing::TempDir() + "zippee_mapped_out";
+
+    {
+        auto out = zippee::mapped_output::create(path, 64 * 1024);
+        ASSERT_TRUE(out.has_value());
+        ASSERT_EQ(out->data().size(), 64 * 1024);
+
+        std::string text = "written in place";
+        std::memcpy(out->data().data(), text.data(), text.size());
+        out->write_back(out->data().size());
+        EXPECT_TRUE(out->finish(text.size()).has_value());
+    }
+
+    EXPECT_EQ(read_file(path), "written in place");
+    std::remove(path.c_str());
+}
+
+TEST(IO, mapped_output_write_back_in_steps) {
+    auto path = testing::TempDir() + "zippee_mapped_steps";
+    const size_t size = 1024 * 1024;
+
+    {
+        auto out = zippee::mapped_output::create(path, size);
+        ASSERT_TRUE(out.has_value());
+
+        for (size_t offset = 0; offset < size; offset += 64 * 1024) {
+            std::memset(out->data().data() + offset, 'a' + offset / (64 * 1024), 64 * 1024);
+            out->write_back(offset + 64 * 1024);
+        }
+        EXPECT_TRUE(out->finish(size).has_value());
+    }
+
+    auto contents = read_file(path);
+    ASSERT_EQ(contents.size(), size);
+    EXPECT_EQ(contents.front(), 'a');
+    EXPECT_EQ(contents[size / 2], 'i');
+    EXPECT_EQ(contents.back(), 'p');
+    std::remove(path.c_str());
+}
+
+TEST(IO, mapped_output_empty) {
+    EXPECT_FALSE(zippee::mapped_output::create(testing::TempDir() + "zippee_mapped_empty", 0).has_value());
+}
+
+TEST(IO, output_tree_nested_files) {
+    auto root = testing::TempDir() + "zippee_tree/out";
+    auto tree = zippee::output_tree::open(root);
+    ASSERT_TRUE(tree.has_value()) << tree.error();
+
+    ASSERT_TRUE((*tree)->make_parents("a/b/c.txt").has_value());
+    auto location = (*tree)->locate("a/b/c.txt");
+    ASSERT_TRUE(location.has_value()) << location.error();
+    EXPECT_EQ(location->name, "c.txt");
+
+    int fd = location->create();
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(::write(fd, "tree", 4), 4);
+    ::close(fd);
+    EXPECT_EQ(read_file(root + "/a/b/c.txt"), "tree");
+
+    auto top = (*tree)->locate("./top.txt");
+    ASSERT_TRUE(top.has_value());
+    EXPECT_EQ(top->name, "top.txt");
+    EXPECT_EQ(top->dir_fd(), (*(*tree)->locate("other.txt")).dir_fd());
+
+    auto directory = (*tree)->locate("a/d/");
+    ASSERT_TRUE(directory.has_value());
+    EXPECT_TRUE(directory->name.empty());
+    EXPECT_EQ(::access((root + "/a/d").c_str(), F_OK), 0);
+
+    std::remove((root + "/a/b/c.txt").c_str());
+    std::remove((root + "/a/b").c_str());
+    std::remove((root + "/a/d").c_str());
+    std::remove((root + "/a").c_str());
+}
+
+TEST(IO, output_tree_refuses_escapes) {
+    auto tree = zippee::output_tree::open(testing::TempDir() + "zippee_tree_escape");
+    ASSERT_TRUE(tree.has_value());
+
+    EXPECT_FALSE((*tree)->locate("../evil.txt").has_value());
+    EXPECT_FALSE((*tree)->locate("a/../../evil.txt").has_value());
+    EXPECT_FALSE((*tree)->locate("/etc/evil.txt").has_value());
+    EXPECT_FALSE((*tree)->make_parents("x/../../y").has_value());
+}
+
+TEST(IO, output_tree_does_not_follow_links) {
+    auto root = testing::TempDir() + "zippee_tree_link";
+    auto tree = zippee::output_tree::open(root);
+    ASSERT_TRUE(tree.has_value());
+    ASSERT_EQ(::symlink(testing::TempDir().c_str(), (root + "/link").c_str()), 0);
+
+    EXPECT_FALSE((*tree)->locate("link/escaped.txt").has_value());
+
+    auto location = (*tree)->locate("link");
+    ASSERT_TRUE(location.has_value());
+    EXPECT_LT(location->create(), 0);
+
+    std::remove((root + "/link").c_str());
+}
+
+TEST(IO, output_tree_reopens_closed_directories) {
+    auto root = testing::TempDir() + "zippee_tree_evict";
+    auto tree = zippee::output_tree::open(root, 2);
+    ASSERT_TRUE(tree.has_value());
+
+    for (auto name : {"a/1", "b/2", "c/3", "a/4"}) {
+        auto location = (*tree)->locate(name);
+        ASSERT_TRUE(location.has_value()) << name;
+        int fd = location->create();
+        ASSERT_GE(fd, 0) << name;
+        ::close(fd);
+    }
+    EXPECT_LE((*tree)->open_directories(), 2);
+    EXPECT_EQ(::access((root + "/a/4").c_str(), F_OK), 0);
+
+    for (auto name : {"/a/1", "/b/2", "/c/3", "/a/4", "/a", "/b", "/c"}) {
+        std::remove((root + name).c_str());
+    }
+}
+
+TEST(IO, clone_file) {
+    auto root = testing::TempDir() + "zippee_clone";
+    auto tree = zippee::output_tree::open(root);
+    ASSERT_TRUE(tree.has_value()) << tree.error();
+
+    auto from = (*tree)->locate("from.txt");
+    auto to = (*tree)->locate("sub/to.txt");
+    ASSERT_TRUE(from.has_value() && to.has_value());
+
+    int fd = from->create();
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(::write(fd, "same bytes", 10), 10);
+    ::close(fd);
+
+    auto cloned = zippee::clone_file(*from, *to);
+    ASSERT_TRUE(cloned.has_value()) << cloned.error();
+    EXPECT_EQ(read_file(root + "/sub/to.txt"), "same bytes");
+
+    auto missing = (*tree)->locate("missing.txt");
+    EXPECT_FALSE(zippee::clone_file(*missing, *to).has_value());
+
+    std::remove((root + "/sub/to.txt").c_str());
+    std::remove((root + "/sub").c_str());
+    std::remove((root + "/from.txt").c_str());
+}
@@ -3,91 +3,257 @@
 // main.cpp
 //------------------------------------------------------------------------------
 
-#include "crc32.hpp"
+#include "append.hpp"
 #include "deflate.hpp"
+#include "extract.hpp"
+#include "gzip.hpp"
+#include "server.hpp"
+#include "source.hpp"
+#include "trace.hpp"
 #include "zip.hpp"
+#include "zlib.hpp"
 
 #include "vendor/CLI11.hpp"
 
-#include <cstdint>
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <format>
 #include <fstream>
 #include <iostream>
 #include <print>
 #include <string>
+#include <thread>
 #include <vector>
 
 namespace {
-    void writeout(const std::string& filename, const std::vector<std::byte>& d) {
-        std::string adjusted = filename;
-        std::replace(adjusted.begin(), adjusted.end(), '/', '_');
+    // Writes the trace on the way out of main, whichever way that is.
+    struct TraceOutput {
+        std::string path;
 
-        std::ofstream decompressed_file(adjusted, std::ios::binary);
-        decompressed_file.write(reinterpret_cast<char*>(const_cast<std::byte*>(&d[0])), d.size() * sizeof(std::byte));
+        ~TraceOutput() {
+            if (path.empty()) {
+                return;
+            }
+            if (auto written = zippee::trace::write(path); !written) {
+                std::println("{}", written.error());
+            }
+        }
+    };
+
+    // Reads input paths one per line from path, or standard input for "-".
+    std::expected<std::vector<std::string>, std::string> read_file_list(const std::string& path) {
+        std::ifstream file;
+        if (path != "-") {
+            file.open(path);
+            if (!file) {
+                return std::unexpected(std::format("Unable to open {}.", path));
+            }
+        }
+        std::istream& in = path == "-" ? std::cin : file;
+
+        std::vector<std::string> inputs;
+        for (std::string line; std::getline(in, line);) {
+            if (!line.empty()) {
+                inputs.push_back(std::move(line));
+            }
+        }
+        return inputs;
+    }
+
+    zippee::Server* serving = nullptr;
+
+    // Serves the archives over a Unix socket until interrupted.
+    int serve(const std::string& socket_path, const std::vector<std::string>& archives, const zippee::ExtractOptions& options, size_t cache_bytes) {
+        auto server = zippee::Server::open(socket_path, archives, {
+            .threads = options.threads,
+            .cache_bytes = cache_bytes,
+            .pread = options.pread,
+        });
+        if (!server) {
+            std::println("{}", server.error());
+            return -1;
+        }
+
+        serving = server->get();
+        std::signal(SIGINT, [](int) { serving->stop(); });
+        std::signal(SIGTERM, [](int) { serving->stop(); });
+        //a client gone mid-reply mustn't end the server
+        std::signal(SIGPIPE, SIG_IGN);
+
+        std::println("Serving {} archives on {}.", archives.size(), socket_path);
+        std::fflush(stdout);
+        (*server)->run();
+
+        auto stats = (*server)->stats();
+        std::println("Served {} requests on {} connections, {} failed, sending {} bytes, {} with sendfile.",
+            stats.requests, stats.connections, stats.errors, stats.bytes_sent, stats.bytes_sendfile);
+        return 0;
     }
 }
 
 int main(int argc, char** argv) {
-    std::string input_filepath;
+    std::vector<std::string> input_filepaths;
+    std::string files_from;
+    std::vector<std::string> append_paths;
+    TraceOutput trace;
     bool list_contents = false;
+    std::string kernel_name;
+    std::string serve_path;
+    size_t cache_bytes = 0;
+    zippee::ExtractOptions options;
+    options.threads = std::max(1u, std::thread::hardware_concurrency());
 
-    CLI::App app{"zippee can decompress data contained with a ZIP file that is compressed with DEFLATE.", "zippee"};
-    app.add_option("input", input_filepath, "Input file.")->required();
-    app.add_flag("--list", list_contents, "List all contents of ZIP only.");
+    CLI::App app{"zippee can decompress data contained with a ZIP file that is compressed with DEFLATE or Zstandard.", "zippee"};
+    app.add_option("input", input_filepaths, "Input files. Several are extracted together, each into its own directory.");
+    app.add_option("--files-from", files_from, "Read further input files, one per line, from a file or - for standard input.");
+    app.add_flag("--list", list_contents, "List all contents of ZIP only, reading just its central directory.");
+    app.add_flag("--local-headers", options.local_headers, "With --list, also read each entry's local header and show where its data starts.");
+    app.add_option("--append", append_paths, "Add files to the ZIP, writing only them and a new central directory.");
+    app.add_option("--kernel", kernel_name, "Force an inflate kernel: generic, bmi2 or avx2.");
+    app.add_option("--table-cache", options.table_cache, "Dynamic block Huffman tables each decoder keeps for reuse; 0 builds them for every block.");
+    app.add_flag("--literal-runs", options.literal_runs, "Decode runs of short literal codes with one lookup.");
+    app.add_option("--threads", options.threads, "Workers for decompressing independent gzip members, checking large stored entries and processing a batch of inputs.");
+    app.add_option("--queue-depth", options.queue_depth, "Entries each extraction stage may queue for the next.");
+    app.add_flag("--pipeline-stats", options.show_stats, "Show how busy each extraction stage was, and its hardware counters where available.");
+    app.add_flag("--mmap-output", options.mmap_output, "Inflate large entries straight into memory-mapped output files.");
+    app.add_flag("--arena", options.arena, "Inflate each entry into its own arena, allocated once from the stated size.");
+    app.add_flag("--dedupe", options.dedupe, "Inflate entries with identical contents once, and reflink, hard link or copy the rest.");
+    app.add_option("--output-dir", options.output_dir, "Extract entries into this directory as the tree their names describe, instead of flattened.");
+    app.add_option("--trace", trace.path, "Write a Chrome trace-event timeline of the run to this file.");
+    app.add_option("--entry", options.entries, "Extract, test or list only the entries with these names.");
+    app.add_flag("--pread", options.pread, "Read archives with pread, fetching only the directory and the entries used, instead of mapping them.");
+    app.add_option("--serve", serve_path, "Keep the input archives open and serve list, stat and read requests on this Unix socket.");
+    app.add_option("--cache-bytes", cache_bytes, "With --serve, bytes of decompressed entries to keep for each archive.");
+    auto test_flag = app.add_flag("--test", options.test_only, "Check every entry's CRC32 without writing anything.");
+    std::pair<uint64_t, uint64_t> range;
+    auto range_option = app.add_option("--range", range, "Extract only LENGTH bytes from OFFSET of each entry, decoding no further than that.")
+        ->type_name("OFFSET LENGTH")
+        ->excludes(test_flag);
+    app.add_flag("--range-crc", options.range_crc, "With --range, decode all of each entry so its CRC32 can be checked.")
+        ->needs(range_option);
 
     try {
         app.parse(argc, argv);
     } catch (const CLI::ParseError& e) {
         return app.exit(e);
     }
+    if (*range_option) {
+        options.range = range;
+    }
 
-    std::ifstream input_file(input_filepath, std::ios::binary | std::ios::ate);
-
-    if (!input_file.is_open()) {
-        std::println("Unable to open file.");
+    if (!trace.path.empty()) {
+#ifdef ZIPPEE_TRACE
+        ZIPPEE_TRACE_THREAD("main");
+        zippee::trace::start();
+#else
+        std::println("Tracing was not built in; configure with -DZIPPEE_TRACE=ON.");
         return -1;
+#endif
     }
 
-    size_t size = input_file.tellg();
-    
-    std::vector<std::byte> data;
-    data.reserve(size);
-    input_file.seekg(0);
+    if (!kernel_name.empty()) {
+        auto kernel = deflate::kernel_from_name(kernel_name);
+        if (!kernel || !deflate::set_kernel(*kernel)) {
+            std::println("Inflate kernel {} is not available.", kernel_name);
+            return -1;
+        }
+    }
 
-    for (size_t i = 0; i < size; i++) {
-        auto getbyte = input_file.get();
-        if (getbyte == std::ifstream::traits_type::eof()) {
-            break;
+    if (!files_from.empty()) {
+        auto listed = read_file_list(files_from);
+        if (!listed) {
+            std::println("{}", listed.error());
+            return -1;
         }
+        input_filepaths.insert(input_filepaths.end(), listed->begin(), listed->end());
+    }
 
-        data.push_back(std::byte{static_cast<uint8_t>(getbyte)});
+    if (input_filepaths.empty()) {
+        std::println("No input files given.");
+        return -1;
+    }
+    if (!serve_path.empty()) {
+        return serve(serve_path, input_filepaths, options, cache_bytes);
+    }
+    if (!append_paths.empty()) {
+        if (input_filepaths.size() != 1) {
+            std::println("Files can only be appended to one archive.");
+            return -1;
+        }
+        auto added = zip::append_files(input_filepaths.front(), append_paths);
+        if (!added) {
+            std::println("Unable to append to {}: {}", input_filepaths.front(), added.error());
+            return -1;
+        }
+        for (auto& h : *added) {
+            std::println("Added {} ({} of {} bytes).", h.file_name, h.compressed_size, h.uncompressed_size);
+        }
+        return 0;
+    }
+    if (input_filepaths.size() > 1) {
+        if (options.range) {
+            std::println("--range extracts from one archive at a time.");
+            return -1;
+        }
+        return zippee::process_batch(input_filepaths, list_contents, options);
     }
-    auto data_span = std::span{data};
 
-    auto eocd = zip::search_for_eocd(data_span);
-    auto centralDir = data_span.subspan(eocd.value().offset_start_central_directory, data_span.size() - eocd.value().offset_start_central_directory);
-    auto headers = zip::read_central_directory_headers(centralDir);
+    auto& input_filepath = input_filepaths.front();
+    auto input_file = zippee::open_source(input_filepath, options.pread || list_contents);
+    if (!input_file) {
+        std::println("Unable to open {}: {}", input_filepath, input_file.error());
+        return -1;
+    }
 
-    for (auto& h : headers) {
-        std::println("Found {}.", h.file_name);
+    deflate::thread_decoder().set_literal_runs(options.literal_runs);
+    deflate::thread_decoder().set_table_cache(options.table_cache);
 
-        auto local_header_data = data_span.subspan(h.relative_offset_of_local_header, data_span.size() - h.relative_offset_of_local_header);
-        auto local_header = zip::read_local_header(local_header_data).value();
+    auto input = zippee::identify_input(**input_file);
+    if (!input) {
+        std::println("{}", input.error());
+        return -1;
+    }
 
-        if (!list_contents) {
-            auto compressed_span = data_span.subspan(h.relative_offset_of_local_header + local_header.header_size(), data_span.size() - h.relative_offset_of_local_header - local_header.header_size());
-            auto decompressed = deflate::decompress(compressed_span);
+    if (input->kind != zippee::InputKind::Zip) {
+        if (options.range) {
+            std::println("--range extracts from ZIP entries only.");
+            return -1;
+        }
+        std::vector<std::byte> buffer;
+        auto data = (*input_file)->read(0, (*input_file)->size(), buffer);
+        if (!data) {
+            std::println("Unable to read {}: {}", input_filepath, data.error());
+            return -1;
+        }
+        if (input->kind == zippee::InputKind::Gzip) {
+            return zippee::extract_stream(input_filepath, gzip::decompress(*data, options.threads), {".gz", ".bgz", ".gzip"}, options.output_dir, options.test_only);
+        }
+        return zippee::extract_stream(input_filepath, zlib::decompress(*data), {".zz", ".zlib"}, options.output_dir, options.test_only);
+    }
 
-            auto crc32 = zip::crc32(decompressed);
-            // below does not honour 4.4.4 of APPNOTE.TXT and check for data descriptor
-            auto check_crc32 = local_header.crc_32 == 0 ? h.crc_32 : local_header.crc_32;
+    auto all_headers = zip::read_central_directory(**input_file, *input->eocd);
+    if (!all_headers) {
+        std::println("{}", all_headers.error());
+        return -1;
+    }
+    auto headers = zippee::select_entries(std::move(*all_headers), options.entries);
+    for (auto& name : options.entries) {
+        if (std::ranges::find(headers, name, &zip::CentralDirectoryHeader::file_name) == headers.end()) {
+            std::println("No entry named {}.", name);
+        }
+    }
 
-            if (check_crc32 != crc32) {
-                std::println("CRC32 does not match for {}.", local_header.file_name);
-            } else {
-                writeout(local_header.file_name, decompressed);
-                std::println("Decompressed and wrote out {}.", local_header.file_name);
-            }            
+    if (list_contents) {
+        for (auto& h : headers) {
+            std::println("{}", zippee::list_entry(**input_file, h, options.local_headers));
         }
+    } else if (options.test_only) {
+        return zippee::test_entries(**input_file, headers, options);
+    } else if (options.range) {
+        return zippee::extract_ranges(**input_file, headers, options);
+    } else {
+        return zippee::extract_entries(**input_file, headers, options);
     }
 
     return 0;
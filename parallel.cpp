@@ -0,0 +1,141 @@
+//------------------------------------------------------------------------------
+// parallel.cpp
+//------------------------------------------------------------------------------
+
+#include "parallel.hpp"
+
+#include "trace.hpp"
+
+#include <format>
+
+#include <utility>
+
+namespace {
+    thread_local const zippee::WorkStealingPool* current_pool = nullptr;
+    thread_local size_t current_worker = 0;
+}
+
+zippee::WorkStealingPool::WorkStealingPool(size_t threads) {
+    threads = std::max<size_t>(threads, 1);
+    for (size_t i = 0; i < threads; i++) {
+        _workers.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < threads; i++) {
+        _threads.emplace_back([this, i] { run(i); });
+    }
+}
+
+zippee::WorkStealingPool::~WorkStealingPool() {
+    {
+        std::unique_lock lock(_mutex);
+        _done_cv.wait(lock, [this] { return _pending == 0; });
+        _stopping = true;
+    }
+    _work_cv.notify_all();
+
+    for (auto& thread : _threads) {
+        thread.join();
+    }
+}
+
+void zippee::WorkStealingPool::submit(Job job) {
+    size_t index = current_pool == this
+        ? current_worker
+        : _next++ % _workers.size();
+
+    //counted first, so the job can't finish before it is counted
+    {
+        std::lock_guard lock(_mutex);
+        _queued++;
+        _pending++;
+    }
+    {
+        std::lock_guard lock(_workers[index]->mutex);
+        _workers[index]->jobs.push_back(std::move(job));
+    }
+    _work_cv.notify_one();
+}
+
+std::optional<zippee::WorkStealingPool::Job> zippee::WorkStealingPool::take(size_t index) {
+    {
+        auto& own = *_workers[index];
+        std::lock_guard lock(own.mutex);
+        if (!own.jobs.empty()) {
+            auto job = std::move(own.jobs.back());
+            own.jobs.pop_back();
+            return job;
+        }
+    }
+
+    for (size_t i = 1; i < _workers.size(); i++) {
+        auto& victim = *_workers[(index + i) % _workers.size()];
+        std::lock_guard lock(victim.mutex);
+        if (!victim.jobs.empty()) {
+            auto job = std::move(victim.jobs.front());
+            victim.jobs.pop_front();
+            _steals++;
+            return job;
+        }
+    }
+
+    return std::nullopt;
+}
+
+void zippee::WorkStealingPool::run(size_t index) {
+    current_pool = this;
+    current_worker = index;
+    ZIPPEE_TRACE_THREAD(std::format("worker {}", index));
+
+    while (true) {
+        {
+            std::unique_lock lock(_mutex);
+            _work_cv.wait(lock, [this] { return _stopping || _queued > 0; });
+            if (_queued == 0) {
+                return;
+            }
+        }
+
+        auto job = take(index);
+        if (!job) {
+            //the job counted is still being pushed
+            std::this_thread::yield();
+            continue;
+        }
+
+        {
+            std::lock_guard lock(_mutex);
+            _queued--;
+        }
+
+        std::exception_ptr exception;
+        try {
+            (*job)();
+        } catch (...) {
+            exception = std::current_exception();
+        }
+
+        std::lock_guard lock(_mutex);
+        if (exception && !_exception) {
+            _exception = exception;
+        }
+        if (--_pending == 0) {
+            _done_cv.notify_all();
+        }
+    }
+}
+
+void zippee::WorkStealingPool::wait() {
+    std::unique_lock lock(_mutex);
+    _done_cv.wait(lock, [this] { return _pending == 0; });
+    if (_exception) {
+        std::rethrow_exception(std::exchange(_exception, nullptr));
+    }
+}
+
+size_t zippee::WorkStealingPool::size() const {
+    return _workers.size();
+}
+
+size_t zippee::WorkStealingPool::steals() const {
+    return _steals;
+}
@@ -0,0 +1,93 @@
+//------------------------------------------------------------------------------
+// parallel.hpp
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace zippee {
+
+// Runs fn(i) for every i below count on up to threads workers, the calling
+// thread included. Each worker claims the next index as it finishes one, so
+// uneven work still balances.
+template<typename F>
+void parallel_for(size_t count, size_t threads, F&& fn) {
+    std::atomic<size_t> next{0};
+    auto worker = [&] {
+        for (size_t i = next++; i < count; i = next++) {
+            fn(i);
+        }
+    };
+
+    std::vector<std::future<void>> workers;
+    for (size_t i = 1; i < std::min(threads, count); i++) {
+        workers.push_back(std::async(std::launch::async, worker));
+    }
+    worker();
+
+    for (auto& w : workers) {
+        w.get();
+    }
+}
+
+// Fixed set of workers, each with its own deque of jobs. A worker runs its
+// newest job first and, once out, steals the oldest job of another worker.
+// Jobs submitted from a worker go on its own deque, so work a job fans out
+// into stays local until someone idle takes it.
+class WorkStealingPool {
+public:
+    using Job = std::function<void()>;
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    std::vector<std::unique_ptr<Worker>> _workers;
+    std::vector<std::thread> _threads;
+
+    std::mutex _mutex;
+    std::condition_variable _work_cv;
+    std::condition_variable _done_cv;
+    size_t _queued = 0;
+    size_t _pending = 0;
+    bool _stopping = false;
+    std::exception_ptr _exception;
+
+    std::atomic<size_t> _next{0};
+    std::atomic<size_t> _steals{0};
+
+    void run(size_t index);
+    std::optional<Job> take(size_t index);
+
+public:
+    explicit WorkStealingPool(size_t threads);
+    ~WorkStealingPool();
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    void submit(Job job);
+
+    // Blocks until every job, including those submitted by jobs, has run.
+    // Rethrows the first exception a job threw.
+    void wait();
+
+    size_t size() const;
+    size_t steals() const;
+};
+
+}
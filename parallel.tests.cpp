@@ -0,0 +1,75 @@
+//------------------------------------------------------------------------------
+// parallel.tests.cpp
+//------------------------------------------------------------------------------
+
+#include "parallel.hpp"
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+TEST(Parallel, parallel_for_covers_every_index) {
+    std::vector<std::atomic<int>> hits(1000);
+
+    zippee::parallel_for(hits.size(), 4, [&](size_t i) { hits[i]++; });
+
+    for (auto& hit : hits) {
+        EXPECT_EQ(hit, 1);
+    }
+}
+
+TEST(Parallel, pool_runs_every_job) {
+    std::atomic<size_t> count{0};
+    zippee::WorkStealingPool pool(4);
+
+    for (size_t i = 0; i < 1000; i++) {
+        pool.submit([&] { count++; });
+    }
+    pool.wait();
+
+    EXPECT_EQ(count, 1000);
+}
+
+TEST(Parallel, pool_runs_jobs_submitted_by_jobs) {
+    std::atomic<size_t> count{0};
+    zippee::WorkStealingPool pool(3);
+
+    for (size_t i = 0; i < 10; i++) {
+        pool.submit([&] {
+            for (size_t j = 0; j < 100; j++) {
+                pool.submit([&] { count++; });
+            }
+        });
+    }
+    pool.wait();
+
+    EXPECT_EQ(count, 1000);
+}
+
+TEST(Parallel, pool_reusable_after_wait) {
+    std::atomic<size_t> count{0};
+    zippee::WorkStealingPool pool(2);
+
+    pool.submit([&] { count++; });
+    pool.wait();
+    pool.submit([&] { count++; });
+    pool.wait();
+
+    EXPECT_EQ(count, 2);
+}
+
+TEST(Parallel, pool_wait_rethrows) {
+    std::atomic<size_t> count{0};
+    zippee::WorkStealingPool pool(2);
+
+    pool.submit([] { throw std::runtime_error("job failed"); });
+    for (size_t i = 0; i < 10; i++) {
+        pool.submit([&] { count++; });
+    }
+
+    EXPECT_THROW(pool.wait(), std::runtime_error);
+    EXPECT_EQ(count, 10);
+    EXPECT_NO_THROW(pool.wait());
+}
@@ -0,0 +1,164 @@
+//------------------------------------------------------------------------------
+// perf.cpp
+//------------------------------------------------------------------------------
+
+#include "perf.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <format>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+    struct EventConfig {
+        uint32_t type;
+        uint64_t config;
+    };
+
+    constexpr uint64_t cache_miss(uint64_t cache) {
+        return cache
+            | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+            | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    }
+
+    constexpr std::array<EventConfig, zippee::PERF_EVENT_COUNT> EVENTS = {{
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        {PERF_TYPE_HW_CACHE, cache_miss(PERF_COUNT_HW_CACHE_L1D)},
+        {PERF_TYPE_HW_CACHE, cache_miss(PERF_COUNT_HW_CACHE_LL)},
+    }};
+
+    int open_event(const EventConfig& event) {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = event.type;
+        attr.config = event.config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+    }
+
+    std::string per_byte(std::optional<double> count, size_t bytes, double scale) {
+        if (!count || bytes == 0) {
+            return "-";
+        }
+        return std::format("{:.3f}", *count * scale / bytes);
+    }
+}
+
+std::string_view zippee::perf_event_name(PerfEvent event) {
+    switch (event) {
+        case PerfEvent::Cycles: return "cycles";
+        case PerfEvent::Instructions: return "instructions";
+        case PerfEvent::BranchMisses: return "branch-misses";
+        case PerfEvent::L1DMisses: return "L1D-misses";
+        case PerfEvent::LLCMisses: return "LLC-misses";
+    }
+    return "";
+}
+
+zippee::PerfSample& zippee::PerfSample::operator+=(const PerfSample& other) {
+    for (size_t i = 0; i < counts.size(); i++) {
+        if (counts[i] && other.counts[i]) {
+            *counts[i] += *other.counts[i];
+        } else if (!counts[i]) {
+            counts[i] = other.counts[i];
+        }
+    }
+    return *this;
+}
+
+zippee::PerfCounters::PerfCounters() {
+    _fds.fill(-1);
+    for (size_t i = 0; i < EVENTS.size(); i++) {
+        _fds[i] = open_event(EVENTS[i]);
+        if (_fds[i] < 0 && _error.empty()) {
+            _error = std::format("perf_event_open failed for {}: {}",
+                perf_event_name(static_cast<PerfEvent>(i)), std::strerror(errno));
+        }
+    }
+}
+
+zippee::PerfCounters::~PerfCounters() {
+    for (auto fd : _fds) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+}
+
+bool zippee::PerfCounters::available() const {
+    for (auto fd : _fds) {
+        if (fd >= 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+const std::string& zippee::PerfCounters::error() const {
+    return _error;
+}
+
+void zippee::PerfCounters::start() {
+    for (auto fd : _fds) {
+        if (fd >= 0) {
+            ::ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ::ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+void zippee::PerfCounters::stop() {
+    for (auto fd : _fds) {
+        if (fd >= 0) {
+            ::ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+}
+
+zippee::PerfSample zippee::PerfCounters::read() const {
+    PerfSample sample;
+    for (size_t i = 0; i < _fds.size(); i++) {
+        if (_fds[i] < 0) {
+            continue;
+        }
+
+        //value, time enabled, time running
+        std::array<uint64_t, 3> values{};
+        if (::read(_fds[i], values.data(), sizeof(values)) != sizeof(values) || values[2] == 0) {
+            continue;
+        }
+        sample.counts[i] = static_cast<double>(values[0]) * values[1] / values[2];
+    }
+    return sample;
+}
+
+std::string zippee::perf_header() {
+    return std::format("{:>10} {:>10} {:>10} {:>6} {:>10} {:>10} {:>10}",
+        "cyc/in B", "cyc/out B", "ins/out B", "IPC", "brmiss/KB", "L1Dmiss/KB", "LLCmiss/KB");
+}
+
+std::string zippee::perf_row(const PerfSample& sample, size_t input_bytes, size_t output_bytes) {
+    auto cycles = sample[PerfEvent::Cycles];
+    auto instructions = sample[PerfEvent::Instructions];
+    auto ipc = cycles && instructions && *cycles > 0
+        ? std::format("{:.2f}", *instructions / *cycles)
+        : std::string("-");
+
+    return std::format("{:>10} {:>10} {:>10} {:>6} {:>10} {:>10} {:>10}",
+        per_byte(cycles, input_bytes, 1),
+        per_byte(cycles, output_bytes, 1),
+        per_byte(instructions, output_bytes, 1),
+        ipc,
+        per_byte(sample[PerfEvent::BranchMisses], output_bytes, 1024),
+        per_byte(sample[PerfEvent::L1DMisses], output_bytes, 1024),
+        per_byte(sample[PerfEvent::LLCMisses], output_bytes, 1024));
+}
@@ -0,0 +1,69 @@
+//------------------------------------------------------------------------------
+// perf.hpp
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace zippee {
+
+enum class PerfEvent {
+    Cycles,
+    Instructions,
+    BranchMisses,
+    L1DMisses,
+    LLCMisses
+};
+
+constexpr size_t PERF_EVENT_COUNT = 5;
+
+std::string_view perf_event_name(PerfEvent event);
+
+// Counts for each event, or nothing where the event couldn't be counted.
+// Counts are scaled up for any time the kernel had the counter multiplexed
+// out.
+struct PerfSample {
+    std::array<std::optional<double>, PERF_EVENT_COUNT> counts;
+
+    std::optional<double> operator[](PerfEvent event) const {
+        return counts[static_cast<size_t>(event)];
+    }
+
+    PerfSample& operator+=(const PerfSample& other);
+};
+
+// Hardware counters for the calling thread, user space only, read through
+// perf_event_open. Each event is opened on its own so that one the CPU or
+// kernel refuses doesn't take the others with it; if none open, available()
+// is false and error() says why, and every sample is empty.
+class PerfCounters {
+private:
+    std::array<int, PERF_EVENT_COUNT> _fds;
+    std::string _error;
+
+public:
+    PerfCounters();
+    ~PerfCounters();
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool available() const;
+    const std::string& error() const;
+
+    // Zeroes and starts the counters.
+    void start();
+    void stop();
+    PerfSample read() const;
+};
+
+// Table of counts per byte of input and output, for printing.
+std::string perf_header();
+std::string perf_row(const PerfSample& sample, size_t input_bytes, size_t output_bytes);
+
+}
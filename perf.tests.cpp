@@ -0,0 +1,59 @@
+//------------------------------------------------------------------------------
+// perf.tests.cpp
+//------------------------------------------------------------------------------
+
+#include "perf.hpp"
+
+#include <gtest/gtest.h>
+
+TEST(Perf, counters_count_or_explain) {
+    zippee::PerfCounters counters;
+    counters.start();
+    volatile uint64_t sum = 0;
+    for (uint64_t i = 0; i < 100000; i++) {
+        sum = sum + i;
+    }
+    counters.stop();
+    auto sample = counters.read();
+
+    if (counters.available()) {
+        auto instructions = sample[zippee::PerfEvent::Instructions];
+        if (instructions) {
+            EXPECT_GT(*instructions, 100000);
+        }
+    } else {
+        EXPECT_FALSE(counters.error().empty());
+        for (auto& count : sample.counts) {
+            EXPECT_FALSE(count.has_value());
+        }
+    }
+}
+
+TEST(Perf, sample_sums_available_counts) {
+    zippee::PerfSample a;
+    a.counts[0] = 10;
+    zippee::PerfSample b;
+    b.counts[0] = 5;
+    b.counts[1] = 7;
+
+    a += b;
+
+    EXPECT_EQ(a[zippee::PerfEvent::Cycles], 15);
+    EXPECT_EQ(a[zippee::PerfEvent::Instructions], 7);
+    EXPECT_FALSE(a[zippee::PerfEvent::LLCMisses].has_value());
+}
+
+TEST(Perf, row_per_byte) {
+    zippee::PerfSample sample;
+    sample.counts[static_cast<size_t>(zippee::PerfEvent::Cycles)] = 2000;
+    sample.counts[static_cast<size_t>(zippee::PerfEvent::Instructions)] = 4000;
+    sample.counts[static_cast<size_t>(zippee::PerfEvent::BranchMisses)] = 10;
+
+    auto row = zippee::perf_row(sample, 1000, 2000);
+
+    EXPECT_NE(row.find("2.000"), std::string::npos); //cycles per input byte
+    EXPECT_NE(row.find("1.000"), std::string::npos); //cycles per output byte
+    EXPECT_NE(row.find("2.00"), std::string::npos); //instructions per cycle
+    EXPECT_NE(row.find("5.120"), std::string::npos); //branch misses per KB out
+    EXPECT_NE(row.find("-"), std::string::npos); //cache misses not counted
+}
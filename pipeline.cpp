@@ -0,0 +1,90 @@
+//------------------------------------------------------------------------------
+// pipeline.cpp
+//------------------------------------------------------------------------------
+
+#include "pipeline.hpp"
+
+namespace {
+    thread_local zippee::Executor* current_executor = nullptr;
+}
+
+zippee::Executor::Executor()
+    : _thread([this] { run(); }) {
+}
+
+zippee::Executor::~Executor() {
+    {
+        std::lock_guard lock(_mutex);
+        _stopping = true;
+    }
+    _ready_cv.notify_one();
+    _thread.join();
+}
+
+void zippee::Executor::run() {
+    current_executor = this;
+
+    while (true) {
+        std::coroutine_handle<> handle;
+        {
+            std::unique_lock lock(_mutex);
+            _ready_cv.wait(lock, [this] { return _stopping || !_ready.empty(); });
+            if (_ready.empty()) {
+                return;
+            }
+            handle = _ready.front();
+            _ready.pop_front();
+        }
+        handle.resume();
+    }
+}
+
+void zippee::Executor::post(std::coroutine_handle<> handle) {
+    {
+        std::lock_guard lock(_mutex);
+        _ready.push_back(handle);
+    }
+    _ready_cv.notify_one();
+}
+
+zippee::Executor* zippee::Executor::current() {
+    return current_executor;
+}
+
+zippee::Task::promise_type::~promise_type() {
+    //the frame is destroyed as the coroutine finishes, so report completion here
+    if (exception) {
+        completion.set_exception(exception);
+    } else {
+        completion.set_value();
+    }
+}
+
+zippee::Task zippee::Task::promise_type::get_return_object() {
+    return Task(std::coroutine_handle<promise_type>::from_promise(*this), completion.get_future());
+}
+
+zippee::Task::Task(std::coroutine_handle<promise_type> handle, std::future<void> completion)
+    : _handle(handle)
+    , _completion(std::move(completion)) {
+}
+
+zippee::Task::Task(Task&& other)
+    : _handle(std::exchange(other._handle, nullptr))
+    , _completion(std::move(other._completion)) {
+}
+
+zippee::Task::~Task() {
+    //never started, so never ran to completion and destroyed itself
+    if (_handle) {
+        _handle.destroy();
+    }
+}
+
+void zippee::Task::start(Executor& executor) {
+    executor.post(std::exchange(_handle, nullptr));
+}
+
+void zippee::Task::wait() {
+    _completion.get();
+}
@@ -0,0 +1,290 @@
+//------------------------------------------------------------------------------
+// pipeline.hpp
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "perf.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+
+// Coroutine stages connected by bounded channels. Each stage runs on its own
+// Executor thread; a stage that pushes to a full channel or pops from an
+// empty one is suspended until the other side makes progress, so the number
+// of items in flight never exceeds the channel capacities.
+namespace zippee {
+
+// Resumes coroutines, one at a time, on a dedicated thread. Channels must be
+// awaited from coroutines running on an executor, which is where they are
+// resumed.
+class Executor {
+private:
+    std::mutex _mutex;
+    std::condition_variable _ready_cv;
+    std::deque<std::coroutine_handle<>> _ready;
+    bool _stopping = false;
+    std::thread _thread;
+
+    void run();
+
+public:
+    Executor();
+    ~Executor();
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+
+    void post(std::coroutine_handle<> handle);
+
+    // The executor running on this thread, or nullptr.
+    static Executor* current();
+};
+
+// A coroutine that starts suspended. start() hands it to an executor, and
+// wait() blocks until it completes, rethrowing anything it threw.
+class Task {
+public:
+    struct promise_type {
+        std::promise<void> completion;
+        std::exception_ptr exception;
+
+        ~promise_type();
+
+        Task get_return_object();
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { exception = std::current_exception(); }
+    };
+
+private:
+    std::coroutine_handle<promise_type> _handle;
+    std::future<void> _completion;
+
+    Task(std::coroutine_handle<promise_type> handle, std::future<void> completion);
+
+public:
+    Task(Task&& other);
+    Task& operator=(Task&& other) = delete;
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task();
+
+    void start(Executor& executor);
+    void wait();
+};
+
+// Time a stage spent working, waiting for input and waiting for room to
+// output. Waits are only counted when the stage was actually suspended.
+// With count_events set, hardware counters are also read for the stage's
+// thread between start() and finish(), which must both run on it.
+struct StageMetrics {
+    using Clock = std::chrono::steady_clock;
+
+    std::string name;
+    size_t items = 0;
+    Clock::time_point started;
+    Clock::duration busy{};
+    Clock::duration starved{};
+    Clock::duration blocked{};
+
+    bool count_events = false;
+    std::unique_ptr<PerfCounters> counters;
+    PerfSample events;
+
+    void start() {
+        if (count_events) {
+            counters = std::make_unique<PerfCounters>();
+            counters->start();
+        }
+        started = Clock::now();
+    }
+
+    // Whatever time wasn't spent waiting was spent working.
+    void finish() {
+        busy = Clock::now() - started - starved - blocked;
+        if (counters) {
+            counters->stop();
+            events = counters->read();
+        }
+    }
+
+    template<typename Awaitable>
+    struct Timed {
+        Awaitable inner;
+        Clock::duration& total;
+        std::optional<Clock::time_point> suspended;
+
+        bool await_ready() { return inner.await_ready(); }
+
+        bool await_suspend(std::coroutine_handle<> handle) {
+            suspended = Clock::now();
+            return inner.await_suspend(handle);
+        }
+
+        auto await_resume() {
+            if (suspended) {
+                total += Clock::now() - *suspended;
+            }
+            return inner.await_resume();
+        }
+    };
+
+    template<typename Awaitable>
+    Timed<Awaitable> wait_input(Awaitable&& awaitable) {
+        return {std::forward<Awaitable>(awaitable), starved, std::nullopt};
+    }
+
+    template<typename Awaitable>
+    Timed<Awaitable> wait_output(Awaitable&& awaitable) {
+        return {std::forward<Awaitable>(awaitable), blocked, std::nullopt};
+    }
+};
+
+// Bounded single producer, single consumer queue between two stages. Either
+// side may close it: the consumer then drains what remains, and a producer
+// pushing to a closed channel has its item dropped.
+template<typename T>
+class Channel {
+private:
+    struct Waiter {
+        std::coroutine_handle<> handle;
+        Executor* executor;
+        T* value = nullptr;
+        bool* accepted = nullptr;
+    };
+
+    std::mutex _mutex;
+    std::deque<T> _items;
+    size_t _capacity;
+    bool _closed = false;
+    std::optional<Waiter> _consumer;
+    std::optional<Waiter> _producer;
+    size_t _max_depth = 0;
+
+    static void resume(const std::optional<Waiter>& waiter) {
+        if (waiter) {
+            waiter->executor->post(waiter->handle);
+        }
+    }
+
+public:
+    explicit Channel(size_t capacity)
+        : _capacity(std::max<size_t>(capacity, 1)) {
+    }
+
+    struct PushAwaiter {
+        Channel& channel;
+        T value;
+        bool accepted = true;
+
+        bool await_ready() { return false; }
+
+        bool await_suspend(std::coroutine_handle<> handle) {
+            std::optional<Waiter> consumer;
+            {
+                std::lock_guard lock(channel._mutex);
+                if (channel._closed) {
+                    accepted = false;
+                    return false;
+                }
+                if (channel._items.size() >= channel._capacity) {
+                    channel._producer = Waiter{handle, Executor::current(), &value, &accepted};
+                    return true;
+                }
+                channel._items.push_back(std::move(value));
+                channel._max_depth = std::max(channel._max_depth, channel._items.size());
+                consumer = std::exchange(channel._consumer, std::nullopt);
+            }
+            resume(consumer);
+            return false;
+        }
+
+        // False if the channel was closed and the value dropped.
+        bool await_resume() { return accepted; }
+    };
+
+    struct PopAwaiter {
+        Channel& channel;
+
+        bool await_ready() { return false; }
+
+        bool await_suspend(std::coroutine_handle<> handle) {
+            std::lock_guard lock(channel._mutex);
+            if (!channel._items.empty() || channel._closed) {
+                return false;
+            }
+            channel._consumer = Waiter{handle, Executor::current()};
+            return true;
+        }
+
+        // Empty once the channel is closed and drained.
+        std::optional<T> await_resume() {
+            std::optional<Waiter> producer;
+            std::optional<T> item;
+            {
+                std::lock_guard lock(channel._mutex);
+                if (channel._items.empty()) {
+                    return std::nullopt;
+                }
+                item = std::move(channel._items.front());
+                channel._items.pop_front();
+
+                //hand the blocked producer's value over in its place
+                producer = std::exchange(channel._producer, std::nullopt);
+                if (producer) {
+                    channel._items.push_back(std::move(*producer->value));
+                }
+            }
+            resume(producer);
+            return item;
+        }
+    };
+
+    PushAwaiter push(T value) {
+        return {*this, std::move(value)};
+    }
+
+    PopAwaiter pop() {
+        return {*this};
+    }
+
+    void close() {
+        std::optional<Waiter> consumer;
+        std::optional<Waiter> producer;
+        {
+            std::lock_guard lock(_mutex);
+            _closed = true;
+            consumer = std::exchange(_consumer, std::nullopt);
+            producer = std::exchange(_producer, std::nullopt);
+            if (producer) {
+                *producer->accepted = false;
+            }
+        }
+        resume(consumer);
+        resume(producer);
+    }
+
+    size_t capacity() const {
+        return _capacity;
+    }
+
+    size_t max_depth() {
+        std::lock_guard lock(_mutex);
+        return _max_depth;
+    }
+};
+
+}
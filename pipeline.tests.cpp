@@ -0,0 +1,128 @@
+//------------------------------------------------------------------------------
+// pipeline.tests.cpp
+//------------------------------------------------------------------------------
+
+#include "pipeline.hpp"
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+zippee::Task produce(size_t count, zippee::Channel<size_t>& output, zippee::StageMetrics& metrics) {
+    metrics.start();
+    for (size_t i = 0; i < count; i++) {
+        if (!co_await metrics.wait_output(output.push(i))) {
+            break;
+        }
+        metrics.items++;
+    }
+    output.close();
+    metrics.finish();
+}
+
+zippee::Task consume(zippee::Channel<size_t>& input, std::vector<size_t>& received, zippee::StageMetrics& metrics) {
+    metrics.start();
+    while (auto item = co_await metrics.wait_input(input.pop())) {
+        received.push_back(*item);
+        metrics.items++;
+    }
+    metrics.finish();
+}
+
+zippee::Task consume_some(zippee::Channel<size_t>& input, size_t count, std::vector<size_t>& received) {
+    while (received.size() < count) {
+        auto item = co_await input.pop();
+        if (!item) {
+            break;
+        }
+        received.push_back(*item);
+    }
+    input.close();
+}
+
+zippee::Task fail() {
+    throw std::runtime_error("stage failed");
+    co_return;
+}
+
+}
+
+TEST(Pipeline, channel_keeps_order_under_backpressure) {
+    zippee::Channel<size_t> channel(2);
+    zippee::StageMetrics producer_metrics{"produce"};
+    zippee::StageMetrics consumer_metrics{"consume"};
+    std::vector<size_t> received;
+
+    {
+        zippee::Executor producer_executor;
+        zippee::Executor consumer_executor;
+        auto producer = produce(1000, channel, producer_metrics);
+        auto consumer = consume(channel, received, consumer_metrics);
+        producer.start(producer_executor);
+        consumer.start(consumer_executor);
+        producer.wait();
+        consumer.wait();
+    }
+
+    ASSERT_EQ(received.size(), 1000);
+    for (size_t i = 0; i < received.size(); i++) {
+        EXPECT_EQ(received[i], i);
+    }
+    EXPECT_LE(channel.max_depth(), 2);
+    EXPECT_EQ(producer_metrics.items, 1000);
+    EXPECT_EQ(consumer_metrics.items, 1000);
+}
+
+TEST(Pipeline, consumer_closing_releases_producer) {
+    zippee::Channel<size_t> channel(1);
+    zippee::StageMetrics producer_metrics{"produce"};
+    std::vector<size_t> received;
+
+    {
+        zippee::Executor producer_executor;
+        zippee::Executor consumer_executor;
+        auto producer = produce(1000, channel, producer_metrics);
+        auto consumer = consume_some(channel, 10, received);
+        producer.start(producer_executor);
+        consumer.start(consumer_executor);
+        consumer.wait();
+        producer.wait();
+    }
+
+    EXPECT_EQ(received.size(), 10);
+    EXPECT_LT(producer_metrics.items, 1000);
+}
+
+TEST(Pipeline, same_executor) {
+    zippee::Channel<size_t> channel(3);
+    zippee::StageMetrics producer_metrics{"produce"};
+    zippee::StageMetrics consumer_metrics{"consume"};
+    std::vector<size_t> received;
+
+    {
+        zippee::Executor executor;
+        auto producer = produce(100, channel, producer_metrics);
+        auto consumer = consume(channel, received, consumer_metrics);
+        consumer.start(executor);
+        producer.start(executor);
+        producer.wait();
+        consumer.wait();
+    }
+
+    EXPECT_EQ(received.size(), 100);
+}
+
+TEST(Pipeline, task_rethrows) {
+    zippee::Executor executor;
+    auto task = fail();
+    task.start(executor);
+    EXPECT_THROW(task.wait(), std::runtime_error);
+}
+
+TEST(Pipeline, task_never_started) {
+    auto task = fail();
+}
@@ -0,0 +1,445 @@
+//------------------------------------------------------------------------------
+// server.cpp
+//------------------------------------------------------------------------------
+
+#include "server.hpp"
+#include "io.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <format>
+#include <future>
+#include <limits>
+#include <optional>
+#include <thread>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+    // a request longer than this is refused and its connection closed
+    constexpr size_t MAX_REQUEST = 64 * 1024;
+
+    std::expected<sockaddr_un, std::string> socket_address(const std::string& path) {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path)) {
+            return std::unexpected(std::format("Socket path {} is too long.", path));
+        }
+        std::memcpy(address.sun_path, path.data(), path.size());
+        return address;
+    }
+
+    bool send_all(int fd, std::span<const std::byte> data) {
+        while (!data.empty()) {
+            auto sent = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+            if (sent < 0 && errno == EINTR) {
+                continue;
+            }
+            if (sent <= 0) {
+                return false;
+            }
+            data = data.subspan(sent);
+        }
+        return true;
+    }
+
+    bool send_all(int fd, std::string_view text) {
+        return send_all(fd, std::as_bytes(std::span{text}));
+    }
+
+    std::vector<std::string_view> split_fields(std::string_view line) {
+        std::vector<std::string_view> fields;
+        while (true) {
+            auto tab = line.find('\t');
+            fields.push_back(line.substr(0, tab));
+            if (tab == std::string_view::npos) {
+                return fields;
+            }
+            line.remove_prefix(tab + 1);
+        }
+    }
+
+    std::optional<uint64_t> parse_number(std::string_view text) {
+        uint64_t value;
+        auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+        if (error != std::errc{} || end != text.data() + text.size()) {
+            return std::nullopt;
+        }
+        return value;
+    }
+
+    std::string describe_entry(const zip::CentralDirectoryHeader& h) {
+        return std::format("{}\t{}\t{}\t{}\t{}\n",
+            h.file_name, h.compression_method, h.compressed_size, h.uncompressed_size, h.crc_32);
+    }
+}
+
+zippee::Server::Server(std::string path, int listener, int wake, size_t threads)
+    : _path(std::move(path))
+    , _listener(listener)
+    , _wake(wake)
+    , _pool(std::make_unique<WorkStealingPool>(threads)) {
+}
+
+std::expected<std::unique_ptr<zippee::Server>, std::string> zippee::Server::open(
+    const std::string& socket_path,
+    std::span<const std::string> archives,
+    const ServerOptions& options) {
+    auto address = socket_address(socket_path);
+    if (!address) {
+        return std::unexpected(address.error());
+    }
+
+    std::unordered_map<std::string, std::unique_ptr<zip::Archive>> opened;
+    for (auto& path : archives) {
+        auto archive = zip::Archive::open(path, {.pread = options.pread, .cache_bytes = options.cache_bytes});
+        if (!archive) {
+            return std::unexpected(std::format("Unable to open {}: {}", path, archive.error()));
+        }
+        opened[path] = std::move(*archive);
+    }
+
+    int listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0) {
+        return std::unexpected(std::format("Unable to create socket: {}", std::strerror(errno)));
+    }
+    ::unlink(socket_path.c_str());
+    if (::bind(listener, reinterpret_cast<const sockaddr*>(&*address), sizeof(*address)) != 0
+        || ::listen(listener, SOMAXCONN) != 0) {
+        auto error = std::format("Unable to listen on {}: {}", socket_path, std::strerror(errno));
+        ::close(listener);
+        return std::unexpected(error);
+    }
+
+    int wake = ::eventfd(0, EFD_CLOEXEC);
+    if (wake < 0) {
+        auto error = std::format("Unable to create eventfd: {}", std::strerror(errno));
+        ::close(listener);
+        ::unlink(socket_path.c_str());
+        return std::unexpected(error);
+    }
+
+    auto server = std::unique_ptr<Server>(new Server(socket_path, listener, wake, options.threads));
+    server->_archives = std::move(opened);
+    return server;
+}
+
+zippee::Server::~Server() {
+    ::close(_listener);
+    ::close(_wake);
+    ::unlink(_path.c_str());
+}
+
+void zippee::Server::run() {
+    while (true) {
+        std::array<pollfd, 2> fds{{{_listener, POLLIN, 0}, {_wake, POLLIN, 0}}};
+        if (::poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (fds[1].revents != 0) {
+            break;
+        }
+
+        int fd = ::accept4(_listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        _connection_count++;
+        {
+            std::lock_guard lock(_mutex);
+            _connections.insert(fd);
+        }
+        std::thread([this, fd] { serve_connection(fd); }).detach();
+    }
+
+    //replies under way are finished, and then the connections see their end
+    std::unique_lock lock(_mutex);
+    for (int fd : _connections) {
+        ::shutdown(fd, SHUT_RD);
+    }
+    _closed.wait(lock, [this] { return _connections.empty(); });
+}
+
+void zippee::Server::stop() {
+    uint64_t one = 1;
+    [[maybe_unused]] auto written = ::write(_wake, &one, sizeof(one));
+}
+
+zippee::ServerStats zippee::Server::stats() const {
+    return {
+        .connections = _connection_count,
+        .requests = _requests,
+        .errors = _errors,
+        .bytes_sent = _bytes_sent,
+        .bytes_sendfile = _bytes_sendfile,
+    };
+}
+
+void zippee::Server::serve_connection(int fd) {
+    std::string pending;
+    std::array<char, 4096> chunk;
+    while (true) {
+        auto newline = pending.find('\n');
+        if (newline == std::string::npos) {
+            if (pending.size() > MAX_REQUEST) {
+                reply_error(fd, "Request too long.");
+                break;
+            }
+            auto got = ::recv(fd, chunk.data(), chunk.size(), 0);
+            if (got < 0 && errno == EINTR) {
+                continue;
+            }
+            if (got <= 0) {
+                break;
+            }
+            pending.append(chunk.data(), got);
+            continue;
+        }
+
+        auto line = std::string_view(pending).substr(0, newline);
+        bool served = serve_request(fd, line);
+        pending.erase(0, newline + 1);
+        if (!served) {
+            break;
+        }
+    }
+
+    std::lock_guard lock(_mutex);
+    _connections.erase(fd);
+    ::close(fd);
+    _closed.notify_all();
+}
+
+bool zippee::Server::serve_request(int fd, std::string_view line) {
+    _requests++;
+    auto fields = split_fields(line);
+    auto& command = fields[0];
+    if (command != "list" && command != "stat" && command != "read") {
+        return reply_error(fd, std::format("Unknown request {}.", command));
+    }
+    auto valid = command == "list" ? fields.size() == 2
+        : command == "stat" ? fields.size() == 3
+        : fields.size() == 3 || fields.size() == 5;
+    if (!valid) {
+        return reply_error(fd, std::format("Wrong number of fields for {}.", command));
+    }
+
+    auto found = _archives.find(std::string(fields[1]));
+    if (found == _archives.end()) {
+        return reply_error(fd, std::format("No archive named {}.", fields[1]));
+    }
+    auto& archive = *found->second;
+
+    if (command == "list") {
+        std::string body;
+        for (auto& h : archive.entries()) {
+            body += describe_entry(h);
+        }
+        return reply(fd, std::as_bytes(std::span{body}));
+    }
+
+    auto index = archive.find(fields[2]);
+    if (!index) {
+        return reply_error(fd, std::format("No entry named {}.", fields[2]));
+    }
+    auto& h = archive.entries()[*index];
+
+    if (command == "stat") {
+        auto body = describe_entry(h);
+        return reply(fd, std::as_bytes(std::span{body}));
+    }
+
+    std::optional<std::pair<uint64_t, uint64_t>> range;
+    if (fields.size() == 5) {
+        auto offset = parse_number(fields[3]);
+        auto length = parse_number(fields[4]);
+        if (!offset || !length) {
+            return reply_error(fd, "Invalid range.");
+        }
+        range = {*offset, *length};
+    }
+
+    if (h.compression_method == 0 && archive.source().fd() >= 0) {
+        auto [offset, length] = range.value_or(std::pair{uint64_t{0}, std::numeric_limits<uint64_t>::max()});
+        return reply_stored(fd, archive, h, offset, length);
+    }
+
+    auto task = std::make_shared<std::packaged_task<std::expected<zip::EntryContents, std::string>()>>(
+        [&archive, index = *index, range]() -> std::expected<zip::EntryContents, std::string> {
+            if (!range) {
+                return archive.read(index);
+            }
+            auto part = archive.read_range(index, range->first, range->second);
+            if (!part) {
+                return std::unexpected(part.error());
+            }
+            return std::make_shared<const std::vector<std::byte>>(std::move(*part));
+        });
+    auto contents = task->get_future();
+    _pool->submit([task] { (*task)(); });
+
+    auto result = contents.get();
+    if (!result) {
+        return reply_error(fd, result.error());
+    }
+    return reply(fd, **result);
+}
+
+bool zippee::Server::reply(int fd, std::span<const std::byte> body) {
+    _bytes_sent += body.size();
+    return send_all(fd, std::format("ok {}\n", body.size())) && send_all(fd, body);
+}
+
+bool zippee::Server::reply_error(int fd, std::string_view message) {
+    _errors++;
+    auto line = std::format("error {}\n", message);
+    std::ranges::replace(line.begin(), line.end() - 1, '\n', ' ');
+    return send_all(fd, line);
+}
+
+bool zippee::Server::reply_stored(int fd, const zip::Archive& archive, const zip::CentralDirectoryHeader& h, uint64_t offset, uint64_t length) {
+    auto location = zip::locate_entry_data(archive.source(), h);
+    if (!location) {
+        return reply_error(fd, location.error());
+    }
+
+    uint64_t first = std::min<uint64_t>(offset, h.compressed_size);
+    uint64_t last = first + std::min<uint64_t>(length, h.compressed_size - first);
+    if (!send_all(fd, std::format("ok {}\n", last - first))) {
+        return false;
+    }
+    _bytes_sent += last - first;
+    _bytes_sendfile += last - first;
+    //once the header has gone, a failure can only end the connection
+    return sendfile_range(archive.source().fd(), location->offset + first, last - first, fd).has_value();
+}
+
+zippee::Client::Client(int fd)
+    : _fd(fd) {
+}
+
+zippee::Client::~Client() {
+    ::close(_fd);
+}
+
+std::expected<std::unique_ptr<zippee::Client>, std::string> zippee::Client::connect(const std::string& socket_path) {
+    auto address = socket_address(socket_path);
+    if (!address) {
+        return std::unexpected(address.error());
+    }
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return std::unexpected(std::format("Unable to create socket: {}", std::strerror(errno)));
+    }
+    if (::connect(fd, reinterpret_cast<const sockaddr*>(&*address), sizeof(*address)) != 0) {
+        auto error = std::format("Unable to connect to {}: {}", socket_path, std::strerror(errno));
+        ::close(fd);
+        return std::unexpected(error);
+    }
+    return std::unique_ptr<Client>(new Client(fd));
+}
+
+std::expected<std::string, std::string> zippee::Client::read_line() {
+    size_t scanned = 0;
+    while (true) {
+        auto newline = std::find(_pending.begin() + scanned, _pending.end(), std::byte{'\n'});
+        if (newline != _pending.end()) {
+            std::string line(reinterpret_cast<const char*>(_pending.data()), newline - _pending.begin());
+            _pending.erase(_pending.begin(), newline + 1);
+            return line;
+        }
+        scanned = _pending.size();
+
+        std::array<std::byte, 4096> chunk;
+        auto got = ::recv(_fd, chunk.data(), chunk.size(), 0);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return std::unexpected("Connection closed by the server.");
+        }
+        _pending.insert(_pending.end(), chunk.begin(), chunk.begin() + got);
+    }
+}
+
+std::expected<void, std::string> zippee::Client::read_exact(std::span<std::byte> output) {
+    auto buffered = std::min(output.size(), _pending.size());
+    std::memcpy(output.data(), _pending.data(), buffered);
+    _pending.erase(_pending.begin(), _pending.begin() + buffered);
+    output = output.subspan(buffered);
+
+    while (!output.empty()) {
+        auto got = ::recv(_fd, output.data(), output.size(), 0);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return std::unexpected("Connection closed by the server.");
+        }
+        output = output.subspan(got);
+    }
+    return {};
+}
+
+std::expected<std::vector<std::byte>, std::string> zippee::Client::request(std::span<const std::string> fields) {
+    std::string line;
+    for (auto& field : fields) {
+        if (field.find_first_of("\t\n") != std::string::npos) {
+            return std::unexpected("Request fields can't hold tabs or newlines.");
+        }
+        line += line.empty() ? field : "\t" + field;
+    }
+    line += '\n';
+    if (!send_all(_fd, line)) {
+        return std::unexpected(std::format("Unable to send request: {}", std::strerror(errno)));
+    }
+
+    auto header = read_line();
+    if (!header) {
+        return std::unexpected(header.error());
+    }
+    if (header->starts_with("error ")) {
+        return std::unexpected(header->substr(6));
+    }
+    auto size = header->starts_with("ok ") ? parse_number(std::string_view(*header).substr(3)) : std::nullopt;
+    if (!size) {
+        return std::unexpected(std::format("Unexpected reply: {}", *header));
+    }
+
+    std::vector<std::byte> body(*size);
+    if (auto read = read_exact(body); !read) {
+        return std::unexpected(read.error());
+    }
+    return body;
+}
+
+std::expected<std::vector<std::byte>, std::string> zippee::Client::list(const std::string& archive) {
+    std::array fields{std::string("list"), archive};
+    return request(fields);
+}
+
+std::expected<std::vector<std::byte>, std::string> zippee::Client::stat(const std::string& archive, const std::string& entry) {
+    std::array fields{std::string("stat"), archive, entry};
+    return request(fields);
+}
+
+std::expected<std::vector<std::byte>, std::string> zippee::Client::read(const std::string& archive, const std::string& entry) {
+    std::array fields{std::string("read"), archive, entry};
+    return request(fields);
+}
+
+std::expected<std::vector<std::byte>, std::string> zippee::Client::read(const std::string& archive, const std::string& entry, uint64_t offset, uint64_t length) {
+    std::array fields{std::string("read"), archive, entry, std::to_string(offset), std::to_string(length)};
+    return request(fields);
+}
@@ -0,0 +1,137 @@
+//------------------------------------------------------------------------------
+// server.hpp
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "archive.hpp"
+#include "parallel.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Serving entries of a fixed set of archives to other processes over a Unix
+// domain socket, so that opening an archive and reading its directory is paid
+// for once rather than on every request.
+//
+// A request is one line of fields separated by tabs:
+//
+//     list  ARCHIVE
+//     stat  ARCHIVE ENTRY
+//     read  ARCHIVE ENTRY [OFFSET LENGTH]
+//
+// naming an archive as it was given to the server. Each reply starts with a
+// line, either "ok SIZE" followed by SIZE bytes of body, or "error MESSAGE".
+// list and stat reply with a line for each entry of its name, compression
+// method, compressed and uncompressed size and CRC-32, separated by tabs;
+// read replies with the entry's contents, or just the range of them asked
+// for. A connection makes any number of requests, one after another.
+namespace zippee {
+    struct ServerOptions {
+        // workers decompressing entries, shared by every connection
+        size_t threads = 1;
+        // bytes of decompressed entries each archive keeps; see zip::Archive
+        size_t cache_bytes = 0;
+        bool pread = false;
+    };
+
+    struct ServerStats {
+        size_t connections = 0;
+        size_t requests = 0;
+        size_t errors = 0;
+        size_t bytes_sent = 0;
+        // of bytes_sent, those the kernel sent straight from an archive
+        size_t bytes_sendfile = 0;
+    };
+
+    // Each connection is served by a thread of its own, which only parses
+    // requests and sends replies. Stored entries are sent from the archive
+    // with sendfile, unchecked, as the data never passes through the server;
+    // everything that needs decompressing is handed to the worker pool.
+    class Server {
+    private:
+        std::string _path;
+        int _listener;
+        int _wake;
+        std::unordered_map<std::string, std::unique_ptr<zip::Archive>> _archives;
+        std::unique_ptr<WorkStealingPool> _pool;
+
+        std::mutex _mutex;
+        std::condition_variable _closed;
+        std::unordered_set<int> _connections;
+
+        std::atomic<size_t> _connection_count{0};
+        std::atomic<size_t> _requests{0};
+        std::atomic<size_t> _errors{0};
+        std::atomic<size_t> _bytes_sent{0};
+        std::atomic<size_t> _bytes_sendfile{0};
+
+        Server(std::string path, int listener, int wake, size_t threads);
+
+        void serve_connection(int fd);
+        // Replies to one request; false if the reply couldn't be sent.
+        bool serve_request(int fd, std::string_view line);
+        bool reply(int fd, std::span<const std::byte> body);
+        bool reply_error(int fd, std::string_view message);
+        bool reply_stored(int fd, const zip::Archive& archive, const zip::CentralDirectoryHeader& h, uint64_t offset, uint64_t length);
+
+    public:
+        // Listens on socket_path, replacing any socket left there, once every
+        // archive has been opened.
+        static std::expected<std::unique_ptr<Server>, std::string> open(
+            const std::string& socket_path,
+            std::span<const std::string> archives,
+            const ServerOptions& options);
+
+        ~Server();
+        Server(const Server&) = delete;
+        Server& operator=(const Server&) = delete;
+
+        // Serves connections until stopped, then closes them, waiting for
+        // the requests under way to be answered.
+        void run();
+        // Safe to call from a signal handler.
+        void stop();
+
+        ServerStats stats() const;
+    };
+
+    // One connection to a Server. Requests are made one at a time; each thread
+    // needs its own client.
+    class Client {
+    private:
+        int _fd;
+        std::vector<std::byte> _pending;
+
+        explicit Client(int fd);
+
+        std::expected<std::string, std::string> read_line();
+        std::expected<void, std::string> read_exact(std::span<std::byte> output);
+
+    public:
+        static std::expected<std::unique_ptr<Client>, std::string> connect(const std::string& socket_path);
+
+        ~Client();
+        Client(const Client&) = delete;
+        Client& operator=(const Client&) = delete;
+
+        // The body of the reply to a request of these fields, or the error
+        // the server gave.
+        std::expected<std::vector<std::byte>, std::string> request(std::span<const std::string> fields);
+
+        std::expected<std::vector<std::byte>, std::string> list(const std::string& archive);
+        std::expected<std::vector<std::byte>, std::string> stat(const std::string& archive, const std::string& entry);
+        std::expected<std::vector<std::byte>, std::string> read(const std::string& archive, const std::string& entry);
+        std::expected<std::vector<std::byte>, std::string> read(const std::string& archive, const std::string& entry, uint64_t offset, uint64_t length);
+    };
+}
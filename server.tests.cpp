@@ -0,0 +1,144 @@
+//------------------------------------------------------------------------------
+// server.tests.cpp
+//------------------------------------------------------------------------------
+
+#include "server.hpp"
+#include "crc32.hpp"
+#include "test_archive.hpp"
+
+#include <format>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+using test::to_bytes;
+
+std::string as_string(const std::vector<std::byte>& bytes) {
+    return std::string(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+}
+
+std::string repeated(const std::string& word, size_t count) {
+    std::string s;
+    for (size_t i = 0; i < count; i++) {
+        s += word + std::to_string(i % 97) + ' ';
+    }
+    return s;
+}
+
+// An archive of "stored.txt" and "deflated.txt", written to a file.
+std::string write_archive(const std::string& name, const std::string& stored, const std::string& deflated) {
+    return test::write_temp_file(name, test::make_archive({{"stored.txt", stored}, {"deflated.txt", deflated, 8}}));
+}
+
+}
+
+TEST(Server, serves_list_stat_and_read) {
+    auto stored = std::string("stored contents");
+    auto deflated = repeated("deflated", 3000);
+    auto archive = write_archive("server_archive.zip", stored, deflated);
+    auto socket_path = testing::TempDir() + "server_test.sock";
+    std::vector<std::string> archives{archive};
+
+    auto server = zippee::Server::open(socket_path, archives, {.threads = 2, .cache_bytes = 1 << 20});
+    ASSERT_TRUE(server.has_value()) << server.error();
+    std::thread running([&] { (*server)->run(); });
+
+    auto client = zippee::Client::connect(socket_path);
+    ASSERT_TRUE(client.has_value()) << client.error();
+    auto& c = **client;
+
+    auto listing = c.list(archive);
+    ASSERT_TRUE(listing.has_value()) << listing.error();
+    EXPECT_TRUE(as_string(*listing).starts_with(std::format("stored.txt\t0\t15\t15\t{}\n", zip::crc32(to_bytes(stored)))));
+    EXPECT_NE(as_string(*listing).find("\ndeflated.txt\t8\t"), std::string::npos);
+
+    auto stat = c.stat(archive, "deflated.txt");
+    ASSERT_TRUE(stat.has_value()) << stat.error();
+    EXPECT_TRUE(as_string(*stat).ends_with(std::format("\t{}\t{}\n", deflated.size(), zip::crc32(to_bytes(deflated)))));
+
+    //twice each, the second read of the deflated entry from the cache
+    for (int i = 0; i < 2; i++) {
+        auto read_stored = c.read(archive, "stored.txt");
+        ASSERT_TRUE(read_stored.has_value()) << read_stored.error();
+        EXPECT_EQ(as_string(*read_stored), stored);
+
+        auto read_deflated = c.read(archive, "deflated.txt");
+        ASSERT_TRUE(read_deflated.has_value()) << read_deflated.error();
+        EXPECT_EQ(as_string(*read_deflated), deflated);
+    }
+
+    EXPECT_EQ(as_string(*c.read(archive, "stored.txt", 7, 4)), "cont");
+    EXPECT_EQ(as_string(*c.read(archive, "stored.txt", 7, 100)), "contents");
+    EXPECT_EQ(as_string(*c.read(archive, "stored.txt", 100, 4)), "");
+    EXPECT_EQ(as_string(*c.read(archive, "deflated.txt", 5000, 300)), deflated.substr(5000, 300));
+
+    EXPECT_EQ(c.read("missing.zip", "stored.txt").error(), "No archive named missing.zip.");
+    EXPECT_EQ(c.read(archive, "missing.txt").error(), "No entry named missing.txt.");
+    std::array unknown{std::string("delete"), archive};
+    EXPECT_EQ(c.request(unknown).error(), "Unknown request delete.");
+    std::array bad_range{std::string("read"), archive, std::string("stored.txt"), std::string("x"), std::string("1")};
+    EXPECT_EQ(c.request(bad_range).error(), "Invalid range.");
+    EXPECT_FALSE(c.read(archive, "stored\t.txt"));
+
+    //the connection carries on after errors
+    EXPECT_EQ(as_string(*c.read(archive, "stored.txt")), stored);
+
+    (*server)->stop();
+    running.join();
+
+    auto stats = (*server)->stats();
+    EXPECT_EQ(stats.connections, 1);
+    EXPECT_EQ(stats.requests, 15);
+    EXPECT_EQ(stats.errors, 4);
+    EXPECT_EQ(stats.bytes_sendfile, 3 * stored.size() + 4 + 8);
+}
+
+TEST(Server, serves_concurrent_clients) {
+    auto stored = repeated("stored", 500);
+    auto deflated = repeated("deflated", 5000);
+    auto archive = write_archive("server_concurrent.zip", stored, deflated);
+    auto socket_path = testing::TempDir() + "server_concurrent.sock";
+    std::vector<std::string> archives{archive};
+
+    auto server = zippee::Server::open(socket_path, archives, {.threads = 4});
+    ASSERT_TRUE(server.has_value()) << server.error();
+    std::thread running([&] { (*server)->run(); });
+
+    std::atomic<size_t> wrong{0};
+    std::vector<std::thread> clients;
+    for (int t = 0; t < 8; t++) {
+        clients.emplace_back([&, t] {
+            auto client = zippee::Client::connect(socket_path);
+            if (!client) {
+                wrong++;
+                return;
+            }
+            for (int i = 0; i < 50; i++) {
+                auto deflate_entry = (t + i) % 2 == 0;
+                auto contents = (*client)->read(archive, deflate_entry ? "deflated.txt" : "stored.txt");
+                if (!contents || as_string(*contents) != (deflate_entry ? deflated : stored)) {
+                    wrong++;
+                }
+            }
+        });
+    }
+    for (auto& client : clients) {
+        client.join();
+    }
+
+    (*server)->stop();
+    running.join();
+
+    EXPECT_EQ(wrong, 0);
+    EXPECT_EQ((*server)->stats().requests, 400);
+    EXPECT_EQ((*server)->stats().errors, 0);
+}
+
+TEST(Server, open_fails_on_a_bad_archive) {
+    std::vector<std::string> archives{testing::TempDir() + "no_such_archive.zip"};
+    auto server = zippee::Server::open(testing::TempDir() + "server_bad.sock", archives, {});
+    ASSERT_FALSE(server.has_value());
+    EXPECT_TRUE(server.error().starts_with("Unable to open"));
+}
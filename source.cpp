@@ -0,0 +1,308 @@
+//------------------------------------------------------------------------------
+// source.cpp
+//------------------------------------------------------------------------------
+
+#include "source.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <format>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    std::expected<void, std::string> check_range(uint64_t offset, size_t length, uint64_t size) {
+        if (offset > size || size - offset < length) {
+            return std::unexpected(std::format("Range of {} bytes at {} is past the end of the input.", length, offset));
+        }
+        return {};
+    }
+}
+
+std::expected<uint64_t, std::string> zippee::byte_source::disk_start(uint32_t disk) const {
+    if (disk != 0) {
+        return std::unexpected(std::format("Volume {} of a split archive is missing.", disk + 1));
+    }
+    return 0;
+}
+
+std::expected<std::unique_ptr<zippee::mapped_source>, std::string> zippee::mapped_source::open(const std::string& path) {
+    auto file = mapped_file::open(path);
+    if (!file) {
+        return std::unexpected(file.error());
+    }
+    return std::make_unique<mapped_source>(std::move(*file));
+}
+
+zippee::mapped_source::mapped_source(mapped_file file)
+    : _file(std::move(file))
+    , _data(_file->data()) {
+}
+
+zippee::mapped_source::mapped_source(std::span<std::byte> data)
+    : _data(data) {
+}
+
+std::span<std::byte> zippee::mapped_source::data() const {
+    return _data;
+}
+
+uint64_t zippee::mapped_source::size() const {
+    return _data.size();
+}
+
+std::expected<std::span<std::byte>, std::string> zippee::mapped_source::read(uint64_t offset, size_t length, std::vector<std::byte>&) const {
+    if (auto checked = check_range(offset, length, _data.size()); !checked) {
+        return std::unexpected(checked.error());
+    }
+    return _data.subspan(offset, length);
+}
+
+void zippee::mapped_source::prefetch(uint64_t offset, size_t length) const {
+    if (_file) {
+        _file->prefetch(offset, length);
+    }
+}
+
+int zippee::mapped_source::fd() const {
+    return _file ? _file->fd() : -1;
+}
+
+std::expected<std::unique_ptr<zippee::pread_source>, std::string> zippee::pread_source::open(const std::string& path, size_t chunk) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return std::unexpected("Unable to open file.");
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        return std::unexpected("Unable to stat file.");
+    }
+
+    //reads are scattered, so the kernel's own sequential readahead would fetch what isn't wanted
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+    return std::unique_ptr<pread_source>(new pread_source(fd, st.st_size, std::max<size_t>(chunk, 4096)));
+}
+
+zippee::pread_source::pread_source(int fd, uint64_t size, size_t chunk)
+    : _fd(fd)
+    , _size(size)
+    , _chunk(chunk) {
+}
+
+zippee::pread_source::~pread_source() {
+    ::close(_fd);
+}
+
+uint64_t zippee::pread_source::bytes_read() const {
+    return _bytes_read.load(std::memory_order_relaxed);
+}
+
+uint64_t zippee::pread_source::size() const {
+    return _size;
+}
+
+std::expected<std::span<std::byte>, std::string> zippee::pread_source::read(uint64_t offset, size_t length, std::vector<std::byte>& buffer) const {
+    if (auto checked = check_range(offset, length, _size); !checked) {
+        return std::unexpected(checked.error());
+    }
+
+    buffer.resize(length);
+    size_t filled = 0;
+    while (filled < length) {
+        auto chunk = std::min(_chunk, length - filled);
+        if (filled + chunk < length) {
+            prefetch(offset + filled + chunk, std::min(_chunk, length - filled - chunk));
+        }
+
+        auto got = ::pread(_fd, buffer.data() + filled, chunk, offset + filled);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got < 0) {
+            return std::unexpected(std::format("Unable to read input: {}", std::strerror(errno)));
+        }
+        if (got == 0) {
+            return std::unexpected("Input ended early.");
+        }
+        filled += got;
+        _bytes_read.fetch_add(got, std::memory_order_relaxed);
+    }
+
+    return std::span{buffer};
+}
+
+void zippee::pread_source::prefetch(uint64_t offset, size_t length) const {
+    ::posix_fadvise(_fd, offset, length, POSIX_FADV_WILLNEED);
+}
+
+int zippee::pread_source::fd() const {
+    return _fd;
+}
+
+std::vector<std::string> zippee::split_source::volume_paths(const std::string& path) {
+    if (!path.ends_with(".zip")) {
+        return {};
+    }
+
+    auto stem = path.substr(0, path.size() - 4);
+    std::vector<std::string> paths;
+    for (size_t i = 1; ; i++) {
+        auto number = std::to_string(i);
+        auto volume = stem + ".z" + (number.size() < 2 ? "0" : "") + number;
+        if (::access(volume.c_str(), F_OK) != 0) {
+            break;
+        }
+        paths.push_back(std::move(volume));
+    }
+
+    if (paths.empty()) {
+        return {};
+    }
+    paths.push_back(path);
+    return paths;
+}
+
+std::expected<std::unique_ptr<zippee::split_source>, std::string> zippee::split_source::open(std::span<const std::string> paths) {
+    std::vector<mapped_file> volumes;
+    for (auto& path : paths) {
+        auto file = mapped_file::open(path);
+        if (!file) {
+            return std::unexpected(std::format("Unable to open {}: {}", path, file.error()));
+        }
+        volumes.push_back(std::move(*file));
+    }
+    return std::unique_ptr<split_source>(new split_source(std::move(volumes)));
+}
+
+zippee::split_source::split_source(std::vector<mapped_file> volumes)
+    : _volumes(std::move(volumes)) {
+    _starts.push_back(0);
+    for (auto& volume : _volumes) {
+        _starts.push_back(_starts.back() + volume.data().size());
+    }
+    map_contiguous();
+}
+
+// Each volume's own mapping stays, for prefetching and for reads if this
+// can't be done.
+void zippee::split_source::map_contiguous() {
+    auto page = static_cast<uint64_t>(::sysconf(_SC_PAGESIZE));
+    for (size_t i = 0; i + 1 < _volumes.size(); i++) {
+        if (_volumes[i].data().size() % page != 0) {
+            return;
+        }
+    }
+
+    auto size = _starts.back();
+    void* reserved = ::mmap(nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (reserved == MAP_FAILED) {
+        return;
+    }
+
+    auto base = static_cast<std::byte*>(reserved);
+    for (size_t i = 0; i < _volumes.size(); i++) {
+        if (::mmap(base + _starts[i], _volumes[i].data().size(), PROT_READ, MAP_PRIVATE | MAP_FIXED, _volumes[i].fd(), 0) == MAP_FAILED) {
+            ::munmap(reserved, size);
+            return;
+        }
+    }
+    _contiguous = {base, size};
+}
+
+zippee::split_source::~split_source() {
+    if (!_contiguous.empty()) {
+        ::munmap(_contiguous.data(), _contiguous.size());
+    }
+}
+
+size_t zippee::split_source::volumes() const {
+    return _volumes.size();
+}
+
+bool zippee::split_source::contiguous() const {
+    return !_contiguous.empty();
+}
+
+uint64_t zippee::split_source::size() const {
+    return _starts.back();
+}
+
+std::expected<std::span<std::byte>, std::string> zippee::split_source::read(uint64_t offset, size_t length, std::vector<std::byte>& buffer) const {
+    if (auto checked = check_range(offset, length, size()); !checked) {
+        return std::unexpected(checked.error());
+    }
+    if (!_contiguous.empty()) {
+        return _contiguous.subspan(offset, length);
+    }
+    if (length == 0) {
+        return std::span<std::byte>{};
+    }
+
+    auto volume = static_cast<size_t>(std::ranges::upper_bound(_starts, offset) - _starts.begin()) - 1;
+    if (offset + length <= _starts[volume + 1]) {
+        return _volumes[volume].data().subspan(offset - _starts[volume], length);
+    }
+
+    //crosses into the next volume, or several
+    buffer.resize(length);
+    size_t filled = 0;
+    for (; filled < length; volume++) {
+        auto from = _volumes[volume].data().subspan(offset + filled - _starts[volume]);
+        auto count = std::min(from.size(), length - filled);
+        std::memcpy(buffer.data() + filled, from.data(), count);
+        filled += count;
+    }
+    return std::span{buffer};
+}
+
+void zippee::split_source::prefetch(uint64_t offset, size_t length) const {
+    auto end = std::min(offset + length, size());
+    for (size_t i = 0; i < _volumes.size(); i++) {
+        auto first = std::max(offset, _starts[i]);
+        auto last = std::min(end, _starts[i + 1]);
+        if (first < last) {
+            _volumes[i].prefetch(first - _starts[i], last - first);
+        }
+    }
+}
+
+int zippee::split_source::fd() const {
+    return -1;
+}
+
+std::expected<uint64_t, std::string> zippee::split_source::disk_start(uint32_t disk) const {
+    if (disk >= _volumes.size()) {
+        return std::unexpected(std::format("Volume {} of a split archive is missing.", disk + 1));
+    }
+    return _starts[disk];
+}
+
+std::expected<std::unique_ptr<zippee::byte_source>, std::string> zippee::open_source(const std::string& path, bool pread) {
+    if (auto volumes = split_source::volume_paths(path); !volumes.empty()) {
+        auto source = split_source::open(volumes);
+        if (!source) {
+            return std::unexpected(source.error());
+        }
+        return std::move(*source);
+    }
+
+    if (pread) {
+        auto source = pread_source::open(path);
+        if (!source) {
+            return std::unexpected(source.error());
+        }
+        return std::move(*source);
+    }
+
+    auto source = mapped_source::open(path);
+    if (!source) {
+        return std::unexpected(source.error());
+    }
+    return std::move(*source);
+}
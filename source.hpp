@@ -0,0 +1,139 @@
+//------------------------------------------------------------------------------
+// source.hpp
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "io.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace zippee {
+    // Random access to an archive's bytes, so it can be parsed and extracted
+    // a range at a time instead of needing all of it in memory. Sources are
+    // safe to read from several threads at once.
+    class byte_source {
+    public:
+        virtual ~byte_source() = default;
+
+        virtual uint64_t size() const = 0;
+
+        // The length bytes at offset. A source already holding them returns
+        // them in place; others read them into buffer.
+        virtual std::expected<std::span<std::byte>, std::string> read(uint64_t offset, size_t length, std::vector<std::byte>& buffer) const = 0;
+
+        // Asks for a range to start being read in ahead of its use.
+        virtual void prefetch(uint64_t offset, size_t length) const = 0;
+
+        // The file behind the source, for the kernel to copy ranges from, or
+        // -1 if there isn't one.
+        virtual int fd() const = 0;
+
+        // Where a volume of a split archive starts, as headers give offsets
+        // from the start of the volume they are on. A single file is only
+        // volume 0.
+        virtual std::expected<uint64_t, std::string> disk_start(uint32_t disk) const;
+    };
+
+    // Bytes already in memory: a mapped file, or a span owned elsewhere.
+    class mapped_source final : public byte_source {
+    private:
+        std::optional<mapped_file> _file;
+        std::span<std::byte> _data;
+
+    public:
+        static std::expected<std::unique_ptr<mapped_source>, std::string> open(const std::string& path);
+
+        explicit mapped_source(mapped_file file);
+        explicit mapped_source(std::span<std::byte> data);
+
+        std::span<std::byte> data() const;
+
+        uint64_t size() const override;
+        std::expected<std::span<std::byte>, std::string> read(uint64_t offset, size_t length, std::vector<std::byte>& buffer) const override;
+        void prefetch(uint64_t offset, size_t length) const override;
+        int fd() const override;
+    };
+
+    // Reads with pread only the ranges asked for, so an archive on slow or
+    // remote storage costs I/O in proportion to what is used of it. Long
+    // reads go a chunk at a time, each first asking the kernel to read ahead
+    // the chunk after it, so the next chunk arrives while this one is waited
+    // on.
+    class pread_source final : public byte_source {
+    private:
+        int _fd;
+        uint64_t _size;
+        size_t _chunk;
+        mutable std::atomic<uint64_t> _bytes_read{0};
+
+        pread_source(int fd, uint64_t size, size_t chunk);
+
+    public:
+        static constexpr size_t DEFAULT_CHUNK = 1024 * 1024;
+
+        static std::expected<std::unique_ptr<pread_source>, std::string> open(const std::string& path, size_t chunk = DEFAULT_CHUNK);
+
+        ~pread_source();
+        pread_source(const pread_source&) = delete;
+        pread_source& operator=(const pread_source&) = delete;
+
+        // Bytes fetched so far.
+        uint64_t bytes_read() const;
+
+        uint64_t size() const override;
+        std::expected<std::span<std::byte>, std::string> read(uint64_t offset, size_t length, std::vector<std::byte>& buffer) const override;
+        void prefetch(uint64_t offset, size_t length) const override;
+        int fd() const override;
+    };
+
+    // The volumes of a split archive, name.z01, name.z02 and so on up to
+    // name.zip, read as the one archive they are cut from. Splitting tools
+    // cut volumes at a whole number of pages, and when they are, the volumes
+    // are mapped again back to back into one reserved range of addresses, so
+    // every read is in place, one crossing from a volume into the next too,
+    // and an entry inflates straight across the cut. Otherwise reads that
+    // cross a cut are gathered into the buffer.
+    class split_source final : public byte_source {
+    private:
+        std::vector<mapped_file> _volumes;
+        // offset of each volume in the archive, then the archive's size
+        std::vector<uint64_t> _starts;
+        std::span<std::byte> _contiguous;
+
+        explicit split_source(std::vector<mapped_file> volumes);
+        void map_contiguous();
+
+    public:
+        // The volumes of the split archive whose last volume is path, first
+        // to last, or none if there are no others beside it.
+        static std::vector<std::string> volume_paths(const std::string& path);
+        static std::expected<std::unique_ptr<split_source>, std::string> open(std::span<const std::string> paths);
+
+        ~split_source();
+        split_source(const split_source&) = delete;
+        split_source& operator=(const split_source&) = delete;
+
+        size_t volumes() const;
+        // Whether the volumes are mapped back to back.
+        bool contiguous() const;
+
+        uint64_t size() const override;
+        std::expected<std::span<std::byte>, std::string> read(uint64_t offset, size_t length, std::vector<std::byte>& buffer) const override;
+        void prefetch(uint64_t offset, size_t length) const override;
+        int fd() const override;
+        std::expected<uint64_t, std::string> disk_start(uint32_t disk) const override;
+    };
+
+    // Opens an archive: a split archive through its last volume, always
+    // mapped; otherwise mapped, or read with pread if asked.
+    std::expected<std::unique_ptr<byte_source>, std::string> open_source(const std::string& path, bool pread = false);
+}
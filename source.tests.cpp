@@ -0,0 +1,240 @@
+//------------------------------------------------------------------------------
+// source.tests.cpp
+//------------------------------------------------------------------------------
+
+#include "source.hpp"
+#include "crc32.hpp"
+#include "test_archive.hpp"
+#include "zip.hpp"
+
+#include <cstdio>
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+namespace {
+
+using test::to_bytes;
+using test::write_temp_file;
+
+// Stored entries of contents, cut into volumes of volume_size bytes named
+// stem.z01 onwards and stem.zip, with offsets given per volume. Returns the
+// path of the last volume.
+std::string write_split_archive(const std::string& stem, const std::vector<std::string>& contents, size_t volume_size) {
+    auto split_signature = to_bytes("PK\x07\x08");
+    std::vector<std::byte> archive(split_signature.begin(), split_signature.end());
+
+    std::vector<zip::CentralDirectoryHeader> headers;
+    for (size_t i = 0; i < contents.size(); i++) {
+        zip::CentralDirectoryHeader header{};
+        header.compressed_size = header.uncompressed_size = static_cast<uint32_t>(contents[i].size());
+        header.disk_number_start = static_cast<uint16_t>(archive.size() / volume_size);
+        header.relative_offset_of_local_header = static_cast<uint32_t>(archive.size() % volume_size);
+        header.file_name = "entry" + std::to_string(i);
+        headers.push_back(header);
+
+        zip::LocalFileHeader local{};
+        local.compressed_size = local.uncompressed_size = header.compressed_size;
+        local.file_name = header.file_name;
+        zip::write_local_header(local, archive);
+        auto data = to_bytes(contents[i]);
+        archive.insert(archive.end(), data.begin(), data.end());
+    }
+
+    zip::EOCD eocd{};
+    eocd.num_disk_with_central_directory_start = static_cast<uint16_t>(archive.size() / volume_size);
+    eocd.offset_start_central_directory = static_cast<uint32_t>(archive.size() % volume_size);
+    auto directory_offset = archive.size();
+    for (auto& header : headers) {
+        zip::write_central_directory_header(header, archive);
+    }
+    eocd.total_num_entries_central_directory = eocd.total_num_entries_central_directory_this_disk = static_cast<uint16_t>(headers.size());
+    eocd.size_central_directory = static_cast<uint32_t>(archive.size() - directory_offset);
+    eocd.disk_number = static_cast<uint16_t>((archive.size() + zip::EOCD::SPEC_MIN_SIZE - 1) / volume_size);
+    zip::write_eocd(eocd, archive);
+
+    std::string last;
+    for (size_t disk = 0; disk * volume_size < archive.size(); disk++) {
+        auto volume = std::span{archive}.subspan(disk * volume_size);
+        volume = volume.first(std::min(volume.size(), volume_size));
+        last = disk == eocd.disk_number
+            ? write_temp_file(stem + ".zip", volume)
+            : write_temp_file(stem + (disk < 9 ? ".z0" : ".z") + std::to_string(disk + 1), volume);
+    }
+    return last;
+}
+
+}
+
+TEST(Source, mapped_source_reads_in_place) {
+    auto bytes = to_bytes("hello world");
+    zippee::mapped_source source(bytes);
+    std::vector<std::byte> buffer;
+
+    auto range = source.read(6, 5, buffer);
+    ASSERT_TRUE(range.has_value());
+    EXPECT_EQ(range->data(), bytes.data() + 6);
+    EXPECT_TRUE(buffer.empty());
+    EXPECT_EQ(source.fd(), -1);
+
+    EXPECT_FALSE(source.read(6, 6, buffer).has_value());
+    EXPECT_FALSE(source.read(12, 0, buffer).has_value());
+}
+
+TEST(Source, pread_source_reads_in_chunks) {
+    std::vector<std::byte> contents(10000);
+    for (size_t i = 0; i < contents.size(); i++) {
+        contents[i] = std::byte(i * 7);
+    }
+    auto path = write_temp_file("zippee_pread", contents);
+
+    auto source = zippee::pread_source::open(path, 4096);
+    ASSERT_TRUE(source.has_value()) << source.error();
+    EXPECT_EQ((*source)->size(), contents.size());
+
+    std::vector<std::byte> buffer;
+    auto range = (*source)->read(100, 9000, buffer);
+    ASSERT_TRUE(range.has_value()) << range.error();
+    EXPECT_TRUE(std::ranges::equal(*range, std::span{contents}.subspan(100, 9000)));
+    EXPECT_EQ((*source)->bytes_read(), 9000);
+
+    EXPECT_FALSE((*source)->read(9000, 1001, buffer).has_value());
+    EXPECT_EQ((*source)->bytes_read(), 9000);
+
+    std::remove(path.c_str());
+}
+
+TEST(Source, archive_read_through_pread_fetches_only_what_is_used) {
+    auto archive = test::make_archive({{"entry.txt", "the entry's data"}}, 1 << 20);
+    auto path = write_temp_file("zippee_pread.zip", archive);
+    auto source = zippee::pread_source::open(path);
+    ASSERT_TRUE(source.has_value());
+
+    auto eocd = zip::read_eocd(**source);
+    ASSERT_TRUE(eocd.has_value()) << eocd.error();
+    auto headers = zip::read_central_directory(**source, *eocd);
+    ASSERT_TRUE(headers.has_value()) << headers.error();
+    ASSERT_EQ(headers->size(), 1);
+    EXPECT_EQ(headers->front().file_name, "entry.txt");
+
+    auto data = zip::locate_entry_data(**source, headers->front());
+    ASSERT_TRUE(data.has_value()) << data.error();
+    EXPECT_EQ(data->crc_32, zip::crc32(to_bytes("the entry's data")));
+
+    std::vector<std::byte> buffer;
+    auto entry = (*source)->read(data->offset, headers->front().compressed_size, buffer);
+    ASSERT_TRUE(entry.has_value());
+    EXPECT_TRUE(std::ranges::equal(*entry, to_bytes("the entry's data")));
+
+    //the megabyte of padding was never read
+    EXPECT_LT((*source)->bytes_read(), 8192);
+
+    std::remove(path.c_str());
+}
+
+TEST(Source, find_duplicates_reads_only_entries_whose_metadata_matches) {
+    auto unique = std::string(100000, 'u');
+    auto last = write_split_archive("zippee_duplicates", {"same", unique, "same", "diff"}, size_t{1} << 30);
+    auto source = zippee::pread_source::open(last);
+    ASSERT_TRUE(source.has_value());
+
+    auto eocd = zip::read_eocd(**source);
+    ASSERT_TRUE(eocd.has_value()) << eocd.error();
+    auto headers = zip::read_central_directory(**source, *eocd);
+    ASSERT_TRUE(headers.has_value()) << headers.error();
+
+    auto before = (*source)->bytes_read();
+    auto originals = zip::find_duplicates(**source, *headers);
+    EXPECT_EQ(originals, (std::vector<size_t>{0, 1, 0, 3}));
+    //the entries sized 4, and none of the one sized apart
+    EXPECT_LT((*source)->bytes_read() - before, 4096);
+
+    std::remove(last.c_str());
+}
+
+TEST(Source, central_directory_read_through_pread_fetches_only_the_tail) {
+    auto archive = test::make_archive({{"entry.txt", std::string(1 << 20, 'x')}});
+    auto path = write_temp_file("zippee_list.zip", archive);
+    auto source = zippee::pread_source::open(path);
+    ASSERT_TRUE(source.has_value());
+
+    auto eocd = zip::read_eocd(**source);
+    ASSERT_TRUE(eocd.has_value()) << eocd.error();
+    auto headers = zip::read_central_directory(**source, *eocd);
+    ASSERT_TRUE(headers.has_value()) << headers.error();
+    EXPECT_EQ(headers->front().uncompressed_size, 1 << 20);
+
+    //a tail holding the EOCD, then the directory; never the entry or its header
+    EXPECT_LE((*source)->bytes_read(), 4096 + eocd->size_central_directory);
+
+    std::remove(path.c_str());
+}
+
+TEST(Source, locate_entry_data_past_end) {
+    auto archive = test::make_archive({{"entry.txt", "data"}});
+    zippee::mapped_source source(std::span{archive}.first(40));
+
+    zip::CentralDirectoryHeader header{};
+    header.compressed_size = 4;
+    header.file_name = "entry.txt";
+    EXPECT_FALSE(zip::locate_entry_data(source, header).has_value());
+
+    header.relative_offset_of_local_header = 100;
+    EXPECT_FALSE(zip::locate_entry_data(source, header).has_value());
+}
+
+TEST(Source, split_archive_read_as_one) {
+    std::vector<std::string> contents{std::string(5000, 'a'), "short", std::string(9000, 'c')};
+    auto page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+
+    //volumes a whole number of pages are mapped back to back, others not
+    for (auto [volume_size, contiguous] : {std::pair{page, true}, std::pair{size_t{3000}, false}}) {
+        auto stem = "zippee_split_" + std::to_string(volume_size);
+        auto path = write_split_archive(stem, contents, volume_size);
+        auto paths = zippee::split_source::volume_paths(path);
+        ASSERT_GT(paths.size(), 2);
+        EXPECT_EQ(paths.front(), testing::TempDir() + stem + ".z01");
+
+        auto source = zippee::split_source::open(paths);
+        ASSERT_TRUE(source.has_value()) << source.error();
+        EXPECT_EQ((*source)->volumes(), paths.size());
+        EXPECT_EQ((*source)->contiguous(), contiguous);
+
+        auto eocd = zip::read_eocd(**source);
+        ASSERT_TRUE(eocd.has_value()) << eocd.error();
+        auto headers = zip::read_central_directory(**source, *eocd);
+        ASSERT_TRUE(headers.has_value()) << headers.error();
+        ASSERT_EQ(headers->size(), contents.size());
+
+        for (size_t i = 0; i < contents.size(); i++) {
+            auto& h = headers->at(i);
+            auto data = zip::locate_entry_data(**source, h);
+            ASSERT_TRUE(data.has_value()) << data.error();
+
+            std::vector<std::byte> buffer;
+            auto entry = (*source)->read(data->offset, h.compressed_size, buffer);
+            ASSERT_TRUE(entry.has_value()) << entry.error();
+            EXPECT_TRUE(std::ranges::equal(*entry, to_bytes(contents[i]))) << volume_size << " " << h.file_name;
+            if (contiguous) {
+                EXPECT_TRUE(buffer.empty());
+            }
+        }
+
+        zip::CentralDirectoryHeader missing = headers->front();
+        missing.disk_number_start = static_cast<uint16_t>(paths.size());
+        EXPECT_FALSE(zip::locate_entry_data(**source, missing).has_value());
+
+        for (auto& volume : paths) {
+            std::remove(volume.c_str());
+        }
+    }
+}
+
+TEST(Source, single_file_has_only_volume_zero) {
+    auto archive = test::make_archive({{"entry.txt", "data"}});
+    zippee::mapped_source source(archive);
+
+    EXPECT_EQ(source.disk_start(0), 0);
+    EXPECT_FALSE(source.disk_start(1).has_value());
+}
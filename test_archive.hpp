@@ -0,0 +1,95 @@
+//------------------------------------------------------------------------------
+// test_archive.hpp
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "compress.hpp"
+#include "crc32.hpp"
+#include "zip.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+// Helpers for tests that need bytes, files and ZIP archives to work on.
+namespace test {
+
+inline std::vector<std::byte> to_bytes(const std::string& s) {
+    std::vector<std::byte> bytes(s.size());
+    std::memcpy(bytes.data(), s.data(), s.size());
+    return bytes;
+}
+
+// Writes contents to name in the test's temporary directory, returning its
+// path.
+inline std::string write_temp_file(const std::string& name, std::span<const std::byte> contents) {
+    auto path = testing::TempDir() + name;
+    std::ofstream file(path, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(contents.data()), contents.size());
+    return path;
+}
+
+struct ArchiveEntry {
+    std::string name;
+    std::string contents;
+    // 0 to store, or 8 to deflate
+    uint16_t method = 0;
+    // the entry's data as given, for methods make_archive can't compress with
+    std::optional<std::string> compressed = std::nullopt;
+};
+
+// An archive of the entries, after padding bytes of zeros, then the central
+// directory and an EOCD with comment.
+inline std::vector<std::byte> make_archive(const std::vector<ArchiveEntry>& entries, size_t padding = 0, const std::string& comment = "") {
+    std::vector<std::byte> archive(padding, std::byte{0});
+    std::vector<zip::CentralDirectoryHeader> headers;
+    for (auto& entry : entries) {
+        auto contents = to_bytes(entry.contents);
+        auto data = entry.compressed ? to_bytes(*entry.compressed)
+            : entry.method == 8 ? deflate::compress(contents)
+            : contents;
+
+        zip::LocalFileHeader local{};
+        local.extraction_version = entry.method == 0 ? 10 : 20;
+        local.compression_method = entry.method;
+        local.crc_32 = zip::crc32(contents);
+        local.compressed_size = static_cast<uint32_t>(data.size());
+        local.uncompressed_size = static_cast<uint32_t>(contents.size());
+        local.file_name = entry.name;
+
+        zip::CentralDirectoryHeader header{};
+        header.version_needed = local.extraction_version;
+        header.compression_method = local.compression_method;
+        header.crc_32 = local.crc_32;
+        header.compressed_size = local.compressed_size;
+        header.uncompressed_size = local.uncompressed_size;
+        header.relative_offset_of_local_header = static_cast<uint32_t>(archive.size());
+        header.file_name = entry.name;
+        headers.push_back(header);
+
+        zip::write_local_header(local, archive);
+        archive.insert(archive.end(), data.begin(), data.end());
+    }
+
+    auto directory_offset = archive.size();
+    for (auto& header : headers) {
+        zip::write_central_directory_header(header, archive);
+    }
+    zip::EOCD eocd{};
+    eocd.total_num_entries_central_directory = eocd.total_num_entries_central_directory_this_disk = static_cast<uint16_t>(headers.size());
+    eocd.size_central_directory = static_cast<uint32_t>(archive.size() - directory_offset);
+    eocd.offset_start_central_directory = static_cast<uint32_t>(directory_offset);
+    eocd.comment = comment;
+    zip::write_eocd(eocd, archive);
+    return archive;
+}
+
+}
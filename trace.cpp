@@ -0,0 +1,159 @@
+//------------------------------------------------------------------------------
+// trace.cpp
+//------------------------------------------------------------------------------
+
+#include "trace.hpp"
+
+#include <atomic>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    struct Event {
+        const char* name;
+        std::string argument;
+        Clock::time_point start;
+        Clock::duration duration;
+    };
+
+    // Each thread records into its own buffer; the lock is only contended
+    // while the trace is being written.
+    struct ThreadEvents {
+        size_t id;
+        std::mutex mutex;
+        std::string name;
+        std::vector<Event> events;
+    };
+
+    std::atomic<bool> recording{false};
+    Clock::time_point started;
+
+    std::mutex threads_mutex;
+    std::vector<std::shared_ptr<ThreadEvents>> threads;
+
+    ThreadEvents& thread_events() {
+        thread_local std::shared_ptr<ThreadEvents> events = [] {
+            std::lock_guard lock(threads_mutex);
+            auto created = std::make_shared<ThreadEvents>();
+            created->id = threads.size() + 1;
+            threads.push_back(created);
+            return created;
+        }();
+        return *events;
+    }
+
+    std::string escape(std::string_view s) {
+        std::string escaped;
+        for (char c : s) {
+            if (c == '"' || c == '\\') {
+                escaped += '\\';
+                escaped += c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                escaped += std::format("\\u{:04x}", static_cast<int>(c));
+            } else {
+                escaped += c;
+            }
+        }
+        return escaped;
+    }
+
+    double microseconds(Clock::duration d) {
+        return std::chrono::duration<double, std::micro>(d).count();
+    }
+}
+
+void zippee::trace::start() {
+    started = Clock::now();
+    recording = true;
+}
+
+bool zippee::trace::enabled() {
+    return recording.load(std::memory_order_relaxed);
+}
+
+std::expected<void, std::string> zippee::trace::write(const std::string& path) {
+    recording = false;
+
+    std::ofstream file(path);
+    if (!file) {
+        return std::unexpected(std::format("Unable to create {}.", path));
+    }
+
+    std::lock_guard lock(threads_mutex);
+    file << "{\"traceEvents\":[\n";
+    bool first = true;
+    auto separate = [&] {
+        if (!first) {
+            file << ",\n";
+        }
+        first = false;
+    };
+
+    for (auto& thread : threads) {
+        std::lock_guard thread_lock(thread->mutex);
+        if (thread->events.empty()) {
+            continue;
+        }
+
+        auto name = thread->name.empty() ? std::format("thread {}", thread->id) : thread->name;
+        separate();
+        file << std::format(R"({{"name":"thread_name","ph":"M","pid":1,"tid":{},"args":{{"name":"{}"}}}})",
+            thread->id, escape(name));
+
+        for (auto& event : thread->events) {
+            separate();
+            file << std::format(R"({{"name":"{}","ph":"X","pid":1,"tid":{},"ts":{:.3f},"dur":{:.3f})",
+                escape(event.name), thread->id, microseconds(event.start - started), microseconds(event.duration));
+            if (!event.argument.empty()) {
+                file << std::format(R"(,"args":{{"entry":"{}"}})", escape(event.argument));
+            }
+            file << "}";
+        }
+        thread->events.clear();
+    }
+    file << "\n]}\n";
+
+    if (!file) {
+        return std::unexpected(std::format("Unable to write {}.", path));
+    }
+    return {};
+}
+
+void zippee::trace::set_thread_name(std::string name) {
+    auto& events = thread_events();
+    std::lock_guard lock(events.mutex);
+    events.name = std::move(name);
+}
+
+zippee::trace::Scope::Scope(const char* name)
+    : _name(name)
+    , _recording(enabled()) {
+    if (_recording) {
+        _start = Clock::now();
+    }
+}
+
+zippee::trace::Scope::Scope(const char* name, const std::string& argument)
+    : _name(name)
+    , _recording(enabled()) {
+    if (_recording) {
+        _argument = argument;
+        _start = Clock::now();
+    }
+}
+
+zippee::trace::Scope::~Scope() {
+    if (!_recording) {
+        return;
+    }
+
+    auto duration = Clock::now() - _start;
+    auto& events = thread_events();
+    std::lock_guard lock(events.mutex);
+    events.events.push_back({_name, std::move(_argument), _start, duration});
+}
@@ -0,0 +1,56 @@
+//------------------------------------------------------------------------------
+// trace.hpp
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <expected>
+#include <string>
+
+// Timeline of what each thread was doing, written as Chrome trace-event JSON
+// for chrome://tracing or Perfetto. Trace points are the ZIPPEE_TRACE_*
+// macros, which compile to nothing unless ZIPPEE_TRACE is defined; compiled
+// in, a trace point costs one atomic load until tracing is started.
+namespace zippee::trace {
+
+void start();
+bool enabled();
+
+// Stops tracing and writes out everything recorded, one track per thread.
+// Call once the traced work has finished.
+std::expected<void, std::string> write(const std::string& path);
+
+// Names the calling thread's track.
+void set_thread_name(std::string name);
+
+// Records the time from construction to destruction as one event on the
+// calling thread's track, with an optional argument such as an entry name.
+class Scope {
+private:
+    const char* _name;
+    std::string _argument;
+    std::chrono::steady_clock::time_point _start;
+    bool _recording;
+
+public:
+    explicit Scope(const char* name);
+    Scope(const char* name, const std::string& argument);
+    ~Scope();
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+};
+
+}
+
+#define ZIPPEE_TRACE_CONCAT_INNER(a, b) a##b
+#define ZIPPEE_TRACE_CONCAT(a, b) ZIPPEE_TRACE_CONCAT_INNER(a, b)
+
+#ifdef ZIPPEE_TRACE
+#define ZIPPEE_TRACE_SCOPE(...) ::zippee::trace::Scope ZIPPEE_TRACE_CONCAT(zippee_trace_scope_, __LINE__)(__VA_ARGS__)
+#define ZIPPEE_TRACE_THREAD(name) ::zippee::trace::set_thread_name(name)
+#else
+#define ZIPPEE_TRACE_SCOPE(...) static_cast<void>(0)
+#define ZIPPEE_TRACE_THREAD(name) static_cast<void>(0)
+#endif
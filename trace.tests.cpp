@@ -0,0 +1,61 @@
+//------------------------------------------------------------------------------
+// trace.tests.cpp
+//------------------------------------------------------------------------------
+
+#include "trace.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+std::string read_file(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), {});
+}
+
+}
+
+TEST(Trace, nothing_recorded_until_started) {
+    { zippee::trace::Scope scope("before"); }
+
+    auto path = testing::TempDir() + "zippee_trace_empty.json";
+    ASSERT_TRUE(zippee::trace::write(path).has_value());
+    EXPECT_EQ(read_file(path).find("before"), std::string::npos);
+
+    std::remove(path.c_str());
+}
+
+TEST(Trace, writes_events_per_thread) {
+    zippee::trace::start();
+    {
+        zippee::trace::Scope scope("outer", "dir/\"quoted\".txt");
+        zippee::trace::Scope inner("inner");
+    }
+    std::thread worker([] {
+        zippee::trace::set_thread_name("helper");
+        zippee::trace::Scope scope("on helper");
+    });
+    worker.join();
+
+    auto path = testing::TempDir() + "zippee_trace.json";
+    ASSERT_TRUE(zippee::trace::write(path).has_value());
+    auto json = read_file(path);
+
+    EXPECT_EQ(json.rfind("{\"traceEvents\":[", 0), 0);
+    EXPECT_NE(json.find(R"("name":"outer","ph":"X")"), std::string::npos);
+    EXPECT_NE(json.find(R"("name":"inner","ph":"X")"), std::string::npos);
+    EXPECT_NE(json.find(R"("args":{"entry":"dir/\"quoted\".txt"})"), std::string::npos);
+    EXPECT_NE(json.find(R"("name":"on helper")"), std::string::npos);
+    EXPECT_NE(json.find(R"("args":{"name":"helper"})"), std::string::npos);
+
+    //stopped by writing
+    { zippee::trace::Scope scope("after"); }
+    ASSERT_TRUE(zippee::trace::write(path).has_value());
+    EXPECT_EQ(read_file(path).find("after"), std::string::npos);
+
+    std::remove(path.c_str());
+}
@@ -5,12 +5,36 @@
 
 #include "zip.hpp"
 
+#include "source.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <map>
+#include <tuple>
+
 namespace {
     template<typename T, typename S>
     void read_adv(T& dest, std::span<S>& data) {
         dest = *reinterpret_cast<T*>(data.data());
         data = data.subspan(sizeof(T));
     }
+
+    template<typename T>
+    void write_adv(T value, std::vector<std::byte>& output) {
+        auto at = output.size();
+        output.resize(at + sizeof(T));
+        std::memcpy(output.data() + at, &value, sizeof(T));
+    }
+
+    void write_bytes(std::span<const std::byte> bytes, std::vector<std::byte>& output) {
+        output.insert(output.end(), bytes.begin(), bytes.end());
+    }
+
+    void write_string(const std::string& s, std::vector<std::byte>& output) {
+        write_bytes(std::as_bytes(std::span{s}), output);
+    }
 }
 
 std::ostream& zip::operator<<(std::ostream& os, const EOCD& s) {
@@ -28,6 +52,7 @@ std::ostream& zip::operator<<(std::ostream& os, const EOCD& s) {
 }
 
 std::expected<zip::EOCD, std::string> zip::search_for_eocd(std::span<std::byte> data) {
+    ZIPPEE_TRACE_SCOPE("search_for_eocd");
     EOCD s;
 
     size_t eof = data.size();
@@ -75,17 +100,25 @@ std::ostream& zip::operator<<(std::ostream& os, const CentralDirectoryHeader& h)
     return os;
 }
 
-std::vector<zip::CentralDirectoryHeader>
+std::expected<std::vector<zip::CentralDirectoryHeader>, std::string>
 zip::read_central_directory_headers(std::span<std::byte> data) {
+    ZIPPEE_TRACE_SCOPE("read_central_directory_headers");
+    constexpr size_t FIXED_SIZE = 46;
     std::vector<zip::CentralDirectoryHeader> headers;
 
     while (!data.empty()) {
         zip::CentralDirectoryHeader h;
 
+        if (data.size() < sizeof(h.signature)) {
+            return std::unexpected("Not enough bytes for a Central Directory Header.");
+        }
         read_adv(h.signature, data);
         if (h.signature != 0x02014b50) {
             return headers;
         }
+        if (data.size() < FIXED_SIZE - sizeof(h.signature)) {
+            return std::unexpected("Not enough bytes for a Central Directory Header.");
+        }
 
         read_adv(h.version_made_by, data);
         read_adv(h.version_needed, data);
@@ -104,11 +137,14 @@ zip::read_central_directory_headers(std::span<std::byte> data) {
         read_adv(h.external_file_attributes, data);
         read_adv(h.relative_offset_of_local_header, data);
 
-        h.file_name.insert(0, reinterpret_cast<char*>(&data[0]), h.file_name_length);
+        if (size_t{h.file_name_length} + h.extra_field_length + h.file_comment_length > data.size()) {
+            return std::unexpected("Central Directory Header extends past the end of the directory.");
+        }
+        h.file_name.insert(0, reinterpret_cast<char*>(data.data()), h.file_name_length);
         data = data.subspan(h.file_name_length);
         h.extra_field.insert(h.extra_field.begin(), data.begin(), data.begin() + h.extra_field_length);
         data = data.subspan(h.extra_field_length);
-        h.file_comment.insert(0, reinterpret_cast<char*>(&data[0]), h.file_comment_length);
+        h.file_comment.insert(0, reinterpret_cast<char*>(data.data()), h.file_comment_length);
         data = data.subspan(h.file_comment_length);
 
         headers.push_back(h);
@@ -145,7 +181,10 @@ zip::read_local_header(std::span<std::byte> data) {
     read_adv(header.file_name_length, data);
     read_adv(header.extra_field_length, data);
 
-    header.file_name.insert(0, reinterpret_cast<char*>(&data[0]), header.file_name_length);
+    if (size_t{header.file_name_length} + header.extra_field_length > data.size()) {
+        return std::unexpected("Local File Header extends past the end of the data.");
+    }
+    header.file_name.insert(0, reinterpret_cast<char*>(data.data()), header.file_name_length);
     data = data.subspan(header.file_name_length);
 
     header.extra_field.insert(header.extra_field.begin(), data.begin(), data.begin() + header.extra_field_length);
@@ -153,3 +192,181 @@ zip::read_local_header(std::span<std::byte> data) {
 
     return header;
 }
+
+void zip::write_local_header(const LocalFileHeader& header, std::vector<std::byte>& output) {
+    write_adv<uint32_t>(0x04034b50, output);
+    write_adv(header.extraction_version, output);
+    write_adv(header.gp_bit_flag, output);
+    write_adv(header.compression_method, output);
+    write_adv(header.last_mod_file_time, output);
+    write_adv(header.last_mod_file_date, output);
+    write_adv(header.crc_32, output);
+    write_adv(header.compressed_size, output);
+    write_adv(header.uncompressed_size, output);
+    write_adv(static_cast<uint16_t>(header.file_name.size()), output);
+    write_adv(static_cast<uint16_t>(header.extra_field.size()), output);
+    write_string(header.file_name, output);
+    write_bytes(header.extra_field, output);
+}
+
+void zip::write_central_directory_header(const CentralDirectoryHeader& header, std::vector<std::byte>& output) {
+    write_adv<uint32_t>(0x02014b50, output);
+    write_adv(header.version_made_by, output);
+    write_adv(header.version_needed, output);
+    write_adv(header.general_purpose_bit_flag, output);
+    write_adv(header.compression_method, output);
+    write_adv(header.last_mod_file_time, output);
+    write_adv(header.last_mod_file_date, output);
+    write_adv(header.crc_32, output);
+    write_adv(header.compressed_size, output);
+    write_adv(header.uncompressed_size, output);
+    write_adv(static_cast<uint16_t>(header.file_name.size()), output);
+    write_adv(static_cast<uint16_t>(header.extra_field.size()), output);
+    write_adv(static_cast<uint16_t>(header.file_comment.size()), output);
+    write_adv(header.disk_number_start, output);
+    write_adv(header.internal_file_attributes, output);
+    write_adv(header.external_file_attributes, output);
+    write_adv(header.relative_offset_of_local_header, output);
+    write_string(header.file_name, output);
+    write_bytes(header.extra_field, output);
+    write_string(header.file_comment, output);
+}
+
+void zip::write_eocd(const EOCD& eocd, std::vector<std::byte>& output) {
+    write_adv<uint32_t>(0x06054b50, output);
+    write_adv(eocd.disk_number, output);
+    write_adv(eocd.num_disk_with_central_directory_start, output);
+    write_adv(eocd.total_num_entries_central_directory_this_disk, output);
+    write_adv(eocd.total_num_entries_central_directory, output);
+    write_adv(eocd.size_central_directory, output);
+    write_adv(eocd.offset_start_central_directory, output);
+    write_adv(static_cast<uint16_t>(eocd.comment.size()), output);
+    write_string(eocd.comment, output);
+}
+
+std::expected<zip::EOCD, std::string> zip::read_eocd(const zippee::byte_source& source) {
+    //most comments are short, so try a small tail before the longest one could need
+    std::vector<std::byte> buffer;
+    std::expected<EOCD, std::string> eocd = std::unexpected("Unable to find EOCD.");
+    for (uint64_t tail_size : {uint64_t{4096}, uint64_t{EOCD::SPEC_MIN_SIZE + 0xffff}}) {
+        tail_size = std::min(tail_size, source.size());
+        auto tail = source.read(source.size() - tail_size, tail_size, buffer);
+        if (!tail) {
+            return std::unexpected(tail.error());
+        }
+
+        eocd = search_for_eocd(*tail);
+        if (eocd || tail_size == source.size()) {
+            break;
+        }
+    }
+    return eocd;
+}
+
+std::expected<std::vector<zip::CentralDirectoryHeader>, std::string>
+zip::read_central_directory(const zippee::byte_source& source, const EOCD& eocd) {
+    auto start = source.disk_start(eocd.num_disk_with_central_directory_start);
+    if (!start) {
+        return std::unexpected(std::format("Unable to read central directory: {}", start.error()));
+    }
+
+    std::vector<std::byte> buffer;
+    auto directory = source.read(*start + eocd.offset_start_central_directory, eocd.size_central_directory, buffer);
+    if (!directory) {
+        return std::unexpected(std::format("Unable to read central directory: {}", directory.error()));
+    }
+    auto headers = read_central_directory_headers(*directory);
+    if (!headers) {
+        return std::unexpected(std::format("Unable to read central directory: {}", headers.error()));
+    }
+    return headers;
+}
+
+std::expected<zip::EntryData, std::string> zip::locate_entry_data(const zippee::byte_source& source, const CentralDirectoryHeader& h) {
+    constexpr size_t FIXED_SIZE = 30;
+
+    auto disk = source.disk_start(h.disk_number_start);
+    if (!disk) {
+        return std::unexpected(std::format("Unable to read local header for {}: {}", h.file_name, disk.error()));
+    }
+
+    uint64_t offset = *disk + h.relative_offset_of_local_header;
+    if (offset >= source.size()) {
+        return std::unexpected(std::format("Unable to read local header for {}: Local header is past the end of the archive.", h.file_name));
+    }
+
+    std::vector<std::byte> buffer;
+    //the local header usually repeats the central one's name and extra field, so one read does
+    auto first_read = FIXED_SIZE + h.file_name.size() + h.extra_field.size();
+    auto bytes = source.read(offset, std::min<uint64_t>(first_read, source.size() - offset), buffer);
+    if (bytes && bytes->size() >= FIXED_SIZE) {
+        auto name_length = std::to_integer<size_t>((*bytes)[26]) | std::to_integer<size_t>((*bytes)[27]) << 8;
+        auto extra_length = std::to_integer<size_t>((*bytes)[28]) | std::to_integer<size_t>((*bytes)[29]) << 8;
+        if (FIXED_SIZE + name_length + extra_length > bytes->size()) {
+            bytes = source.read(offset, FIXED_SIZE + name_length + extra_length, buffer);
+        }
+    }
+
+    auto local_header = bytes
+        ? read_local_header(*bytes)
+        : std::unexpected(bytes.error());
+    if (!local_header) {
+        return std::unexpected(std::format("Unable to read local header for {}: {}", h.file_name, local_header.error()));
+    }
+
+    EntryData data;
+    data.offset = offset + local_header->header_size();
+    // below does not honour 4.4.4 of APPNOTE.TXT and check for data descriptor
+    data.crc_32 = local_header->crc_32 == 0 ? h.crc_32 : local_header->crc_32;
+
+    if (data.offset > source.size() || source.size() - data.offset < h.compressed_size) {
+        return std::unexpected(std::format("Data for {} extends past the end of the archive.", h.file_name));
+    }
+    return data;
+}
+
+std::vector<size_t> zip::find_duplicates(const zippee::byte_source& source, std::span<const CentralDirectoryHeader> headers) {
+    std::vector<size_t> originals(headers.size());
+    using Key = std::tuple<uint16_t, uint32_t, uint32_t, uint32_t>;
+    std::map<Key, std::vector<size_t>> candidates;
+    for (size_t i = 0; i < headers.size(); i++) {
+        auto& h = headers[i];
+        originals[i] = i;
+        if (h.uncompressed_size == 0 || h.file_name.ends_with('/')) {
+            continue;
+        }
+        candidates[{h.compression_method, h.crc_32, h.compressed_size, h.uncompressed_size}].push_back(i);
+    }
+
+    //only entries whose metadata matches another's are read, each once
+    std::vector<std::byte> buffer;
+    for (auto& [key, entries] : candidates) {
+        if (entries.size() < 2) {
+            continue;
+        }
+
+        std::vector<std::pair<size_t, std::vector<std::byte>>> distinct;
+        for (auto i : entries) {
+            auto& h = headers[i];
+            auto data = locate_entry_data(source, h);
+            if (!data) {
+                continue;
+            }
+            auto bytes = source.read(data->offset, h.compressed_size, buffer);
+            if (!bytes || bytes->size() != h.compressed_size) {
+                continue;
+            }
+
+            auto match = std::find_if(distinct.begin(), distinct.end(), [&](auto& earlier) {
+                return std::ranges::equal(earlier.second, *bytes);
+            });
+            if (match != distinct.end()) {
+                originals[i] = match->first;
+            } else {
+                distinct.emplace_back(i, std::vector<std::byte>(bytes->begin(), bytes->end()));
+            }
+        }
+    }
+
+    return originals;
+}
@@ -13,6 +13,10 @@
 #include <span>
 #include <vector>
 
+namespace zippee {
+    class byte_source;
+}
+
 namespace zip {
 
 struct EOCD {
@@ -59,7 +63,9 @@ struct CentralDirectoryHeader {
     friend std::ostream& operator<<(std::ostream& os, const CentralDirectoryHeader& s);
 };
 
-std::vector<CentralDirectoryHeader> read_central_directory_headers(std::span<std::byte> data);
+// The headers at the start of data, up to the first that isn't one. A header
+// running past the end of data is an error.
+std::expected<std::vector<CentralDirectoryHeader>, std::string> read_central_directory_headers(std::span<std::byte> data);
 
 struct LocalFileHeader {
     uint32_t signature;
@@ -82,4 +88,33 @@ struct LocalFileHeader {
 
 std::expected<LocalFileHeader, std::string> read_local_header(std::span<std::byte> data);
 
+// The writers append a structure in its on-disk layout, taking the length
+// fields from the names, comments and extra fields themselves.
+void write_local_header(const LocalFileHeader& header, std::vector<std::byte>& output);
+void write_central_directory_header(const CentralDirectoryHeader& header, std::vector<std::byte>& output);
+void write_eocd(const EOCD& eocd, std::vector<std::byte>& output);
+
+// Reading through a byte_source fetches only what each step needs: the tail
+// of the archive holding the EOCD, then the central directory, then an
+// entry's local header. Offsets count from the start of the volume the EOCD
+// or header names, which the source places.
+std::expected<EOCD, std::string> read_eocd(const zippee::byte_source& source);
+std::expected<std::vector<CentralDirectoryHeader>, std::string> read_central_directory(const zippee::byte_source& source, const EOCD& eocd);
+
+struct EntryData {
+    uint64_t offset;
+    uint32_t crc_32;
+};
+
+// Where an entry's compressed data starts, found through its local header
+// and checked to lie within the source, and the CRC-32 to check it against.
+std::expected<EntryData, std::string> locate_entry_data(const zippee::byte_source& source, const CentralDirectoryHeader& h);
+
+// For each entry, the index of the first entry with the same contents, or
+// its own index if it has none. Entries match when their method, CRC-32 and
+// sizes agree and their compressed bytes are identical; only entries whose
+// metadata matches another's are read, each once. Directories, empty entries
+// and entries whose data can't be found match nothing.
+std::vector<size_t> find_duplicates(const zippee::byte_source& source, std::span<const CentralDirectoryHeader> headers);
+
 }
\ No newline at end of file
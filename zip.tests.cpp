@@ -4,6 +4,8 @@
 
 #include "zip.hpp"
 
+#include "source.hpp"
+
 #include <span>
 
 #include <gtest/gtest.h>
@@ -129,7 +131,8 @@ TEST(ZipTests, read_no_central_directory_header) {
     );
 
     auto result = zip::read_central_directory_headers(std::span{data});
-    EXPECT_TRUE(result.empty());
+    ASSERT_TRUE(result.has_value()) << result.error();
+    EXPECT_TRUE(result->empty());
 }
 
 TEST(ZipTests, read_one_central_directory_header_dynamic_content) {
@@ -157,9 +160,10 @@ TEST(ZipTests, read_one_central_directory_header_dynamic_content) {
     );
 
     auto result = zip::read_central_directory_headers(std::span{data});
-    ASSERT_FALSE(result.empty());
+    ASSERT_TRUE(result.has_value()) << result.error();
+    ASSERT_FALSE(result->empty());
 
-    auto frontHeader = result.front();
+    auto frontHeader = result->front();
     EXPECT_EQ(frontHeader.signature, 0x02014b50);
     EXPECT_EQ(frontHeader.version_made_by, 0x0314);
     EXPECT_EQ(frontHeader.version_needed, 0x14);
@@ -207,9 +211,10 @@ TEST(ZipTests, read_one_central_directory_header_no_dynamic_content) {
     );
 
     auto result = zip::read_central_directory_headers(std::span{data});
-    ASSERT_FALSE(result.empty());
+    ASSERT_TRUE(result.has_value()) << result.error();
+    ASSERT_FALSE(result->empty());
 
-    auto frontHeader = result.front();
+    auto frontHeader = result->front();
     EXPECT_EQ(frontHeader.signature, 0x02014b50);
     EXPECT_EQ(frontHeader.version_made_by, 0x0314);
     EXPECT_EQ(frontHeader.version_needed, 0x14);
@@ -277,9 +282,10 @@ TEST(ZipTests, read_two_central_directory_header_dynamic_content) {
     );
 
     auto result = zip::read_central_directory_headers(std::span{data});
-    ASSERT_EQ(result.size(), 2);
+    ASSERT_TRUE(result.has_value()) << result.error();
+    ASSERT_EQ(result->size(), 2);
 
-    for (auto& header : result) {
+    for (auto& header : *result) {
         EXPECT_EQ(header.signature, 0x02014b50);
         EXPECT_EQ(header.version_made_by, 0x0314);
         EXPECT_EQ(header.version_needed, 0x14);
@@ -345,11 +351,12 @@ TEST(ZipTests, read_two_central_directory_header_no_dynamic_content) {
     );
 
     auto result = zip::read_central_directory_headers(std::span{data});
-    ASSERT_EQ(result.size(), 2);
+    ASSERT_TRUE(result.has_value()) << result.error();
+    ASSERT_EQ(result->size(), 2);
 
-    auto frontHeader = result.front();
+    auto frontHeader = result->front();
 
-    for (auto& header : result) {
+    for (auto& header : *result) {
         EXPECT_EQ(header.signature, 0x02014b50);
         EXPECT_EQ(header.version_made_by, 0x0314);
         EXPECT_EQ(header.version_needed, 0x14);
@@ -415,9 +422,10 @@ TEST(ZipTests, read_two_central_directory_header_mixed_content) {
     );
 
     auto result = zip::read_central_directory_headers(std::span{data});
-    ASSERT_FALSE(result.empty());
+    ASSERT_TRUE(result.has_value()) << result.error();
+    ASSERT_FALSE(result->empty());
 
-    auto frontHeader = result.front();
+    auto frontHeader = result->front();
     EXPECT_EQ(frontHeader.signature, 0x02014b50);
     EXPECT_EQ(frontHeader.version_made_by, 0x0314);
     EXPECT_EQ(frontHeader.version_needed, 0x14);
@@ -442,7 +450,7 @@ TEST(ZipTests, read_two_central_directory_header_mixed_content) {
         make_bytes(0x01, 0x02, 0x03, 0x04, 0x05).begin()));
     EXPECT_EQ(frontHeader.file_comment, "there");
 
-    frontHeader = result.back();
+    frontHeader = result->back();
     EXPECT_EQ(frontHeader.signature, 0x02014b50);
     EXPECT_EQ(frontHeader.version_made_by, 0x0314);
     EXPECT_EQ(frontHeader.version_needed, 0x14);
@@ -465,6 +473,47 @@ TEST(ZipTests, read_two_central_directory_header_mixed_content) {
     EXPECT_TRUE(frontHeader.file_comment.empty());
 }
 
+TEST(ZipTests, read_truncated_central_directory) {
+    zip::CentralDirectoryHeader header{};
+    header.file_name = "hello.txt";
+    header.file_comment = "greeting";
+    std::vector<std::byte> bytes;
+    zip::write_central_directory_header(header, bytes);
+
+    //cut short within the fixed fields, and within the comment
+    for (size_t size : {size_t{20}, bytes.size() - 1}) {
+        auto result = zip::read_central_directory_headers(std::span{bytes}.first(size));
+        EXPECT_FALSE(result.has_value()) << size;
+    }
+
+    //a name far longer than the directory, read through a source
+    bytes[28] = std::byte{0xa0};
+    bytes[29] = std::byte{0x0f};
+    auto directory_size = bytes.size();
+    zip::EOCD eocd{};
+    eocd.total_num_entries_central_directory = eocd.total_num_entries_central_directory_this_disk = 1;
+    eocd.size_central_directory = static_cast<uint32_t>(directory_size);
+    zip::write_eocd(eocd, bytes);
+
+    zippee::mapped_source source(bytes);
+    auto found = zip::read_eocd(source);
+    ASSERT_TRUE(found.has_value()) << found.error();
+    auto headers = zip::read_central_directory(source, *found);
+    ASSERT_FALSE(headers.has_value());
+    EXPECT_EQ(headers.error(), "Unable to read central directory: Central Directory Header extends past the end of the directory.");
+}
+
+TEST(ZipTests, read_local_file_header_truncated_name) {
+    zip::LocalFileHeader header{};
+    header.file_name = "hello.txt";
+    std::vector<std::byte> bytes;
+    zip::write_local_header(header, bytes);
+
+    auto result = zip::read_local_header(std::span{bytes}.first(bytes.size() - 1));
+    ASSERT_FALSE(result.has_value());
+    EXPECT_EQ(result.error(), "Local File Header extends past the end of the data.");
+}
+
 TEST(ZipTests, read_local_file_header_no_content) {
     auto data = make_bytes();
     auto result = zip::read_local_header(data);
@@ -524,4 +573,104 @@ TEST(ZipTests, read_local_file_header_content) {
     EXPECT_EQ(local_header.extra_field_length, 0x00);
     EXPECT_EQ(local_header.file_name, "hello");
     EXPECT_TRUE(local_header.extra_field.empty());
-}
\ No newline at end of file
+}
+TEST(ZipTests, write_local_header_round_trip) {
+    zip::LocalFileHeader header{};
+    header.extraction_version = 20;
+    header.compression_method = 8;
+    header.last_mod_file_time = 0x581a;
+    header.last_mod_file_date = 0x5a7f;
+    header.crc_32 = 0x12345678;
+    header.compressed_size = 10;
+    header.uncompressed_size = 20;
+    header.file_name = "dir/hello.txt";
+    header.extra_field = {std::byte{1}, std::byte{2}};
+
+    std::vector<std::byte> bytes;
+    zip::write_local_header(header, bytes);
+    EXPECT_EQ(bytes.size(), header.header_size());
+
+    auto result = zip::read_local_header(bytes);
+    ASSERT_TRUE(result.has_value());
+    EXPECT_EQ(result->signature, 0x04034b50);
+    EXPECT_EQ(result->compression_method, 8);
+    EXPECT_EQ(result->last_mod_file_date, 0x5a7f);
+    EXPECT_EQ(result->crc_32, 0x12345678);
+    EXPECT_EQ(result->compressed_size, 10);
+    EXPECT_EQ(result->uncompressed_size, 20);
+    EXPECT_EQ(result->file_name, "dir/hello.txt");
+    EXPECT_EQ(result->extra_field, header.extra_field);
+}
+
+TEST(ZipTests, write_central_directory_and_eocd_round_trip) {
+    zip::CentralDirectoryHeader header{};
+    header.version_made_by = 0x0314;
+    header.compression_method = 8;
+    header.crc_32 = 0xcafebabe;
+    header.external_file_attributes = 0x81a40000;
+    header.relative_offset_of_local_header = 1234;
+    header.file_name = "hello.txt";
+    header.file_comment = "greeting";
+
+    std::vector<std::byte> bytes;
+    zip::write_central_directory_header(header, bytes);
+    zip::write_central_directory_header(header, bytes);
+    auto directory_size = bytes.size();
+
+    zip::EOCD eocd{};
+    eocd.total_num_entries_central_directory = 2;
+    eocd.total_num_entries_central_directory_this_disk = 2;
+    eocd.size_central_directory = static_cast<uint32_t>(directory_size);
+    eocd.comment = "archive";
+    zip::write_eocd(eocd, bytes);
+
+    auto headers = zip::read_central_directory_headers(std::span{bytes}.first(directory_size));
+    ASSERT_TRUE(headers.has_value()) << headers.error();
+    ASSERT_EQ(headers->size(), 2);
+    EXPECT_EQ((*headers)[1].crc_32, 0xcafebabe);
+    EXPECT_EQ((*headers)[1].relative_offset_of_local_header, 1234);
+    EXPECT_EQ((*headers)[1].file_name, "hello.txt");
+    EXPECT_EQ((*headers)[1].file_comment, "greeting");
+
+    auto found = zip::search_for_eocd(bytes);
+    ASSERT_TRUE(found.has_value());
+    EXPECT_EQ(found->total_num_entries_central_directory, 2);
+    EXPECT_EQ(found->size_central_directory, directory_size);
+    EXPECT_EQ(found->comment, "archive");
+}
+
+TEST(ZipTests, find_duplicates_compares_compressed_bytes) {
+    std::vector<std::byte> bytes;
+    std::vector<zip::CentralDirectoryHeader> headers;
+    auto add = [&](std::string name, std::string contents, uint32_t crc) {
+        zip::LocalFileHeader local{};
+        local.crc_32 = crc;
+        local.compressed_size = static_cast<uint32_t>(contents.size());
+        local.uncompressed_size = local.compressed_size;
+        local.file_name = name;
+
+        zip::CentralDirectoryHeader h{};
+        h.crc_32 = crc;
+        h.compressed_size = local.compressed_size;
+        h.uncompressed_size = local.uncompressed_size;
+        h.relative_offset_of_local_header = static_cast<uint32_t>(bytes.size());
+        h.file_name = name;
+        headers.push_back(h);
+
+        zip::write_local_header(local, bytes);
+        for (char c : contents) {
+            bytes.push_back(std::byte(c));
+        }
+    };
+
+    add("a.txt", "hello", 1);
+    add("b.txt", "hello", 1);
+    add("c.txt", "jello", 1); //same metadata, different bytes
+    add("d.txt", "jello", 1);
+    add("e.txt", "hello", 2);
+    add("dir/", "", 0);
+    add("empty.txt", "", 0);
+
+    auto originals = zip::find_duplicates(zippee::mapped_source(bytes), headers);
+    EXPECT_EQ(originals, (std::vector<size_t>{0, 0, 2, 2, 4, 5, 6}));
+}
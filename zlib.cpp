@@ -0,0 +1,97 @@
+//------------------------------------------------------------------------------
+// zlib.cpp
+//------------------------------------------------------------------------------
+
+#include "zlib.hpp"
+
+#include "deflate.hpp"
+
+#include <stdexcept>
+
+namespace {
+    constexpr uint32_t ADLER_MODULUS = 65521;
+
+    // Largest n such that 255n(n+1)/2 + (n+1)(ADLER_MODULUS-1) fits in 32 bits,
+    // so the modulo can be deferred for that many bytes.
+    constexpr size_t ADLER_NMAX = 5552;
+
+    uint32_t read_be32(std::span<const std::byte> data) {
+        return (std::to_integer<uint32_t>(data[0]) << 24)
+            | (std::to_integer<uint32_t>(data[1]) << 16)
+            | (std::to_integer<uint32_t>(data[2]) << 8)
+            | std::to_integer<uint32_t>(data[3]);
+    }
+}
+
+uint32_t zlib::adler32(std::span<const std::byte> data, uint32_t adler) {
+    uint32_t a = adler & 0xffff;
+    uint32_t b = adler >> 16;
+
+    while (!data.empty()) {
+        auto block = data.subspan(0, std::min(data.size(), ADLER_NMAX));
+        for (auto byte : block) {
+            a += std::to_integer<uint32_t>(byte);
+            b += a;
+        }
+        a %= ADLER_MODULUS;
+        b %= ADLER_MODULUS;
+        data = data.subspan(block.size());
+    }
+
+    return (b << 16) | a;
+}
+
+std::expected<zlib::Header, std::string> zlib::read_header(std::span<const std::byte> data) {
+    if (data.size() < Header::SIZE) {
+        return std::unexpected("Not enough bytes for a zlib header.");
+    }
+
+    auto cmf = std::to_integer<uint8_t>(data[0]);
+    auto flg = std::to_integer<uint8_t>(data[1]);
+    if ((cmf * 256 + flg) % 31 != 0) {
+        return std::unexpected("zlib header check bits are invalid.");
+    }
+
+    Header h;
+    h.compression_method = cmf & 0x0f;
+    h.compression_info = cmf >> 4;
+    h.level = flg >> 6;
+    h.preset_dictionary = (flg & 0x20) != 0;
+
+    if (h.compression_method != 8) {
+        return std::unexpected("zlib stream is not compressed with DEFLATE.");
+    }
+    if (h.compression_info > 7) {
+        return std::unexpected("zlib window size is too large.");
+    }
+
+    return h;
+}
+
+std::expected<std::vector<std::byte>, std::string> zlib::decompress(std::span<std::byte> data) {
+    auto header = read_header(data);
+    if (!header) {
+        return std::unexpected(header.error());
+    }
+    if (header->preset_dictionary) {
+        return std::unexpected("zlib preset dictionaries are unsupported.");
+    }
+
+    std::vector<std::byte> output;
+    size_t deflate_size;
+    try {
+        deflate_size = deflate::thread_decoder().decompress(data.subspan(Header::SIZE), output);
+    } catch (const std::runtime_error& e) {
+        return std::unexpected(e.what());
+    }
+
+    auto trailer = data.subspan(Header::SIZE + deflate_size);
+    if (trailer.size() < 4) {
+        return std::unexpected("zlib stream is missing its Adler-32.");
+    }
+    if (read_be32(trailer) != adler32(output)) {
+        return std::unexpected("Adler-32 does not match.");
+    }
+
+    return output;
+}
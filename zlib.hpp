@@ -0,0 +1,33 @@
+//------------------------------------------------------------------------------
+// zlib.hpp
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace zlib {
+
+uint32_t adler32(std::span<const std::byte> data, uint32_t adler = 1);
+
+// RFC 1950 stream header: CMF and FLG.
+struct Header {
+    uint8_t compression_method;
+    uint8_t compression_info; // log2 of the window size, less 8
+    uint8_t level;
+    bool preset_dictionary;
+
+    static constexpr size_t SIZE = 2;
+};
+
+std::expected<Header, std::string> read_header(std::span<const std::byte> data);
+
+// Inflates a whole zlib stream and checks its Adler-32 trailer.
+std::expected<std::vector<std::byte>, std::string> decompress(std::span<std::byte> data);
+
+}
@@ -0,0 +1,89 @@
+//------------------------------------------------------------------------------
+// zlib.tests.cpp
+//------------------------------------------------------------------------------
+
+#include "zlib.hpp"
+#include "test_archive.hpp"
+
+#include <gtest/gtest.h>
+
+namespace {
+
+// https://stackoverflow.com/a/45172360
+template<typename... Ts>
+std::array<std::byte, sizeof...(Ts)> make_bytes(Ts&&... args) noexcept {
+    return{std::byte(std::forward<Ts>(args))...};
+}
+
+using test::to_bytes;
+
+// "Hello, zlib! Hello, zlib!\n"
+auto hello_stream() {
+    return make_bytes(
+        0x78, 0x9c, 0xf3, 0x48, 0xcd, 0xc9, 0xc9, 0xd7, 0x51, 0xa8, 0xca, 0xc9, 0x4c, 0x52, 0x54, 0xf0,
+        0x40, 0xe2, 0x70, 0x01, 0x00, 0x75, 0xa4, 0x08, 0x4f
+    );
+}
+
+}
+
+TEST(Zlib, adler32) {
+    EXPECT_EQ(zlib::adler32(to_bytes("")), 1);
+    EXPECT_EQ(zlib::adler32(to_bytes("Wikipedia")), 0x11e60398);
+}
+
+TEST(Zlib, adler32_long_input) {
+    // long enough to need the deferred modulo several times
+    std::vector<std::byte> data(100000, std::byte{0xff});
+
+    uint32_t a = 1, b = 0;
+    for (auto byte : data) {
+        a = (a + std::to_integer<uint32_t>(byte)) % 65521;
+        b = (b + a) % 65521;
+    }
+
+    EXPECT_EQ(zlib::adler32(data), (b << 16) | a);
+    EXPECT_EQ(zlib::adler32(std::span{data}.subspan(50000), zlib::adler32(std::span{data}.subspan(0, 50000))), (b << 16) | a);
+}
+
+TEST(Zlib, read_header) {
+    auto header = zlib::read_header(hello_stream());
+
+    ASSERT_TRUE(header);
+    EXPECT_EQ(header->compression_method, 8);
+    EXPECT_EQ(header->compression_info, 7);
+    EXPECT_EQ(header->level, 2);
+    EXPECT_FALSE(header->preset_dictionary);
+}
+
+TEST(Zlib, read_header_invalid) {
+    EXPECT_FALSE(zlib::read_header(make_bytes(0x78)));
+    EXPECT_FALSE(zlib::read_header(make_bytes(0x78, 0x9d)));
+    EXPECT_FALSE(zlib::read_header(make_bytes('P', 'K')));
+}
+
+TEST(Zlib, decompress) {
+    auto data = hello_stream();
+
+    auto output = zlib::decompress(data);
+
+    ASSERT_TRUE(output);
+    EXPECT_EQ(*output, to_bytes("Hello, zlib! Hello, zlib!\n"));
+}
+
+TEST(Zlib, decompress_adler_mismatch) {
+    auto data = hello_stream();
+    data[24] ^= std::byte{1};
+
+    auto output = zlib::decompress(data);
+
+    ASSERT_FALSE(output);
+    EXPECT_EQ(output.error(), "Adler-32 does not match.");
+}
+
+TEST(Zlib, decompress_preset_dictionary) {
+    // 0x78 0xbb: FDICT set
+    auto data = make_bytes(0x78, 0xbb, 0x00, 0x00, 0x00, 0x00);
+
+    EXPECT_FALSE(zlib::decompress(data));
+}
@@ -0,0 +1,1107 @@
+//------------------------------------------------------------------------------
+// zstd.cpp
+//------------------------------------------------------------------------------
+
+#include "zstd.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+
+namespace {
+    constexpr uint32_t SKIPPABLE_MAGIC = 0x184D2A50;
+    constexpr uint32_t SKIPPABLE_MASK = 0xFFFFFFF0;
+    constexpr size_t MIN_FRAME_HEADER = 5; //magic and descriptor
+    constexpr size_t BLOCK_HEADER_SIZE = 3;
+    constexpr size_t CHECKSUM_SIZE = 4;
+    constexpr size_t LITERAL_COPY = 16;
+
+    constexpr uint64_t PRIME64_1 = 0x9E3779B185EBCA87;
+    constexpr uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4F;
+    constexpr uint64_t PRIME64_3 = 0x165667B19E3779F9;
+    constexpr uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63;
+    constexpr uint64_t PRIME64_5 = 0x27D4EB2F165667C5;
+
+    enum class BlockType {
+        Raw = 0,
+        RLE = 1,
+        Compressed = 2,
+        Reserved = 3
+    };
+
+    enum class LiteralsType {
+        Raw = 0,
+        RLE = 1,
+        Compressed = 2,
+        Treeless = 3
+    };
+
+    enum class TableMode {
+        Predefined = 0,
+        RLE = 1,
+        Compressed = 2,
+        Repeat = 3
+    };
+
+    // indexed by the symbol kinds in the order their modes are given
+    enum SymbolKind {
+        LiteralLength = 0,
+        Offset = 1,
+        MatchLength = 2
+    };
+
+    constexpr std::array<uint8_t, 3> MAX_SYMBOLS = {35, 31, 52};
+    constexpr std::array<uint8_t, 3> MAX_ACCURACY_LOGS = {9, 8, 9};
+    // extra bits a sequence can read along with its state updates after one reload
+    constexpr size_t MAX_EXTRA_BITS = 57 - (9 + 8 + 9);
+
+    // Huffman weights are FSE coded with a table of their own.
+    constexpr uint8_t MAX_WEIGHT = 12;
+    constexpr uint8_t MAX_WEIGHT_ACCURACY_LOG = 6;
+    constexpr size_t MAX_WEIGHTS = 255;
+
+    constexpr std::array<int16_t, 36> DEFAULT_LITERAL_LENGTH_COUNTS = {
+        4, 3, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1,
+        2, 2, 2, 2, 2, 2, 2, 2, 2, 3, 2, 1, 1, 1, 1, 1,
+        -1, -1, -1, -1
+    };
+
+    constexpr std::array<int16_t, 53> DEFAULT_MATCH_LENGTH_COUNTS = {
+        1, 4, 3, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, -1, -1,
+        -1, -1, -1, -1, -1
+    };
+
+    constexpr std::array<int16_t, 29> DEFAULT_OFFSET_COUNTS = {
+        1, 1, 1, 1, 1, 1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+        1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1
+    };
+
+    constexpr std::array<uint8_t, 3> DEFAULT_ACCURACY_LOGS = {6, 5, 6};
+
+    constexpr std::array<uint32_t, 36> LITERAL_LENGTH_BASES = {
+        0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+        16, 18, 20, 22, 24, 28, 32, 40, 48, 64, 128, 256, 512, 1024, 2048, 4096,
+        8192, 16384, 32768, 65536
+    };
+
+    constexpr std::array<uint8_t, 36> LITERAL_LENGTH_EXTRAS = {
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        1, 1, 1, 1, 2, 2, 3, 3, 4, 6, 7, 8, 9, 10, 11, 12,
+        13, 14, 15, 16
+    };
+
+    constexpr std::array<uint32_t, 53> MATCH_LENGTH_BASES = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18,
+        19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34,
+        35, 37, 39, 41, 43, 47, 51, 59, 67, 83, 99, 131, 259, 515, 1027, 2051,
+        4099, 8195, 16387, 32771, 65539
+    };
+
+    constexpr std::array<uint8_t, 53> MATCH_LENGTH_EXTRAS = {
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        1, 1, 1, 1, 2, 2, 3, 3, 4, 4, 5, 7, 8, 9, 10, 11,
+        12, 13, 14, 15, 16
+    };
+
+    uint64_t load_le(std::span<const std::byte> data, size_t size) {
+        uint64_t value = 0;
+        for (size_t i = 0; i < size; i++) {
+            value |= static_cast<uint64_t>(data[i]) << (8 * i);
+        }
+        return value;
+    }
+
+    void need(std::span<const std::byte> data, size_t size, const char* what) {
+        if (data.size() < size) {
+            throw std::runtime_error(std::format("Zstandard {} is truncated.", what));
+        }
+    }
+
+    uint64_t rotl(uint64_t x, int r) {
+        return std::rotl(x, r);
+    }
+
+    uint64_t xxh_round(uint64_t acc, uint64_t input) {
+        acc += input * PRIME64_2;
+        return rotl(acc, 31) * PRIME64_1;
+    }
+
+    uint64_t xxh_merge(uint64_t acc, uint64_t lane) {
+        acc ^= xxh_round(0, lane);
+        return acc * PRIME64_1 + PRIME64_4;
+    }
+
+    uint64_t read64(const std::byte* p) {
+        uint64_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    uint32_t read32(const std::byte* p) {
+        uint32_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    // Reads a bitstream from its end back, as FSE and Huffman coded streams
+    // are written: the highest set bit of the last byte marks where it
+    // starts, and each read takes the bits just below the ones before. Bits
+    // come from a 64-bit container read from the top down; reload() moves it
+    // back through the stream, after which at least 57 bits can be read, or
+    // whatever is left. Near the beginning reads are padded with zeros, which
+    // Huffman lookups of the last few literals rely on.
+    class BackwardBits {
+    private:
+        const std::byte* _start;
+        const std::byte* _in;
+        uint64_t _container = 0;
+        size_t _consumed;
+
+    public:
+        explicit BackwardBits(std::span<const std::byte> data)
+            : _start(data.data()) {
+            if (data.empty() || data.back() == std::byte{0}) {
+                throw std::runtime_error("Zstandard bitstream has no end marker.");
+            }
+
+            if (data.size() >= sizeof(_container)) {
+                _in = data.data() + data.size() - sizeof(_container);
+                _container = read64(_in);
+                _consumed = 0;
+            } else {
+                //the missing top bytes count as read
+                _in = _start;
+                std::memcpy(&_container, _start, data.size());
+                _consumed = (sizeof(_container) - data.size()) * 8;
+            }
+            _consumed += std::countl_zero(static_cast<uint8_t>(data.back())) + 1;
+        }
+
+        // Bits left before the start, negative once read past it.
+        ptrdiff_t position() const {
+            return (_in - _start) * 8 + 64 - static_cast<ptrdiff_t>(_consumed);
+        }
+
+        [[gnu::always_inline]] inline void reload() {
+            if (_in - _start >= static_cast<ptrdiff_t>(sizeof(_container))) {
+                _in -= _consumed >> 3;
+                _consumed &= 7;
+            } else if (_in == _start) {
+                return;
+            } else {
+                auto bytes = std::min<size_t>(_consumed >> 3, _in - _start);
+                _in -= bytes;
+                _consumed -= bytes * 8;
+            }
+            _container = read64(_in);
+        }
+
+        [[gnu::always_inline]] inline uint64_t peek(size_t bits) const {
+            //shifting twice leaves nothing for zero bits
+            return ((_container << (_consumed & 63)) >> 1) >> (63 - bits);
+        }
+
+        [[gnu::always_inline]] inline void consume(size_t bits) {
+            _consumed += bits;
+        }
+
+        [[gnu::always_inline]] inline uint64_t read(size_t bits) {
+            auto value = peek(bits);
+            consume(bits);
+            return value;
+        }
+    };
+
+    struct Distribution {
+        std::array<int16_t, 256> counts{};
+        size_t symbols = 0;
+        uint8_t accuracy_log = 0;
+        // bytes of input the description took
+        size_t size = 0;
+    };
+
+    // Reads the normalised counts an FSE table is built from, which are
+    // written forwards, least significant bit first, as DEFLATE is.
+    Distribution read_distribution(std::span<std::byte> data, size_t max_symbol, uint8_t max_accuracy_log) {
+        zippee::bitspan bits(data);
+        // the last value may end close to the end of input, past which bits are zeros
+        auto peek = [&](size_t count) {
+            return bits.peek_bits(static_cast<uint8_t>(std::min(count, bits.bits_remaining())));
+        };
+        auto read = [&](size_t count) {
+            auto value = peek(count);
+            bits.skip_bits(std::min(count, bits.bits_remaining()));
+            return value;
+        };
+
+        Distribution distribution;
+        distribution.accuracy_log = static_cast<uint8_t>(read(4) + 5);
+        if (distribution.accuracy_log > max_accuracy_log) {
+            throw std::runtime_error("FSE accuracy log is too large.");
+        }
+
+        int32_t remaining = (1 << distribution.accuracy_log) + 1;
+        int32_t threshold = 1 << distribution.accuracy_log;
+        size_t value_bits = distribution.accuracy_log + 1;
+        size_t symbol = 0;
+
+        while (remaining > 1) {
+            if (symbol > max_symbol) {
+                throw std::runtime_error("FSE distribution has too many symbols.");
+            }
+
+            // values below max take one bit fewer
+            int32_t max = 2 * threshold - 1 - remaining;
+            int32_t count;
+            if (static_cast<int32_t>(peek(value_bits - 1)) < max) {
+                count = static_cast<int32_t>(read(value_bits - 1));
+            } else {
+                count = static_cast<int32_t>(read(value_bits));
+                if (count >= threshold) {
+                    count -= max;
+                }
+            }
+
+            count--;
+            remaining -= count < 0 ? -count : count;
+            if (remaining < 1) {
+                throw std::runtime_error("FSE distribution exceeds its accuracy.");
+            }
+            distribution.counts[symbol++] = static_cast<int16_t>(count);
+
+            if (count == 0) {
+                //zeros are followed by how many more zeros there are, 3 meaning more follow
+                uint32_t repeat;
+                do {
+                    repeat = read(2);
+                    if (symbol + repeat > max_symbol + 1) {
+                        throw std::runtime_error("FSE distribution has too many symbols.");
+                    }
+                    for (uint32_t i = 0; i < repeat; i++) {
+                        distribution.counts[symbol++] = 0;
+                    }
+                } while (repeat == 3);
+            }
+
+            while (remaining < threshold) {
+                value_bits--;
+                threshold >>= 1;
+            }
+        }
+
+        distribution.symbols = symbol;
+        distribution.size = (bits.bits_read() + 7) / 8;
+        if (distribution.size > data.size()) {
+            throw std::runtime_error("FSE distribution is truncated.");
+        }
+        return distribution;
+    }
+
+    // Gives each state of an FSE table for sequence codes the base and extra
+    // bits of its code.
+    void bake_sequence_table(const zstd::FseTable& fse, SymbolKind kind, zstd::SequenceTable& table) {
+        size_t size = size_t{1} << fse.accuracy_log;
+        for (size_t i = 0; i < size; i++) {
+            auto& entry = fse.entries[i];
+            uint32_t base;
+            uint8_t extra_bits;
+            switch (kind) {
+                case LiteralLength:
+                    base = LITERAL_LENGTH_BASES[entry.symbol];
+                    extra_bits = LITERAL_LENGTH_EXTRAS[entry.symbol];
+                    break;
+                case Offset:
+                    base = uint32_t{1} << entry.symbol;
+                    extra_bits = entry.symbol;
+                    break;
+                case MatchLength:
+                    base = MATCH_LENGTH_BASES[entry.symbol];
+                    extra_bits = MATCH_LENGTH_EXTRAS[entry.symbol];
+                    break;
+            }
+            table.entries[i] = {base, entry.baseline, entry.bits, extra_bits};
+        }
+        table.accuracy_log = fse.accuracy_log;
+    }
+
+    const zstd::SequenceTable& default_table(SymbolKind kind) {
+        static const std::array<zstd::SequenceTable, 3> tables = [] {
+            std::array<zstd::SequenceTable, 3> baked;
+            zstd::FseTable fse;
+            zstd::build_fse_table(DEFAULT_LITERAL_LENGTH_COUNTS, DEFAULT_ACCURACY_LOGS[LiteralLength], fse);
+            bake_sequence_table(fse, LiteralLength, baked[LiteralLength]);
+            zstd::build_fse_table(DEFAULT_OFFSET_COUNTS, DEFAULT_ACCURACY_LOGS[Offset], fse);
+            bake_sequence_table(fse, Offset, baked[Offset]);
+            zstd::build_fse_table(DEFAULT_MATCH_LENGTH_COUNTS, DEFAULT_ACCURACY_LOGS[MatchLength], fse);
+            bake_sequence_table(fse, MatchLength, baked[MatchLength]);
+            return baked;
+        }();
+        return tables[kind];
+    }
+
+    // One state's worth of FSE decoding: the symbol, then the next state.
+    [[gnu::always_inline]] inline uint8_t fse_symbol(const zstd::FseTable& table, size_t state) {
+        return table.entries[state].symbol;
+    }
+
+    [[gnu::always_inline]] inline size_t fse_next(const zstd::FseTable& table, size_t state, BackwardBits& bits) {
+        auto& entry = table.entries[state];
+        return entry.baseline + bits.read(entry.bits);
+    }
+}
+
+bool zstd::is_zstd(std::span<const std::byte> data) {
+    return data.size() >= 4 && load_le(data, 4) == MAGIC;
+}
+
+zstd::XXHash64::XXHash64(uint64_t seed)
+    : _lanes{seed + PRIME64_1 + PRIME64_2, seed + PRIME64_2, seed, seed - PRIME64_1}
+    , _seed(seed) {
+}
+
+void zstd::XXHash64::update(std::span<const std::byte> data) {
+    _length += data.size();
+
+    if (_pending_size > 0) {
+        auto taken = std::min(data.size(), _pending.size() - _pending_size);
+        std::memcpy(_pending.data() + _pending_size, data.data(), taken);
+        _pending_size += taken;
+        data = data.subspan(taken);
+        if (_pending_size < _pending.size()) {
+            return;
+        }
+        for (size_t i = 0; i < 4; i++) {
+            _lanes[i] = xxh_round(_lanes[i], read64(_pending.data() + 8 * i));
+        }
+        _pending_size = 0;
+    }
+
+    //in locals, as the input may alias anything
+    auto p = data.data();
+    auto end = p + data.size();
+    auto [v1, v2, v3, v4] = _lanes;
+    while (end - p >= 32) {
+        v1 = xxh_round(v1, read64(p));
+        v2 = xxh_round(v2, read64(p + 8));
+        v3 = xxh_round(v3, read64(p + 16));
+        v4 = xxh_round(v4, read64(p + 24));
+        p += 32;
+    }
+    _lanes = {v1, v2, v3, v4};
+
+    _pending_size = end - p;
+    std::memcpy(_pending.data(), p, _pending_size);
+}
+
+uint64_t zstd::XXHash64::digest() const {
+    uint64_t h;
+    if (_length >= 32) {
+        h = rotl(_lanes[0], 1) + rotl(_lanes[1], 7) + rotl(_lanes[2], 12) + rotl(_lanes[3], 18);
+        for (auto lane : _lanes) {
+            h = xxh_merge(h, lane);
+        }
+    } else {
+        h = _seed + PRIME64_5;
+    }
+    h += _length;
+
+    auto p = _pending.data();
+    auto end = p + _pending_size;
+    for (; end - p >= 8; p += 8) {
+        h ^= xxh_round(0, read64(p));
+        h = rotl(h, 27) * PRIME64_1 + PRIME64_4;
+    }
+    if (end - p >= 4) {
+        h ^= read32(p) * PRIME64_1;
+        h = rotl(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        h ^= static_cast<uint64_t>(*p) * PRIME64_5;
+        h = rotl(h, 11) * PRIME64_1;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t zstd::xxhash64(std::span<const std::byte> data, uint64_t seed) {
+    XXHash64 hash(seed);
+    hash.update(data);
+    return hash.digest();
+}
+
+std::expected<zstd::FrameHeader, std::string> zstd::read_frame_header(std::span<const std::byte> data) {
+    if (data.size() < MIN_FRAME_HEADER) {
+        return std::unexpected("Zstandard frame header is truncated.");
+    }
+    if (load_le(data, 4) != MAGIC) {
+        return std::unexpected("Not a Zstandard frame.");
+    }
+
+    auto descriptor = static_cast<uint8_t>(data[4]);
+    auto content_size_flag = descriptor >> 6;
+    bool single_segment = descriptor & 0x20;
+    if (descriptor & 0x08) {
+        return std::unexpected("Zstandard frame header has a reserved bit set.");
+    }
+
+    constexpr std::array<size_t, 4> DICTIONARY_ID_SIZES = {0, 1, 2, 4};
+    constexpr std::array<size_t, 4> CONTENT_SIZE_SIZES = {0, 2, 4, 8};
+    auto dictionary_id_size = DICTIONARY_ID_SIZES[descriptor & 0x03];
+    auto content_size_size = content_size_flag == 0 && single_segment ? 1 : CONTENT_SIZE_SIZES[content_size_flag];
+
+    FrameHeader header{};
+    header.has_checksum = descriptor & 0x04;
+    header.header_size = MIN_FRAME_HEADER + (single_segment ? 0 : 1) + dictionary_id_size + content_size_size;
+    if (data.size() < header.header_size) {
+        return std::unexpected("Zstandard frame header is truncated.");
+    }
+
+    size_t pos = MIN_FRAME_HEADER;
+    if (!single_segment) {
+        auto window = static_cast<uint8_t>(data[pos++]);
+        uint64_t base = uint64_t{1} << (10 + (window >> 3));
+        header.window_size = base + (base / 8) * (window & 0x07);
+    }
+
+    header.dictionary_id = static_cast<uint32_t>(load_le(data.subspan(pos), dictionary_id_size));
+    pos += dictionary_id_size;
+
+    if (content_size_size > 0) {
+        auto content_size = load_le(data.subspan(pos), content_size_size);
+        header.content_size = content_size_size == 2 ? content_size + 256 : content_size;
+    }
+    if (single_segment) {
+        header.window_size = *header.content_size;
+    }
+    if (header.window_size > MAX_WINDOW_SIZE) {
+        return std::unexpected("Zstandard frame window is too large.");
+    }
+
+    return header;
+}
+
+size_t zstd::sink_window(std::span<const std::byte> frame, uint64_t size) {
+    auto header = read_frame_header(frame);
+    if (!header) {
+        throw std::runtime_error(header.error());
+    }
+    return std::min(header->window_size, size);
+}
+
+void zstd::build_fse_table(std::span<const int16_t> counts, uint8_t accuracy_log, FseTable& table) {
+    if (accuracy_log > FseTable::MAX_ACCURACY_LOG) {
+        throw std::runtime_error("FSE accuracy log is too large.");
+    }
+
+    size_t size = size_t{1} << accuracy_log;
+    size_t total = 0;
+    for (auto count : counts) {
+        total += count == -1 ? 1 : std::max<int16_t>(count, 0);
+    }
+    if (counts.size() > 256 || total != size) {
+        throw std::runtime_error("FSE counts don't fill the table.");
+    }
+
+    // symbols of below one state's probability take a state each at the top
+    size_t high = size - 1;
+    std::array<uint16_t, 256> next{};
+
+    for (size_t s = 0; s < counts.size(); s++) {
+        if (counts[s] == -1) {
+            table.entries[high--].symbol = static_cast<uint8_t>(s);
+            next[s] = 1;
+        } else if (counts[s] > 0) {
+            next[s] = static_cast<uint16_t>(counts[s]);
+        }
+    }
+
+    // the rest are spread through the table with a step that visits every state
+    size_t step = (size >> 1) + (size >> 3) + 3;
+    size_t mask = size - 1;
+    size_t position = 0;
+    for (size_t s = 0; s < counts.size(); s++) {
+        for (int16_t i = 0; i < counts[s]; i++) {
+            table.entries[position].symbol = static_cast<uint8_t>(s);
+            do {
+                position = (position + step) & mask;
+            } while (position > high);
+        }
+    }
+    for (size_t i = 0; i < size; i++) {
+        auto& entry = table.entries[i];
+        auto state = next[entry.symbol]++;
+        auto bits = accuracy_log - (std::bit_width(state) - 1);
+        entry.bits = static_cast<uint8_t>(bits);
+        entry.baseline = static_cast<uint16_t>((state << bits) - size);
+    }
+    table.accuracy_log = accuracy_log;
+}
+
+zstd::Decoder::Decoder()
+    : _literal_buffer(MAX_BLOCK_SIZE) {
+}
+
+const zstd::DecoderStats& zstd::Decoder::stats() const {
+    return _stats;
+}
+
+void zstd::Decoder::reset_stats() {
+    _stats = {};
+}
+
+size_t zstd::Decoder::decompress(std::span<std::byte> data, std::vector<std::byte>& output) {
+    output.clear();
+    deflate::VectorSink sink(output);
+    return decompress(data, sink);
+}
+
+size_t zstd::Decoder::decompress(std::span<std::byte> data, std::pmr::vector<std::byte>& output) {
+    output.clear();
+    deflate::PmrVectorSink sink(output);
+    return decompress(data, sink);
+}
+
+size_t zstd::Decoder::decompress(std::span<std::byte> data, deflate::OutputSink& output) {
+    if (data.empty()) {
+        throw std::runtime_error("No Zstandard frame.");
+    }
+
+    size_t pos = 0;
+    while (pos < data.size()) {
+        auto rest = data.subspan(pos);
+        need(rest, 4, "frame");
+        auto magic = static_cast<uint32_t>(load_le(rest, 4));
+        if ((magic & SKIPPABLE_MASK) == SKIPPABLE_MAGIC) {
+            need(rest, 8, "skippable frame");
+            auto skipped = 8 + load_le(rest.subspan(4), 4);
+            need(rest, skipped, "skippable frame");
+            pos += skipped;
+        } else {
+            pos += frame(rest, output);
+        }
+    }
+    return pos;
+}
+
+bool zstd::Decoder::decompress_range(std::span<std::byte> data, deflate::RangeSink& output) {
+    try {
+        decompress(data, output);
+    } catch (const deflate::OutputComplete&) {
+        return false;
+    }
+    output.flush();
+    return true;
+}
+
+size_t zstd::Decoder::frame(std::span<std::byte> data, deflate::OutputSink& output) {
+    auto header = read_frame_header(data);
+    if (!header) {
+        throw std::runtime_error(header.error());
+    }
+    if (header->dictionary_id != 0) {
+        throw std::runtime_error("Zstandard dictionaries are not supported.");
+    }
+
+    _tables_set.fill(false);
+    _huffman_set = false;
+    _repeat_offsets = {1, 4, 8};
+    _stats.frames++;
+
+    auto block_limit = std::min<uint64_t>(header->window_size, MAX_BLOCK_SIZE);
+    XXHash64 hash;
+    size_t frame_output = 0;
+    size_t pos = header->header_size;
+
+    bool last = false;
+    while (!last) {
+        auto rest = data.subspan(pos);
+        need(rest, BLOCK_HEADER_SIZE, "block header");
+        auto block_header = static_cast<uint32_t>(load_le(rest, BLOCK_HEADER_SIZE));
+        last = block_header & 1;
+        auto type = static_cast<BlockType>((block_header >> 1) & 3);
+        size_t block_size = block_header >> 3;
+        pos += BLOCK_HEADER_SIZE;
+        rest = rest.subspan(BLOCK_HEADER_SIZE);
+
+        if (block_size > block_limit) {
+            throw std::runtime_error("Zstandard block exceeds the largest block size.");
+        }
+
+        std::span<std::byte> written;
+        switch (type) {
+            case BlockType::Raw:
+            {
+                need(rest, block_size, "block");
+                auto area = output.reserve(block_size);
+                written = area.subspan(output.size(), block_size);
+                std::memcpy(written.data(), rest.data(), block_size);
+                output.commit(output.size() + block_size);
+                pos += block_size;
+                _stats.raw_blocks++;
+            }
+            break;
+
+            case BlockType::RLE:
+            {
+                need(rest, 1, "block");
+                auto area = output.reserve(block_size);
+                written = area.subspan(output.size(), block_size);
+                std::memset(written.data(), static_cast<int>(rest[0]), block_size);
+                output.commit(output.size() + block_size);
+                pos += 1;
+                _stats.rle_blocks++;
+            }
+            break;
+
+            case BlockType::Compressed:
+                need(rest, block_size, "block");
+                compressed_block(rest.first(block_size), block_limit);
+                written = execute(output, frame_output, block_limit);
+                pos += block_size;
+                _stats.compressed_blocks++;
+                break;
+
+            case BlockType::Reserved:
+                throw std::runtime_error("Zstandard block type is reserved.");
+        }
+
+        frame_output += written.size();
+        if (header->content_size && frame_output > *header->content_size) {
+            throw std::runtime_error("Zstandard frame exceeds its content size.");
+        }
+        if (header->has_checksum) {
+            hash.update(written);
+        }
+    }
+
+    if (header->content_size && frame_output != *header->content_size) {
+        throw std::runtime_error("Zstandard frame is shorter than its content size.");
+    }
+
+    if (header->has_checksum) {
+        auto rest = data.subspan(pos);
+        need(rest, CHECKSUM_SIZE, "checksum");
+        if (load_le(rest, CHECKSUM_SIZE) != (hash.digest() & 0xFFFFFFFF)) {
+            throw std::runtime_error("Zstandard checksum does not match.");
+        }
+        pos += CHECKSUM_SIZE;
+    }
+
+    return pos;
+}
+
+void zstd::Decoder::compressed_block(std::span<std::byte> block, size_t block_limit) {
+    auto literals_size = read_literals(block, block_limit);
+    read_sequences(block.subspan(literals_size));
+}
+
+size_t zstd::Decoder::read_literals(std::span<std::byte> block, size_t block_limit) {
+    need(block, 1, "literals section");
+    auto first = static_cast<uint8_t>(block[0]);
+    auto type = static_cast<LiteralsType>(first & 3);
+    auto size_format = (first >> 2) & 3;
+
+    if (type == LiteralsType::Raw || type == LiteralsType::RLE) {
+        size_t header_size = size_format == 1 ? 2 : size_format == 3 ? 3 : 1;
+        need(block, header_size, "literals section");
+        auto header = load_le(block, header_size);
+        size_t regenerated = header_size == 1 ? header >> 3 : header >> 4;
+        if (regenerated > block_limit) {
+            throw std::runtime_error("Zstandard literals exceed the block size.");
+        }
+
+        auto rest = block.subspan(header_size);
+        if (type == LiteralsType::Raw) {
+            need(rest, regenerated, "literals");
+            _literals = rest.first(regenerated);
+            return header_size + regenerated;
+        }
+
+        need(rest, 1, "literals");
+        std::memset(_literal_buffer.data(), static_cast<int>(rest[0]), regenerated);
+        _literals = std::span(_literal_buffer).first(regenerated);
+        return header_size + 1;
+    }
+
+    // both sizes share the header, with 10, 14 or 18 bits each
+    size_t header_size = size_format < 2 ? 3 : size_format + 2;
+    size_t size_bits = size_format < 2 ? 10 : 4 * size_format + 6;
+    bool single_stream = size_format == 0;
+    need(block, header_size, "literals section");
+    auto header = load_le(block, header_size);
+    size_t regenerated = (header >> 4) & ((size_t{1} << size_bits) - 1);
+    size_t compressed = (header >> (4 + size_bits)) & ((size_t{1} << size_bits) - 1);
+    if (regenerated > block_limit) {
+        throw std::runtime_error("Zstandard literals exceed the block size.");
+    }
+
+    auto rest = block.subspan(header_size);
+    need(rest, compressed, "literals");
+    auto streams = rest.first(compressed);
+
+    if (type == LiteralsType::Compressed) {
+        auto table_size = read_huffman_table(streams);
+        streams = streams.subspan(table_size);
+    } else if (!_huffman_set) {
+        throw std::runtime_error("Zstandard literals repeat a Huffman table that was never given.");
+    }
+
+    auto output = _literal_buffer.data();
+    if (single_stream) {
+        decode_literal_stream(streams, output, regenerated);
+    } else {
+        //a jump table gives the sizes of the first three streams
+        need(streams, 6, "jump table");
+        std::array<size_t, 4> sizes;
+        size_t total = 6;
+        for (size_t i = 0; i < 3; i++) {
+            sizes[i] = load_le(streams.subspan(2 * i), 2);
+            total += sizes[i];
+        }
+        if (total > streams.size()) {
+            throw std::runtime_error("Zstandard jump table exceeds the literals.");
+        }
+        sizes[3] = streams.size() - total;
+
+        size_t segment = (regenerated + 3) / 4;
+        if (segment * 3 > regenerated) {
+            throw std::runtime_error("Zstandard literals are too few for four streams.");
+        }
+
+        auto stream = streams.subspan(6);
+        for (size_t i = 0; i < 4; i++) {
+            auto count = i < 3 ? segment : regenerated - 3 * segment;
+            decode_literal_stream(stream.first(sizes[i]), output + i * segment, count);
+            stream = stream.subspan(sizes[i]);
+        }
+    }
+
+    _literals = std::span(_literal_buffer).first(regenerated);
+    return header_size + compressed;
+}
+
+size_t zstd::Decoder::read_huffman_table(std::span<std::byte> data) {
+    need(data, 1, "Huffman table");
+    auto header = static_cast<uint8_t>(data[0]);
+
+    std::array<uint8_t, MAX_WEIGHTS + 1> weights{};
+    size_t count = 0;
+    size_t size;
+
+    if (header >= 128) {
+        //four bits each, the first in the high half
+        count = header - 127;
+        size = 1 + (count + 1) / 2;
+        need(data, size, "Huffman table");
+        for (size_t i = 0; i < count; i++) {
+            auto byte = static_cast<uint8_t>(data[1 + i / 2]);
+            weights[i] = i % 2 == 0 ? byte >> 4 : byte & 0x0f;
+        }
+    } else {
+        //FSE coded, with two states taking turns over one stream
+        size = 1 + header;
+        need(data, size, "Huffman table");
+        auto description = data.subspan(1, header);
+        auto distribution = read_distribution(description, MAX_WEIGHT, MAX_WEIGHT_ACCURACY_LOG);
+        FseTable table;
+        build_fse_table(std::span(distribution.counts).first(distribution.symbols), distribution.accuracy_log, table);
+
+        BackwardBits bits(description.subspan(distribution.size));
+        bits.reload();
+        std::array<size_t, 2> states;
+        states[0] = bits.read(table.accuracy_log);
+        states[1] = bits.read(table.accuracy_log);
+
+        for (size_t turn = 0;; turn ^= 1) {
+            if (count + 2 > MAX_WEIGHTS) {
+                throw std::runtime_error("Zstandard Huffman table has too many weights.");
+            }
+            weights[count++] = fse_symbol(table, states[turn]);
+            bits.reload();
+            states[turn] = fse_next(table, states[turn], bits);
+            if (bits.position() < 0) {
+                //the stream ran out, so the other state holds the last weight
+                weights[count++] = fse_symbol(table, states[turn ^ 1]);
+                break;
+            }
+        }
+    }
+
+    // the last symbol's weight is left out, as what brings the total to a power of two
+    uint32_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (weights[i] > HuffmanTable::MAX_BITS) {
+            throw std::runtime_error("Zstandard Huffman weight is too large.");
+        }
+        if (weights[i] > 0) {
+            total += uint32_t{1} << (weights[i] - 1);
+        }
+    }
+    if (total == 0) {
+        throw std::runtime_error("Zstandard Huffman table is empty.");
+    }
+
+    auto max_bits = std::bit_width(total);
+    auto left = (uint32_t{1} << max_bits) - total;
+    if (max_bits > static_cast<int>(HuffmanTable::MAX_BITS) || !std::has_single_bit(left)) {
+        throw std::runtime_error("Zstandard Huffman weights don't make a prefix code.");
+    }
+    weights[count++] = static_cast<uint8_t>(std::bit_width(left));
+
+    // codes are laid out lightest weight first, each weight in symbol order
+    std::array<uint32_t, HuffmanTable::MAX_BITS + 2> starts{};
+    for (size_t i = 0; i < count; i++) {
+        if (weights[i] > 0) {
+            starts[weights[i] + 1] += uint32_t{1} << (weights[i] - 1);
+        }
+    }
+    for (size_t w = 1; w < starts.size(); w++) {
+        starts[w] += starts[w - 1];
+    }
+
+    for (size_t s = 0; s < count; s++) {
+        auto weight = weights[s];
+        if (weight == 0) {
+            continue;
+        }
+        HuffmanEntry entry{static_cast<uint8_t>(s), static_cast<uint8_t>(max_bits + 1 - weight)};
+        auto start = _huffman.entries.begin() + starts[weight];
+        std::fill(start, start + (size_t{1} << (weight - 1)), entry);
+        starts[weight] += uint32_t{1} << (weight - 1);
+    }
+
+    _huffman.max_bits = static_cast<uint8_t>(max_bits);
+    _huffman_set = true;
+    return size;
+}
+
+void zstd::Decoder::decode_literal_stream(std::span<const std::byte> stream, std::byte* output, size_t count) {
+    BackwardBits bits(stream);
+    auto max_bits = _huffman.max_bits;
+    auto decode = [&](size_t i) {
+        auto entry = _huffman.entries[bits.peek(max_bits)];
+        output[i] = static_cast<std::byte>(entry.symbol);
+        bits.consume(entry.bits);
+    };
+
+    //a reload leaves room for four of the longest codes
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        bits.reload();
+        decode(i);
+        decode(i + 1);
+        decode(i + 2);
+        decode(i + 3);
+    }
+    for (; i < count; i++) {
+        bits.reload();
+        decode(i);
+    }
+
+    if (bits.position() != 0) {
+        throw std::runtime_error("Zstandard literal stream doesn't end with its literals.");
+    }
+}
+
+void zstd::Decoder::read_sequences(std::span<std::byte> data) {
+    _sequences.clear();
+    need(data, 1, "sequences section");
+
+    auto first = static_cast<uint8_t>(data[0]);
+    size_t count;
+    size_t pos;
+    if (first < 128) {
+        count = first;
+        pos = 1;
+    } else if (first < 255) {
+        need(data, 2, "sequences section");
+        count = ((first - 128) << 8) + static_cast<uint8_t>(data[1]);
+        pos = 2;
+    } else {
+        need(data, 3, "sequences section");
+        count = load_le(data.subspan(1), 2) + 0x7F00;
+        pos = 3;
+    }
+    if (count == 0) {
+        return;
+    }
+
+    need(data, pos + 1, "sequences section");
+    auto modes = static_cast<uint8_t>(data[pos++]);
+    if (modes & 0x03) {
+        throw std::runtime_error("Zstandard sequences section has reserved bits set.");
+    }
+
+    std::array<SequenceTable*, 3> tables = {&_literal_lengths, &_offsets, &_match_lengths};
+    for (size_t kind = 0; kind < tables.size(); kind++) {
+        auto& table = *tables[kind];
+        auto mode = static_cast<TableMode>((modes >> (6 - 2 * kind)) & 3);
+        switch (mode) {
+            case TableMode::Predefined:
+                table = default_table(static_cast<SymbolKind>(kind));
+                break;
+
+            case TableMode::RLE:
+            {
+                need(data, pos + 1, "sequences section");
+                auto symbol = static_cast<uint8_t>(data[pos++]);
+                if (symbol > MAX_SYMBOLS[kind]) {
+                    throw std::runtime_error("Zstandard sequence symbol is out of range.");
+                }
+                FseTable fse;
+                fse.entries[0] = {0, symbol, 0};
+                fse.accuracy_log = 0;
+                bake_sequence_table(fse, static_cast<SymbolKind>(kind), table);
+            }
+            break;
+
+            case TableMode::Compressed:
+            {
+                auto distribution = read_distribution(data.subspan(pos), MAX_SYMBOLS[kind], MAX_ACCURACY_LOGS[kind]);
+                FseTable fse;
+                build_fse_table(std::span(distribution.counts).first(distribution.symbols), distribution.accuracy_log, fse);
+                bake_sequence_table(fse, static_cast<SymbolKind>(kind), table);
+                pos += distribution.size;
+            }
+            break;
+
+            case TableMode::Repeat:
+                if (!_tables_set[kind]) {
+                    throw std::runtime_error("Zstandard sequences repeat a table that was never given.");
+                }
+                break;
+        }
+        _tables_set[kind] = true;
+    }
+
+    BackwardBits bits(data.subspan(pos));
+    bits.reload();
+    auto& literal_lengths = _literal_lengths.entries;
+    auto& offsets = _offsets.entries;
+    auto& match_lengths = _match_lengths.entries;
+    size_t literal_length_state = bits.read(_literal_lengths.accuracy_log);
+    size_t offset_state = bits.read(_offsets.accuracy_log);
+    size_t match_length_state = bits.read(_match_lengths.accuracy_log);
+    bits.reload();
+    auto [repeat0, repeat1, repeat2] = _repeat_offsets;
+
+    _sequences.resize(count);
+    auto sequences = _sequences.data();
+    for (size_t i = 0; i < count; i++) {
+        auto& literal_length_entry = literal_lengths[literal_length_state];
+        auto& offset_entry = offsets[offset_state];
+        auto& match_length_entry = match_lengths[match_length_state];
+
+        //extra bits come offset first, then match length, then literal length;
+        //a reload leaves enough for them and the next states unless they are long
+        uint64_t offset_value = offset_entry.base + bits.read(offset_entry.extra_bits);
+        uint32_t match_length = match_length_entry.base + static_cast<uint32_t>(bits.read(match_length_entry.extra_bits));
+        if (size_t{offset_entry.extra_bits} + match_length_entry.extra_bits + literal_length_entry.extra_bits > MAX_EXTRA_BITS) {
+            bits.reload();
+        }
+        uint32_t literal_length = literal_length_entry.base + static_cast<uint32_t>(bits.read(literal_length_entry.extra_bits));
+
+        if (i + 1 < count) {
+            literal_length_state = literal_length_entry.baseline + bits.read(literal_length_entry.bits);
+            match_length_state = match_length_entry.baseline + bits.read(match_length_entry.bits);
+            offset_state = offset_entry.baseline + bits.read(offset_entry.bits);
+            bits.reload();
+        }
+
+        // values of 3 and below pick one of the last three offsets, shifted by
+        // one when there are no literals, as repeating the last would be pointless
+        uint64_t offset;
+        if (offset_value > 3) {
+            offset = offset_value - 3;
+            repeat2 = repeat1;
+            repeat1 = repeat0;
+            repeat0 = offset;
+        } else {
+            auto index = offset_value - 1 + (literal_length == 0 ? 1 : 0);
+            if (index == 0) {
+                offset = repeat0;
+            } else {
+                offset = index == 1 ? repeat1 : index == 2 ? repeat2 : repeat0 - 1;
+                if (index != 1) {
+                    repeat2 = repeat1;
+                }
+                repeat1 = repeat0;
+                repeat0 = offset;
+            }
+        }
+
+        sequences[i] = {literal_length, match_length, offset};
+    }
+    _repeat_offsets = {repeat0, repeat1, repeat2};
+
+    if (bits.position() != 0) {
+        throw std::runtime_error("Zstandard sequence stream doesn't end with its sequences.");
+    }
+    _stats.sequences += count;
+}
+
+std::span<std::byte> zstd::Decoder::execute(deflate::OutputSink& output, size_t frame_output, size_t block_limit) {
+    size_t total = _literals.size();
+    size_t literals_used = 0;
+    for (auto& sequence : _sequences) {
+        total += sequence.match_length;
+        literals_used += sequence.literal_length;
+    }
+    if (literals_used > _literals.size()) {
+        throw std::runtime_error("Zstandard sequences use more literals than there are.");
+    }
+    if (total > block_limit) {
+        throw std::runtime_error("Zstandard block exceeds the largest block size.");
+    }
+
+    auto area = output.reserve(total + deflate::OUTPUT_MARGIN);
+    auto begin = area.data();
+    auto start = begin + output.size();
+    auto pos = start;
+    // the frame's output still in the area, which is as far back as matches may go
+    auto history = start - std::min<size_t>(frame_output, start - begin);
+    auto literals = _literals.data();
+    auto literals_end = literals + _literals.size();
+
+    for (auto& sequence : _sequences) {
+        //short runs are copied in one go, overrunning into the margin
+        if (sequence.literal_length <= LITERAL_COPY && literals_end - literals >= static_cast<ptrdiff_t>(LITERAL_COPY)) {
+            std::memcpy(pos, literals, LITERAL_COPY);
+        } else {
+            std::memcpy(pos, literals, sequence.literal_length);
+        }
+        pos += sequence.literal_length;
+        literals += sequence.literal_length;
+
+        deflate::copy_match<16>(history, pos, sequence.match_length, sequence.offset);
+    }
+
+    auto rest = literals_end - literals;
+    std::memcpy(pos, literals, rest);
+    pos += rest;
+
+    output.commit(pos - begin);
+    return {start, pos};
+}
+
+zstd::Decoder& zstd::thread_decoder() {
+    thread_local Decoder decoder;
+    return decoder;
+}
+
+std::vector<std::byte> zstd::decompress(std::span<std::byte> data) {
+    std::vector<std::byte> decompressed;
+    thread_decoder().decompress(data, decompressed);
+    return decompressed;
+}
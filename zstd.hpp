@@ -0,0 +1,191 @@
+//------------------------------------------------------------------------------
+// zstd.hpp
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "deflate.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <memory_resource>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+// Zstandard (RFC 8878) frame decoding, for ZIP entries stored with method 93.
+// Output goes through the same sinks as inflate, and matches are copied with
+// deflate::copy_match.
+namespace zstd {
+
+// Compression method number of Zstandard entries in a ZIP archive.
+constexpr uint16_t ZIP_METHOD = 93;
+
+constexpr uint32_t MAGIC = 0xFD2FB528;
+constexpr size_t MAX_BLOCK_SIZE = 128 * 1024;
+// Frames expand furthest with RLE blocks, a 3 byte header and one byte for up
+// to a whole block.
+constexpr size_t MAX_RATIO = MAX_BLOCK_SIZE / 4;
+
+// The largest window a frame may ask for, as libzstd's default limit; frames
+// wanting more are refused rather than given that much memory.
+constexpr uint64_t MAX_WINDOW_SIZE = uint64_t{1} << 27;
+
+bool is_zstd(std::span<const std::byte> data);
+
+// XXH64, fed in pieces. Frames end with the low 32 bits of it, seeded with 0.
+class XXHash64 {
+private:
+    std::array<uint64_t, 4> _lanes;
+    std::array<std::byte, 32> _pending;
+    size_t _pending_size = 0;
+    uint64_t _length = 0;
+    uint64_t _seed;
+
+public:
+    explicit XXHash64(uint64_t seed = 0);
+
+    void update(std::span<const std::byte> data);
+    uint64_t digest() const;
+};
+
+uint64_t xxhash64(std::span<const std::byte> data, uint64_t seed = 0);
+
+struct FrameHeader {
+    uint64_t window_size;
+    std::optional<uint64_t> content_size;
+    uint32_t dictionary_id;
+    bool has_checksum;
+
+    // including the magic number
+    size_t header_size;
+};
+
+std::expected<FrameHeader, std::string> read_frame_header(std::span<const std::byte> data);
+
+// A deflate::WindowSink chunk large enough for a whole block at once.
+constexpr size_t SINK_CHUNK = MAX_BLOCK_SIZE + deflate::OUTPUT_MARGIN;
+
+// The window a deflate::WindowSink must keep to decode frame into at most
+// size bytes: the frame's own, or less when the output is smaller. size
+// should be trusted, as the sink allocates its window up front. Throws
+// std::runtime_error on a header the decoder would refuse.
+size_t sink_window(std::span<const std::byte> frame, uint64_t size);
+
+// Decoding table for one FSE coded symbol stream: a state picks an entry,
+// whose symbol is output, and the next state is baseline plus the next bits
+// read.
+struct FseEntry {
+    uint16_t baseline;
+    uint8_t symbol;
+    uint8_t bits;
+};
+
+struct FseTable {
+    static constexpr size_t MAX_ACCURACY_LOG = 9;
+
+    std::array<FseEntry, size_t{1} << MAX_ACCURACY_LOG> entries;
+    uint8_t accuracy_log = 0;
+};
+
+// Builds a table from normalised counts, where -1 marks a symbol with a
+// probability below one state. Throws if they don't add up.
+void build_fse_table(std::span<const int16_t> counts, uint8_t accuracy_log, FseTable& table);
+
+// Sequence codes decode straight to the value they stand for, a base to
+// which extra bits are added, saving a lookup per code.
+struct SequenceEntry {
+    uint32_t base;
+    uint16_t baseline;
+    uint8_t bits;
+    uint8_t extra_bits;
+};
+
+struct SequenceTable {
+    std::array<SequenceEntry, size_t{1} << FseTable::MAX_ACCURACY_LOG> entries;
+    uint8_t accuracy_log = 0;
+};
+
+// Literals are prefix coded with codes of up to 11 bits, decoded with one
+// lookup of the longest code's width.
+struct HuffmanEntry {
+    uint8_t symbol;
+    uint8_t bits;
+};
+
+struct HuffmanTable {
+    static constexpr size_t MAX_BITS = 11;
+
+    std::array<HuffmanEntry, size_t{1} << MAX_BITS> entries;
+    uint8_t max_bits = 0;
+};
+
+struct Sequence {
+    uint32_t literal_length;
+    uint32_t match_length;
+    uint64_t offset;
+};
+
+struct DecoderStats {
+    size_t frames = 0;
+    size_t raw_blocks = 0;
+    size_t rle_blocks = 0;
+    size_t compressed_blocks = 0;
+    size_t sequences = 0;
+};
+
+// Decodes frames. Tables and buffers are kept between frames to save
+// allocating them again; not thread safe, so each thread has its own.
+class Decoder {
+private:
+    SequenceTable _literal_lengths;
+    SequenceTable _offsets;
+    SequenceTable _match_lengths;
+    // whether each table above may be repeated by the next block
+    std::array<bool, 3> _tables_set{};
+    HuffmanTable _huffman;
+    bool _huffman_set = false;
+    std::array<uint64_t, 3> _repeat_offsets{};
+
+    std::vector<std::byte> _literal_buffer;
+    std::span<const std::byte> _literals;
+    std::vector<Sequence> _sequences;
+    DecoderStats _stats;
+
+    size_t frame(std::span<std::byte> data, deflate::OutputSink& output);
+    void compressed_block(std::span<std::byte> block, size_t block_limit);
+    size_t read_literals(std::span<std::byte> block, size_t block_limit);
+    size_t read_huffman_table(std::span<std::byte> data);
+    void decode_literal_stream(std::span<const std::byte> stream, std::byte* output, size_t count);
+    void read_sequences(std::span<std::byte> data);
+    std::span<std::byte> execute(deflate::OutputSink& output, size_t frame_output, size_t block_limit);
+
+public:
+    Decoder();
+
+    const DecoderStats& stats() const;
+    void reset_stats();
+
+    // Replaces the contents of output with the frames decoded from data,
+    // which may hold several, and skippable frames between them. Returns the
+    // bytes of input used, which is all of it. Throws std::runtime_error on
+    // anything malformed, including a checksum that doesn't match.
+    size_t decompress(std::span<std::byte> data, std::vector<std::byte>& output);
+    size_t decompress(std::span<std::byte> data, std::pmr::vector<std::byte>& output);
+    // Appends the decoded frames to output. Matches may reach back a whole
+    // window, which can be the whole frame, so output must keep that much; a
+    // deflate::WindowSink keeps only DEFLATE's 32 KiB.
+    size_t decompress(std::span<std::byte> data, deflate::OutputSink& output);
+    // As deflate::Decoder::decompress_range. The sink's window must be at
+    // least the frame's.
+    bool decompress_range(std::span<std::byte> data, deflate::RangeSink& output);
+};
+
+Decoder& thread_decoder();
+
+std::vector<std::byte> decompress(std::span<std::byte> data);
+
+}
@@ -0,0 +1,249 @@
+//------------------------------------------------------------------------------
+// zstd.tests.cpp
+//------------------------------------------------------------------------------
+
+#include "zstd.hpp"
+#include "test_archive.hpp"
+
+#include <algorithm>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+// https://stackoverflow.com/a/45172360
+template<typename... Ts>
+std::array<std::byte, sizeof...(Ts)> make_bytes(Ts&&... args) noexcept {
+    return{std::byte(std::forward<Ts>(args))...};
+}
+
+using test::to_bytes;
+
+// "Hello, zstd! Hello, zstd!\n", one compressed block with a repeat
+auto hello_frame() {
+    return make_bytes(
+        0x28, 0xb5, 0x2f, 0xfd, 0x04, 0x68, 0xa5, 0x00, 0x00, 0x70, 0x48, 0x65, 0x6c, 0x6c, 0x6f, 0x2c,
+        0x20, 0x7a, 0x73, 0x74, 0x64, 0x21, 0x20, 0x0a, 0x01, 0x00, 0xc0, 0xcd, 0x2f, 0xdf, 0x80, 0x77,
+        0xb6
+    );
+}
+
+// 100000 zero bytes
+auto zeros_frame() {
+    return make_bytes(
+        0x28, 0xb5, 0x2f, 0xfd, 0x04, 0x58, 0x55, 0x00, 0x00, 0x10, 0x00, 0x00, 0x01, 0x00, 0x9b, 0x86,
+        0x39, 0xc0, 0x02, 0xdb, 0x23, 0x4e, 0xf3
+    );
+}
+
+// lcg_text() at level 19: Huffman coded literals and FSE coded sequences
+auto lcg_frame() {
+    return make_bytes(
+        0x28, 0xb5, 0x2f, 0xfd, 0x64, 0x36, 0x0a, 0x3d, 0x0c, 0x00, 0x52, 0x83, 0x0b, 0x11, 0xc0, 0xb7,
+        0x01, 0x40, 0x46, 0x22, 0x6d, 0xb4, 0x57, 0xc8, 0xca, 0x24, 0xfe, 0xff, 0x7e, 0x9d, 0x38, 0x5e,
+        0xc3, 0xfb, 0x0c, 0xd2, 0xa7, 0x58, 0x2b, 0x80, 0xb5, 0x81, 0x66, 0xbc, 0x02, 0xd3, 0xc6, 0x7f,
+        0x02, 0x22, 0x97, 0x02, 0xd5, 0xad, 0xa6, 0x5a, 0xeb, 0x4f, 0x02, 0x80, 0xb9, 0xa8, 0xe0, 0xb5,
+        0xa6, 0x35, 0x20, 0x44, 0x60, 0x8c, 0x42, 0x76, 0xb6, 0x01, 0x11, 0x20, 0x04, 0x0c, 0x42, 0x13,
+        0x24, 0x62, 0x5c, 0x51, 0x05, 0x26, 0x51, 0x52, 0x69, 0x0c, 0x82, 0xc9, 0xa1, 0x23, 0xb1, 0xa1,
+        0x32, 0xa7, 0xb6, 0x47, 0x41, 0xe0, 0x93, 0x00, 0xe2, 0xc5, 0x05, 0xe5, 0x5a, 0x19, 0x1e, 0xd9,
+        0x6b, 0x51, 0x02, 0xb6, 0x78, 0x35, 0x2b, 0x67, 0x47, 0x8f, 0x1e, 0x5f, 0x05, 0x44, 0x7e, 0x14,
+        0xa9, 0x80, 0x1d, 0x46, 0x2b, 0x13, 0x47, 0xcb, 0xea, 0xaa, 0x75, 0x84, 0x36, 0xb6, 0xa2, 0xd9,
+        0xec, 0x0e, 0xd7, 0xcd, 0x44, 0x0e, 0x2d, 0x04, 0xfc, 0xbd, 0x7b, 0x28, 0x02, 0xf7, 0xc9, 0x9b,
+        0x7b, 0x93, 0xb1, 0xbf, 0xd6, 0xc6, 0x78, 0x66, 0x2c, 0xf9, 0x79, 0x5c, 0xca, 0x81, 0x97, 0x49,
+        0x64, 0x80, 0x67, 0x43, 0xae, 0x98, 0x0f, 0x50, 0xf8, 0x97, 0xb7, 0xa0, 0xf2, 0x72, 0xcb, 0x20,
+        0xa8, 0x79, 0x11, 0x8a, 0xaa, 0x75, 0x63, 0xfb, 0x26, 0x68, 0xe6, 0x00, 0x8d, 0x5d, 0x72, 0xf3,
+        0xcd, 0xee, 0x50, 0x2f, 0x16, 0xc7, 0x4f, 0x1f, 0x1a, 0xdd, 0xbd, 0x5b, 0xbb, 0x45, 0x68, 0x6b,
+        0x53, 0xed, 0xac, 0xd6, 0xfd, 0x5f, 0x9b, 0x42, 0x86, 0x26, 0x61, 0x86, 0xcc, 0x3b, 0xc6, 0xe0,
+        0x84, 0x54, 0x7c, 0xba, 0xdc, 0xdb, 0x8b, 0x01, 0x68, 0x2b, 0xf6, 0x29, 0xdf, 0xb5, 0x1b, 0x66,
+        0x2d, 0x68, 0x58, 0xd2, 0x25, 0x7e, 0x40, 0x5c, 0x56, 0xc5, 0x44, 0xdb, 0x55, 0x20, 0x71, 0x6e,
+        0xc4, 0x06, 0x97, 0x16, 0x8b, 0xd1, 0x79, 0x00, 0xf3, 0x9b, 0xb4, 0x53, 0xb3, 0x95, 0x1c, 0x86,
+        0x32, 0x97, 0x7d, 0x59, 0x80, 0x33, 0x44, 0x81, 0x60, 0x43, 0x65, 0x26, 0x11, 0x36, 0x0c, 0x0a,
+        0xa2, 0x67, 0xca, 0xca, 0x55, 0x1f, 0x32, 0x0e, 0x0e, 0xa5, 0x33, 0x79, 0x31, 0xf0, 0x99, 0xa3,
+        0xe6, 0x00, 0x16, 0xaa, 0x13, 0x43, 0xa8, 0x89, 0x4a, 0x23, 0x8a, 0x07, 0xa1, 0x23, 0xe5, 0xb8,
+        0xb0, 0x9d, 0xb4, 0x3a, 0xb9, 0xd9, 0xe6, 0x84, 0x0e, 0xdb, 0xa3, 0x27, 0x8f, 0xa5, 0x3c, 0x2c,
+        0x67, 0x5c, 0x6b, 0x94, 0x86, 0x55, 0x90, 0xfb, 0x5c, 0x43, 0x88, 0xe6, 0xed, 0x52, 0x4b, 0x18,
+        0xef, 0x17, 0x80, 0x62, 0x04, 0xe2, 0x0e, 0x4e, 0x78, 0x7b, 0x64, 0x79, 0xe2, 0xcb, 0x9b, 0xb8,
+        0xc7, 0x1c, 0x57, 0x34, 0x73, 0x2d, 0x0a, 0x39, 0xed, 0x78, 0xcb, 0x6c, 0x43, 0x23, 0x15, 0x94,
+        0x1d, 0x9a, 0xdf, 0xec, 0xd5
+    );
+}
+
+// 400 words picked by an LCG, so the literals have a skewed distribution
+std::string lcg_text() {
+    const char* words[] = {"deflate", "zstd", "huffman", "window", "literal", "match", "offset", "sequence"};
+    std::string text;
+    uint32_t x = 1;
+    for (int i = 0; i < 400; i++) {
+        x = (x * 1103515245 + 12345) % (1u << 31);
+        if (i > 0) {
+            text += ' ';
+        }
+        text += words[(x >> 16) % 8];
+    }
+    return text;
+}
+
+auto skippable_frame() {
+    return make_bytes(0x50, 0x2a, 0x4d, 0x18, 0x04, 0x00, 0x00, 0x00, 0xde, 0xad, 0xbe, 0xef);
+}
+
+template<typename... Frames>
+std::vector<std::byte> concatenate(const Frames&... frames) {
+    std::vector<std::byte> data;
+    (data.insert(data.end(), frames.begin(), frames.end()), ...);
+    return data;
+}
+
+std::string decompress_error(std::span<std::byte> data) {
+    try {
+        zstd::decompress(data);
+    } catch (const std::runtime_error& e) {
+        return e.what();
+    }
+    return "";
+}
+
+}
+
+TEST(Zstd, xxhash64) {
+    EXPECT_EQ(zstd::xxhash64({}), 0xef46db3751d8e999);
+    EXPECT_EQ(zstd::xxhash64(to_bytes("abc")), 0x44bc2cf5ad770999);
+
+    auto text = to_bytes(lcg_text());
+    zstd::XXHash64 pieces;
+    for (size_t offset = 0; offset < text.size(); offset += 7) {
+        pieces.update(std::span{text}.subspan(offset, std::min<size_t>(7, text.size() - offset)));
+    }
+    EXPECT_EQ(pieces.digest(), zstd::xxhash64(text));
+}
+
+TEST(Zstd, is_zstd) {
+    EXPECT_TRUE(zstd::is_zstd(hello_frame()));
+    EXPECT_FALSE(zstd::is_zstd(make_bytes(0x1f, 0x8b, 0x08, 0x00)));
+    EXPECT_FALSE(zstd::is_zstd(make_bytes(0x28, 0xb5)));
+}
+
+TEST(Zstd, read_frame_header) {
+    // single segment, with a two byte content size
+    auto header = zstd::read_frame_header(lcg_frame());
+
+    ASSERT_TRUE(header);
+    EXPECT_EQ(header->content_size, 2870);
+    EXPECT_EQ(header->window_size, 2870);
+    EXPECT_EQ(header->dictionary_id, 0);
+    EXPECT_TRUE(header->has_checksum);
+    EXPECT_EQ(header->header_size, 7);
+
+    // streamed, so a window descriptor and no content size
+    header = zstd::read_frame_header(hello_frame());
+
+    ASSERT_TRUE(header);
+    EXPECT_FALSE(header->content_size);
+    EXPECT_EQ(header->window_size, 8 * 1024 * 1024);
+    EXPECT_EQ(header->header_size, 6);
+
+    auto data = hello_frame();
+    EXPECT_FALSE(zstd::read_frame_header(std::span{data}.subspan(0, 5)));
+    data[4] |= std::byte{0x08};
+    EXPECT_FALSE(zstd::read_frame_header(data));
+}
+
+TEST(Zstd, refuses_oversized_windows) {
+    // 2 GiB
+    auto data = hello_frame();
+    data[5] = std::byte{0xa8};
+    auto header = zstd::read_frame_header(data);
+    ASSERT_FALSE(header);
+    EXPECT_EQ(header.error(), "Zstandard frame window is too large.");
+    EXPECT_THROW(zstd::decompress(data), std::runtime_error);
+
+    // the largest allowed, 128 MiB
+    data[5] = std::byte{0x88};
+    header = zstd::read_frame_header(data);
+    ASSERT_TRUE(header);
+    EXPECT_EQ(header->window_size, zstd::MAX_WINDOW_SIZE);
+}
+
+TEST(Zstd, build_fse_table) {
+    std::array<int16_t, 3> counts{20, -1, 11};
+    zstd::FseTable table;
+
+    zstd::build_fse_table(counts, 5, table);
+
+    // the symbol below one state takes the last, with a full reload
+    EXPECT_EQ(table.accuracy_log, 5);
+    EXPECT_EQ(table.entries[31].symbol, 1);
+    EXPECT_EQ(table.entries[31].bits, 5);
+    EXPECT_EQ(table.entries[31].baseline, 0);
+    std::array<int, 3> seen{};
+    for (size_t state = 0; state < 32; state++) {
+        seen[table.entries[state].symbol]++;
+    }
+    EXPECT_EQ(seen, (std::array<int, 3>{20, 1, 11}));
+
+    counts[2] = 10;
+    EXPECT_THROW(zstd::build_fse_table(counts, 3, table), std::runtime_error);
+}
+
+TEST(Zstd, decompress) {
+    auto hello = hello_frame();
+    EXPECT_EQ(zstd::decompress(hello), to_bytes("Hello, zstd! Hello, zstd!\n"));
+
+    auto zeros = zeros_frame();
+    EXPECT_EQ(zstd::decompress(zeros), std::vector<std::byte>(100000));
+
+    auto lcg = lcg_frame();
+    EXPECT_EQ(zstd::decompress(lcg), to_bytes(lcg_text()));
+}
+
+TEST(Zstd, decompress_frames_and_skippable_frames) {
+    auto data = concatenate(hello_frame(), skippable_frame(), lcg_frame(), hello_frame());
+
+    zstd::Decoder decoder;
+    std::vector<std::byte> output;
+
+    EXPECT_EQ(decoder.decompress(data, output), data.size());
+    EXPECT_EQ(output, to_bytes("Hello, zstd! Hello, zstd!\n" + lcg_text() + "Hello, zstd! Hello, zstd!\n"));
+    EXPECT_EQ(decoder.stats().frames, 3);
+}
+
+TEST(Zstd, decompress_into_span_sink) {
+    auto data = concatenate(lcg_frame(), hello_frame());
+    auto expected = to_bytes(lcg_text() + "Hello, zstd! Hello, zstd!\n");
+    std::vector<std::byte> area(expected.size() + deflate::OUTPUT_MARGIN);
+    deflate::SpanSink sink(area);
+
+    zstd::Decoder decoder;
+    EXPECT_EQ(decoder.decompress(data, sink), data.size());
+
+    EXPECT_EQ(sink.size(), expected.size());
+    EXPECT_TRUE(std::ranges::equal(std::span{area}.first(expected.size()), expected));
+}
+
+TEST(Zstd, decompress_checksum_mismatch) {
+    auto data = hello_frame();
+    data[data.size() - 1] ^= std::byte{1};
+
+    EXPECT_EQ(decompress_error(data), "Zstandard checksum does not match.");
+}
+
+TEST(Zstd, decompress_corrupt) {
+    auto lcg = lcg_frame();
+    EXPECT_EQ(decompress_error(std::span{lcg}.subspan(0, lcg.size() - 1)), "Zstandard checksum is truncated.");
+    EXPECT_EQ(decompress_error({}), "No Zstandard frame.");
+
+    auto garbage = concatenate(hello_frame(), make_bytes(0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07));
+    EXPECT_EQ(decompress_error(garbage), "Not a Zstandard frame.");
+
+    // a flipped byte must throw or, where it only touched padding bits the
+    // decoder never reads, leave the output as it was
+    auto expected = to_bytes(lcg_text());
+    for (size_t i = 6; i < lcg.size() - 4; i++) {
+        auto corrupt = lcg;
+        corrupt[i] ^= std::byte{0x5a};
+        try {
+            EXPECT_EQ(zstd::decompress(corrupt), expected) << "byte " << i;
+        } catch (const std::runtime_error&) {
+        }
+    }
+}